@@ -20,7 +20,26 @@
 #include <boolean.h>
 #include <string.h>
 #include <stdio.h>
+#include <compat/strl.h>
+#include <file/file_path.h>
 #include "general.h"
+#include "file_ops.h"
+#include "hash.h"
+
+#if defined(_WIN32) && !defined(_XBOX)
+#include <io.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/* SRAM is compared and written back in blocks of this size. */
+#define AUTOSAVE_BLOCK_SIZE      4096
+
+/* Journal: magic, size of the SRAM file and block count, then 
+ * offset, length and data of each block, then a CRC32 of all 
+ * that. All little endian. */
+#define AUTOSAVE_JOURNAL_MAGIC   "RASRAMJ1"
+#define AUTOSAVE_JOURNAL_HEADER  16
 
 struct autosave
 {
@@ -36,6 +55,17 @@ struct autosave
    const char *path;
    size_t bufsize;
    unsigned interval;
+
+   /* One flag per block of @buffer not yet written to @path. */
+   uint8_t *dirty;
+   size_t blocks;
+   /* Set once @path holds all of @buffer, so later saves only 
+    * need to write the dirty blocks into it. */
+   bool written;
+   bool journal;
+   /* Set when the last save failed, so it is retried even if 
+    * SRAM does not change again. */
+   bool pending;
 };
 
 /**
@@ -60,6 +90,285 @@ static void autosave_unlock(autosave_t *handle)
    slock_unlock(handle->lock);
 }
 
+static void autosave_put_u32(uint8_t *data, uint32_t val)
+{
+   data[0] = (uint8_t)(val >>  0);
+   data[1] = (uint8_t)(val >>  8);
+   data[2] = (uint8_t)(val >> 16);
+   data[3] = (uint8_t)(val >> 24);
+}
+
+static uint32_t autosave_get_u32(const uint8_t *data)
+{
+   return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void autosave_journal_path(char *s, size_t len, const char *path)
+{
+   snprintf(s, len, "%s.journal", path);
+}
+
+/**
+ * autosave_sync:
+ * @file            : file to flush.
+ *
+ * Flushes @file and, where the platform allows it, waits 
+ * until its data has reached the disk.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool autosave_sync(FILE *file)
+{
+   if (fflush(file) != 0)
+      return false;
+#if defined(_WIN32) && !defined(_XBOX)
+   return _commit(_fileno(file)) == 0;
+#elif defined(__unix__) || defined(__APPLE__)
+   return fsync(fileno(file)) == 0;
+#else
+   return true;
+#endif
+}
+
+/**
+ * autosave_diff:
+ * @save            : pointer to autosave object
+ *
+ * Compares SRAM with the last copy of it block by block, and 
+ * copies and marks the blocks that changed. Must be called with 
+ * the autosave lock held, as the core does not run meanwhile.
+ *
+ * Returns: true if any block changed.
+ **/
+static bool autosave_diff(autosave_t *save)
+{
+   size_t i;
+   bool differ          = false;
+   uint8_t *buffer      = (uint8_t*)save->buffer;
+   const uint8_t *retro = (const uint8_t*)save->retro_buffer;
+
+   for (i = 0; i < save->blocks; i++)
+   {
+      size_t offset = i * AUTOSAVE_BLOCK_SIZE;
+      size_t len    = save->bufsize - offset;
+
+      if (len > AUTOSAVE_BLOCK_SIZE)
+         len = AUTOSAVE_BLOCK_SIZE;
+
+      if (!memcmp(buffer + offset, retro + offset, len))
+         continue;
+
+      memcpy(buffer + offset, retro + offset, len);
+      save->dirty[i] = 1;
+      differ         = true;
+   }
+
+   return differ;
+}
+
+/**
+ * autosave_write_full:
+ * @save            : pointer to autosave object
+ *
+ * Writes all of SRAM to a temporary file next to the SRAM file, 
+ * then puts it in place.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool autosave_write_full(autosave_t *save)
+{
+   char tmp_path[PATH_MAX_LENGTH];
+   bool ok    = false;
+   FILE *file = NULL;
+
+   snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", save->path);
+
+   if (!(file = fopen(tmp_path, "wb")))
+      return false;
+
+   ok = fwrite(save->buffer, 1, save->bufsize, file) == save->bufsize;
+   ok = autosave_sync(file) && ok;
+   ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+   /* rename() does not replace existing files here. */
+   if (ok)
+      remove(save->path);
+#endif
+   if (ok && rename(tmp_path, save->path) == 0)
+   {
+      char journal_path[PATH_MAX_LENGTH];
+
+      /* Whatever a journal left over from a crash held is 
+       * superseded now. */
+      autosave_journal_path(journal_path, sizeof(journal_path),
+            save->path);
+      remove(journal_path);
+      return true;
+   }
+
+   remove(tmp_path);
+   return false;
+}
+
+/**
+ * autosave_write_journal:
+ * @save            : pointer to autosave object
+ *
+ * Writes the dirty blocks to the journal next to the SRAM file, 
+ * so they can be applied again if writing them is interrupted.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool autosave_write_journal(autosave_t *save)
+{
+   char journal_path[PATH_MAX_LENGTH];
+   uint8_t header[AUTOSAVE_JOURNAL_HEADER];
+   size_t i;
+   uint32_t count = 0;
+   uint32_t crc   = 0;
+   bool ok        = true;
+   FILE *file     = NULL;
+
+   autosave_journal_path(journal_path, sizeof(journal_path), save->path);
+
+   if (!(file = fopen(journal_path, "wb")))
+      return false;
+
+   for (i = 0; i < save->blocks; i++)
+      count += save->dirty[i];
+
+   memcpy(header, AUTOSAVE_JOURNAL_MAGIC, 8);
+   autosave_put_u32(header + 8, (uint32_t)save->bufsize);
+   autosave_put_u32(header + 12, count);
+   crc = crc32_update(crc, header, sizeof(header));
+   ok  = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+   for (i = 0; ok && i < save->blocks; i++)
+   {
+      uint8_t entry[8];
+      size_t offset         = i * AUTOSAVE_BLOCK_SIZE;
+      size_t len            = save->bufsize - offset;
+      const uint8_t *buffer = (const uint8_t*)save->buffer + offset;
+
+      if (!save->dirty[i])
+         continue;
+      if (len > AUTOSAVE_BLOCK_SIZE)
+         len = AUTOSAVE_BLOCK_SIZE;
+
+      autosave_put_u32(entry, (uint32_t)offset);
+      autosave_put_u32(entry + 4, (uint32_t)len);
+      crc = crc32_update(crc, entry, sizeof(entry));
+      crc = crc32_update(crc, buffer, len);
+      ok  = fwrite(entry, 1, sizeof(entry), file) == sizeof(entry)
+         && fwrite(buffer, 1, len, file) == len;
+   }
+
+   if (ok)
+   {
+      uint8_t trailer[4];
+
+      autosave_put_u32(trailer, crc);
+      ok = fwrite(trailer, 1, sizeof(trailer), file) == sizeof(trailer);
+   }
+
+   ok = autosave_sync(file) && ok;
+   ok = (fclose(file) == 0) && ok;
+
+   if (!ok)
+      remove(journal_path);
+   return ok;
+}
+
+/**
+ * autosave_write_blocks:
+ * @save            : pointer to autosave object
+ *
+ * Writes runs of dirty blocks in place into the SRAM file, 
+ * which already holds all of SRAM.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool autosave_write_blocks(autosave_t *save)
+{
+   size_t i   = 0;
+   bool ok    = true;
+   FILE *file = fopen(save->path, "r+b");
+
+   if (!file)
+      return false;
+
+   while (ok && i < save->blocks)
+   {
+      size_t first, offset, len;
+
+      if (!save->dirty[i])
+      {
+         i++;
+         continue;
+      }
+
+      first = i;
+      while (i < save->blocks && save->dirty[i])
+         i++;
+
+      offset = first * AUTOSAVE_BLOCK_SIZE;
+      len    = i * AUTOSAVE_BLOCK_SIZE;
+      if (len > save->bufsize)
+         len = save->bufsize;
+      len   -= offset;
+
+      ok = fseek(file, (long)offset, SEEK_SET) == 0 &&
+         fwrite((const uint8_t*)save->buffer + offset, 1, len, file) == len;
+   }
+
+   ok = (save->journal ? autosave_sync(file) : fflush(file) == 0) && ok;
+   ok = (fclose(file) == 0) && ok;
+   return ok;
+}
+
+/**
+ * autosave_write:
+ * @save            : pointer to autosave object
+ *
+ * Writes the dirty blocks to the SRAM file. The first time, all 
+ * of SRAM is written, so the file matches it in size and content.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool autosave_write(autosave_t *save)
+{
+   char journal_path[PATH_MAX_LENGTH];
+
+   if (!save->written)
+   {
+      if (!autosave_write_full(save))
+         return false;
+      save->written = true;
+      return true;
+   }
+
+   if (save->journal && !autosave_write_journal(save))
+      return false;
+
+   if (!autosave_write_blocks(save))
+   {
+      /* Blocks may be half written, write all of it next time. */
+      save->written = false;
+      return false;
+   }
+
+   if (save->journal)
+   {
+      autosave_journal_path(journal_path, sizeof(journal_path),
+            save->path);
+      remove(journal_path);
+   }
+
+   return true;
+}
+
 /**
  * autosave_thread:
  * @data            : pointer to autosave object
@@ -75,39 +384,31 @@ static void autosave_thread(void *data)
    {
       bool differ = false;
 
+      /* Only the comparison needs the core to stand still, 
+       * the blocks are written from our own copy. */
       autosave_lock(save);
-      differ = memcmp(save->buffer, save->retro_buffer,
-            save->bufsize) != 0;
-      if (differ)
-         memcpy(save->buffer, save->retro_buffer, save->bufsize);
+      differ = autosave_diff(save);
       autosave_unlock(save);
 
-      if (differ)
+      if (differ || save->pending)
       {
-         /* Should probably deal with this more elegantly. */
-         FILE *file = fopen(save->path, "wb");
-
-         if (file)
+         /* Avoid spamming down stderr ... */
+         if (first_log)
          {
-            bool failed = false;
-
-            /* Avoid spamming down stderr ... */
-            if (first_log)
-            {
-               RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n",
-                     save->path, save->interval);
-               first_log = false;
-            }
-            else
-               RARCH_LOG("SRAM changed ... autosaving ...\n");
-
-            failed |= fwrite(save->buffer, 1, save->bufsize, file)
-               != save->bufsize;
-            failed |= fflush(file) != 0;
-            failed |= fclose(file) != 0;
-            if (failed)
-               RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
+            RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n",
+                  save->path, save->interval);
+            first_log = false;
          }
+         else
+            RARCH_LOG("SRAM changed ... autosaving ...\n");
+
+         /* Blocks stay dirty until written, so a failed save 
+          * is retried on the next check. */
+         save->pending = !autosave_write(save);
+         if (save->pending)
+            RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
+         else
+            memset(save->dirty, 0, save->blocks);
       }
 
       slock_lock(save->cond_lock);
@@ -126,6 +427,7 @@ static void autosave_thread(void *data)
  * @data            : pointer to buffer
  * @size            : size of @data buffer
  * @interval        : interval at which saves should be performed.
+ * @journal         : journal changed blocks before writing them.
  *
  * Create and initialize autosave object.
  *
@@ -133,7 +435,7 @@ static void autosave_thread(void *data)
  * NULL.
  **/
 autosave_t *autosave_new(const char *path, const void *data, size_t size,
-      unsigned interval)
+      unsigned interval, bool journal)
 {
    autosave_t *handle = (autosave_t*)calloc(1, sizeof(*handle));
    if (!handle)
@@ -144,9 +446,14 @@ autosave_t *autosave_new(const char *path, const void *data, size_t size,
    handle->path = path;
    handle->buffer = malloc(size);
    handle->retro_buffer = data;
+   handle->blocks = (size + AUTOSAVE_BLOCK_SIZE - 1) / AUTOSAVE_BLOCK_SIZE;
+   handle->dirty = (uint8_t*)calloc(handle->blocks, sizeof(*handle->dirty));
+   handle->journal = journal;
 
-   if (!handle->buffer)
+   if (!handle->buffer || !handle->dirty)
    {
+      free(handle->buffer);
+      free(handle->dirty);
       free(handle);
       return NULL;
    }
@@ -183,9 +490,93 @@ void autosave_free(autosave_t *handle)
    scond_free(handle->cond);
 
    free(handle->buffer);
+   free(handle->dirty);
    free(handle);
 }
 
+/**
+ * autosave_recover:
+ * @path            : path to autosave file
+ *
+ * Applies the blocks left in the journal of @path by an autosave 
+ * that was interrupted, then drops the journal. A journal that 
+ * was not completely written is dropped as is, as the file was 
+ * not touched yet then.
+ **/
+void autosave_recover(const char *path)
+{
+   char journal_path[PATH_MAX_LENGTH];
+   ssize_t size;
+   uint32_t i, count;
+   const uint8_t *entry = NULL;
+   const uint8_t *end   = NULL;
+   uint8_t *data        = NULL;
+   FILE *file           = NULL;
+   bool ok              = true;
+
+   autosave_journal_path(journal_path, sizeof(journal_path), path);
+
+   if (!path_file_exists(journal_path))
+      return;
+
+   if (!read_file(journal_path, (void**)&data, &size))
+      return;
+
+   if (size < AUTOSAVE_JOURNAL_HEADER + 4 ||
+         memcmp(data, AUTOSAVE_JOURNAL_MAGIC, 8) ||
+         crc32_calculate(data, size - 4) !=
+         autosave_get_u32(data + size - 4))
+   {
+      RARCH_WARN("Dropping incomplete SRAM journal \"%s\".\n",
+            journal_path);
+      goto end;
+   }
+
+   if (!(file = fopen(path, "r+b")))
+      goto end;
+
+   count = autosave_get_u32(data + 12);
+   entry = data + AUTOSAVE_JOURNAL_HEADER;
+   end   = data + size - 4;
+
+   for (i = 0; ok && i < count; i++)
+   {
+      uint32_t offset, len;
+
+      if (end - entry < 8)
+         break;
+
+      offset = autosave_get_u32(entry);
+      len    = autosave_get_u32(entry + 4);
+      entry += 8;
+
+      if ((size_t)(end - entry) < len)
+         break;
+
+      ok = fseek(file, (long)offset, SEEK_SET) == 0 &&
+         fwrite(entry, 1, len, file) == len;
+      entry += len;
+   }
+
+   ok = autosave_sync(file) && ok;
+   ok = (fclose(file) == 0) && ok;
+
+   if (!ok)
+   {
+      /* Keep the journal to try again next time. */
+      RARCH_ERR("Failed to apply SRAM journal \"%s\".\n", journal_path);
+      free(data);
+      return;
+   }
+
+   RARCH_LOG("Applied %u blocks of interrupted SRAM autosave to \"%s\".\n",
+         count, path);
+
+end:
+   free(data);
+   remove(journal_path);
+}
+
 /**
  * lock_autosave:
  *
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <boolean.h>
 
 typedef struct autosave autosave_t;
 
@@ -31,6 +32,7 @@ typedef struct autosave autosave_t;
  * @data            : pointer to buffer
  * @size            : size of @data buffer
  * @interval        : interval at which saves should be performed.
+ * @journal         : journal changed blocks before writing them.
  *
  * Create and initialize autosave object.
  *
@@ -38,7 +40,7 @@ typedef struct autosave autosave_t;
  * NULL.
  **/
 autosave_t *autosave_new(const char *path, const void *data,
-      size_t size, unsigned interval);
+      size_t size, unsigned interval, bool journal);
 
 /**
  * autosave_free:
@@ -48,6 +50,15 @@ autosave_t *autosave_new(const char *path, const void *data,
  **/
 void autosave_free(autosave_t *handle);
 
+/**
+ * autosave_recover:
+ * @path            : path to autosave file
+ *
+ * Finishes an autosave of @path that was interrupted, if its 
+ * journal was left behind. To be called before loading @path.
+ **/
+void autosave_recover(const char *path);
+
 /**
  * lock_autosave:
  *
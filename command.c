@@ -17,7 +17,7 @@
 #include "command.h"
 
 #include "net_compat.h"
-#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+#ifdef HAVE_NETPLAY
 #include "netplay.h"
 #endif
 
@@ -28,6 +28,7 @@
 #include <file/file_path.h>
 #include <retro_miscellaneous.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef _WIN32
@@ -37,6 +38,7 @@
 
 #define DEFAULT_NETWORK_CMD_PORT 55355
 #define STDIN_BUF_SIZE 4096
+#define REPLY_BUF_SIZE 1024
 
 struct rarch_cmd
 {
@@ -51,6 +53,10 @@ struct rarch_cmd
 #endif
 
    bool state[RARCH_BIND_LIST_END];
+
+   /* Answers to queries, sent back to whoever asked. */
+   char reply[REPLY_BUF_SIZE];
+   size_t reply_size;
 };
 
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
@@ -175,6 +181,12 @@ struct cmd_action_map
    const char *arg_desc;
 };
 
+struct cmd_query_map
+{
+   const char *str;
+   void (*query)(char *reply, size_t size);
+};
+
 static const struct cmd_map map[] = {
    { "FAST_FORWARD",           RARCH_FAST_FORWARD_KEY },
    { "FAST_FORWARD_HOLD",      RARCH_FAST_FORWARD_HOLD_KEY },
@@ -238,10 +250,78 @@ static bool cmd_set_shader(const char *arg)
    return driver.video->set_shader(driver.video_data, type, arg);
 }
 
+static bool cmd_rewind_seek(const char *arg)
+{
+   unsigned frames = strtoul(arg, NULL, 0);
+
+   if (!g_extern.rewind.state || !frames)
+      return false;
+
+   g_extern.rewind.seek_frames = frames;
+   return true;
+}
+
 static const struct cmd_action_map action_map[] = {
-   { "SET_SHADER", cmd_set_shader, "<shader path>" },
+   { "SET_SHADER",  cmd_set_shader,  "<shader path>" },
+   { "REWIND_SEEK", cmd_rewind_seek, "<frames>" },
+};
+
+static void cmd_netplay_stats(char *reply, size_t size)
+{
+#ifdef HAVE_NETPLAY
+   struct netplay_stats stats;
+   netplay_t *netplay = (netplay_t*)driver.netplay_data;
+
+   if (netplay)
+   {
+      netplay_get_stats(netplay, &stats);
+      snprintf(reply, size,
+            "NETPLAY_STATS frame=%u confirmed=%u "
+            "rtt_usec=%lld rtt_max_usec=%lld "
+            "input_latency_usec=%lld input_latency_max_usec=%lld "
+            "rollbacks=%llu resimulated_frames=%llu rollback_depth_max=%u "
+            "crc_checks=%llu desyncs=%llu last_desync_frame=%u "
+            "stalls=%llu stall_usec=%lld\n",
+            stats.frame_count, stats.confirmed_frame_count,
+            (long long)stats.rtt_usec, (long long)stats.rtt_max_usec,
+            (long long)stats.input_latency_usec,
+            (long long)stats.input_latency_max_usec,
+            (unsigned long long)stats.rollbacks,
+            (unsigned long long)stats.resimulated_frames,
+            stats.rollback_depth_max,
+            (unsigned long long)stats.crc_checks,
+            (unsigned long long)stats.desyncs,
+            stats.last_desync_frame,
+            (unsigned long long)stats.stalls,
+            (long long)stats.stall_usec);
+      return;
+   }
+#endif
+
+   strlcpy(reply, "NETPLAY_STATS none\n", size);
+}
+
+static const struct cmd_query_map query_map[] = {
+   { "NETPLAY_STATS", cmd_netplay_stats },
 };
 
+static bool command_get_query(const char *tok, unsigned *index)
+{
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(query_map); i++)
+   {
+      if (strcmp(tok, query_map[i].str) == 0)
+      {
+         if (index)
+            *index = i;
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static bool command_get_arg(const char *tok,
       const char **arg, unsigned *index)
 {
@@ -288,7 +368,13 @@ static void parse_sub_msg(rarch_cmd_t *handle, const char *tok)
    const char *arg = NULL;
    unsigned index  = 0;
 
-   if (command_get_arg(tok, &arg, &index))
+   if (command_get_query(tok, &index))
+   {
+      query_map[index].query(handle->reply + handle->reply_size,
+            sizeof(handle->reply) - handle->reply_size);
+      handle->reply_size += strlen(handle->reply + handle->reply_size);
+   }
+   else if (command_get_arg(tok, &arg, &index))
    {
       if (arg)
       {
@@ -326,6 +412,36 @@ bool rarch_cmd_get(rarch_cmd_t *handle, unsigned id)
 }
 
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+/**
+ * cmd_addr_is_local:
+ * @addr                 : address a command came from
+ *
+ * UDP source addresses are easy to forge, so replies only ever 
+ * go back to this machine. Anyone else could otherwise have them 
+ * sent to a third party.
+ *
+ * Returns: true (1) if @addr is a loopback address.
+ **/
+static bool cmd_addr_is_local(const struct sockaddr_storage *addr)
+{
+   if (addr->ss_family == AF_INET)
+   {
+      const struct sockaddr_in *in = (const struct sockaddr_in*)addr;
+      return (ntohl(in->sin_addr.s_addr) >> 24) == 127;
+   }
+#if !defined(_WIN32) && !defined(HAVE_SOCKET_LEGACY)
+   else if (addr->ss_family == AF_INET6)
+   {
+      const struct sockaddr_in6 *in = (const struct sockaddr_in6*)addr;
+      return IN6_IS_ADDR_LOOPBACK(&in->sin6_addr) ||
+         (IN6_IS_ADDR_V4MAPPED(&in->sin6_addr) &&
+          in->sin6_addr.s6_addr[12] == 127);
+   }
+#endif
+
+   return false;
+}
+
 static void network_cmd_poll(rarch_cmd_t *handle)
 {
    fd_set fds;
@@ -346,14 +462,21 @@ static void network_cmd_poll(rarch_cmd_t *handle)
    for (;;)
    {
       char buf[1024];
+      struct sockaddr_storage addr;
+      socklen_t addr_size = sizeof(addr);
       ssize_t ret = recvfrom(handle->net_fd, buf,
-            sizeof(buf) - 1, 0, NULL, NULL);
+            sizeof(buf) - 1, 0, (struct sockaddr*)&addr, &addr_size);
 
       if (ret <= 0)
          break;
 
       buf[ret] = '\0';
+      handle->reply_size = 0;
       parse_msg(handle, buf);
+
+      if (handle->reply_size && cmd_addr_is_local(&addr))
+         sendto(handle->net_fd, handle->reply, handle->reply_size, 0,
+               (struct sockaddr*)&addr, addr_size);
    }
 }
 #endif
@@ -499,8 +622,15 @@ static void stdin_cmd_poll(rarch_cmd_t *handle)
    *last_newline++ = '\0';
    msg_len = last_newline - handle->stdin_buf;
 
+   handle->reply_size = 0;
    parse_msg(handle, handle->stdin_buf);
 
+   if (handle->reply_size)
+   {
+      fputs(handle->reply, stdout);
+      fflush(stdout);
+   }
+
    memmove(handle->stdin_buf, last_newline,
          handle->stdin_buf_ptr - msg_len);
    handle->stdin_buf_ptr -= msg_len;
@@ -521,8 +651,17 @@ void rarch_cmd_poll(rarch_cmd_t *handle)
 }
 
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+/**
+ * send_udp_packet:
+ * @host                 : host to send to
+ * @port                 : port to send to
+ * @msg                  : command to send
+ * @reply                : wait for a reply and print it
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
 static bool send_udp_packet(const char *host,
-      uint16_t port, const char *msg)
+      uint16_t port, const char *msg, bool reply)
 {
    char port_buf[16];
    struct addrinfo hints, *res = NULL;
@@ -565,6 +704,29 @@ static bool send_udp_packet(const char *host,
          goto end;
       }
 
+      if (reply)
+      {
+         char buf[REPLY_BUF_SIZE];
+         fd_set fds;
+         struct timeval tv = {1, 0};
+
+         FD_ZERO(&fds);
+         FD_SET(fd, &fds);
+
+         /* Whichever address answers first is the one RetroArch is on. */
+         if (socket_select(fd + 1, &fds, NULL, NULL, &tv) > 0)
+         {
+            ssize_t size = recv(fd, buf, sizeof(buf) - 1, 0);
+
+            if (size > 0)
+            {
+               buf[size] = '\0';
+               fputs(buf, stdout);
+               goto end;
+            }
+         }
+      }
+
       socket_close(fd);
       fd = -1;
       tmp = tmp->ai_next;
@@ -581,7 +743,7 @@ static bool verify_command(const char *cmd)
 {
    unsigned i;
 
-   if (command_get_arg(cmd, NULL, NULL))
+   if (command_get_arg(cmd, NULL, NULL) || command_get_query(cmd, NULL))
       return true;
 
    RARCH_ERR("Command \"%s\" is not recognized by RetroArch.\n", cmd);
@@ -592,6 +754,9 @@ static bool verify_command(const char *cmd)
    for (i = 0; i < sizeof(action_map) / sizeof(action_map[0]); i++)
       RARCH_ERR("\t\t%s %s\n", action_map[i].str, action_map[i].arg_desc);
 
+   for (i = 0; i < sizeof(query_map) / sizeof(query_map[0]); i++)
+      RARCH_ERR("\t\t%s\n", query_map[i].str);
+
    return false;
 }
 
@@ -634,7 +799,8 @@ bool network_cmd_send(const char *cmd_)
    RARCH_LOG("Sending command: \"%s\" to %s:%hu\n",
          cmd, host, (unsigned short)port);
 
-   ret = verify_command(cmd) && send_udp_packet(host, port, cmd);
+   ret = verify_command(cmd) && send_udp_packet(host, port, cmd,
+         command_get_query(cmd, NULL));
    free(command);
 
    g_extern.verbosity = old_verbose;
@@ -574,6 +574,23 @@ static const unsigned rewind_buffer_size = 20 << 20; /* 20MiB */
 /* How many frames to rewind at a time. */
 static const unsigned rewind_granularity = 1;
 
+/* Store a full savestate in the rewind buffer every this many
+ * rewind states, so that seeking far back only needs to apply the
+ * states after the closest one. 0 disables keyframes. */
+static const unsigned rewind_keyframe_interval = 0;
+
+/* Generate rewind deltas on a separate thread, so the
+ * delta scan overlaps with emulation of the following frames. */
+#if defined(HAVE_THREADS)
+static const bool rewind_threaded = true;
+#else
+static const bool rewind_threaded = false;
+#endif
+
+/* Deflate rewind deltas before storing them. Costs some CPU time
+ * per frame, but fits several times more history into the buffer. */
+static const bool rewind_compression = false;
+
 /* Pause gameplay when gameplay loses focus. */
 static const bool pause_nonactive = false;
 
@@ -581,6 +598,11 @@ static const bool pause_nonactive = false;
  * It is measured in seconds. A value of 0 disables autosave. */
 static const unsigned autosave_interval = 0;
 
+/* Autosave writes the changed parts of SRAM to a journal first, 
+ * so an autosave interrupted by a crash is finished on the next 
+ * start rather than leaving a damaged SRAM file. */
+static const bool autosave_journal = false;
+
 /* When being client over netplay, use keybinds for 
  * user 1 rather than user 2. */
 static const bool netplay_client_swap_input = true;
@@ -602,6 +624,15 @@ static const bool savestate_auto_index = false;
 static const bool savestate_auto_save = false;
 static const bool savestate_auto_load = false;
 
+/* Deflate savestates when writing them. Compressed and plain 
+ * states both load either way. */
+static const bool savestate_compression = false;
+
+/* Store savestates as chunks shared between all savestates in 
+ * the same directory, so slots that hold mostly the same data 
+ * take up little extra space. */
+static const bool savestate_dedup = false;
+
 /* Slowmotion ratio. */
 static const float slowmotion_ratio = 3.0;
 
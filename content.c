@@ -25,9 +25,31 @@
 #include "dynamic.h"
 #include "movie.h"
 #include "patch.h"
+#include "savestate_store.h"
 #include "compat/strl.h"
 #include "hash.h"
 #include "file_extract.h"
+#include "runloop.h"
+#include "retroarch.h"
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 
 #ifdef _WIN32
 #ifdef _XBOX
@@ -41,6 +63,152 @@
 #endif
 #endif
 
+#ifdef HAVE_MMAP
+/* Content handed to the core straight from a file mapping. It is 
+ * kept until the core is deinitialized. Cores may write to the 
+ * mapping, so its CRC32 is taken from the file, on a thread of its 
+ * own, until content_get_crc() needs it. */
+static struct
+{
+   void *data;
+   size_t size;
+#ifdef HAVE_THREADS
+   sthread_t *crc_thread;
+   int crc_fd;
+   uint32_t crc;
+#endif
+} content_map;
+
+#ifdef HAVE_THREADS
+static void content_map_crc_worker(void *data)
+{
+   uint8_t buf[64 * 1024];
+   ssize_t len;
+   uint32_t crc = 0;
+
+   (void)data;
+
+   while ((len = read(content_map.crc_fd, buf, sizeof(buf))) > 0)
+      crc = crc32_update(crc, buf, len);
+
+   if (len < 0)
+      RARCH_WARN("Could not read content to compute its CRC32.\n");
+
+   close(content_map.crc_fd);
+   content_map.crc_fd = -1;
+   content_map.crc    = crc;
+}
+#endif
+
+/**
+ * content_map_crc_start:
+ * @fd           : Descriptor of the mapped file, positioned at its 
+ *                 start, or -1. Closed when done with.
+ * @data         : Mapped content.
+ * @size         : Size of the content.
+ *
+ * Starts computing the CRC32 of mapped content from its file. Without 
+ * a thread for it, the mapping is hashed right away, which is still 
+ * before the core gets to write to it.
+ **/
+static void content_map_crc_start(int fd, const void *data, size_t size)
+{
+#ifdef HAVE_THREADS
+   if (fd >= 0)
+   {
+      content_map.crc_fd     = fd;
+      content_map.crc_thread = sthread_create(content_map_crc_worker, NULL);
+      if (content_map.crc_thread)
+         return;
+      content_map.crc_fd = -1;
+   }
+#endif
+
+   if (fd >= 0)
+      close(fd);
+
+   g_extern.content_crc = crc32_calculate((const uint8_t*)data, size);
+   RARCH_LOG("CRC32: 0x%x .\n", (unsigned)g_extern.content_crc);
+}
+
+/**
+ * content_has_patch:
+ * @ups_path     : UPS patch path.
+ * @bps_path     : BPS patch path.
+ * @ips_path     : IPS patch path.
+ *
+ * Returns: true if soft patching would find a patch to apply.
+ **/
+static bool content_has_patch(const char *ups_path,
+      const char *bps_path, const char *ips_path)
+{
+   return path_file_exists(ups_path) ||
+      path_file_exists(bps_path) ||
+      path_file_exists(ips_path);
+}
+
+/**
+ * map_content_file:
+ * @path         : path of the content file.
+ * @buf          : mapped content.
+ * @length       : size of the content file.
+ * @map_size     : size of the mapping, to unmap it with.
+ * @crc_fd       : if not NULL, set to a descriptor of the file 
+ *                 for content_map_crc_start().
+ *
+ * Maps a plain content file copy-on-write, so cores that write to 
+ * their content don't change the file, and other instances share 
+ * the page cache. As with read_file(), the data is followed by a 
+ * NUL byte.
+ *
+ * Returns: true if successful, false if the file has to be read 
+ * instead.
+ **/
+static bool map_content_file(const char *path, void **buf,
+      ssize_t *length, size_t *map_size, int *crc_fd)
+{
+   struct stat fds;
+   size_t total;
+   void *ret_buf = MAP_FAILED;
+   int fd        = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return false;
+
+   if (fstat(fd, &fds) < 0 || !S_ISREG(fds.st_mode) || fds.st_size <= 0)
+      goto error;
+
+   /* Reserve one byte more than the file, then map the file over 
+    * the start of it. The tail stays zero-filled anonymous memory 
+    * even when the file ends on a page boundary. */
+   total   = (size_t)fds.st_size + 1;
+   ret_buf = mmap(NULL, total, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (ret_buf == MAP_FAILED)
+      goto error;
+
+   if (mmap(ret_buf, fds.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+      goto error;
+
+   if (crc_fd)
+      *crc_fd = fd;
+   else
+      close(fd);
+
+   *buf      = ret_buf;
+   *length   = fds.st_size;
+   *map_size = total;
+   return true;
+
+error:
+   if (ret_buf != MAP_FAILED)
+      munmap(ret_buf, total);
+   close(fd);
+   return false;
+}
+#endif
+
 /**
  * read_content_file:
  * @path         : buffer of the content file.
@@ -56,27 +224,493 @@
 static bool read_content_file(const char *path, void **buf,
       ssize_t *length)
 {
-   uint8_t *ret_buf = NULL;
+   uint8_t *ret_buf     = NULL;
+   uint8_t *patched_buf = NULL;
+   ssize_t patched_size = 0;
+   size_t map_size      = 0;
+#ifdef HAVE_MMAP
+   int crc_fd           = -1;
+#endif
 
    RARCH_LOG("Loading content file: %s.\n", path);
-   if (!read_file(path, (void**) &ret_buf, length))
-      return false;
 
-   if (*length <= 0)
-      return false;
+#ifdef HAVE_MMAP
+   /* Patches read straight from the mapping too, so the unpatched 
+    * content never takes up memory of its own. */
+   if (!path_contains_compressed_file(path)
+         && map_content_file(path, (void**)&ret_buf, length, &map_size,
+            &crc_fd))
+   {
+      if (g_extern.block_patch || !content_has_patch(g_extern.ups_name,
+               g_extern.bps_name, g_extern.ips_name))
+         goto mapped;
+   }
+   else
+#endif
+   {
+      if (!read_file(path, (void**) &ret_buf, length))
+         return false;
+
+      if (*length <= 0)
+      {
+         free(ret_buf);
+         return false;
+      }
+   }
 
    /* Attempt to apply a patch. */
-   if (!g_extern.block_patch)
-      patch_content(&ret_buf, length);
-   
-   g_extern.content_crc = crc32_calculate(ret_buf, *length);
+   if (!g_extern.block_patch && patch_content(ret_buf, *length,
+            &patched_buf, &patched_size, &g_extern.content_crc))
+   {
+#ifdef HAVE_MMAP
+      if (map_size)
+      {
+         munmap(ret_buf, map_size);
+         close(crc_fd);
+      }
+      else
+#endif
+         free(ret_buf);
+
+      ret_buf = patched_buf;
+      *length = patched_size;
+   }
+#ifdef HAVE_MMAP
+   else if (map_size)
+      goto mapped;
+#endif
+   else
+      g_extern.content_crc = crc32_calculate(ret_buf, *length);
 
    RARCH_LOG("CRC32: 0x%x .\n", (unsigned)g_extern.content_crc);
    *buf = ret_buf;
 
+   return true;
+
+#ifdef HAVE_MMAP
+mapped:
+   content_map.data = ret_buf;
+   content_map.size = map_size;
+   content_map_crc_start(crc_fd, ret_buf, *length);
+   *buf             = ret_buf;
+   return true;
+#endif
+}
+
+#ifdef HAVE_THREADS
+#define CONTENT_LOAD_CHUNK_SIZE (1 << 20)
+
+/* Content being prepared off the main thread. Extraction, reading, 
+ * patching and hashing run on a worker; the core only sees the 
+ * result once the normal load path picks it up. */
+struct content_load_task
+{
+   sthread_t *thread;
+   slock_t *lock;
+
+   /* Set up before the worker starts. */
+   char path[PATH_MAX_LENGTH];
+   char content_path[PATH_MAX_LENGTH];
+   char extraction_directory[PATH_MAX_LENGTH];
+   char patch_cache_directory[PATH_MAX_LENGTH];
+   char ups_name[PATH_MAX_LENGTH];
+   char bps_name[PATH_MAX_LENGTH];
+   char ips_name[PATH_MAX_LENGTH];
+   char *valid_ext;
+   bool need_fullpath;
+   bool block_extract;
+   bool block_patch;
+
+   /* Written by the worker, read once it is done. */
+   bool extracted;
+   uint8_t *data;
+   ssize_t size;
+   size_t map_size;
+   uint32_t crc;
+   bool crc_valid;
+
+   /* Shared, under @lock. */
+   const char *stage;
+   size_t progress;
+   size_t total;
+   bool cancel;
+   bool done;
+   bool ok;
+};
+
+static struct content_load_task *content_task;
+
+static bool content_load_task_set_stage(struct content_load_task *task,
+      const char *stage, size_t progress, size_t total)
+{
+   bool cancel;
+
+   slock_lock(task->lock);
+   task->stage    = stage;
+   task->progress = progress;
+   task->total    = total;
+   cancel         = task->cancel;
+   slock_unlock(task->lock);
+
+   return !cancel;
+}
+
+static bool content_load_task_read(struct content_load_task *task)
+{
+   long len;
+   size_t pos;
+   FILE *file;
+
+   if (path_contains_compressed_file(task->content_path))
+   {
+      content_load_task_set_stage(task, "Extracting", 0, 0);
+      return read_file(task->content_path, (void**)&task->data, &task->size)
+         && task->size > 0;
+   }
+
+   if (!(file = fopen(task->content_path, "rb")))
+      return false;
+
+   if (fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) <= 0)
+      goto error;
+   rewind(file);
+
+   /* One byte over for the NUL read_file() adds. */
+   if (!(task->data = (uint8_t*)malloc(len + 1)))
+      goto error;
+
+   for (pos = 0; pos < (size_t)len; )
+   {
+      size_t chunk = (size_t)len - pos;
+      if (chunk > CONTENT_LOAD_CHUNK_SIZE)
+         chunk = CONTENT_LOAD_CHUNK_SIZE;
+
+      if (!content_load_task_set_stage(task, "Loading", pos, len))
+         goto error;
+
+      if (fread(task->data + pos, 1, chunk, file) != chunk)
+         goto error;
+      pos += chunk;
+   }
+
+   task->data[len] = '\0';
+   task->size      = len;
+   fclose(file);
+   return true;
+
+error:
+   free(task->data);
+   task->data = NULL;
+   fclose(file);
+   return false;
+}
+
+static bool content_load_task_hash(struct content_load_task *task)
+{
+   size_t pos;
+   uint32_t crc = 0;
+
+   for (pos = 0; pos < (size_t)task->size; )
+   {
+      size_t chunk = (size_t)task->size - pos;
+      if (chunk > CONTENT_LOAD_CHUNK_SIZE)
+         chunk = CONTENT_LOAD_CHUNK_SIZE;
+
+      if (!content_load_task_set_stage(task, "Hashing", pos, task->size))
+         return false;
+
+      crc  = crc32_update(crc, task->data + pos, chunk);
+      pos += chunk;
+   }
+
+   task->crc       = crc;
+   task->crc_valid = true;
+   return true;
+}
+
+/**
+ * content_load_task_load:
+ * @task         : Content load task.
+ *
+ * Does what read_content_file() does for @task's content. The CRC32 
+ * is always computed here, before the core can write to the data.
+ *
+ * Returns: true if successful, false on error or if cancelled.
+ **/
+static bool content_load_task_load(struct content_load_task *task)
+{
+   uint8_t *patched_buf = NULL;
+   ssize_t patched_size = 0;
+
+#ifdef HAVE_MMAP
+   if (!path_contains_compressed_file(task->content_path)
+         && map_content_file(task->content_path, (void**)&task->data,
+            &task->size, &task->map_size, NULL))
+   {
+      if (task->block_patch || !content_has_patch(task->ups_name,
+               task->bps_name, task->ips_name))
+         return content_load_task_hash(task);
+   }
+   else
+#endif
+   if (!content_load_task_read(task))
+      return false;
+
+   if (!task->block_patch)
+   {
+      if (!content_load_task_set_stage(task, "Patching", 0, 0))
+         return false;
+
+      if (patch_content_files(task->data, task->size,
+               &patched_buf, &patched_size, &task->crc,
+               task->ups_name, task->bps_name, task->ips_name,
+               task->patch_cache_directory))
+      {
+#ifdef HAVE_MMAP
+         if (task->map_size)
+            munmap(task->data, task->map_size);
+         else
+#endif
+            free(task->data);
+
+         task->data      = patched_buf;
+         task->size      = patched_size;
+         task->map_size  = 0;
+         task->crc_valid = true;
+         return true;
+      }
+   }
+
+   return content_load_task_hash(task);
+}
+
+static void content_load_task_worker(void *data)
+{
+   struct content_load_task *task = (struct content_load_task*)data;
+   const char *ext = path_get_extension(task->path);
+   bool ok         = true;
+
+#ifdef HAVE_ZLIB
+   if (!task->block_extract && ext && !strcasecmp(ext, "zip"))
+   {
+      content_load_task_set_stage(task, "Extracting", 0, 0);
+
+      ok = zlib_extract_first_content_file(task->content_path,
+            sizeof(task->content_path), task->valid_ext,
+            *task->extraction_directory ? task->extraction_directory : NULL);
+      task->extracted = ok;
+   }
+#endif
+
+   if (ok && !task->need_fullpath)
+      ok = content_load_task_load(task);
+
+   slock_lock(task->lock);
+   task->done = true;
+   task->ok   = ok && !task->cancel;
+   slock_unlock(task->lock);
+}
+
+/**
+ * content_load_task_free:
+ *
+ * Cancels and frees the content load task, along with anything 
+ * it prepared that nothing took.
+ **/
+void content_load_task_free(void)
+{
+   struct content_load_task *task = content_task;
+
+   if (!task)
+      return;
+
+   content_task = NULL;
+
+   if (task->thread)
+   {
+      slock_lock(task->lock);
+      task->cancel = true;
+      slock_unlock(task->lock);
+
+      sthread_join(task->thread);
+   }
+
+#ifdef HAVE_MMAP
+   if (task->map_size)
+      munmap(task->data, task->map_size);
+   else
+#endif
+      free(task->data);
+
+   if (task->extracted)
+      remove(task->content_path);
+
+   if (task->lock)
+      slock_free(task->lock);
+   free(task->valid_ext);
+   free(task);
+}
+
+/**
+ * content_load_task_start:
+ * @path         : Path of the content to load.
+ *
+ * Starts preparing @path on a worker thread for the core the menu 
+ * has selected. Does nothing if @path is already prepared, or has 
+ * nothing worth doing off the main thread.
+ *
+ * Returns: true if a task was started, false if loading can go 
+ * ahead right away.
+ **/
+bool content_load_task_start(const char *path)
+{
+   char basename[PATH_MAX_LENGTH];
+   struct content_load_task *task = NULL;
+   const struct retro_system_info *info = &g_extern.menu.info;
+   const char *ext = path_get_extension(path);
+
+   if (content_task && !strcmp(content_task->path, path))
+   {
+      bool ready;
+
+      slock_lock(content_task->lock);
+      ready = content_task->done && content_task->ok;
+      slock_unlock(content_task->lock);
+
+      if (ready)
+         return false;
+   }
+
+   content_load_task_free();
+
+   if (!*path || *g_extern.subsystem || !info->library_name)
+      return false;
+
+#ifdef HAVE_MENU
+   if (driver.menu && driver.menu->load_no_content)
+      return false;
+#endif
+
+   if (info->need_fullpath && (info->block_extract
+            || !ext || strcasecmp(ext, "zip")))
+      return false;
+
+   task = (struct content_load_task*)calloc(1, sizeof(*task));
+   if (!task)
+      return false;
+
+   strlcpy(task->path, path, sizeof(task->path));
+   strlcpy(task->content_path, path, sizeof(task->content_path));
+   strlcpy(task->extraction_directory, g_settings.extraction_directory,
+         sizeof(task->extraction_directory));
+   strlcpy(task->patch_cache_directory, g_settings.patch_cache_directory,
+         sizeof(task->patch_cache_directory));
+   task->valid_ext     = info->valid_extensions ?
+      strdup(info->valid_extensions) : NULL;
+   task->need_fullpath = info->need_fullpath;
+   task->block_extract = info->block_extract;
+   task->block_patch   = g_extern.block_patch;
+
+   /* Menu loads never ask for a specific patch, so these are 
+    * what fill_pathnames() will come up with. */
+   rarch_fill_content_basename(basename, path, sizeof(basename));
+   fill_pathname_noext(task->ups_name, basename, ".ups",
+         sizeof(task->ups_name));
+   fill_pathname_noext(task->bps_name, basename, ".bps",
+         sizeof(task->bps_name));
+   fill_pathname_noext(task->ips_name, basename, ".ips",
+         sizeof(task->ips_name));
+
+   content_task = task;
+
+   if (!(task->lock = slock_new()))
+      goto error;
+   if (!(task->thread = sthread_create(content_load_task_worker, task)))
+      goto error;
+
+   return true;
+
+error:
+   content_load_task_free();
+   return false;
+}
+
+/**
+ * content_load_task_iterate:
+ *
+ * Shows progress of the content load task. Call once per frame.
+ *
+ * Returns: true once the content is ready to be loaded.
+ **/
+bool content_load_task_iterate(void)
+{
+   /* Room for the stage and progress around the name. */
+   char msg[PATH_MAX_LENGTH + 64], name[PATH_MAX_LENGTH];
+   const char *stage;
+   size_t progress, total;
+   bool done, ok;
+   struct content_load_task *task = content_task;
+
+   if (!task || !task->thread)
+      return false;
+
+   slock_lock(task->lock);
+   stage    = task->stage;
+   progress = task->progress;
+   total    = task->total;
+   done     = task->done;
+   ok       = task->ok;
+   slock_unlock(task->lock);
+
+   fill_pathname_base(name, task->path, sizeof(name));
+
+   if (!done)
+   {
+      if (!stage)
+         return false;
+
+      if (total)
+         snprintf(msg, sizeof(msg), "%s %s: %u%%", stage, name,
+               (unsigned)((uint64_t)progress * 100 / total));
+      else
+         snprintf(msg, sizeof(msg), "%s %s ...", stage, name);
+
+      rarch_main_msg_queue_push(msg, 1, 10, true);
+      return false;
+   }
+
+   sthread_join(task->thread);
+   task->thread = NULL;
+
+   if (!ok)
+   {
+      snprintf(msg, sizeof(msg), "Failed to load %s.\n", name);
+      rarch_main_msg_queue_push(msg, 1, 90, true);
+      content_load_task_free();
+      return false;
+   }
+
    return true;
 }
 
+/**
+ * content_load_task_get:
+ * @path         : Path the load path is about to use.
+ *
+ * Returns: the finished content load task for @path, or NULL.
+ **/
+static struct content_load_task *content_load_task_get(const char *path)
+{
+   struct content_load_task *task = content_task;
+
+   if (!task || task->thread || !task->ok)
+      return NULL;
+   if (strcmp(task->path, path) && strcmp(task->content_path, path))
+      return NULL;
+   return task;
+}
+#endif
+
 /**
  * dump_to_file_desperate:
  * @data         : pointer to data buffer.
@@ -126,46 +760,384 @@ struct sram_block
    size_t size;
 };
 
+/* Compressed savestates start with this, followed by the size of 
+ * the state as a 64-bit little endian number and a zlib stream. */
+#define STATE_COMPRESSED_MAGIC "RASTATEZ"
+#define STATE_HEADER_SIZE      16
+#define STATE_CHUNK_SIZE       (256 * 1024)
+
+/* A serialized state on its way to disk. */
+struct save_state_job
+{
+   char path[PATH_MAX_LENGTH];
+   uint8_t *data;
+   size_t size;
+   bool compress;
+   bool dedup;
+   bool ok;
+};
+
+/* Savestates are serialized on the main thread, then compressed 
+ * and written on a worker while the next frames run. One state 
+ * is in flight at most, so two buffers are enough to serialize 
+ * the next one before the last one is on disk. */
+static struct
+{
+   struct save_state_job job;
+   bool pending;
+   /* A state kept in the chunk store this session, whose unused 
+    * chunks are dropped once saving is over. */
+   char collect_path[PATH_MAX_LENGTH];
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   bool done;
+#endif
+
+   struct
+   {
+      uint8_t *data;
+      size_t size;
+   } pool[2];
+} save_state_writer;
+
+#ifdef HAVE_ZLIB_DEFLATE
+static bool save_state_write_compressed(FILE *file,
+      const uint8_t *data, size_t size)
+{
+   unsigned i;
+   uint8_t header[STATE_HEADER_SIZE];
+   z_stream stream;
+   size_t pos   = 0;
+   int ret      = Z_OK;
+   uint8_t *out = NULL;
+
+   memcpy(header, STATE_COMPRESSED_MAGIC, 8);
+   for (i = 0; i < 8; i++)
+      header[8 + i] = (uint8_t)((uint64_t)size >> (8 * i));
+
+   if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+      return false;
+
+   memset(&stream, 0, sizeof(stream));
+   if (!(out = (uint8_t*)malloc(STATE_CHUNK_SIZE)))
+      return false;
+   if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
+   {
+      free(out);
+      return false;
+   }
+
+   while (ret == Z_OK)
+   {
+      size_t written;
+
+      if (!stream.avail_in && pos < size)
+      {
+         size_t chunk = size - pos;
+         if (chunk > STATE_CHUNK_SIZE)
+            chunk = STATE_CHUNK_SIZE;
+
+         stream.next_in  = (Bytef*)data + pos;
+         stream.avail_in = chunk;
+         pos            += chunk;
+      }
+
+      stream.next_out  = out;
+      stream.avail_out = STATE_CHUNK_SIZE;
+      ret = deflate(&stream, pos == size ? Z_FINISH : Z_NO_FLUSH);
+
+      written = STATE_CHUNK_SIZE - stream.avail_out;
+      if (fwrite(out, 1, written, file) != written)
+         break;
+   }
+
+   deflateEnd(&stream);
+   free(out);
+   return ret == Z_STREAM_END;
+}
+#endif
+
+/**
+ * save_state_write:
+ * @job       : state to write.
+ *
+ * Writes @job to a temporary file next to its path first, so an 
+ * interrupted write leaves the previous state in place.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool save_state_write(const struct save_state_job *job)
+{
+   char tmp_path[PATH_MAX_LENGTH];
+   bool ok    = false;
+   FILE *file = NULL;
+
+   if (job->dedup)
+      return savestate_store_write(job->path, job->data, job->size,
+            job->compress);
+
+   strlcpy(tmp_path, job->path, sizeof(tmp_path));
+   strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+   if (!(file = fopen(tmp_path, "wb")))
+      return false;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (job->compress)
+      ok = save_state_write_compressed(file, job->data, job->size);
+   else
+#endif
+      ok = fwrite(job->data, 1, job->size, file) == job->size;
+
+   ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+   /* rename() does not replace existing files here. */
+   if (ok)
+      remove(job->path);
+#endif
+   if (ok && rename(tmp_path, job->path) == 0)
+      return true;
+
+   remove(tmp_path);
+   return false;
+}
+
+#ifdef HAVE_THREADS
+static void save_state_worker(void *data)
+{
+   bool ok = save_state_write(&save_state_writer.job);
+
+   (void)data;
+
+   slock_lock(save_state_writer.lock);
+   save_state_writer.job.ok = ok;
+   save_state_writer.done   = true;
+   slock_unlock(save_state_writer.lock);
+}
+#endif
+
+/**
+ * save_state_wait:
+ *
+ * Waits for the state in flight, if any, and reports whether 
+ * it made it to disk.
+ **/
+static void save_state_wait(void)
+{
+   char msg[PATH_MAX_LENGTH + 32];
+
+   if (!save_state_writer.pending)
+      return;
+
+#ifdef HAVE_THREADS
+   if (save_state_writer.thread)
+   {
+      sthread_join(save_state_writer.thread);
+      save_state_writer.thread = NULL;
+   }
+#endif
+   save_state_writer.pending = false;
+
+   if (save_state_writer.job.ok)
+      return;
+
+   snprintf(msg, sizeof(msg), "Failed to save state to \"%s\".",
+         save_state_writer.job.path);
+   RARCH_ERR("%s\n", msg);
+   rarch_main_msg_queue_push(msg, 2, 180, true);
+}
+
+/**
+ * save_state_iterate:
+ *
+ * Reports on a state written in the background once it is done. 
+ * Call once per frame.
+ **/
+void save_state_iterate(void)
+{
+#ifdef HAVE_THREADS
+   bool done = false;
+
+   if (!save_state_writer.pending || !save_state_writer.thread)
+      return;
+
+   slock_lock(save_state_writer.lock);
+   done = save_state_writer.done;
+   slock_unlock(save_state_writer.lock);
+
+   if (done)
+      save_state_wait();
+#endif
+}
+
+/**
+ * save_state_flush:
+ *
+ * Waits for states written in the background to be on disk, 
+ * drops savestate chunks they no longer use, and frees the 
+ * buffers kept for serializing.
+ **/
+void save_state_flush(void)
+{
+   unsigned i;
+
+   save_state_wait();
+
+   if (*save_state_writer.collect_path)
+      savestate_store_collect(save_state_writer.collect_path);
+   *save_state_writer.collect_path = '\0';
+
+#ifdef HAVE_THREADS
+   if (save_state_writer.lock)
+      slock_free(save_state_writer.lock);
+   save_state_writer.lock = NULL;
+#endif
+
+   for (i = 0; i < ARRAY_SIZE(save_state_writer.pool); i++)
+   {
+      free(save_state_writer.pool[i].data);
+      save_state_writer.pool[i].data = NULL;
+      save_state_writer.pool[i].size = 0;
+   }
+}
+
 /**
  * save_state:
  * @path      : path of saved state that shall be written to.
  *
- * Save a state from memory to disk.
+ * Save a state from memory to disk. The state is serialized right 
+ * away, and compressed and written on a worker thread where 
+ * available; failing to write it is reported once that is done.
  *
  * Returns: true if successful, false otherwise.
  **/
 bool save_state(const char *path)
 {
-   bool ret = false;
-   void *data = NULL;
-   size_t size = pretro_serialize_size();
+   struct save_state_job *job = &save_state_writer.job;
+   size_t size                = pretro_serialize_size();
+   unsigned slot              = 0;
 
    RARCH_LOG("Saving state: \"%s\".\n", path);
 
    if (size == 0)
       return false;
 
-   data = malloc(size);
+   /* Leave the buffer of the state in flight alone. */
+   if (save_state_writer.pending
+         && job->data == save_state_writer.pool[0].data)
+      slot = 1;
 
-   if (!data)
+   if (save_state_writer.pool[slot].size < size)
    {
-      RARCH_ERR("Failed to allocate memory for save state buffer.\n");
-      return false;
+      free(save_state_writer.pool[slot].data);
+      save_state_writer.pool[slot].size = 0;
+
+      if (!(save_state_writer.pool[slot].data = (uint8_t*)malloc(size)))
+      {
+         RARCH_ERR("Failed to allocate memory for save state buffer.\n");
+         return false;
+      }
+      save_state_writer.pool[slot].size = size;
    }
 
    RARCH_LOG("State size: %d bytes.\n", (int)size);
-   ret = pretro_serialize(data, size);
 
-   if (ret)
-      ret = write_file(path, data, size);
-
-   if (!ret)
+   if (!pretro_serialize(save_state_writer.pool[slot].data, size))
+   {
       RARCH_ERR("Failed to save state to \"%s\".\n", path);
+      return false;
+   }
 
-   free(data);
+   save_state_wait();
+
+   strlcpy(job->path, path, sizeof(job->path));
+   job->data     = save_state_writer.pool[slot].data;
+   job->size     = size;
+   job->compress = g_settings.savestate_compression;
+   job->dedup    = g_settings.savestate_dedup;
+   job->ok       = false;
+
+   if (job->dedup)
+      strlcpy(save_state_writer.collect_path, path,
+            sizeof(save_state_writer.collect_path));
+
+#ifdef HAVE_THREADS
+   save_state_writer.done = false;
+   if (!save_state_writer.lock)
+      save_state_writer.lock = slock_new();
+   if (save_state_writer.lock && (save_state_writer.thread =
+            sthread_create(save_state_worker, NULL)))
+   {
+      save_state_writer.pending = true;
+      return true;
+   }
+#endif
 
-   return ret;
+   return save_state_write(job);
+}
+
+#ifdef HAVE_ZLIB
+/**
+ * load_state_decompress:
+ * @buf       : state read from disk, replaced by the decompressed 
+ *              state if it was compressed.
+ * @size      : size of @buf, updated along with it.
+ *
+ * Returns: true if @buf holds a plain state, false if it was 
+ * compressed but could not be decompressed.
+ **/
+static bool load_state_decompress(void **buf, ssize_t *size)
+{
+   unsigned i;
+   z_stream stream;
+   uint64_t state_size = 0;
+   const uint8_t *in   = (const uint8_t*)*buf;
+   uint8_t *out        = NULL;
+   int ret             = Z_DATA_ERROR;
+
+   if (*size < STATE_HEADER_SIZE
+         || memcmp(in, STATE_COMPRESSED_MAGIC, 8) != 0)
+      return true;
+
+   for (i = 0; i < 8; i++)
+      state_size |= (uint64_t)in[8 + i] << (8 * i);
+
+   /* zlib counts in 32 bits. */
+   if (state_size > 0xffffffffu || *size - STATE_HEADER_SIZE > 0xffffffffu)
+      return false;
+
+   if (!(out = (uint8_t*)malloc(state_size + 1)))
+      return false;
+
+   memset(&stream, 0, sizeof(stream));
+   if (inflateInit(&stream) != Z_OK)
+   {
+      free(out);
+      return false;
+   }
+
+   stream.next_in   = (Bytef*)in + STATE_HEADER_SIZE;
+   stream.avail_in  = *size - STATE_HEADER_SIZE;
+   stream.next_out  = out;
+   stream.avail_out = state_size;
+
+   ret = inflate(&stream, Z_FINISH);
+   inflateEnd(&stream);
+
+   if (ret != Z_STREAM_END || stream.total_out != state_size)
+   {
+      free(out);
+      return false;
+   }
+
+   free(*buf);
+   *buf  = out;
+   *size = state_size;
+   return true;
 }
+#endif
 
 /**
  * load_state:
@@ -184,10 +1156,28 @@ bool load_state(const char *path)
    struct sram_block *blocks = NULL;
    ssize_t size;
 
+   /* The state may still be on its way to disk. */
+   save_state_wait();
+
    ret = read_file(path, &buf, &size);
 
    RARCH_LOG("Loading state: \"%s\".\n", path);
 
+#ifdef HAVE_ZLIB
+   if (ret && size >= 0 && !load_state_decompress(&buf, &size))
+   {
+      free(buf);
+      ret = false;
+   }
+#endif
+
+   if (ret && size >= 0 && savestate_store_is_manifest(buf, size)
+         && !savestate_store_read(path, &buf, &size))
+   {
+      free(buf);
+      ret = false;
+   }
+
    if (!ret || size < 0)
    {
       RARCH_ERR("Failed to load state from \"%s\".\n", path);
@@ -267,6 +1257,10 @@ void load_ram_file(const char *path, int type)
    if (size == 0 || !data)
       return;
 
+#ifdef HAVE_THREADS
+   autosave_recover(path);
+#endif
+
    ret = read_file(path, &buf, &rc);
 
    if (!ret)
@@ -327,7 +1321,35 @@ static bool load_content_dont_need_fullpath(
    /* First content file is significant, attempt to do patching,
     * CRC checking, etc. */
    bool ret = false;
+#ifdef HAVE_THREADS
+   struct content_load_task *task = (i == 0) ?
+      content_load_task_get(path) : NULL;
+
+   if (task && task->data)
+   {
+      info->data = task->data;
+      len        = task->size;
+      task->data = NULL;
+
+#ifdef HAVE_MMAP
+      if (task->map_size)
+      {
+         content_map.data = (void*)info->data;
+         content_map.size = task->map_size;
+         task->map_size   = 0;
+      }
+#endif
 
+      if (task->crc_valid)
+      {
+         g_extern.content_crc = task->crc;
+         RARCH_LOG("CRC32: 0x%x .\n", (unsigned)g_extern.content_crc);
+      }
+
+      ret = true;
+   }
+   else
+#endif
    if (i == 0)
       ret = read_content_file(path, (void**)&info->data, &len);
    else
@@ -480,7 +1502,16 @@ static bool load_content(const struct retro_subsystem_info *special,
 
 end:
    for (i = 0; i < content->size; i++)
+   {
+#ifdef HAVE_MMAP
+      if (info[i].data && info[i].data == content_map.data)
+         continue;
+#endif
       free((void*)info[i].data);
+   }
+
+   if (!ret)
+      deinit_content_file();
 
    string_list_free(additional_path_allocs);
    if (info)
@@ -507,6 +1538,8 @@ bool init_content_file(void)
    struct string_list *content = NULL;
    const struct retro_subsystem_info *special = NULL;
 
+   deinit_content_file();
+
    g_extern.temporary_content = string_list_new();
 
    if (!g_extern.temporary_content)
@@ -581,11 +1614,28 @@ bool init_content_file(void)
    {
       const char *ext = NULL;
       const char *valid_ext = NULL;
+#ifdef HAVE_THREADS
+      struct content_load_task *task = (i == 0) ?
+         content_load_task_get(content->elems[i].data) : NULL;
+#endif
 
       /* Block extract check. */
       if (content->elems[i].attr.i & 1)
          continue;
 
+#ifdef HAVE_THREADS
+      if (task && task->extracted)
+      {
+         /* Hand the extracted file over, it is cleaned up 
+          * with the rest of the temporary content now. */
+         task->extracted = false;
+         string_list_set(content, i, task->content_path);
+         string_list_append(g_extern.temporary_content,
+               task->content_path, attr);
+         continue;
+      }
+#endif
+
       ext       = path_get_extension(content->elems[i].data);
       valid_ext = special ? special->roms[i].valid_extensions :
          g_extern.system.info.valid_extensions;
@@ -616,6 +1666,10 @@ bool init_content_file(void)
    /* Set attr to need_fullpath as appropriate. */
    ret = load_content(special, content);
 
+#ifdef HAVE_THREADS
+   content_load_task_free();
+#endif
+
 error:
    g_extern.content_is_init = (ret) ? true : false;
 
@@ -623,3 +1677,42 @@ error:
       string_list_free(content);
    return ret;
 }
+
+/**
+ * deinit_content_file:
+ *
+ * Releases content kept around after loading. 
+ * Call after the core has unloaded it.
+ **/
+void deinit_content_file(void)
+{
+#ifdef HAVE_MMAP
+#ifdef HAVE_THREADS
+   if (content_map.crc_thread)
+      sthread_join(content_map.crc_thread);
+#endif
+   if (content_map.data)
+      munmap(content_map.data, content_map.size);
+   memset(&content_map, 0, sizeof(content_map));
+#endif
+}
+
+/**
+ * content_get_crc:
+ *
+ * Returns: CRC32 of the loaded content, waiting for it first if 
+ * it is still being computed.
+ **/
+uint32_t content_get_crc(void)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_THREADS)
+   if (content_map.crc_thread)
+   {
+      sthread_join(content_map.crc_thread);
+      content_map.crc_thread = NULL;
+      g_extern.content_crc   = content_map.crc;
+      RARCH_LOG("CRC32: 0x%x .\n", (unsigned)g_extern.content_crc);
+   }
+#endif
+   return g_extern.content_crc;
+}
@@ -43,12 +43,30 @@ bool load_state(const char *path);
  * save_state:
  * @path      : path of saved state that shall be written to.
  *
- * Save a state from memory to disk.
+ * Save a state from memory to disk. The state is serialized right 
+ * away, and compressed and written on a worker thread where 
+ * available; failing to write it is reported once that is done.
  *
  * Returns: true if successful, false otherwise.
  **/
 bool save_state(const char *path);
 
+/**
+ * save_state_iterate:
+ *
+ * Reports on a state written in the background once it is done. 
+ * Call once per frame.
+ **/
+void save_state_iterate(void);
+
+/**
+ * save_state_flush:
+ *
+ * Waits for states written in the background to be on disk, and 
+ * frees the buffers kept for serializing.
+ **/
+void save_state_flush(void);
+
 /**
  * load_ram_file:
  * @path             : path of RAM state that will be loaded from.
@@ -83,6 +101,54 @@ void save_ram_file(const char *path, int type);
  **/
 bool init_content_file(void);
 
+/**
+ * deinit_content_file:
+ *
+ * Releases content kept around after loading. 
+ * Call after the core has unloaded it.
+ **/
+void deinit_content_file(void);
+
+/**
+ * content_get_crc:
+ *
+ * Returns: CRC32 of the loaded content, computing it first if 
+ * loading skipped it.
+ **/
+uint32_t content_get_crc(void);
+
+#ifdef HAVE_THREADS
+/**
+ * content_load_task_start:
+ * @path         : Path of the content to load.
+ *
+ * Starts preparing @path on a worker thread for the core the menu 
+ * has selected. Does nothing if @path is already prepared, or has 
+ * nothing worth doing off the main thread.
+ *
+ * Returns: true if a task was started, false if loading can go 
+ * ahead right away.
+ **/
+bool content_load_task_start(const char *path);
+
+/**
+ * content_load_task_iterate:
+ *
+ * Shows progress of the content load task. Call once per frame.
+ *
+ * Returns: true once the content is ready to be loaded.
+ **/
+bool content_load_task_iterate(void);
+
+/**
+ * content_load_task_free:
+ *
+ * Cancels and frees the content load task, along with anything 
+ * it prepared that nothing took.
+ **/
+void content_load_task_free(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,13 @@
 #include <file/file_path.h>
 #include "file_ext.h"
 #include <file/dir_list.h>
+#include "performance.h"
+#include "database_scan_cache.h"
+#include "playlist.h"
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -44,20 +51,562 @@ int database_open_cursor(libretrodb_t *db,
    if ((libretrodb_cursor_open(db, cur, q)) != 0)
       return -1;
 
+   /* The cursor holds its own reference. */
+   if (q)
+      libretrodb_query_free(q);
+
    return 0;
 }
 
+/* Files are hashed through a buffer of this size, so memory 
+ * use does not depend on how large the content is. */
+#define RDL_CHUNK_SIZE (64 * 1024)
+
+#ifdef HAVE_THREADS
+struct database_info_rdl_worker
+{
+   sthread_t *thread;
+   uint8_t *buf;
+   database_info_rdl_handle_t *dbl;
+};
+
+struct database_info_rdl_pool
+{
+   struct database_info_rdl_worker *workers;
+   unsigned count;
+   slock_t *lock;
+   /* Next file to hand out to a worker. */
+   size_t next;
+   bool cancel;
+};
+#endif
+
+/* A database scanned files are matched against, and the 
+ * playlist its matches are added to. */
+struct database_info_rdl_db
+{
+   char path[PATH_MAX_LENGTH];
+   /* Core whose info lists this database, or empty. */
+   char core_path[PATH_MAX_LENGTH];
+   content_playlist_t *playlist;
+};
+
+/* A CRC32 found while scanning, and the file it was found in, 
+ * as an index into the scanned list. */
+struct database_info_rdl_crc
+{
+   uint32_t crc;
+   size_t file;
+};
+
+/* CRC32s found in a single scanned file. */
+struct database_info_rdl_crcs
+{
+   uint32_t *list;
+   size_t count;
+};
+
+static bool database_info_rdl_crcs_push(struct database_info_rdl_crcs *crcs,
+      uint32_t crc)
+{
+   uint32_t *list = (uint32_t*)realloc(crcs->list,
+         (crcs->count + 1) * sizeof(uint32_t));
+
+   if (!list)
+      return false;
+
+   list[crcs->count++] = crc;
+   crcs->list          = list;
+   return true;
+}
+
+/**
+ * database_info_rdl_collect:
+ * @dbl                  : Scan handle.
+ * @file                 : Index of the scanned file in the list.
+ * @crcs                 : CRC32s found in the file.
+ * @count                : Number of CRC32s.
+ *
+ * Records the CRC32s of one scanned file, to be looked up along 
+ * with every other file's once the scan is done.
+ **/
+static void database_info_rdl_collect(database_info_rdl_handle_t *dbl,
+      size_t file, const uint32_t *crcs, size_t count)
+{
+   size_t i;
+
+   if (!dbl->db_count || !count)
+      return;
+
+#ifdef HAVE_THREADS
+   if (dbl->pool)
+      slock_lock(dbl->pool->lock);
+#endif
+
+   if (dbl->crc_count + count > dbl->crc_cap)
+   {
+      size_t cap = dbl->crc_cap ? dbl->crc_cap * 2 : 256;
+      struct database_info_rdl_crc *tmp = NULL;
+
+      while (cap < dbl->crc_count + count)
+         cap *= 2;
+
+      tmp = (struct database_info_rdl_crc*)
+         realloc(dbl->crcs, cap * sizeof(*tmp));
+      if (!tmp)
+         count = 0;
+      else
+      {
+         dbl->crcs    = tmp;
+         dbl->crc_cap = cap;
+      }
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      dbl->crcs[dbl->crc_count].crc  = crcs[i];
+      dbl->crcs[dbl->crc_count].file = file;
+      dbl->crc_count++;
+   }
+
+#ifdef HAVE_THREADS
+   if (dbl->pool)
+      slock_unlock(dbl->pool->lock);
+#endif
+}
+
+/**
+ * database_info_rdl_add_crcs:
+ * @dbl                  : Scan handle.
+ * @file                 : Index of the scanned file in the list.
+ * @size                 : Size of the file.
+ * @mtime                : Modification time of the file.
+ * @crcs                 : CRC32s found in the file.
+ * @count                : Number of CRC32s.
+ *
+ * Collects the CRC32s of a freshly hashed file and records them 
+ * in the scan cache.
+ **/
+static void database_info_rdl_add_crcs(database_info_rdl_handle_t *dbl,
+      size_t file, uint64_t size, uint64_t mtime,
+      const uint32_t *crcs, size_t count)
+{
+   const char *name = dbl->list->elems[file].data;
+
+   database_info_rdl_collect(dbl, file, crcs, count);
+
+   if (!dbl->cache)
+      return;
+
+#ifdef HAVE_THREADS
+   if (dbl->pool)
+      slock_lock(dbl->pool->lock);
+#endif
+
+   database_scan_cache_add(dbl->cache, name, size, mtime, crcs, count);
+
+#ifdef HAVE_THREADS
+   if (dbl->pool)
+      slock_unlock(dbl->pool->lock);
+#endif
+}
+
 #ifdef HAVE_ZLIB
 static int zlib_compare_crc32(const char *name, const char *valid_exts,
       const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
       uint32_t crc32, void *userdata)
 {
+   struct database_info_rdl_crcs *crcs = 
+      (struct database_info_rdl_crcs*)userdata;
+   size_t len = strlen(name);
+
+   /* Directories are stored as empty entries. */
+   if (len && name[len - 1] == '/')
+      return 1;
+
+   RARCH_LOG("CRC32: 0x%x\n", crc32);
+
+   return database_info_rdl_crcs_push(crcs, crc32);
+}
+#endif
+
+#ifdef HAVE_7ZIP
+static int compressed_7zip_compare_crc32(const char *name, uint64_t size,
+      uint32_t crc32, void *userdata)
+{
+   struct database_info_rdl_crcs *crcs = 
+      (struct database_info_rdl_crcs*)userdata;
+
    RARCH_LOG("CRC32: 0x%x\n", crc32);
 
-   return 1;
+   return database_info_rdl_crcs_push(crcs, crc32);
 }
 #endif
 
+/**
+ * database_info_rdl_scan_file:
+ * @dbl                  : Scan handle.
+ * @idx                  : Index of the file to scan in the list.
+ * @buf                  : Buffer of RDL_CHUNK_SIZE bytes to read through.
+ *
+ * Collects the CRC32 of the file, or of each file inside it if it 
+ * is a ZIP or 7z archive. Files the scan cache has seen at the same 
+ * size and modification time are not read. Safe to call from 
+ * several workers at once.
+ **/
+static void database_info_rdl_scan_file(database_info_rdl_handle_t *dbl,
+      size_t idx, uint8_t *buf)
+{
+   const char *name = dbl->list->elems[idx].data;
+   FILE *file;
+   size_t len;
+   uint32_t crc = 0;
+   uint64_t size = 0, mtime = 0;
+   const uint32_t *cached = NULL;
+   size_t cached_count = 0;
+   struct database_info_rdl_crcs crcs = {NULL, 0};
+
+   if (!database_scan_cache_stat(name, &size, &mtime))
+      return;
+
+   if (dbl->cache && database_scan_cache_find(dbl->cache, name,
+            size, mtime, &cached, &cached_count))
+   {
+      database_info_rdl_collect(dbl, idx, cached, cached_count);
+      return;
+   }
+
+   /* Archives store the CRC32 of each file they hold, so only 
+    * their directories need to be read. */
+#ifdef HAVE_ZLIB
+   if (!strcmp(path_get_extension(name), "zip"))
+   {
+      RARCH_LOG("[ZIP]: name: %s\n", name);
+
+      if (zlib_parse_file_directory(name, NULL, zlib_compare_crc32, &crcs))
+         database_info_rdl_add_crcs(dbl, idx, size, mtime,
+               crcs.list, crcs.count);
+      else
+         RARCH_LOG("Could not process ZIP file.\n");
+
+      free(crcs.list);
+      return;
+   }
+#endif
+#ifdef HAVE_7ZIP
+   if (!strcmp(path_get_extension(name), "7z"))
+   {
+      RARCH_LOG("[7z]: name: %s\n", name);
+
+      if (compressed_7zip_parse_file(name,
+               compressed_7zip_compare_crc32, &crcs))
+         database_info_rdl_add_crcs(dbl, idx, size, mtime,
+               crcs.list, crcs.count);
+      else
+         RARCH_LOG("Could not process 7z file.\n");
+
+      free(crcs.list);
+      return;
+   }
+#endif
+
+   if (!(file = fopen(name, "rb")))
+      return;
+
+   while ((len = fread(buf, 1, RDL_CHUNK_SIZE, file)) > 0)
+      crc = crc32_update(crc, buf, len);
+
+   if (!ferror(file))
+   {
+      RARCH_LOG("CRC32: 0x%x .\n", (unsigned)crc);
+      database_info_rdl_add_crcs(dbl, idx, size, mtime, &crc, 1);
+   }
+
+   fclose(file);
+}
+
+#ifdef HAVE_THREADS
+static void database_info_rdl_worker(void *data)
+{
+   struct database_info_rdl_worker *worker = 
+      (struct database_info_rdl_worker*)data;
+   database_info_rdl_handle_t *dbl      = worker->dbl;
+   struct database_info_rdl_pool *pool = dbl->pool;
+
+   for (;;)
+   {
+      size_t idx;
+
+      slock_lock(pool->lock);
+      if (pool->cancel || pool->next >= dbl->list->size)
+      {
+         slock_unlock(pool->lock);
+         break;
+      }
+      idx = pool->next++;
+      slock_unlock(pool->lock);
+
+      database_info_rdl_scan_file(dbl, idx, worker->buf);
+
+      slock_lock(pool->lock);
+      dbl->list_ptr++;
+      slock_unlock(pool->lock);
+   }
+}
+
+static void database_info_rdl_pool_free(database_info_rdl_handle_t *dbl)
+{
+   unsigned i;
+   struct database_info_rdl_pool *pool = dbl->pool;
+
+   if (!pool)
+      return;
+
+   if (pool->lock)
+   {
+      slock_lock(pool->lock);
+      pool->cancel = true;
+      slock_unlock(pool->lock);
+   }
+
+   for (i = 0; i < pool->count; i++)
+   {
+      if (pool->workers[i].thread)
+         sthread_join(pool->workers[i].thread);
+      free(pool->workers[i].buf);
+   }
+
+   if (pool->lock)
+      slock_free(pool->lock);
+   free(pool->workers);
+   free(pool);
+   dbl->pool = NULL;
+}
+
+/**
+ * database_info_rdl_pool_new:
+ * @dbl                  : Scan handle.
+ *
+ * Starts one worker per CPU core. Workers take files off the 
+ * list in order until it runs out, and collect the CRC32s of 
+ * each one.
+ *
+ * Returns: true if the workers were started.
+ **/
+static bool database_info_rdl_pool_new(database_info_rdl_handle_t *dbl)
+{
+   unsigned i;
+   struct database_info_rdl_pool *pool = NULL;
+   unsigned count = rarch_get_cpu_cores();
+
+   if (count > dbl->list->size)
+      count = dbl->list->size;
+   if (count < 1)
+      count = 1;
+
+   pool = (struct database_info_rdl_pool*)calloc(1, sizeof(*pool));
+   if (!pool)
+      return false;
+
+   dbl->pool     = pool;
+   pool->workers = (struct database_info_rdl_worker*)
+      calloc(count, sizeof(*pool->workers));
+   pool->lock    = slock_new();
+
+   if (!pool->workers || !pool->lock)
+      goto error;
+
+   pool->count = count;
+
+   for (i = 0; i < count; i++)
+   {
+      pool->workers[i].dbl = dbl;
+      pool->workers[i].buf = (uint8_t*)malloc(RDL_CHUNK_SIZE);
+      if (!pool->workers[i].buf)
+         goto error;
+   }
+
+   /* Threads only start once every buffer is in place, so a 
+    * failure above never leaves files half handed out. */
+   for (i = 0; i < count; i++)
+   {
+      pool->workers[i].thread = sthread_create(database_info_rdl_worker,
+            &pool->workers[i]);
+      if (!pool->workers[i].thread)
+         break;
+   }
+
+   if (i == 0)
+      goto error;
+
+   RARCH_LOG("Scanning with %u threads.\n", i);
+   return true;
+
+error:
+   database_info_rdl_pool_free(dbl);
+   return false;
+}
+#endif
+
+static int database_info_rdl_crc_cmp(const void *a, const void *b)
+{
+   uint32_t x = ((const struct database_info_rdl_crc*)a)->crc;
+   uint32_t y = ((const struct database_info_rdl_crc*)b)->crc;
+
+   return x < y ? -1 : (x > y);
+}
+
+/**
+ * database_info_rdl_match:
+ * @dbl                  : Scan handle.
+ *
+ * Looks up every CRC32 the scan found in each database, one 
+ * lookup per database, and adds the files they were found in 
+ * to the playlist of every database that has them.
+ **/
+static void database_info_rdl_match(database_info_rdl_handle_t *dbl)
+{
+   size_t i, j, k;
+   uint32_t *crcs = NULL;
+
+   if (!dbl->crc_count)
+      return;
+
+   if (dbl->crc_count > 1)
+      qsort(dbl->crcs, dbl->crc_count, sizeof(*dbl->crcs),
+            database_info_rdl_crc_cmp);
+
+   if (!(crcs = (uint32_t*)malloc(dbl->crc_count * sizeof(*crcs))))
+      return;
+
+   for (i = 0; i < dbl->crc_count; i++)
+      crcs[i] = dbl->crcs[i].crc;
+
+   for (i = 0; i < dbl->db_count; i++)
+   {
+      database_info_list_t *db_info = database_info_list_new_crc32(
+            dbl->dbs[i].path, crcs, dbl->crc_count);
+
+      if (!db_info)
+         continue;
+
+      for (j = 0; j < db_info->count; j++)
+      {
+         char core_name[64];
+         struct database_info_rdl_crc key;
+         const struct database_info_rdl_crc *found = NULL;
+         const database_info_t *entry = &db_info->list[j];
+
+         if (!entry->crc32)
+            continue;
+
+         key.crc = strtoul(entry->crc32, NULL, 16);
+         found   = (const struct database_info_rdl_crc*)bsearch(&key,
+               dbl->crcs, dbl->crc_count, sizeof(*dbl->crcs),
+               database_info_rdl_crc_cmp);
+         if (!found)
+            continue;
+
+         /* bsearch() may land on any of the files with this CRC32. */
+         while (found > dbl->crcs && found[-1].crc == key.crc)
+            found--;
+
+         RARCH_LOG("Found: %s (CRC32: %s).\n",
+               entry->name ? entry->name : "", entry->crc32);
+
+         /* The menu looks entries up by this name. */
+         snprintf(core_name, sizeof(core_name), "%s|crc", entry->crc32);
+
+         for (k = found - dbl->crcs;
+               k < dbl->crc_count && dbl->crcs[k].crc == key.crc; k++)
+            content_playlist_push(dbl->dbs[i].playlist,
+                  dbl->list->elems[dbl->crcs[k].file].data,
+                  dbl->dbs[i].core_path, core_name);
+      }
+
+      database_info_list_free(db_info);
+   }
+
+   free(crcs);
+   dbl->crc_count = 0;
+}
+
+/**
+ * database_info_rdl_core_path:
+ * @db_name              : Name of database, without extension.
+ * @s                    : Set to the path of the first core whose 
+ *                         info lists @db_name, or to "".
+ * @len                  : Size of @s.
+ **/
+static void database_info_rdl_core_path(const char *db_name,
+      char *s, size_t len)
+{
+   size_t i;
+
+   *s = '\0';
+
+   if (!g_extern.core_info)
+      return;
+
+   for (i = 0; i < g_extern.core_info->count; i++)
+   {
+      const core_info_t *info = &g_extern.core_info->list[i];
+
+      if (info->path && string_list_find_elem(info->databases_list, db_name))
+      {
+         strlcpy(s, info->path, len);
+         return;
+      }
+   }
+}
+
+/**
+ * database_info_rdl_dbs_init:
+ * @dbl                  : Scan handle.
+ *
+ * Lists the databases under the content database directory and 
+ * loads the playlist (.rdl) each one's matches are added to.
+ **/
+static void database_info_rdl_dbs_init(database_info_rdl_handle_t *dbl)
+{
+   size_t i;
+   struct string_list *rdb_list = dir_list_new(
+         g_settings.content_database, "rdb", false);
+
+   if (!rdb_list)
+      return;
+
+   if (rdb_list->size)
+      dbl->dbs = (struct database_info_rdl_db*)
+         calloc(rdb_list->size, sizeof(*dbl->dbs));
+
+   for (i = 0; dbl->dbs && i < rdb_list->size; i++)
+   {
+      char base[PATH_MAX_LENGTH], rdl_path[PATH_MAX_LENGTH];
+      struct database_info_rdl_db *db = &dbl->dbs[dbl->db_count];
+      const char *path                = rdb_list->elems[i].data;
+
+      strlcpy(base, path_basename(path), sizeof(base));
+      path_remove_extension(base);
+      database_info_rdl_core_path(base, db->core_path,
+            sizeof(db->core_path));
+      strlcat(base, ".rdl", sizeof(base));
+      fill_pathname_join(rdl_path, g_settings.content_database, base,
+            sizeof(rdl_path));
+
+      /* Leave room for every scanned file on top of earlier ones. */
+      db->playlist = content_playlist_init(rdl_path,
+            dbl->list->size + 1000);
+      if (!db->playlist)
+         continue;
+
+      strlcpy(db->path, path, sizeof(db->path));
+      dbl->db_count++;
+   }
+
+   string_list_free(rdb_list);
+}
+
 database_info_rdl_handle_t *database_info_write_rdl_init(const char *dir)
 {
    const char *exts = "";
@@ -74,82 +623,128 @@ database_info_rdl_handle_t *database_info_write_rdl_init(const char *dir)
    dbl->blocking  = false;
    dbl->iterating = true;
 
+   if (!dbl->list)
+   {
+      free(dbl);
+      return NULL;
+   }
+
+   /* Kept next to the config file, like the content history. */
+   if (*g_extern.config_path)
+   {
+      char cache_path[PATH_MAX_LENGTH];
+
+      fill_pathname_resolve_relative(cache_path, g_extern.config_path,
+            "retroarch-content-scan.cache", sizeof(cache_path));
+      dbl->cache = database_scan_cache_new(cache_path);
+   }
+
+   if (*g_settings.content_database)
+      database_info_rdl_dbs_init(dbl);
+
+#ifdef HAVE_7ZIP
+   /* Before any worker can read a 7z archive. */
+   compressed_7zip_init();
+#endif
+
+#ifdef HAVE_THREADS
+   if (dbl->list->size)
+      database_info_rdl_pool_new(dbl);
+#endif
+
    return dbl;
 }
 
 void database_info_write_rdl_free(database_info_rdl_handle_t *dbl)
 {
+   size_t i;
+
    if (!dbl)
       return;
 
+#ifdef HAVE_THREADS
+   database_info_rdl_pool_free(dbl);
+#endif
+
+   free(dbl->crcs);
+
+   /* Freeing a playlist writes it out. */
+   for (i = 0; i < dbl->db_count; i++)
+      content_playlist_free(dbl->dbs[i].playlist);
+   free(dbl->dbs);
+
+   database_scan_cache_free(dbl->cache);
    string_list_free(dbl->list);
+   free(dbl->buf);
    free(dbl);
 
    rarch_main_msg_queue_push("Scanning of directory finished.\n", 1, 180, true);
 }
 
+/**
+ * database_info_write_rdl_iterate:
+ * @dbl                  : Scan handle.
+ *
+ * Advances the scan. With threads the workers hash and match 
+ * files and this only reports progress; otherwise one file is 
+ * done per call. Once every file is done, iterating is cleared 
+ * and the matches are written out by 
+ * database_info_write_rdl_free().
+ *
+ * Returns: 0 while scanning, 1 once done, -1 on error.
+ **/
 int database_info_write_rdl_iterate(database_info_rdl_handle_t *dbl)
 {
-   char parent_dir[PATH_MAX_LENGTH];
-   const char *name = NULL;
+   char msg[PATH_MAX_LENGTH];
+   size_t done;
 
    if (!dbl)
       return -1;
    if (dbl->blocking)
       return 1;
-   if (dbl->list_ptr < dbl->list->size) {}
-   else
-   {
-      dbl->iterating = false;
-      return 1;
-   }
-
-   name = dbl->list->elems[dbl->list_ptr].data;
-
-   if (!name)
-      return 0;
-
-   path_parent_dir(parent_dir);
 
-#ifdef HAVE_ZLIB
-   if (!strcmp(path_get_extension(name), "zip"))
+#ifdef HAVE_THREADS
+   if (dbl->pool)
    {
-      RARCH_LOG("[ZIP]: name: %s\n", name);
+      slock_lock(dbl->pool->lock);
+      done = dbl->list_ptr;
+      slock_unlock(dbl->pool->lock);
 
-      if (!zlib_parse_file(name, NULL, zlib_compare_crc32,
-               (void*)parent_dir))
-         RARCH_LOG("Could not process ZIP file.\n");
+      if (done < dbl->list->size)
+      {
+         snprintf(msg, sizeof(msg), "%zu/%zu: Scanning...\n",
+               done, dbl->list->size);
+         rarch_main_msg_queue_push(msg, 1, 180, true);
+         return 0;
+      }
+
+      database_info_rdl_pool_free(dbl);
    }
-   else
 #endif
-   {
-      char msg[PATH_MAX_LENGTH];
-      ssize_t ret;
-      uint32_t crc, target_crc = 0;
-      uint8_t *ret_buf = NULL;
-      int read_from = 0;
 
-      (void)target_crc;
+   done = dbl->list_ptr;
 
-      read_from = read_file(name, (void**)&ret_buf, &ret);
-
-      if (read_from != 1)
-         return 0;
-      if (ret <= 0)
-         return 0;
+   if (done >= dbl->list->size)
+   {
+      database_info_rdl_match(dbl);
 
-      snprintf(msg, sizeof(msg), "%zu/%zu: Scanning %s...\n",
-            dbl->list_ptr, dbl->list->size, name);
+      if (dbl->cache && database_scan_cache_write(dbl->cache) != 0)
+         RARCH_WARN("Could not write content scan cache.\n");
 
-      rarch_main_msg_queue_push(msg, 1, 180, true);
+      dbl->iterating = false;
+      return 1;
+   }
 
-      crc = crc32_calculate(ret_buf, ret);
+   snprintf(msg, sizeof(msg), "%zu/%zu: Scanning %s...\n",
+         done, dbl->list->size, dbl->list->elems[done].data);
+   rarch_main_msg_queue_push(msg, 1, 180, true);
 
-      RARCH_LOG("CRC32: 0x%x .\n", (unsigned)crc);
+   if (!dbl->buf)
+      dbl->buf = (uint8_t*)malloc(RDL_CHUNK_SIZE);
+   if (!dbl->buf)
+      return -1;
 
-      if (ret_buf)
-         free(ret_buf);
-   }
+   database_info_rdl_scan_file(dbl, done, dbl->buf);
 
    dbl->list_ptr++;
 
@@ -169,17 +764,123 @@ static char *bin_to_hex_alloc(const uint8_t *data, size_t len)
    return ret;
 }
 
+static void database_info_set(database_info_t *db_info,
+      const struct rmsgpack_dom_value *item)
+{
+   size_t j;
+
+   db_info->name                   = NULL;
+   db_info->description            = NULL;
+   db_info->publisher              = NULL;
+   db_info->developer              = NULL;
+   db_info->origin                 = NULL;
+   db_info->franchise              = NULL;
+   db_info->bbfc_rating            = NULL;
+   db_info->elspa_rating           = NULL;
+   db_info->esrb_rating            = NULL;
+   db_info->pegi_rating            = NULL;
+   db_info->cero_rating            = NULL;
+   db_info->edge_magazine_review   = NULL;
+   db_info->enhancement_hw         = NULL;
+   db_info->crc32                  = NULL;
+   db_info->sha1                   = NULL;
+   db_info->md5                    = NULL;
+   db_info->famitsu_magazine_rating= 0;
+   db_info->edge_magazine_rating   = 0;
+   db_info->edge_magazine_issue    = 0;
+   db_info->max_users              = 0;
+   db_info->releasemonth           = 0;
+   db_info->releaseyear            = 0;
+   db_info->analog_supported       = -1;
+   db_info->rumble_supported       = -1;
+
+   for (j = 0; j < item->map.len; j++)
+   {
+      struct rmsgpack_dom_value *key = &item->map.items[j].key;
+      struct rmsgpack_dom_value *val = &item->map.items[j].value;
+
+      if (!strcmp(key->string.buff, "name"))
+         db_info->name = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "description"))
+         db_info->description = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "publisher"))
+         db_info->publisher = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "developer"))
+         db_info->developer = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "origin"))
+         db_info->origin = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "franchise"))
+         db_info->franchise = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "bbfc_rating"))
+         db_info->bbfc_rating = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "esrb_rating"))
+         db_info->esrb_rating = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "elspa_rating"))
+         db_info->elspa_rating = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "cero_rating"))
+         db_info->cero_rating = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "pegi_rating"))
+         db_info->pegi_rating = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "enhancement_hw"))
+         db_info->enhancement_hw = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "edge_review"))
+         db_info->edge_magazine_review = strdup(val->string.buff);
+
+      if (!strcmp(key->string.buff, "edge_rating"))
+         db_info->edge_magazine_rating = val->uint_;
+
+      if (!strcmp(key->string.buff, "edge_issue"))
+         db_info->edge_magazine_issue = val->uint_;
+
+      if (!strcmp(key->string.buff, "famitsu_rating"))
+         db_info->famitsu_magazine_rating = val->uint_;
+
+      if (!strcmp(key->string.buff, "users"))
+         db_info->max_users = val->uint_;
+
+      if (!strcmp(key->string.buff, "releasemonth"))
+         db_info->releasemonth = val->uint_;
+
+      if (!strcmp(key->string.buff, "releaseyear"))
+         db_info->releaseyear = val->uint_;
+
+      if (!strcmp(key->string.buff, "rumble"))
+         db_info->rumble_supported = val->uint_;
+
+      if (!strcmp(key->string.buff, "analog"))
+         db_info->analog_supported = val->uint_;
+
+      if (!strcmp(key->string.buff, "crc"))
+         db_info->crc32 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
+      if (!strcmp(key->string.buff, "sha1"))
+         db_info->sha1 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
+      if (!strcmp(key->string.buff, "md5"))
+         db_info->md5 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
+   }
+}
+
 database_info_list_t *database_info_list_new(const char *rdb_path, const char *query)
 {
    libretrodb_t db;
    libretrodb_cursor_t cur;
    struct rmsgpack_dom_value item;
-   size_t j;
    unsigned k = 0;
    database_info_t *database_info = NULL;
    database_info_list_t *database_info_list = NULL;
 
-   if ((libretrodb_open(rdb_path, &db)) != 0)
+   if ((libretrodb_open_mapped(rdb_path, &db)) != 0)
       return NULL;
    if ((database_open_cursor(&db, &cur, query) != 0))
       return NULL;
@@ -190,133 +891,170 @@ database_info_list_t *database_info_list_new(const char *rdb_path, const char *q
 
    while (libretrodb_cursor_read_item(&cur, &item) == 0)
    {
-      database_info_t *db_info = NULL;
+      database_info_t *new_info = NULL;
+
       if (item.type != RDT_MAP)
+      {
+         rmsgpack_dom_value_free(&item);
          continue;
+      }
 
-      database_info = (database_info_t*)realloc(database_info, (k+1) * sizeof(database_info_t));
-
-      if (!database_info)
-         goto error;
-
-      db_info = &database_info[k];
-
-      if (!db_info)
-         continue;
+      new_info = (database_info_t*)realloc(database_info, (k+1) * sizeof(database_info_t));
 
-      db_info->name                   = NULL;
-      db_info->description            = NULL;
-      db_info->publisher              = NULL;
-      db_info->developer              = NULL;
-      db_info->origin                 = NULL;
-      db_info->franchise              = NULL;
-      db_info->bbfc_rating            = NULL;
-      db_info->elspa_rating           = NULL;
-      db_info->esrb_rating            = NULL;
-      db_info->pegi_rating            = NULL;
-      db_info->cero_rating            = NULL;
-      db_info->edge_magazine_review   = NULL;
-      db_info->enhancement_hw         = NULL;
-      db_info->crc32                  = NULL;
-      db_info->sha1                   = NULL;
-      db_info->md5                    = NULL;
-      db_info->famitsu_magazine_rating= 0;
-      db_info->edge_magazine_rating   = 0;
-      db_info->edge_magazine_issue    = 0;
-      db_info->max_users              = 0;
-      db_info->releasemonth           = 0;
-      db_info->releaseyear            = 0;
-      db_info->analog_supported       = -1;
-      db_info->rumble_supported       = -1;
-
-      for (j = 0; j < item.map.len; j++)
+      if (!new_info)
       {
-         struct rmsgpack_dom_value *key = &item.map.items[j].key;
-         struct rmsgpack_dom_value *val = &item.map.items[j].value;
+         rmsgpack_dom_value_free(&item);
+         goto error;
+      }
 
-         if (!strcmp(key->string.buff, "name"))
-            db_info->name = strdup(val->string.buff);
+      database_info = new_info;
+      database_info_set(&database_info[k++], &item);
+      rmsgpack_dom_value_free(&item);
+   }
 
-         if (!strcmp(key->string.buff, "description"))
-            db_info->description = strdup(val->string.buff);
+   database_info_list->list  = database_info;
+   database_info_list->count = k;
 
-         if (!strcmp(key->string.buff, "publisher"))
-            db_info->publisher = strdup(val->string.buff);
+   libretrodb_cursor_close(&cur);
+   libretrodb_close(&db);
 
-         if (!strcmp(key->string.buff, "developer"))
-            db_info->developer = strdup(val->string.buff);
+   return database_info_list;
 
-         if (!strcmp(key->string.buff, "origin"))
-            db_info->origin = strdup(val->string.buff);
+error:
+   libretrodb_cursor_close(&cur);
+   libretrodb_close(&db);
+   if (database_info_list)
+   {
+      database_info_list->list  = database_info;
+      database_info_list->count = k;
+   }
+   else
+      free(database_info);
+   database_info_list_free(database_info_list);
+   return NULL;
+}
 
-         if (!strcmp(key->string.buff, "franchise"))
-            db_info->franchise = strdup(val->string.buff);
+static int database_info_crc_cmp(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t*)a;
+   uint32_t y = *(const uint32_t*)b;
 
-         if (!strcmp(key->string.buff, "bbfc_rating"))
-            db_info->bbfc_rating = strdup(val->string.buff);
+   return x < y ? -1 : (x > y);
+}
 
-         if (!strcmp(key->string.buff, "esrb_rating"))
-            db_info->esrb_rating = strdup(val->string.buff);
+/**
+ * database_info_list_new_crc32_db:
+ * @db                   : Open database.
+ * @crcs                 : CRC32s to look up, in any order.
+ * @count                : Number of CRC32s.
+ *
+ * Looks up all of @crcs in the database's "crc" index in a 
+ * single pass, rather than with one query per CRC.
+ *
+ * Returns: list of the entries found, or NULL.
+ **/
+static database_info_list_t *database_info_list_new_crc32_db(
+      libretrodb_t *db, const uint32_t *crcs, size_t count)
+{
+   size_t i, n = 0;
+   int found;
+   uint32_t *sorted                         = NULL;
+   uint8_t *keys                            = NULL;
+   struct rmsgpack_dom_value *values        = NULL;
+   database_info_list_t *database_info_list = NULL;
 
-         if (!strcmp(key->string.buff, "elspa_rating"))
-            db_info->elspa_rating = strdup(val->string.buff);
+   if (!crcs || !count)
+      return NULL;
 
-         if (!strcmp(key->string.buff, "cero_rating"))
-            db_info->cero_rating = strdup(val->string.buff);
+   sorted = (uint32_t*)malloc(count * sizeof(*sorted));
+   keys   = (uint8_t*)malloc(count * sizeof(uint32_t));
+   values = (struct rmsgpack_dom_value*)calloc(count, sizeof(*values));
+   database_info_list = (database_info_list_t*)calloc(1, sizeof(*database_info_list));
 
-         if (!strcmp(key->string.buff, "pegi_rating"))
-            db_info->pegi_rating = strdup(val->string.buff);
+   if (!sorted || !keys || !values || !database_info_list)
+      goto error;
 
-         if (!strcmp(key->string.buff, "enhancement_hw"))
-            db_info->enhancement_hw = strdup(val->string.buff);
+   memcpy(sorted, crcs, count * sizeof(*sorted));
+   if (count > 1)
+      qsort(sorted, count, sizeof(*sorted), database_info_crc_cmp);
 
-         if (!strcmp(key->string.buff, "edge_review"))
-            db_info->edge_magazine_review = strdup(val->string.buff);
+   /* Keys are stored big-endian, so numeric order is key order. */
+   for (i = 0; i < count; i++)
+   {
+      if (n && sorted[i] == sorted[i - 1])
+         continue;
 
-         if (!strcmp(key->string.buff, "edge_rating"))
-            db_info->edge_magazine_rating = val->uint_;
+      keys[n * 4 + 0] = sorted[i] >> 24;
+      keys[n * 4 + 1] = sorted[i] >> 16;
+      keys[n * 4 + 2] = sorted[i] >>  8;
+      keys[n * 4 + 3] = sorted[i];
+      n++;
+   }
 
-         if (!strcmp(key->string.buff, "edge_issue"))
-            db_info->edge_magazine_issue = val->uint_;
+   if ((found = libretrodb_find_entries(db, "crc", keys, n, values)) <= 0)
+      goto error;
 
-         if (!strcmp(key->string.buff, "famitsu_rating"))
-            db_info->famitsu_magazine_rating = val->uint_;
+   database_info_list->list = (database_info_t*)
+      calloc(found, sizeof(database_info_t));
+   if (!database_info_list->list)
+      goto error;
 
-         if (!strcmp(key->string.buff, "users"))
-            db_info->max_users = val->uint_;
+   for (i = 0; i < n; i++)
+   {
+      if (values[i].type != RDT_MAP)
+         continue;
 
-         if (!strcmp(key->string.buff, "releasemonth"))
-            db_info->releasemonth = val->uint_;
+      database_info_set(&database_info_list->list[
+            database_info_list->count++], &values[i]);
+   }
 
-         if (!strcmp(key->string.buff, "releaseyear"))
-            db_info->releaseyear = val->uint_;
+   for (i = 0; i < n; i++)
+      rmsgpack_dom_value_free(&values[i]);
 
-         if (!strcmp(key->string.buff, "rumble"))
-            db_info->rumble_supported = val->uint_;
+   free(values);
+   free(keys);
+   free(sorted);
 
-         if (!strcmp(key->string.buff, "analog"))
-            db_info->analog_supported = val->uint_;
+   return database_info_list;
 
-         if (!strcmp(key->string.buff, "crc"))
-            db_info->crc32 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
-         if (!strcmp(key->string.buff, "sha1"))
-            db_info->sha1 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
-         if (!strcmp(key->string.buff, "md5"))
-            db_info->md5 = bin_to_hex_alloc((uint8_t*)val->binary.buff, val->binary.len);
-      }
-      k++;
+error:
+   if (values)
+   {
+      for (i = 0; i < n; i++)
+         rmsgpack_dom_value_free(&values[i]);
    }
+   free(values);
+   free(keys);
+   free(sorted);
+   database_info_list_free(database_info_list);
+   return NULL;
+}
 
-   database_info_list->list  = database_info;
-   database_info_list->count = k;
+/**
+ * database_info_list_new_crc32:
+ * @rdb_path             : Path to database. 
+ * @crcs                 : CRC32s to look up, in any order.
+ * @count                : Number of CRC32s.
+ *
+ * Opens the database and looks up all of @crcs at once.
+ *
+ * Returns: list of the entries found, or NULL.
+ **/
+database_info_list_t *database_info_list_new_crc32(const char *rdb_path,
+      const uint32_t *crcs, size_t count)
+{
+   libretrodb_t db;
+   database_info_list_t *database_info_list = NULL;
 
-   return database_info_list;
+   if (!crcs || !count)
+      return NULL;
+   if ((libretrodb_open_mapped(rdb_path, &db)) != 0)
+      return NULL;
 
-error:
-   libretrodb_cursor_close(&cur);
+   database_info_list = database_info_list_new_crc32_db(&db, crcs, count);
    libretrodb_close(&db);
-   database_info_list_free(database_info_list);
-   return NULL;
+
+   return database_info_list;
 }
 
 void database_info_list_free(database_info_list_t *database_info_list)
@@ -27,12 +27,32 @@
 extern "C" {
 #endif
 
+struct database_info_rdl_pool;
+struct database_info_rdl_db;
+struct database_info_rdl_crc;
+struct database_scan_cache;
+
 typedef struct
 {
    bool blocking;
    bool iterating;
+   /* Number of files scanned so far. */
    size_t list_ptr;
    struct string_list *list;
+   /* Databases scanned files are matched against. */
+   struct database_info_rdl_db *dbs;
+   size_t db_count;
+   /* CRC32s found so far, looked up all at once when the 
+    * scan is done. */
+   struct database_info_rdl_crc *crcs;
+   size_t crc_count;
+   size_t crc_cap;
+   /* Read buffer when scanning without threads. */
+   uint8_t *buf;
+   /* Hashing workers, if threads are available. */
+   struct database_info_rdl_pool *pool;
+   /* CRC32s of files seen by earlier scans. */
+   struct database_scan_cache *cache;
 } database_info_rdl_handle_t;
 
 typedef struct
@@ -72,6 +92,9 @@ typedef struct
 
 database_info_list_t *database_info_list_new(const char *rdb_path, const char *query);
 
+database_info_list_t *database_info_list_new_crc32(const char *rdb_path,
+      const uint32_t *crcs, size_t count);
+
 void database_info_list_free(database_info_list_t *list);
 
 int database_open_cursor(libretrodb_t *db,
@@ -0,0 +1,437 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2015 - Daniel De Matteis
+ *  Copyright (C) 2013-2015 - Jason Fetters
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <file/file_path.h>
+#include <compat/strl.h>
+#include <retro_miscellaneous.h>
+
+#include "database_scan_cache.h"
+#include "libretro-db/libretrodb.h"
+#include "libretro-db/rmsgpack_dom.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Each scanned file is stored as one record, with mtime in nanoseconds:
+ * { "path": string, "size": uint, "mtime": uint, "crc": [uint, ...] }
+ * where "crc" holds a CRC32 per file inside an archive, or just 
+ * the one for the file itself. */
+
+struct database_scan_entry
+{
+   char *path;
+   uint64_t size;
+   uint64_t mtime;
+   uint32_t *crcs;
+   size_t count;
+};
+
+struct database_scan_cache
+{
+   char path[PATH_MAX_LENGTH];
+   /* Read from disk and sorted by path. Never changed after 
+    * loading, so lookups need no locking. */
+   struct database_scan_entry *loaded;
+   size_t loaded_count;
+   /* Files hashed since loading. */
+   struct database_scan_entry *added;
+   size_t added_count;
+   size_t added_cap;
+};
+
+static int database_scan_entry_cmp(const void *a, const void *b)
+{
+   const struct database_scan_entry *x = (const struct database_scan_entry*)a;
+   const struct database_scan_entry *y = (const struct database_scan_entry*)b;
+
+   return strcmp(x->path, y->path);
+}
+
+static void database_scan_entry_free(struct database_scan_entry *entry)
+{
+   free(entry->path);
+   free(entry->crcs);
+}
+
+static const struct database_scan_entry *database_scan_entry_find(
+      const struct database_scan_entry *entries, size_t count,
+      const char *path)
+{
+   struct database_scan_entry key;
+
+   if (!count)
+      return NULL;
+
+   key.path = (char*)path;
+   return (const struct database_scan_entry*)bsearch(&key, entries, count,
+         sizeof(*entries), database_scan_entry_cmp);
+}
+
+static bool database_scan_entry_read(struct database_scan_entry *entry,
+      const struct rmsgpack_dom_value *item)
+{
+   uint32_t i;
+   const struct rmsgpack_dom_value *crc = NULL;
+
+   memset(entry, 0, sizeof(*entry));
+
+   if (item->type != RDT_MAP)
+      return false;
+
+   for (i = 0; i < item->map.len; i++)
+   {
+      const struct rmsgpack_dom_value *key = &item->map.items[i].key;
+      const struct rmsgpack_dom_value *val = &item->map.items[i].value;
+
+      if (key->type != RDT_STRING)
+         continue;
+
+      if (!strcmp(key->string.buff, "path") && val->type == RDT_STRING)
+         entry->path = strdup(val->string.buff);
+      else if (!strcmp(key->string.buff, "size") && val->type == RDT_UINT)
+         entry->size = val->uint_;
+      else if (!strcmp(key->string.buff, "mtime") && val->type == RDT_UINT)
+         entry->mtime = val->uint_;
+      else if (!strcmp(key->string.buff, "crc") && val->type == RDT_ARRAY)
+         crc = val;
+   }
+
+   if (!entry->path || !crc || crc->array.len == 0)
+      goto error;
+
+   entry->crcs = (uint32_t*)malloc(crc->array.len * sizeof(uint32_t));
+   if (!entry->crcs)
+      goto error;
+
+   for (i = 0; i < crc->array.len; i++)
+   {
+      if (crc->array.items[i].type != RDT_UINT)
+         goto error;
+      entry->crcs[entry->count++] = (uint32_t)crc->array.items[i].uint_;
+   }
+
+   return true;
+
+error:
+   database_scan_entry_free(entry);
+   return false;
+}
+
+static void database_scan_cache_load(database_scan_cache_t *cache)
+{
+   libretrodb_t db;
+   libretrodb_cursor_t cur;
+   struct rmsgpack_dom_value item;
+   size_t cap = 0;
+
+   if (libretrodb_open_mapped(cache->path, &db) != 0)
+      return;
+
+   if (libretrodb_cursor_open(&db, &cur, NULL) != 0)
+   {
+      libretrodb_close(&db);
+      return;
+   }
+
+   while (libretrodb_cursor_read_item(&cur, &item) == 0)
+   {
+      struct database_scan_entry entry;
+      bool valid = database_scan_entry_read(&entry, &item);
+
+      rmsgpack_dom_value_free(&item);
+
+      if (!valid)
+         continue;
+
+      if (cache->loaded_count == cap)
+      {
+         size_t new_cap = cap ? cap * 2 : 256;
+         struct database_scan_entry *loaded = (struct database_scan_entry*)
+            realloc(cache->loaded, new_cap * sizeof(*loaded));
+
+         if (!loaded)
+         {
+            database_scan_entry_free(&entry);
+            break;
+         }
+
+         cache->loaded = loaded;
+         cap           = new_cap;
+      }
+
+      cache->loaded[cache->loaded_count++] = entry;
+   }
+
+   libretrodb_cursor_close(&cur);
+   libretrodb_close(&db);
+
+   if (cache->loaded_count > 1)
+      qsort(cache->loaded, cache->loaded_count, sizeof(*cache->loaded),
+            database_scan_entry_cmp);
+}
+
+database_scan_cache_t *database_scan_cache_new(const char *path)
+{
+   database_scan_cache_t *cache = (database_scan_cache_t*)
+      calloc(1, sizeof(*cache));
+
+   if (!cache)
+      return NULL;
+
+   strlcpy(cache->path, path, sizeof(cache->path));
+   database_scan_cache_load(cache);
+
+   return cache;
+}
+
+void database_scan_cache_free(database_scan_cache_t *cache)
+{
+   size_t i;
+
+   if (!cache)
+      return;
+
+   for (i = 0; i < cache->loaded_count; i++)
+      database_scan_entry_free(&cache->loaded[i]);
+   for (i = 0; i < cache->added_count; i++)
+      database_scan_entry_free(&cache->added[i]);
+
+   free(cache->loaded);
+   free(cache->added);
+   free(cache);
+}
+
+bool database_scan_cache_stat(const char *path,
+      uint64_t *size, uint64_t *mtime)
+{
+   struct stat buf;
+
+   if (stat(path, &buf) < 0)
+      return false;
+
+   *size  = buf.st_size;
+
+   /* In nanoseconds where the platform has them, so a file 
+    * rewritten within the same second is still seen as changed. */
+#if defined(__APPLE__)
+   *mtime = (uint64_t)buf.st_mtimespec.tv_sec * 1000000000
+      + buf.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+   *mtime = (uint64_t)buf.st_mtim.tv_sec * 1000000000
+      + buf.st_mtim.tv_nsec;
+#else
+   *mtime = (uint64_t)buf.st_mtime * 1000000000;
+#endif
+   return true;
+}
+
+bool database_scan_cache_find(const database_scan_cache_t *cache,
+      const char *path, uint64_t size, uint64_t mtime,
+      const uint32_t **crcs, size_t *count)
+{
+   const struct database_scan_entry *entry = database_scan_entry_find(
+         cache->loaded, cache->loaded_count, path);
+
+   if (!entry || entry->size != size || entry->mtime != mtime)
+      return false;
+
+   *crcs  = entry->crcs;
+   *count = entry->count;
+   return true;
+}
+
+bool database_scan_cache_add(database_scan_cache_t *cache,
+      const char *path, uint64_t size, uint64_t mtime,
+      const uint32_t *crcs, size_t count)
+{
+   struct database_scan_entry *entry;
+
+   if (count == 0)
+      return false;
+
+   if (cache->added_count == cache->added_cap)
+   {
+      size_t new_cap = cache->added_cap ? cache->added_cap * 2 : 256;
+      struct database_scan_entry *added = (struct database_scan_entry*)
+         realloc(cache->added, new_cap * sizeof(*added));
+
+      if (!added)
+         return false;
+
+      cache->added     = added;
+      cache->added_cap = new_cap;
+   }
+
+   entry        = &cache->added[cache->added_count];
+   entry->path  = strdup(path);
+   entry->size  = size;
+   entry->mtime = mtime;
+   entry->count = count;
+   entry->crcs  = (uint32_t*)malloc(count * sizeof(uint32_t));
+
+   if (!entry->path || !entry->crcs)
+   {
+      database_scan_entry_free(entry);
+      return false;
+   }
+
+   memcpy(entry->crcs, crcs, count * sizeof(uint32_t));
+   cache->added_count++;
+   return true;
+}
+
+struct database_scan_writer
+{
+   database_scan_cache_t *cache;
+   size_t pos;
+};
+
+static void database_scan_set_key(struct rmsgpack_dom_pair *pair,
+      const char *key)
+{
+   pair->key.type        = RDT_STRING;
+   pair->key.string.len  = strlen(key);
+   pair->key.string.buff = strdup(key);
+}
+
+/* Value provider for libretrodb_create(). Emits the added entries, 
+ * then the loaded ones that are still current. */
+static int database_scan_cache_next(void *ctx,
+      struct rmsgpack_dom_value *out)
+{
+   size_t i;
+   struct database_scan_writer *writer  = (struct database_scan_writer*)ctx;
+   database_scan_cache_t *cache         = writer->cache;
+   const struct database_scan_entry *entry = NULL;
+   struct rmsgpack_dom_pair *items      = NULL;
+
+   /* libretrodb_create() only frees the last value it is given. */
+   rmsgpack_dom_value_free(out);
+   out->type = RDT_NULL;
+
+   while (!entry)
+   {
+      if (writer->pos < cache->added_count)
+         entry = &cache->added[writer->pos];
+      else if (writer->pos < cache->added_count + cache->loaded_count)
+      {
+         entry = &cache->loaded[writer->pos - cache->added_count];
+
+         if (database_scan_entry_find(cache->added, cache->added_count,
+                  entry->path) || !path_file_exists(entry->path))
+            entry = NULL;
+      }
+      else
+         return 1;
+
+      writer->pos++;
+   }
+
+   items = (struct rmsgpack_dom_pair*)calloc(4, sizeof(*items));
+   if (!items)
+      return -1;
+
+   out->type      = RDT_MAP;
+   out->map.len   = 4;
+   out->map.items = items;
+
+   database_scan_set_key(&items[0], "path");
+   items[0].value.type        = RDT_STRING;
+   items[0].value.string.len  = strlen(entry->path);
+   items[0].value.string.buff = strdup(entry->path);
+
+   database_scan_set_key(&items[1], "size");
+   items[1].value.type  = RDT_UINT;
+   items[1].value.uint_ = entry->size;
+
+   database_scan_set_key(&items[2], "mtime");
+   items[2].value.type  = RDT_UINT;
+   items[2].value.uint_ = entry->mtime;
+
+   database_scan_set_key(&items[3], "crc");
+   items[3].value.type        = RDT_ARRAY;
+   items[3].value.array.len   = entry->count;
+   items[3].value.array.items = (struct rmsgpack_dom_value*)
+      calloc(entry->count, sizeof(struct rmsgpack_dom_value));
+
+   if (!items[3].value.array.items)
+   {
+      items[3].value.array.len = 0;
+      return -1;
+   }
+
+   for (i = 0; i < entry->count; i++)
+   {
+      items[3].value.array.items[i].type  = RDT_UINT;
+      items[3].value.array.items[i].uint_ = entry->crcs[i];
+   }
+
+   for (i = 0; i < 4; i++)
+      if (!items[i].key.string.buff)
+         return -1;
+
+   return items[0].value.string.buff ? 0 : -1;
+}
+
+int database_scan_cache_write(database_scan_cache_t *cache)
+{
+   int fd, rv;
+   char tmp_path[PATH_MAX_LENGTH];
+   struct database_scan_writer writer;
+
+   /* Sorted so loaded entries can check whether they were replaced. */
+   if (cache->added_count > 1)
+      qsort(cache->added, cache->added_count, sizeof(*cache->added),
+            database_scan_entry_cmp);
+
+   writer.cache = cache;
+   writer.pos   = 0;
+
+   strlcpy(tmp_path, cache->path, sizeof(tmp_path));
+   strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+   if ((fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644)) < 0)
+      return -1;
+
+   rv = libretrodb_create(fd, database_scan_cache_next, &writer);
+   close(fd);
+
+   if (rv < 0)
+   {
+      remove(tmp_path);
+      return rv;
+   }
+
+#ifdef _WIN32
+   /* rename() does not replace existing files here. */
+   remove(cache->path);
+#endif
+   return rename(tmp_path, cache->path) == 0 ? 0 : -1;
+}
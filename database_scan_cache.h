@@ -0,0 +1,109 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2015 - Daniel De Matteis
+ *  Copyright (C) 2013-2015 - Jason Fetters
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATABASE_SCAN_CACHE_H_
+#define DATABASE_SCAN_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <boolean.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct database_scan_cache database_scan_cache_t;
+
+/**
+ * database_scan_cache_new:
+ * @path                 : Path of cache file.
+ *
+ * Loads the scan cache at @path. A missing or unreadable 
+ * file gives an empty cache.
+ *
+ * Returns: new scan cache, or NULL on allocation failure.
+ **/
+database_scan_cache_t *database_scan_cache_new(const char *path);
+
+void database_scan_cache_free(database_scan_cache_t *cache);
+
+/**
+ * database_scan_cache_stat:
+ * @path                 : Path of content file.
+ * @size                 : Set to the size of the file.
+ * @mtime                : Set to the modification time of the file, 
+ *                         in nanoseconds.
+ *
+ * Returns: true if the file could be examined.
+ **/
+bool database_scan_cache_stat(const char *path,
+      uint64_t *size, uint64_t *mtime);
+
+/**
+ * database_scan_cache_find:
+ * @cache                : Scan cache.
+ * @path                 : Path of content file.
+ * @size                 : Current size of the file.
+ * @mtime                : Current modification time of the file.
+ * @crcs                 : Set to the CRC32s stored for the file.
+ * @count                : Set to the number of CRC32s.
+ *
+ * Looks up a file as it was when the cache was loaded. Does 
+ * not see entries added since, so it is safe to call from 
+ * several threads while one thread adds entries.
+ *
+ * Returns: true if the file is cached and has not changed.
+ **/
+bool database_scan_cache_find(const database_scan_cache_t *cache,
+      const char *path, uint64_t size, uint64_t mtime,
+      const uint32_t **crcs, size_t *count);
+
+/**
+ * database_scan_cache_add:
+ * @cache                : Scan cache.
+ * @path                 : Path of content file.
+ * @size                 : Size of the file.
+ * @mtime                : Modification time of the file.
+ * @crcs                 : CRC32 of the file, or of each file inside 
+ *                         it for archives.
+ * @count                : Number of CRC32s.
+ *
+ * Records a freshly hashed file, replacing any loaded entry 
+ * for it when the cache is written.
+ *
+ * Returns: true if successful.
+ **/
+bool database_scan_cache_add(database_scan_cache_t *cache,
+      const char *path, uint64_t size, uint64_t mtime,
+      const uint32_t *crcs, size_t count);
+
+/**
+ * database_scan_cache_write:
+ * @cache                : Scan cache.
+ *
+ * Writes the added entries, and the loaded entries that were 
+ * not replaced and whose files still exist, back to disk.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int database_scan_cache_write(database_scan_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
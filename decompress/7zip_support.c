@@ -39,6 +39,24 @@
 
 static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
+static bool crc_table_ready;
+
+/**
+ * compressed_7zip_init:
+ *
+ * Builds the CRC table archives are checked against. Only the 
+ * first call writes it, so once this has run on the main thread, 
+ * archives can be read from several threads at once.
+ **/
+void compressed_7zip_init(void)
+{
+   if (crc_table_ready)
+      return;
+
+   CrcGenerateTable();
+   crc_table_ready = true;
+}
+
 static int Buf_EnsureSize(CBuf *dest, size_t size)
 {
    if (dest->size >= size)
@@ -207,7 +225,7 @@ int read_7zip_file(const char * archive_path,
    LookToRead_CreateVTable(&lookStream, False);
    lookStream.realStream = &archiveStream.s;
    LookToRead_Init(&lookStream);
-   CrcGenerateTable();
+   compressed_7zip_init();
    SzArEx_Init(&db);
    res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
    if (res == SZ_OK)
@@ -359,7 +377,7 @@ struct string_list *compressed_7zip_file_list_new(const char *path,
    LookToRead_CreateVTable(&lookStream, False);
    lookStream.realStream = &archiveStream.s;
    LookToRead_Init(&lookStream);
-   CrcGenerateTable();
+   compressed_7zip_init();
    SzArEx_Init(&db);
    res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
    if (res == SZ_OK)
@@ -461,4 +479,97 @@ error:
    return NULL;
 }
 
+/**
+ * compressed_7zip_parse_file:
+ * @path                        : filename path of archive
+ * @file_cb                     : called for each file in the archive
+ * @userdata                    : userdata to pass to file_cb
+ *
+ * Enumerates the files of a 7z archive with the size and CRC32 
+ * stored in its header. Nothing is decompressed but the header 
+ * itself, so this is cheap even for large archives. Files without 
+ * a stored CRC32 are skipped.
+ *
+ * Returns: true (1) if every file was passed to @file_cb, false (0) 
+ * on error or if @file_cb stopped early.
+ **/
+bool compressed_7zip_parse_file(const char *path,
+      compressed_7zip_file_cb file_cb, void *userdata)
+{
+   CFileInStream archiveStream;
+   CLookToRead lookStream;
+   CSzArEx db;
+   SRes res;
+   ISzAlloc allocImp;
+   ISzAlloc allocTempImp;
+   uint32_t i;
+   uint16_t *temp  = NULL;
+   size_t tempSize = 0;
+   bool stopped    = false;
+
+   allocImp.Alloc     = SzAlloc;
+   allocImp.Free      = SzFree;
+   allocTempImp.Alloc = SzAllocTemp;
+   allocTempImp.Free  = SzFreeTemp;
+
+   if (InFile_Open(&archiveStream.file, path))
+   {
+      RARCH_ERR("Could not open %s as 7z archive.\n", path);
+      return false;
+   }
+
+   FileInStream_CreateVTable(&archiveStream);
+   LookToRead_CreateVTable(&lookStream, False);
+   lookStream.realStream = &archiveStream.s;
+   LookToRead_Init(&lookStream);
+   compressed_7zip_init();
+   SzArEx_Init(&db);
+   res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
+
+   for (i = 0; res == SZ_OK && i < db.db.NumFiles; i++)
+   {
+      char infile[PATH_MAX_LENGTH];
+      const CSzFileItem *f = db.db.Files + i;
+      size_t len;
+
+      if (f->IsDir || !f->CrcDefined)
+         continue;
+
+      len = SzArEx_GetFileNameUtf16(&db, i, NULL);
+      if (len > tempSize)
+      {
+         free(temp);
+         tempSize = len;
+         temp = (uint16_t *)malloc(tempSize * sizeof(temp[0]));
+         if (!temp)
+         {
+            res = SZ_ERROR_MEM;
+            break;
+         }
+      }
+
+      SzArEx_GetFileNameUtf16(&db, i, temp);
+      if ((res = ConvertUtf16toCharString(temp, infile)) != SZ_OK)
+         break;
+
+      if (!file_cb(infile, f->Size, f->Crc, userdata))
+      {
+         stopped = true;
+         break;
+      }
+   }
+
+   SzArEx_Free(&db, &allocImp);
+   free(temp);
+   File_Close(&archiveStream.file);
+
+   if (res != SZ_OK)
+   {
+      RARCH_ERR("Failed to read 7z archive \"%s\", error #%d.\n", path, res);
+      return false;
+   }
+
+   return !stopped;
+}
+
 #undef RARCH_ZIP_SUPPORT_BUFFER_SIZE_MAX
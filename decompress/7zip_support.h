@@ -17,16 +17,28 @@
 #ifndef __RARCH_7ZIP_SUPPORT_H
 #define __RARCH_7ZIP_SUPPORT_H
 
+#include <stdint.h>
+#include <boolean.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void compressed_7zip_init(void);
+
 int read_7zip_file(const char * archive_path,
       const char *relative_path, void **buf, char const* optional_outfileq);
 
 struct string_list *compressed_7zip_file_list_new(const char *path,
       const char* ext);
 
+/* Returns true when parsing should continue. False to stop. */
+typedef int (*compressed_7zip_file_cb)(const char *name, uint64_t size,
+      uint32_t crc32, void *userdata);
+
+bool compressed_7zip_parse_file(const char *path,
+      compressed_7zip_file_cb file_cb, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1078,7 +1078,7 @@ bool rarch_environment_cb(unsigned cmd, void *data)
 
          RARCH_LOG("Environ GET_PERF_INTERFACE.\n");
          cb->get_time_usec    = rarch_get_time_usec;
-         cb->get_cpu_features = rarch_get_cpu_features;
+         cb->get_cpu_features = rarch_get_core_cpu_features;
          cb->get_perf_counter = rarch_get_perf_counter;
          cb->perf_register    = retro_perf_register; /* libretro specific path. */
          cb->perf_start       = rarch_perf_start;
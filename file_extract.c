@@ -374,6 +374,111 @@ end:
    return ret;
 }
 
+/**
+ * zlib_parse_file_directory:
+ * @file                        : filename path of archive
+ * @valid_exts                  : Valid extensions of archive to be parsed. 
+ *                                If NULL, allow all.
+ * @file_cb                     : file_cb function pointer
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ *
+ * Like zlib_parse_file(), but only reads the end of central 
+ * directory record and the central directory itself, never the 
+ * file data. file_cb gets a NULL cdata, so this is only useful 
+ * for listing entries with their sizes and CRC32s.
+ *
+ * Returns: true (1) if every entry was passed to @file_cb, false (0) 
+ * on error or if @file_cb stopped early.
+ **/
+bool zlib_parse_file_directory(const char *file, const char *valid_exts,
+      zlib_file_cb file_cb, void *userdata)
+{
+   long file_size;
+   size_t tail_size;
+   uint32_t dir_size, dir_offset;
+   const uint8_t *footer    = NULL;
+   const uint8_t *entry     = NULL;
+   uint8_t *tail            = NULL;
+   uint8_t *directory       = NULL;
+   bool ret                 = true;
+   FILE *fp                 = fopen(file, "rb");
+
+   if (!fp)
+      GOTO_END_ERROR();
+
+   if (fseek(fp, 0, SEEK_END) != 0 || (file_size = ftell(fp)) < 22)
+      GOTO_END_ERROR();
+
+   /* The record is 22 bytes, followed by up to 64 KiB of comment. */
+   tail_size = file_size < 22 + 0xffff ? (size_t)file_size : 22 + 0xffff;
+
+   if (!(tail = (uint8_t*)malloc(tail_size)))
+      GOTO_END_ERROR();
+
+   if (fseek(fp, file_size - tail_size, SEEK_SET) != 0 ||
+         fread(tail, 1, tail_size, fp) != tail_size)
+      GOTO_END_ERROR();
+
+   for (footer = tail + tail_size - 22; ; footer--)
+   {
+      if (read_le(footer, 4) == 0x06054b50 &&
+            footer + 22 + read_le(footer + 20, 2) == tail + tail_size)
+         break;
+      if (footer == tail)
+         GOTO_END_ERROR();
+   }
+
+   dir_size   = read_le(footer + 12, 4);
+   dir_offset = read_le(footer + 16, 4);
+
+   if ((uint64_t)dir_offset + dir_size > (uint64_t)file_size)
+      GOTO_END_ERROR();
+
+   if (!(directory = (uint8_t*)malloc(dir_size ? dir_size : 1)))
+      GOTO_END_ERROR();
+
+   if (fseek(fp, dir_offset, SEEK_SET) != 0 ||
+         fread(directory, 1, dir_size, fp) != dir_size)
+      GOTO_END_ERROR();
+
+   for (entry = directory; entry + 46 <= directory + dir_size; )
+   {
+      char filename[PATH_MAX_LENGTH] = {0};
+      unsigned namelength, extralength, commentlength;
+
+      if (read_le(entry + 0, 4) != 0x02014b50)
+         GOTO_END_ERROR();
+
+      namelength    = read_le(entry + 28, 2);
+      extralength   = read_le(entry + 30, 2);
+      commentlength = read_le(entry + 32, 2);
+
+      if (namelength >= PATH_MAX_LENGTH || entry + 46 + namelength + 
+            extralength + commentlength > directory + dir_size)
+         GOTO_END_ERROR();
+
+      memcpy(filename, entry + 46, namelength);
+
+      if (!file_cb(filename, valid_exts, NULL, read_le(entry + 10, 2),
+               read_le(entry + 20, 4), read_le(entry + 24, 4),
+               read_le(entry + 16, 4), userdata))
+      {
+         /* The caller has not seen every entry. */
+         ret = false;
+         break;
+      }
+
+      entry += 46 + namelength + extralength + commentlength;
+   }
+
+end:
+   free(directory);
+   free(tail);
+   if (fp)
+      fclose(fp);
+   return ret;
+}
+
 struct zip_extract_userdata
 {
    char *zip_path;
@@ -409,6 +514,8 @@ static int zip_extract_cb(const char *name, const char *valid_exts,
          /* Uncompressed. */
          case 0:
             data->found_content = write_file(new_path, cdata, size);
+            if (data->found_content)
+               strlcpy(data->zip_path, new_path, data->zip_path_size);
             return false;
          /* Deflate. */
          case 8:
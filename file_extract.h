@@ -50,6 +50,23 @@ typedef int (*zlib_file_cb)(const char *name, const char *valid_exts,
 bool zlib_parse_file(const char *file, const char *valid_exts,
       zlib_file_cb file_cb, void *userdata);
 
+/**
+ * zlib_parse_file_directory:
+ * @file                        : filename path of archive
+ * @valid_exts                  : Valid extensions of archive to be parsed. 
+ *                                If NULL, allow all.
+ * @file_cb                     : file_cb function pointer
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ *
+ * Enumerates over all files using only the central directory, 
+ * without reading any file data. file_cb gets a NULL cdata.
+ *
+ * Returns: true (1) if every entry was passed to @file_cb, 
+ * false (0) on error or if @file_cb stopped early.
+ **/
+bool zlib_parse_file_directory(const char *file, const char *valid_exts,
+      zlib_file_cb file_cb, void *userdata);
+
 /**
  * zlib_extract_first_content_file:
  * @zip_path                    : filename path to ZIP archive.
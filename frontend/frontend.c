@@ -21,6 +21,7 @@
 #include "../settings.h"
 #include "../retroarch.h"
 #include "../runloop.h"
+#include "../content.h"
 #include <file/file_path.h>
 
 #if defined(RARCH_CONSOLE) || defined(RARCH_MOBILE)
@@ -89,6 +90,10 @@ void main_exit(args_type() args)
 
    main_exit_save_config();
 
+#ifdef HAVE_THREADS
+   content_load_task_free();
+#endif
+
    if (g_extern.main_is_init)
    {
 #ifdef HAVE_MENU
@@ -98,6 +103,9 @@ void main_exit(args_type() args)
       rarch_main_deinit();
    }
 
+   /* Auto savestates may still be on their way to disk. */
+   save_state_flush();
+
    rarch_main_command(RARCH_CMD_PERFCNT_REPORT_FRONTEND_LOG);
 
 #if defined(HAVE_LOGGER) && !defined(ANDROID)
@@ -343,12 +343,16 @@ struct settings
    char system_directory[PATH_MAX_LENGTH];
 
    char extraction_directory[PATH_MAX_LENGTH];
+   char patch_cache_directory[PATH_MAX_LENGTH];
    char playlist_directory[PATH_MAX_LENGTH];
 
    bool history_list_enable;
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
+   unsigned rewind_keyframe_interval;
+   bool rewind_threaded;
+   bool rewind_compression;
 
    float slowmotion_ratio;
    float fastforward_ratio;
@@ -356,11 +360,14 @@ struct settings
 
    bool pause_nonactive;
    unsigned autosave_interval;
+   bool autosave_journal;
 
    bool block_sram_overwrite;
    bool savestate_auto_index;
    bool savestate_auto_save;
    bool savestate_auto_load;
+   bool savestate_compression;
+   bool savestate_dedup;
 
    bool network_cmd_enable;
    uint16_t network_cmd_port;
@@ -422,6 +429,7 @@ struct global
    bool has_set_netplay_ip_address;
    bool has_set_netplay_delay_frames;
    bool has_set_netplay_ip_port;
+   bool has_set_netplay_users;
 
    bool has_set_ups_pref;
    bool has_set_bps_pref;
@@ -570,6 +578,8 @@ struct global
       state_manager_t *state;
       size_t size;
       bool frame_is_reverse;
+      /* Frames to jump back on the next frame, if non-zero. */
+      unsigned seek_frames;
    } rewind;
 
    struct
@@ -609,6 +619,11 @@ struct global
    bool netplay_is_spectate;
    unsigned netplay_sync_frames;
    unsigned netplay_port;
+   /* Total users in a session, host included. 0 means 2. */
+   unsigned netplay_users;
+   /* Compare savestate CRCs with peers every this many frames. 
+    * 0 disables it. */
+   unsigned netplay_check_frames;
 #endif
 
    /* Recording. */
@@ -556,6 +556,7 @@ DYNAMIC
 FILE
 ============================================================ */
 #include "../content.c"
+#include "../savestate_store.c"
 #include "../libretro-common/file/file_path.c"
 #include "../file_path_special.c"
 #include "../libretro-common/file/dir_list.c"
@@ -810,11 +811,11 @@ XML
  LIBRETRODB
 ============================================================ */
 #ifdef HAVE_LIBRETRODB
-#include "../libretro-db/bintree.c"
 #include "../libretro-db/libretrodb.c"
 #include "../libretro-db/rmsgpack.c"
 #include "../libretro-db/rmsgpack_dom.c"
 #include "../libretro-db/query.c"
+#include "../database_scan_cache.c"
 #include "../database_info.c"
 #endif
 
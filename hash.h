@@ -48,7 +48,7 @@
 #include "config.h"
 #endif
 
-#include <retro_inline.h>
+void hash_init(void);
 
 /** 
  * sha256_hash:
@@ -60,31 +60,47 @@
  **/
 void sha256_hash(char *out, const uint8_t *in, size_t size);
 
-#ifdef HAVE_ZLIB
-#include <zlib.h>
-
-static INLINE uint32_t crc32_calculate(const uint8_t *data, size_t length)
+typedef struct sha256_ctx
 {
-   return crc32(0, data, length);
-}
+   uint32_t h[8];
+   uint8_t in[64];
+   unsigned inlen;
+   uint64_t len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *ctx);
+
+void sha256_update(sha256_ctx_t *ctx, const uint8_t *data, size_t len);
+
+/**
+ * sha256_final:
+ * @ctx               : Context fed with sha256_update().
+ * @digest            : 32 byte output.
+ **/
+void sha256_final(sha256_ctx_t *ctx, uint8_t *digest);
 
-static INLINE uint32_t crc32_adjust(uint32_t crc, uint8_t data)
-{
-   /* zlib and nall have different
-    * assumptions on "sign" for this function. */
-   return ~crc32(~crc, &data, 1);
-}
-#else
 uint32_t crc32_calculate(const uint8_t *data, size_t length);
+
 uint32_t crc32_adjust(uint32_t crc, uint8_t data);
-#endif
+
+/**
+ * crc32_update:
+ * @crc               : CRC32 of the data so far, 0 to start.
+ * @data              : Next chunk of data.
+ * @length            : Size of @data.
+ *
+ * Continues a CRC32, same as zlib's crc32().
+ *
+ * Returns: CRC32 of all data passed so far.
+ **/
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);
 
 typedef struct SHA1Context
 {
-   unsigned Message_Digest[5]; /* Message Digest (output)          */
+   uint32_t Message_Digest[5]; /* Message Digest (output)          */
 
-   unsigned Length_Low;        /* Message length in bits           */
-   unsigned Length_High;       /* Message length in bits           */
+   uint32_t Length_Low;        /* Message length in bits           */
+   uint32_t Length_High;       /* Message length in bits           */
 
    unsigned char Message_Block[64]; /* 512-bit message blocks      */
    int Message_Block_Index;    /* Index into message block array   */
@@ -93,6 +109,19 @@ typedef struct SHA1Context
    int Corrupted;              /* Is the message digest corruped?  */
 } SHA1Context;
 
+void sha1_init(SHA1Context *context);
+
+void sha1_update(SHA1Context *context, const uint8_t *data, size_t length);
+
+/**
+ * sha1_final:
+ * @context           : Context fed with sha1_update().
+ * @digest            : 20 byte output.
+ *
+ * Returns: 0 on success, -1 if the context was misused.
+ **/
+int sha1_final(SHA1Context *context, uint8_t *digest);
+
 int sha1_calculate(const char *path, char *result);
 
 #endif
@@ -5,6 +5,7 @@
 #include <direct.h>
 #else
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 #include <string.h>
 #include <errno.h>
@@ -16,14 +17,29 @@
 
 #include "rmsgpack_dom.h"
 #include "rmsgpack.h"
-#include "bintree.h"
 #include "libretrodb_endian.h"
 #include "query.h"
 
-struct node_iter_ctx
+/* Hash index slot: key hash, then record offset (0 if empty). */
+#define HASH_SLOT_SIZE (2 * sizeof(uint64_t))
+
+/* Longest key a sorted index can hold. */
+#define MAX_KEY_SIZE 255
+
+/* Stack memory for running queries on records before decoding. */
+#define VIEW_ARENA_SIZE 16384
+
+struct libretrodb_planner
+{
+   libretrodb_cursor_t *cursor;
+   /* 0 for a full scan, 1 for a range scan, 2 for a lookup. */
+   int rank;
+};
+
+struct hash_build_entry
 {
-	libretrodb_t *db;
-	libretrodb_index_t *idx;
+   uint64_t hash;
+   uint64_t offset;
 };
 
 static struct rmsgpack_dom_value sentinal;
@@ -119,38 +135,70 @@ clean:
    return rv;
 }
 
-static int libretrodb_read_index_header(int fd, libretrodb_index_t *idx)
-{
-   uint64_t name_len = 50;
-   return rmsgpack_dom_read_into(fd,
-         "name", idx->name, &name_len,
-         "key_size", &idx->key_size,
-         "next", &idx->next, NULL);
-}
+static const char *key_type_names[] = {
+   "binary",
+   "string",
+   "uint",
+   "int",
+};
 
 static void libretrodb_write_index_header(int fd, libretrodb_index_t * idx)
 {
-	rmsgpack_write_map_header(fd, 3);
+   unsigned entries = 4;
+
+   if (idx->type == LIBRETRODB_INDEX_HASH)
+      entries += 2;
+   if (idx->key_type != LIBRETRODB_KEY_BINARY)
+      entries++;
+
+	rmsgpack_write_map_header(fd, entries);
 	rmsgpack_write_string(fd, "name", strlen("name"));
 	rmsgpack_write_string(fd, idx->name, strlen(idx->name));
 	rmsgpack_write_string(fd, "key_size", strlen("key_size"));
 	rmsgpack_write_uint(fd, idx->key_size);
 	rmsgpack_write_string(fd, "next", strlen("next"));
 	rmsgpack_write_uint(fd, idx->next);
+   rmsgpack_write_string(fd, "field", strlen("field"));
+   rmsgpack_write_string(fd, idx->field, strlen(idx->field));
+
+   if (idx->type == LIBRETRODB_INDEX_HASH)
+   {
+      rmsgpack_write_string(fd, "type", strlen("type"));
+      rmsgpack_write_string(fd, "hash", strlen("hash"));
+      rmsgpack_write_string(fd, "buckets", strlen("buckets"));
+      rmsgpack_write_uint(fd, idx->buckets);
+   }
+
+   if (idx->key_type != LIBRETRODB_KEY_BINARY)
+   {
+      const char *key_type = key_type_names[idx->key_type];
+
+      rmsgpack_write_string(fd, "key_type", strlen("key_type"));
+      rmsgpack_write_string(fd, key_type, strlen(key_type));
+   }
 }
 
 void libretrodb_close(libretrodb_t *db)
 {
+#ifndef _WIN32
+   if (db->map)
+      munmap((void*)db->map, db->map_size);
+#endif
+   db->map = NULL;
+
 	close(db->fd);
 	db->fd = -1;
 }
 
-int libretrodb_open(const char *path, libretrodb_t *db)
+static int libretrodb_open_flags(const char *path, libretrodb_t *db, int flags)
 {
    libretrodb_header_t header;
    libretrodb_metadata_t md;
    int rv;
-   int fd = open(path, O_RDWR);
+   int fd = open(path, flags);
+
+   db->map      = NULL;
+   db->map_size = 0;
 
    if (fd == -1)
       return -errno;
@@ -164,7 +212,7 @@ int libretrodb_open(const char *path, libretrodb_t *db)
       goto error;
    }
 
-   if (strncmp(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0)
+   if (strncmp(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)-1) != 0)
    {
       rv = -EINVAL;
       goto error;
@@ -188,96 +236,646 @@ error:
    return rv;
 }
 
+int libretrodb_open(const char *path, libretrodb_t *db)
+{
+   return libretrodb_open_flags(path, db, O_RDWR);
+}
+
+/**
+ * libretrodb_open_mapped:
+ * @path                : Path to database.
+ * @db                  : Handle to database.
+ *
+ * Opens database read-only and maps it into memory, so that 
+ * lookups and cursors read indexes and records in place instead 
+ * of going through the file. Falls back to regular file access 
+ * where mapping is not available.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libretrodb_open_mapped(const char *path, libretrodb_t *db)
+{
+#ifndef _WIN32
+   void *map;
+   struct stat st;
+#endif
+   int rv = libretrodb_open_flags(path, db, O_RDONLY);
+
+   if (rv != 0)
+      return rv;
+
+#ifndef _WIN32
+   if (fstat(db->fd, &st) == -1 || st.st_size <= 0)
+      return 0;
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db->fd, 0);
+   if (map == MAP_FAILED)
+      return 0;
+
+   db->map      = (const uint8_t*)map;
+   db->map_size = st.st_size;
+#endif
+
+   return 0;
+}
+
+static int libretrodb_string_equals(const struct rmsgpack_dom_value *value,
+      const char *str)
+{
+   return value->type == RDT_STRING && value->string.len == strlen(str) &&
+      memcmp(value->string.buff, str, value->string.len) == 0;
+}
+
+static int libretrodb_parse_index_header(
+      const struct rmsgpack_dom_value *map, libretrodb_index_t *idx)
+{
+   unsigned i;
+   struct rmsgpack_dom_value key;
+   const struct rmsgpack_dom_value *name, *key_size, *next;
+   const struct rmsgpack_dom_value *type, *field, *buckets, *key_type;
+
+   if (map->type != RDT_MAP)
+      return -EINVAL;
+
+   key.type        = RDT_STRING;
+   key.string.buff = (char*)"name";
+   key.string.len  = strlen("name");
+   name            = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"key_size";
+   key.string.len  = strlen("key_size");
+   key_size        = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"next";
+   key.string.len  = strlen("next");
+   next            = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"type";
+   key.string.len  = strlen("type");
+   type            = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"field";
+   key.string.len  = strlen("field");
+   field           = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"buckets";
+   key.string.len  = strlen("buckets");
+   buckets         = rmsgpack_dom_value_map_value(map, &key);
+   key.string.buff = (char*)"key_type";
+   key.string.len  = strlen("key_type");
+   key_type        = rmsgpack_dom_value_map_value(map, &key);
+
+   if (!name || name->type != RDT_STRING || !key_size ||
+         key_size->type != RDT_UINT || !next || next->type != RDT_UINT)
+      return -EINVAL;
+
+   if ((field && field->type != RDT_STRING) ||
+         (key_type && key_type->type != RDT_STRING))
+      return -EINVAL;
+
+   strncpy(idx->name, name->string.buff, sizeof(idx->name));
+   idx->name[sizeof(idx->name) - 1] = '\0';
+   idx->key_size = key_size->uint_;
+   idx->next     = next->uint_;
+   idx->type     = LIBRETRODB_INDEX_SORTED;
+   idx->key_type = LIBRETRODB_KEY_BINARY;
+   idx->buckets  = 0;
+
+   /* Older indexes are named after the field they index. */
+   strncpy(idx->field, field ? field->string.buff : idx->name,
+         sizeof(idx->field));
+   idx->field[sizeof(idx->field) - 1] = '\0';
+
+   if (key_type)
+   {
+      for (i = 0; i < sizeof(key_type_names) / sizeof(key_type_names[0]); i++)
+         if (libretrodb_string_equals(key_type, key_type_names[i]))
+            break;
+
+      if (i == sizeof(key_type_names) / sizeof(key_type_names[0]))
+         return -EINVAL;
+
+      idx->key_type = i;
+   }
+
+   /* Headers without a type are sorted indexes. */
+   if (!type)
+      return 0;
+
+   if (!libretrodb_string_equals(type, "hash") ||
+         !buckets || buckets->type != RDT_UINT)
+      return -EINVAL;
+
+   idx->type    = LIBRETRODB_INDEX_HASH;
+   idx->buckets = buckets->uint_;
+   return 0;
+}
+
+static uint64_t libretrodb_end(libretrodb_t *db)
+{
+   if (db->map)
+      return db->map_size;
+   return lseek(db->fd, 0, SEEK_END);
+}
+
+/**
+ * libretrodb_read_index:
+ * @db                  : Handle to database.
+ * @offset              : Offset of an index header, advanced 
+ *                        to the next one.
+ * @idx                 : Index header.
+ * @data_offset         : Set to the offset of the index entries.
+ *
+ * Returns: 0 if the index lies entirely within the database, 
+ * otherwise negative.
+ **/
+static int libretrodb_read_index(libretrodb_t *db, uint64_t *offset,
+      libretrodb_index_t *idx, uint64_t *data_offset)
+{
+   int rv;
+   uint64_t end = libretrodb_end(db);
+   struct rmsgpack_dom_value header;
+
+   if (db->map)
+   {
+      size_t header_size;
+
+      if (*offset >= db->map_size)
+         return -EINVAL;
+
+      rv = rmsgpack_dom_read_mem(db->map + *offset, db->map_size - *offset,
+            &header_size, &header);
+      *data_offset = *offset + header_size;
+   }
+   else
+   {
+      lseek(db->fd, *offset, SEEK_SET);
+      rv = rmsgpack_dom_read(db->fd, &header);
+      *data_offset = lseek(db->fd, 0, SEEK_CUR);
+   }
+
+   if (rv < 0)
+      return rv;
+
+   rv = libretrodb_parse_index_header(&header, idx);
+   rmsgpack_dom_value_free(&header);
+   if (rv < 0)
+      return rv;
+
+   if (*data_offset > end || idx->next > end - *data_offset)
+      return -EINVAL;
+
+   *offset = *data_offset + idx->next;
+   return 0;
+}
+
 static int libretrodb_find_index(libretrodb_t *db, const char *index_name,
-      libretrodb_index_t *idx)
+      libretrodb_index_t *idx, uint64_t *data_offset)
 {
-   off_t eof    = lseek(db->fd, 0, SEEK_END);
-   off_t offset = lseek(db->fd, db->first_index_offset, SEEK_SET);
+   int rv;
+   uint64_t offset = db->first_index_offset;
+   uint64_t end    = libretrodb_end(db);
 
-   while (offset < eof)
+   while (offset < end)
    {
-      libretrodb_read_index_header(db->fd, idx);
+      if ((rv = libretrodb_read_index(db, &offset, idx, data_offset)) < 0)
+         return rv;
 
-      if (strncmp(index_name, idx->name, strlen(idx->name)) == 0)
+      if (strcmp(index_name, idx->name) == 0)
          return 0;
-
-      offset = lseek(db->fd, idx->next, SEEK_CUR);
    }
 
    return -1;
 }
 
-static int node_compare(const void * a, const void * b, void * ctx)
+/**
+ * libretrodb_read_at:
+ * @db                  : Handle to database.
+ * @offset              : Offset in database.
+ * @size                : Number of bytes.
+ * @buff                : Buffer of at least @size bytes.
+ *
+ * Returns: pointer into the mapping for mapped databases, 
+ * otherwise @buff filled from the file. NULL on short reads.
+ **/
+static const uint8_t *libretrodb_read_at(libretrodb_t *db,
+      uint64_t offset, size_t size, uint8_t *buff)
+{
+   size_t nread = 0;
+
+   if (db->map)
+   {
+      if (offset > db->map_size || size > db->map_size - offset)
+         return NULL;
+      return db->map + offset;
+   }
+
+   if (lseek(db->fd, offset, SEEK_SET) == (off_t)-1)
+      return NULL;
+
+   while (nread < size)
+   {
+      ssize_t rv = read(db->fd, buff + nread, size - nread);
+
+      if (rv <= 0)
+         return NULL;
+      nread += rv;
+   }
+
+   return buff;
+}
+
+static int libretrodb_read_record(libretrodb_t *db, uint64_t offset,
+      struct rmsgpack_dom_value *out)
 {
-   return memcmp(a, b, *(uint8_t *)ctx);
+   if (db->map)
+   {
+      if (offset >= db->map_size)
+         return -EINVAL;
+
+      return rmsgpack_dom_read_mem(db->map + offset,
+            db->map_size - offset, NULL, out);
+   }
+
+   lseek(db->fd, offset, SEEK_SET);
+   return rmsgpack_dom_read(db->fd, out);
 }
 
-static int binsearch(const void * buff, const void * item,
-      uint64_t count, uint8_t field_size, uint64_t * offset)
+/* 64-bit FNV-1a. */
+static uint64_t libretrodb_hash(const void *key, size_t size)
 {
-   int mid            = count / 2;
-   int item_size      = field_size + sizeof(uint64_t);
-   uint64_t * current = (uint64_t *)buff + (mid * item_size);
-   int rv             = node_compare(current, item, &field_size);
+   size_t i;
+   const uint8_t *bytes = (const uint8_t*)key;
+   uint64_t hash        = UINT64_C(0xcbf29ce484222325);
 
-   if (rv == 0)
+   for (i = 0; i < size; i++)
    {
-      *offset = *(uint64_t *)(current + field_size);
+      hash ^= bytes[i];
+      hash *= UINT64_C(0x100000001b3);
+   }
+
+   return hash;
+}
+
+static void libretrodb_encode_uint(uint64_t value, uint8_t *key)
+{
+   unsigned i;
+
+   for (i = 0; i < sizeof(uint64_t); i++)
+      key[i] = (uint8_t)(value >> (56 - 8 * i));
+}
+
+static void libretrodb_encode_int(int64_t value, uint8_t *key)
+{
+   libretrodb_encode_uint((uint64_t)value ^ (UINT64_C(1) << 63), key);
+}
+
+/**
+ * libretrodb_field_key:
+ * @field               : Field value.
+ * @key                 : Set to the key bytes of @field.
+ * @key_size            : Set to the number of key bytes.
+ *
+ * Binary and string fields can be indexed.
+ *
+ * Returns: 0 if @field can be used as a key, otherwise negative.
+ **/
+static int libretrodb_field_key(const struct rmsgpack_dom_value *field,
+      const uint8_t **key, size_t *key_size)
+{
+   switch (field->type)
+   {
+      case RDT_BINARY:
+         *key      = (const uint8_t*)field->binary.buff;
+         *key_size = field->binary.len;
+         return 0;
+      case RDT_STRING:
+         *key      = (const uint8_t*)field->string.buff;
+         *key_size = field->string.len;
+         return 0;
+      default:
+         break;
+   }
+
+   return -EINVAL;
+}
+
+static int libretrodb_record_matches(
+      const struct rmsgpack_dom_value *item, const char *field_name,
+      const void *key, size_t key_size)
+{
+   size_t size;
+   const uint8_t *bytes;
+   struct rmsgpack_dom_value field_key;
+   const struct rmsgpack_dom_value *field;
+
+   if (item->type != RDT_MAP)
+      return 0;
+
+   field_key.type        = RDT_STRING;
+   field_key.string.len  = strlen(field_name);
+   field_key.string.buff = (char*)field_name;
+   field = rmsgpack_dom_value_map_value(item, &field_key);
+
+   if (!field || libretrodb_field_key(field, &bytes, &size) != 0)
       return 0;
+
+   return size == key_size && memcmp(bytes, key, key_size) == 0;
+}
+
+/**
+ * libretrodb_sorted_bound:
+ * @db                  : Handle to database.
+ * @idx                 : Sorted index.
+ * @data_offset         : Offset of the index entries.
+ * @key                 : Key to look up.
+ * @upper               : Find the first entry past @key instead 
+ *                        of the first entry not below it.
+ * @first               : Entry to start searching from.
+ * @pos                 : Set to the entry found.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+static int libretrodb_sorted_bound(libretrodb_t *db,
+      const libretrodb_index_t *idx, uint64_t data_offset,
+      const void *key, int upper, uint64_t first, uint64_t *pos)
+{
+   uint8_t buff[MAX_KEY_SIZE + sizeof(uint64_t)];
+   size_t item_size = idx->key_size + sizeof(uint64_t);
+   uint64_t base    = first;
+   uint64_t count   = idx->next / item_size;
+
+   if (idx->key_size == 0 || idx->key_size > MAX_KEY_SIZE || first > count)
+      return -EINVAL;
+
+   count -= first;
+
+   while (count > 0)
+   {
+      uint64_t mid = count / 2;
+      const uint8_t *current = libretrodb_read_at(db,
+            data_offset + (base + mid) * item_size, item_size, buff);
+      int rv;
+
+      if (!current)
+         return -EINVAL;
+
+      rv = memcmp(current, key, idx->key_size);
+
+      if (rv > 0 || (rv == 0 && !upper))
+         count = mid;
+      else
+      {
+         base  += mid + 1;
+         count -= mid + 1;
+      }
    }
 
-   if (count == 0)
+   *pos = base;
+   return 0;
+}
+
+static int libretrodb_sorted_entry(libretrodb_t *db,
+      const libretrodb_index_t *idx, uint64_t data_offset,
+      uint64_t pos, const uint8_t **key, uint64_t *offset)
+{
+   uint8_t buff[MAX_KEY_SIZE + sizeof(uint64_t)];
+   size_t item_size = idx->key_size + sizeof(uint64_t);
+   const uint8_t *current;
+
+   if (idx->key_size == 0 || idx->key_size > MAX_KEY_SIZE ||
+         pos >= idx->next / item_size)
+      return -EINVAL;
+
+   current = libretrodb_read_at(db, data_offset + pos * item_size,
+         item_size, buff);
+   if (!current)
+      return -EINVAL;
+
+   memcpy(offset, current + idx->key_size, sizeof(uint64_t));
+   if (key && memcmp(current, *key, idx->key_size) != 0)
+      return -1;
+   return 0;
+}
+
+static int libretrodb_find_sorted(libretrodb_t *db,
+      const libretrodb_index_t *idx, uint64_t data_offset,
+      const void *key, uint64_t *offset)
+{
+   int rv;
+   uint64_t pos;
+   const uint8_t *bytes = (const uint8_t*)key;
+
+   if ((rv = libretrodb_sorted_bound(db, idx, data_offset,
+               key, 0, 0, &pos)) < 0)
+      return rv;
+
+   if (pos >= idx->next / (idx->key_size + sizeof(uint64_t)))
       return -1;
 
-   if (rv > 0)
-      return binsearch(buff, item, mid, field_size, offset);
+   return libretrodb_sorted_entry(db, idx, data_offset, pos, &bytes, offset);
+}
+
+static int libretrodb_find_hashed(libretrodb_t *db,
+      const libretrodb_index_t *idx, uint64_t data_offset,
+      const void *key, struct rmsgpack_dom_value *out)
+{
+   uint64_t i, probe, hash;
+   uint8_t buff[HASH_SLOT_SIZE];
+   size_t key_size = idx->key_type == LIBRETRODB_KEY_STRING ?
+      strlen((const char*)key) : idx->key_size;
+
+   if (idx->buckets == 0 || (idx->buckets & (idx->buckets - 1)) ||
+         idx->buckets > idx->next / HASH_SLOT_SIZE)
+      return -EINVAL;
+
+   hash = libretrodb_hash(key, key_size);
+   i    = hash & (idx->buckets - 1);
+
+   for (probe = 0; probe < idx->buckets; probe++)
+   {
+      int rv;
+      uint64_t slot_hash, offset;
+      const uint8_t *slot = libretrodb_read_at(db,
+            data_offset + i * HASH_SLOT_SIZE, HASH_SLOT_SIZE, buff);
+
+      if (!slot)
+         return -EINVAL;
+
+      memcpy(&slot_hash, slot, sizeof(uint64_t));
+      memcpy(&offset, slot + sizeof(uint64_t), sizeof(uint64_t));
+
+      if (offset == 0)
+         break;
+
+      if (slot_hash == hash)
+      {
+         if ((rv = libretrodb_read_record(db, offset, out)) < 0)
+            return rv;
+
+         if (libretrodb_record_matches(out, idx->field, key, key_size))
+            return 0;
+
+         rmsgpack_dom_value_free(out);
+      }
+
+      i = (i + 1) & (idx->buckets - 1);
+   }
 
-   return binsearch(current + item_size, item,
-         count - mid, field_size, offset);
+   return -1;
 }
 
+/**
+ * libretrodb_find_entry:
+ * @db                  : Handle to database.
+ * @index_name          : Name of index.
+ * @key                 : Key to look up. For hash indexes over 
+ *                        string fields, a NUL-terminated string, 
+ *                        for integer indexes an encoded key.
+ * @out                 : Set to the matching record.
+ *
+ * Returns: 0 if found, otherwise negative.
+ **/
 int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
         const void *key, struct rmsgpack_dom_value *out)
 {
-   libretrodb_index_t idx;
    int rv;
-   void * buff;
+   libretrodb_index_t idx;
+   uint64_t data_offset, offset;
+
+   if ((rv = libretrodb_find_index(db, index_name, &idx, &data_offset)) < 0)
+      return rv;
+
+   if (idx.type == LIBRETRODB_INDEX_HASH)
+      return libretrodb_find_hashed(db, &idx, data_offset, key, out);
+
+   if ((rv = libretrodb_find_sorted(db, &idx, data_offset, key, &offset)) < 0)
+      return rv;
+
+   return libretrodb_read_record(db, offset, out);
+}
+
+struct libretrodb_batch_hit
+{
    uint64_t offset;
-   ssize_t bufflen, nread = 0;
+   size_t key;
+};
 
-   if (libretrodb_find_index(db, index_name, &idx) < 0)
-      return -1;
+static int libretrodb_batch_hit_cmp(const void *a, const void *b)
+{
+   const struct libretrodb_batch_hit *x = (const struct libretrodb_batch_hit*)a;
+   const struct libretrodb_batch_hit *y = (const struct libretrodb_batch_hit*)b;
 
-   bufflen = idx.next;
-   buff = malloc(bufflen);
+   if (x->offset != y->offset)
+      return x->offset < y->offset ? -1 : 1;
+   return x->key < y->key ? -1 : (x->key > y->key);
+}
 
-   if (!buff)
+/**
+ * libretrodb_find_entries:
+ * @db                  : Handle to database.
+ * @index_name          : Index to look the keys up in.
+ * @keys                : Keys of the index's key size, packed back 
+ *                        to back in ascending order.
+ * @count               : Number of keys.
+ * @out                 : Array of @count values, filled in with the 
+ *                        record of each key, or RDT_NULL on a miss.
+ *
+ * Looks up all of @keys at once. On a sorted index the keys are 
+ * resolved in a single forward pass over the entries, and the 
+ * records are then read back in file order rather than key order.
+ *
+ * Returns: number of keys found, otherwise negative.
+ **/
+int libretrodb_find_entries(libretrodb_t *db, const char *index_name,
+      const void *keys, size_t count, struct rmsgpack_dom_value *out)
+{
+   int rv;
+   size_t i, found = 0;
+   uint64_t pos = 0, entries, offset, data_offset;
+   libretrodb_index_t idx;
+   struct libretrodb_batch_hit *hits = NULL;
+   const uint8_t *bytes = (const uint8_t*)keys;
+
+   for (i = 0; i < count; i++)
+      out[i].type = RDT_NULL;
+
+   if ((rv = libretrodb_find_index(db, index_name, &idx, &data_offset)) < 0)
+      return rv;
+
+   /* String keys have no fixed size to pack them by. */
+   if (idx.key_type == LIBRETRODB_KEY_STRING ||
+         idx.key_size == 0 || idx.key_size > MAX_KEY_SIZE)
+      return -EINVAL;
+
+   for (i = 1; i < count; i++)
+      if (memcmp(bytes + (i - 1) * idx.key_size,
+               bytes + i * idx.key_size, idx.key_size) > 0)
+         return -EINVAL;
+
+   if (count == 0)
+      return 0;
+
+   if (!(hits = (struct libretrodb_batch_hit*)malloc(count * sizeof(*hits))))
       return -ENOMEM;
 
-   while (nread < bufflen)
+   entries = idx.next / (idx.key_size + sizeof(uint64_t));
+
+   for (i = 0; i < count; i++)
    {
-      void * buff_ = (uint64_t *)buff + nread;
-      rv = read(db->fd, buff_, bufflen - nread);
+      const uint8_t *key = bytes + i * idx.key_size;
 
-      if (rv <= 0)
+      if (idx.type == LIBRETRODB_INDEX_HASH)
       {
-         free(buff);
-         return -errno;
+         /* Probes are random access either way, so just 
+          * take the record the lookup already verified. */
+         rv = libretrodb_find_hashed(db, &idx, data_offset, key, &out[i]);
+         if (rv == 0)
+            found++;
+         else
+            out[i].type = RDT_NULL;
+         if (rv < 0 && rv != -1)
+            goto error;
+         continue;
       }
-      nread += rv;
-   }
 
-   rv = binsearch(buff, key, db->count, idx.key_size, &offset);
-   free(buff);
+      /* Keys are ascending, so each search starts where the 
+       * previous one ended. */
+      if ((rv = libretrodb_sorted_bound(db, &idx, data_offset,
+                  key, 0, pos, &pos)) < 0)
+         goto error;
 
-   if (rv == 0)
-      lseek(db->fd, offset, SEEK_SET);
+      if (pos >= entries)
+         break;
 
-   rv = rmsgpack_dom_read(db->fd, out);
+      if ((rv = libretrodb_sorted_entry(db, &idx, data_offset,
+                  pos, &key, &offset)) == 0)
+      {
+         hits[found].offset = offset;
+         hits[found].key    = i;
+         found++;
+      }
+      else if (rv != -1)
+         goto error;
+   }
 
-   if (rv < 0)
-      return rv;
+   if (idx.type == LIBRETRODB_INDEX_SORTED)
+   {
+      qsort(hits, found, sizeof(*hits), libretrodb_batch_hit_cmp);
+
+      for (i = 0; i < found; i++)
+      {
+         if ((rv = libretrodb_read_record(db, hits[i].offset,
+                     &out[hits[i].key])) < 0)
+            goto error;
+      }
+   }
 
+   free(hits);
+   return (int)found;
+
+error:
+   for (i = 0; i < count; i++)
+   {
+      rmsgpack_dom_value_free(&out[i]);
+      out[i].type = RDT_NULL;
+   }
+   free(hits);
    return rv;
 }
 
@@ -292,36 +890,176 @@ int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
 int libretrodb_cursor_reset(libretrodb_cursor_t *cursor)
 {
 	cursor->eof = 0;
+   cursor->offset = cursor->db->root + sizeof(libretrodb_header_t);
+   cursor->index_pos = cursor->plan == LIBRETRODB_PLAN_RANGE ?
+      cursor->index_begin : 0;
 	return lseek(cursor->fd,
          cursor->db->root + sizeof(libretrodb_header_t),
          SEEK_SET);
 }
 
+/**
+ * libretrodb_cursor_next:
+ * @cursor              : Handle to database cursor.
+ * @offset              : Set to the offset of the next candidate.
+ *
+ * Steps an index-planned cursor through the entries of its 
+ * range, or through the probe sequence of its hash.
+ *
+ * Returns: 0 if successful, EOF at the end, otherwise negative.
+ **/
+static int libretrodb_cursor_next(libretrodb_cursor_t *cursor,
+      uint64_t *offset)
+{
+   uint8_t buff[HASH_SLOT_SIZE];
+   uint64_t mask = cursor->index.buckets - 1;
+
+   if (cursor->plan == LIBRETRODB_PLAN_RANGE)
+   {
+      if (cursor->index_pos >= cursor->index_end)
+         return EOF;
+
+      return libretrodb_sorted_entry(cursor->db, &cursor->index,
+            cursor->index_offset, cursor->index_pos++, NULL, offset);
+   }
+
+   while (cursor->index_pos < cursor->index.buckets)
+   {
+      uint64_t slot_hash;
+      uint64_t slot = (cursor->index_begin + cursor->index_pos++) & mask;
+      const uint8_t *data = libretrodb_read_at(cursor->db,
+            cursor->index_offset + slot * HASH_SLOT_SIZE,
+            HASH_SLOT_SIZE, buff);
+
+      if (!data)
+         return -EINVAL;
+
+      memcpy(&slot_hash, data, sizeof(uint64_t));
+      memcpy(offset, data + sizeof(uint64_t), sizeof(uint64_t));
+
+      if (*offset == 0)
+         break;
+
+      if (slot_hash == cursor->index_hash)
+         return 0;
+   }
+
+   cursor->index_pos = cursor->index.buckets;
+   return EOF;
+}
+
+/**
+ * libretrodb_cursor_decode:
+ * @cursor              : Handle to database cursor.
+ * @offset              : Offset of the record.
+ * @size                : Set to the encoded size of the record.
+ * @out                 : Set to the record.
+ *
+ * Decodes the record at @offset, unless the cursor query rejects 
+ * it. On mapped databases the query is first run on a view of 
+ * the record in stack memory, so rejected records never reach 
+ * the heap.
+ *
+ * Returns: 0 if decoded, 1 if rejected, otherwise negative.
+ **/
+static int libretrodb_cursor_decode(libretrodb_cursor_t *cursor,
+      uint64_t offset, size_t *size, struct rmsgpack_dom_value *out)
+{
+   int rv;
+   int filtered = 0;
+   libretrodb_t *db = cursor->db;
+
+   if (db->map)
+   {
+      const uint8_t *ptr;
+      uint64_t avail;
+
+      if (offset >= db->map_size)
+         return -EINVAL;
+
+      ptr   = db->map + offset;
+      avail = db->map_size - offset;
+
+      if (cursor->query)
+      {
+         uint64_t arena[VIEW_ARENA_SIZE / sizeof(uint64_t)];
+         struct rmsgpack_dom_value view;
+
+         rv = rmsgpack_dom_read_view(ptr, avail, size,
+               arena, sizeof(arena), &view);
+
+         /* Records too big for the arena take the heap path. */
+         if (rv == 0)
+         {
+            if (view.type != RDT_NULL &&
+                  !libretrodb_query_filter(cursor->query, &view))
+               return 1;
+            filtered = 1;
+         }
+         else if (rv != -ENOMEM)
+            return rv;
+      }
+
+      rv = rmsgpack_dom_read_mem(ptr, avail, size, out);
+   }
+   else if (cursor->plan == LIBRETRODB_PLAN_SCAN)
+      rv = rmsgpack_dom_read(cursor->fd, out);
+   else
+      rv = libretrodb_read_record(db, offset, out);
+
+   if (rv < 0)
+      return rv;
+
+   if (cursor->query && !filtered && out->type != RDT_NULL &&
+         !libretrodb_query_filter(cursor->query, out))
+   {
+      rmsgpack_dom_value_free(out);
+      return 1;
+   }
+
+   return 0;
+}
+
 int libretrodb_cursor_read_item(libretrodb_cursor_t *cursor,
       struct rmsgpack_dom_value * out)
 {
    int rv;
+   size_t size = 0;
+   uint64_t offset;
 
    if (cursor->eof)
       return EOF;
 
 retry:
-   rv = rmsgpack_dom_read(cursor->fd, out);
+   if (cursor->plan != LIBRETRODB_PLAN_SCAN)
+   {
+      if ((rv = libretrodb_cursor_next(cursor, &offset)) != 0)
+      {
+         if (rv == EOF)
+            cursor->eof = 1;
+         return rv;
+      }
+   }
+   else
+      offset = cursor->offset;
+
+   rv = libretrodb_cursor_decode(cursor, offset, &size, out);
+
    if (rv < 0)
       return rv;
 
+   if (cursor->plan == LIBRETRODB_PLAN_SCAN)
+      cursor->offset += size;
+
+   if (rv == 1)
+      goto retry;
+
    if (out->type == RDT_NULL)
    {
       cursor->eof = 1;
       return EOF;
    }
 
-   if (cursor->query)
-   {
-      if (!libretrodb_query_filter(cursor->query, out))
-         goto retry;
-   }
-
    return 0;
 }
 
@@ -348,6 +1086,158 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
 	cursor->query = NULL;
 }
 
+/**
+ * libretrodb_plan_index:
+ * @cursor              : Handle to database cursor.
+ * @idx                 : Index on a field of the query.
+ * @data_offset         : Offset of the index entries.
+ * @min                 : Smallest value of the field.
+ * @max                 : Largest value of the field, or @min.
+ *
+ * Sets up @cursor to visit only the records @idx lists for 
+ * the field values. The query still filters every record, so 
+ * this only has to cover all of its possible matches.
+ *
+ * Returns: 0 if @idx can be used, otherwise negative.
+ **/
+static int libretrodb_plan_index(libretrodb_cursor_t *cursor,
+      const libretrodb_index_t *idx, uint64_t data_offset,
+      const struct rmsgpack_dom_value *min,
+      const struct rmsgpack_dom_value *max)
+{
+   int rv;
+   uint64_t begin, end;
+   uint8_t lo[sizeof(uint64_t)], hi[sizeof(uint64_t)];
+   const uint8_t *lo_key = lo, *hi_key = hi;
+
+   if (idx->type == LIBRETRODB_INDEX_HASH)
+   {
+      const uint8_t *key;
+      size_t key_size;
+
+      if (min != max || libretrodb_field_key(min, &key, &key_size) != 0)
+         return -1;
+
+      if ((idx->key_type == LIBRETRODB_KEY_STRING) != (min->type == RDT_STRING))
+         return -1;
+
+      if (idx->key_type == LIBRETRODB_KEY_BINARY && key_size != idx->key_size)
+         return -1;
+
+      if (idx->buckets == 0 || (idx->buckets & (idx->buckets - 1)) ||
+            idx->buckets > idx->next / HASH_SLOT_SIZE)
+         return -1;
+
+      cursor->plan         = LIBRETRODB_PLAN_HASH;
+      cursor->index        = *idx;
+      cursor->index_offset = data_offset;
+      cursor->index_hash   = libretrodb_hash(key, key_size);
+      cursor->index_begin  = cursor->index_hash & (idx->buckets - 1);
+      return 0;
+   }
+
+   switch (idx->key_type)
+   {
+      case LIBRETRODB_KEY_BINARY:
+         if (min != max || min->type != RDT_BINARY ||
+               min->binary.len != idx->key_size)
+            return -1;
+         lo_key = hi_key = (const uint8_t*)min->binary.buff;
+         break;
+      case LIBRETRODB_KEY_UINT:
+         if (min == max)
+         {
+            /* Integer literals compare equal to unsigned fields. */
+            if (min->type == RDT_UINT)
+               libretrodb_encode_uint(min->uint_, lo);
+            else if (min->type == RDT_INT && min->int_ >= 0)
+               libretrodb_encode_uint(min->int_, lo);
+            else
+               return -1;
+            hi_key = lo;
+         }
+         else if (max->int_ < 0 || min->int_ > max->int_)
+            lo_key = hi_key = NULL;
+         else
+         {
+            libretrodb_encode_uint(min->int_ < 0 ? 0 : min->int_, lo);
+            libretrodb_encode_uint(max->int_, hi);
+         }
+         break;
+      case LIBRETRODB_KEY_INT:
+         if (min->type != RDT_INT || max->type != RDT_INT)
+            return -1;
+         if (min->int_ > max->int_)
+            lo_key = hi_key = NULL;
+         else
+         {
+            libretrodb_encode_int(min->int_, lo);
+            libretrodb_encode_int(max->int_, hi);
+         }
+         break;
+      default:
+         return -1;
+   }
+
+   if (idx->key_size == 0 || idx->key_size > MAX_KEY_SIZE)
+      return -1;
+
+   /* Empty ranges match nothing. */
+   begin = end = 0;
+
+   if (lo_key)
+   {
+      if ((rv = libretrodb_sorted_bound(cursor->db, idx, data_offset,
+                  lo_key, 0, 0, &begin)) < 0)
+         return rv;
+      if ((rv = libretrodb_sorted_bound(cursor->db, idx, data_offset,
+                  hi_key, 1, begin, &end)) < 0)
+         return rv;
+   }
+
+   cursor->plan         = LIBRETRODB_PLAN_RANGE;
+   cursor->index        = *idx;
+   cursor->index_offset = data_offset;
+   cursor->index_begin  = begin;
+   cursor->index_end    = end;
+   return 0;
+}
+
+static void libretrodb_plan_term(void *ctx,
+      const struct rmsgpack_dom_value *field,
+      const struct rmsgpack_dom_value *min,
+      const struct rmsgpack_dom_value *max)
+{
+   libretrodb_index_t idx;
+   uint64_t data_offset;
+   struct libretrodb_planner *planner = (struct libretrodb_planner*)ctx;
+   libretrodb_t *db = planner->cursor->db;
+   uint64_t offset  = db->first_index_offset;
+   uint64_t end     = libretrodb_end(db);
+   int rank         = min == max ? 2 : 1;
+
+   /* Lookups beat range scans, which beat full scans. */
+   if (planner->rank >= rank)
+      return;
+
+   while (offset < end)
+   {
+      if (libretrodb_read_index(db, &offset, &idx, &data_offset) < 0)
+         return;
+
+      if (field->string.len != strlen(idx.field) ||
+            memcmp(field->string.buff, idx.field, field->string.len) != 0)
+         continue;
+
+      if (libretrodb_plan_index(planner->cursor, &idx,
+               data_offset, min, max) == 0)
+      {
+         planner->rank = rank;
+         return;
+      }
+   }
+}
+
 /**
  * libretrodb_cursor_open:
  * @db                  : Handle to database.
@@ -368,6 +1258,17 @@ int libretrodb_cursor_open(libretrodb_t *db, libretrodb_cursor_t *cursor,
 
    cursor->db = db;
    cursor->is_valid = 1;
+   cursor->plan = LIBRETRODB_PLAN_SCAN;
+
+   if (q)
+   {
+      struct libretrodb_planner planner;
+
+      planner.cursor = cursor;
+      planner.rank   = 0;
+      libretrodb_query_terms(q, libretrodb_plan_term, &planner);
+   }
+
    libretrodb_cursor_reset(cursor);
    cursor->query = q;
 
@@ -377,46 +1278,119 @@ int libretrodb_cursor_open(libretrodb_t *db, libretrodb_cursor_t *cursor,
    return 0;
 }
 
-static int node_iter(void * value, void * ctx)
+static uint64_t libretrodb_tell(libretrodb_t *db)
+{
+	return lseek(db->fd, 0, SEEK_CUR);
+}
+
+static int libretrodb_write_index(libretrodb_t *db,
+      libretrodb_index_t *idx, const uint8_t *data)
 {
-	struct node_iter_ctx *nictx = (struct node_iter_ctx*)ctx;
+   uint64_t nwritten = 0;
+
+   lseek(db->fd, 0, SEEK_END);
+   libretrodb_write_index_header(db->fd, idx);
 
-	if (write(nictx->db->fd, value,
-            nictx->idx->key_size + sizeof(uint64_t)) > 0)
-		return 0;
+   while (nwritten < idx->next)
+   {
+      ssize_t rv = write(db->fd, data + nwritten, idx->next - nwritten);
 
-	return -1;
+      if (rv <= 0)
+         return -errno;
+      nwritten += rv;
+   }
+
+   return 0;
 }
 
-static uint64_t libretrodb_tell(libretrodb_t *db)
+/**
+ * libretrodb_index_sort:
+ * @entries             : Index entries.
+ * @tmp                 : Scratch space the size of @entries.
+ * @count               : Number of entries.
+ * @item_size           : Size of an entry.
+ * @key_size            : Size of the key at the start of an entry.
+ *
+ * Bottom-up merge sort, so building stays O(n log n) whatever 
+ * order the records are in.
+ *
+ * Returns: @entries or @tmp, whichever holds the sorted entries.
+ **/
+static uint8_t *libretrodb_index_sort(uint8_t *entries, uint8_t *tmp,
+      uint64_t count, size_t item_size, size_t key_size)
 {
-	return lseek(db->fd, 0, SEEK_CUR);
+   uint64_t width;
+
+   for (width = 1; width < count; width *= 2)
+   {
+      uint64_t lo;
+      uint8_t *swap;
+
+      for (lo = 0; lo < count; lo += 2 * width)
+      {
+         uint64_t mid = (lo + width < count) ? lo + width : count;
+         uint64_t hi  = (lo + 2 * width < count) ? lo + 2 * width : count;
+         uint64_t a   = lo;
+         uint64_t b   = mid;
+         uint8_t *out = tmp + lo * item_size;
+
+         while (a < mid && b < hi)
+         {
+            const uint8_t *ea = entries + a * item_size;
+            const uint8_t *eb = entries + b * item_size;
+
+            if (memcmp(ea, eb, key_size) <= 0)
+            {
+               memcpy(out, ea, item_size);
+               a++;
+            }
+            else
+            {
+               memcpy(out, eb, item_size);
+               b++;
+            }
+            out += item_size;
+         }
+
+         memcpy(out, entries + a * item_size, (mid - a) * item_size);
+         out += (mid - a) * item_size;
+         memcpy(out, entries + b * item_size, (hi - b) * item_size);
+      }
+
+      swap    = entries;
+      entries = tmp;
+      tmp     = swap;
+   }
+
+   return entries;
 }
 
 int libretrodb_create_index(libretrodb_t *db,
       const char *name, const char *field_name)
 {
-	int rv;
-	struct node_iter_ctx nictx;
+	int rv = 0;
 	struct rmsgpack_dom_value key;
 	libretrodb_index_t idx;
 	struct rmsgpack_dom_value item;
 	struct rmsgpack_dom_value * field;
-	struct bintree tree;
 	libretrodb_cursor_t cur;
-	uint64_t idx_header_offset;
-	void * buff = NULL;
-	uint64_t * buff_u64 = NULL;
+	uint8_t *entries = NULL, *tmp = NULL, *sorted;
+	uint64_t count = 0, capacity = 0, i;
+	size_t item_size = 0;
 	uint8_t field_size = 0;
-	uint64_t item_loc = libretrodb_tell(db);
+	uint64_t item_loc;
+	uint8_t int_key[sizeof(uint64_t)];
+	const uint8_t *field_key;
+	size_t field_key_size;
+	int key_type = -1;
 
-	bintree_new(&tree, node_compare, &field_size);
+	item.type = RDT_NULL;
 
 	if (libretrodb_cursor_open(db, &cur, NULL) != 0)
-   {
-		rv = -1;
-		goto clean;
-	}
+		return -1;
+
+	/* The cursor shares our file offset. */
+	item_loc = libretrodb_tell(db);
 
 	key.type = RDT_STRING;
 	key.string.len = strlen(field_name);
@@ -442,75 +1416,277 @@ int libretrodb_create_index(libretrodb_t *db,
 			goto clean;
 		}
 
-		if (field->type != RDT_BINARY)
+		switch (field->type)
       {
-			rv = -EINVAL;
-			printf("field is not binary\n");
-			goto clean;
+			case RDT_BINARY:
+				field_key      = (const uint8_t*)field->binary.buff;
+				field_key_size = field->binary.len;
+				break;
+			case RDT_UINT:
+				libretrodb_encode_uint(field->uint_, int_key);
+				field_key      = int_key;
+				field_key_size = sizeof(int_key);
+				break;
+			case RDT_INT:
+				libretrodb_encode_int(field->int_, int_key);
+				field_key      = int_key;
+				field_key_size = sizeof(int_key);
+				break;
+			default:
+				rv = -EINVAL;
+				printf("field is not binary or integer\n");
+				goto clean;
 		}
 
-		if (field->binary.len == 0)
+		if (field_key_size == 0 || field_key_size > MAX_KEY_SIZE)
       {
 			rv = -EINVAL;
-			printf("field is empty\n");
+			printf("field is empty or too long\n");
 			goto clean;
 		}
 
-		if (field_size == 0)
-			field_size = field->binary.len;
-		else if (field->binary.len != field_size)
+		if (key_type == -1)
+      {
+			key_type   = field->type;
+			field_size = field_key_size;
+			item_size  = field_size + sizeof(uint64_t);
+      }
+		else if (field->type != key_type || field_key_size != field_size)
       {
 			rv = -EINVAL;
-			printf("field is not of correct size\n");
+			printf("field is not of correct type or size\n");
 			goto clean;
 		}
 
-		buff = malloc(field_size + sizeof(uint64_t));
-		if (!buff)
+		if (count == capacity)
       {
-			rv = -ENOMEM;
+			uint8_t *grown;
+
+			capacity = capacity ? capacity * 2 :
+            (db->count ? db->count : 64);
+			grown    = (uint8_t*)realloc(entries, capacity * item_size);
+
+			if (!grown)
+         {
+				rv = -ENOMEM;
+				goto clean;
+			}
+			entries = grown;
+		}
+
+		memcpy(entries + count * item_size, field_key, field_size);
+		memcpy(entries + count * item_size + field_size,
+            &item_loc, sizeof(uint64_t));
+		count++;
+
+		rmsgpack_dom_value_free(&item);
+		item.type = RDT_NULL;
+		item_loc = libretrodb_tell(db);
+	}
+
+	if (count == 0)
+		goto clean;
+
+	tmp = (uint8_t*)malloc(count * item_size);
+	if (!tmp)
+   {
+		rv = -ENOMEM;
+		goto clean;
+	}
+
+	sorted = libretrodb_index_sort(entries, tmp, count, item_size, field_size);
+
+	/* Binary fields are identifiers such as checksums, 
+	 * integer fields are usually shared by many records. */
+	for (i = 1; key_type == RDT_BINARY && i < count; i++)
+   {
+		if (memcmp(sorted + (i - 1) * item_size,
+               sorted + i * item_size, field_size) == 0)
+      {
+			printf("Value is not unique\n");
+			rv = -EINVAL;
 			goto clean;
 		}
+	}
+
+	memset(&idx, 0, sizeof(idx));
+	strncpy(idx.name, name, 50);
 
-		memcpy(buff, field->binary.buff, field_size);
+	idx.name[49] = '\0';
+	strncpy(idx.field, field_name, 50);
+	idx.field[49] = '\0';
+	idx.type = LIBRETRODB_INDEX_SORTED;
+	idx.key_type = key_type == RDT_UINT ? LIBRETRODB_KEY_UINT :
+      key_type == RDT_INT ? LIBRETRODB_KEY_INT : LIBRETRODB_KEY_BINARY;
+	idx.key_size = field_size;
+	idx.next = count * item_size;
+	rv = libretrodb_write_index(db, &idx, sorted);
+clean:
+	rmsgpack_dom_value_free(&item);
+	free(entries);
+	free(tmp);
+	if (cur.is_valid)
+		libretrodb_cursor_close(&cur);
+	return rv;
+}
 
-		buff_u64 = (uint64_t *)buff + field_size;
+/**
+ * libretrodb_create_hash_index:
+ * @db                  : Handle to database.
+ * @name                : Name of index.
+ * @field_name          : Field to index.
+ *
+ * Builds an open addressing hash index over an exact-match field.
+ * Unlike sorted indexes, string fields can be indexed, records 
+ * without the field are skipped and values need not be unique: 
+ * records sharing a value end up on the same probe sequence.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libretrodb_create_hash_index(libretrodb_t *db,
+      const char *name, const char *field_name)
+{
+	int rv = 0;
+	struct rmsgpack_dom_value key;
+	libretrodb_index_t idx;
+	struct rmsgpack_dom_value item;
+	struct rmsgpack_dom_value * field;
+	libretrodb_cursor_t cur;
+	struct hash_build_entry *entries = NULL;
+	uint8_t *slots = NULL;
+	uint64_t count = 0, capacity = 0, buckets, i;
+	uint64_t item_loc;
+	size_t key_size = 0;
+	int key_type = RDT_NULL;
+
+	item.type = RDT_NULL;
+
+	if (libretrodb_cursor_open(db, &cur, NULL) != 0)
+		return -1;
 
-		memcpy(buff_u64, &item_loc, sizeof(uint64_t));
+	/* The cursor shares our file offset. */
+	item_loc = libretrodb_tell(db);
 
-		if (bintree_insert(&tree, buff) != 0)
+	key.type = RDT_STRING;
+	key.string.len = strlen(field_name);
+	key.string.buff = (char *) field_name;
+
+	while (libretrodb_cursor_read_item(&cur, &item) == 0)
+   {
+		const uint8_t *bytes;
+		size_t size;
+
+		if (item.type != RDT_MAP)
       {
-			printf("Value is not unique: ");
-			rmsgpack_dom_value_print(field);
-			printf("\n");
 			rv = -EINVAL;
+			printf("Only map keys are supported\n");
 			goto clean;
 		}
-		buff = NULL;
+
+		field = rmsgpack_dom_value_map_value(&item, &key);
+
+		if (field)
+      {
+			if (libretrodb_field_key(field, &bytes, &size) != 0)
+         {
+				rv = -EINVAL;
+				printf("field is not binary or string\n");
+				goto clean;
+			}
+
+			if (key_type == RDT_NULL)
+         {
+				key_type = field->type;
+				key_size = size;
+			}
+
+			/* String keys are passed to lookups NUL-terminated, 
+			 * binary keys have a fixed size. */
+			if (field->type != key_type ||
+               (key_type == RDT_BINARY && size != key_size))
+         {
+				rv = -EINVAL;
+				printf("field is not of correct type or size\n");
+				goto clean;
+			}
+
+			if (count == capacity)
+         {
+				struct hash_build_entry *grown;
+
+				capacity = capacity ? capacity * 2 :
+               (db->count ? db->count : 64);
+				grown    = (struct hash_build_entry*)
+               realloc(entries, capacity * sizeof(*entries));
+
+				if (!grown)
+            {
+					rv = -ENOMEM;
+					goto clean;
+				}
+				entries = grown;
+			}
+
+			entries[count].hash   = libretrodb_hash(bytes, size);
+			entries[count].offset = item_loc;
+			count++;
+		}
+
 		rmsgpack_dom_value_free(&item);
+		item.type = RDT_NULL;
 		item_loc = libretrodb_tell(db);
 	}
 
-	(void)rv;
-	(void)idx_header_offset;
+	/* Keep the load factor at or below one half. */
+	for (buckets = 2; buckets < count * 2; buckets *= 2);
 
-	idx_header_offset = lseek(db->fd, 0, SEEK_END);
-	strncpy(idx.name, name, 50);
+	slots = (uint8_t*)calloc(buckets, HASH_SLOT_SIZE);
 
-	idx.name[49] = '\0';
-	idx.key_size = field_size;
-	idx.next = db->count * (field_size + sizeof(uint64_t));
-	libretrodb_write_index_header(db->fd, &idx);
+	if (!slots)
+   {
+		rv = -ENOMEM;
+		goto clean;
+	}
+
+	for (i = 0; i < count; i++)
+   {
+		struct hash_build_entry *entry = &entries[i];
+		uint64_t slot = entry->hash & (buckets - 1);
+		uint64_t offset;
 
-	nictx.db = db;
-	nictx.idx = &idx;
-	bintree_iterate(&tree, node_iter, &nictx);
-	bintree_free(&tree);
+		/* Records are added in file order, so lookups that stop 
+		 * at the first match find the first such record. */
+		for (;; slot = (slot + 1) & (buckets - 1))
+      {
+			memcpy(&offset, slots + slot * HASH_SLOT_SIZE + sizeof(uint64_t),
+               sizeof(uint64_t));
+			if (offset == 0)
+				break;
+		}
+
+		memcpy(slots + slot * HASH_SLOT_SIZE,
+            &entry->hash, sizeof(uint64_t));
+		memcpy(slots + slot * HASH_SLOT_SIZE + sizeof(uint64_t),
+            &entry->offset, sizeof(uint64_t));
+	}
+
+	memset(&idx, 0, sizeof(idx));
+	strncpy(idx.name, name, 50);
+	idx.name[49] = '\0';
+	strncpy(idx.field, field_name, 50);
+	idx.field[49] = '\0';
+	idx.type     = LIBRETRODB_INDEX_HASH;
+	idx.key_type = key_type == RDT_BINARY ?
+      LIBRETRODB_KEY_BINARY : LIBRETRODB_KEY_STRING;
+	idx.key_size = key_type == RDT_BINARY ? key_size : 0;
+	idx.buckets  = buckets;
+	idx.next     = buckets * HASH_SLOT_SIZE;
+	rv = libretrodb_write_index(db, &idx, slots);
 clean:
 	rmsgpack_dom_value_free(&item);
-	if (buff)
-		free(buff);
+	free(entries);
+	free(slots);
 	if (cur.is_valid)
 		libretrodb_cursor_close(&cur);
-	return 0;
+	return rv;
 }
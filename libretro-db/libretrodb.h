@@ -24,13 +24,32 @@ typedef struct libretrodb
 	uint64_t count;
 	uint64_t first_index_offset;
    char path[1024];
+   /* Whole file, if opened with libretrodb_open_mapped(). */
+   const uint8_t *map;
+   uint64_t map_size;
 } libretrodb_t;
 
+#define LIBRETRODB_INDEX_SORTED 0
+#define LIBRETRODB_INDEX_HASH   1
+
+/* Sorted indexes over integer fields store 8 byte big-endian 
+ * keys, with the sign bit flipped for signed ones. */
+#define LIBRETRODB_KEY_BINARY   0
+#define LIBRETRODB_KEY_STRING   1
+#define LIBRETRODB_KEY_UINT     2
+#define LIBRETRODB_KEY_INT      3
+
 typedef struct libretrodb_index
 {
 	char name[50];
+	/* 0 for hash indexes over string fields. */
 	uint64_t key_size;
 	uint64_t next;
+	uint64_t type;
+	uint64_t key_type;
+	char field[50];
+	/* Hash indexes only. */
+	uint64_t buckets;
 } libretrodb_index_t;
 
 typedef struct libretrodb_metadata
@@ -44,11 +63,27 @@ typedef struct libretrodb_header
 	uint64_t metadata_offset;
 } libretrodb_header_t;
 
+#define LIBRETRODB_PLAN_SCAN    0
+#define LIBRETRODB_PLAN_RANGE   1
+#define LIBRETRODB_PLAN_HASH    2
+
 typedef struct libretrodb_cursor
 {
 	int is_valid;
 	int fd;
 	int eof;
+   /* Next item, when reading from a mapped database. */
+   uint64_t offset;
+   /* How the query is answered: by reading every record, or 
+    * only those a range of sorted index entries or a hash 
+    * index probe sequence point to. */
+   int plan;
+   libretrodb_index_t index;
+   uint64_t index_offset;
+   uint64_t index_begin;
+   uint64_t index_end;
+   uint64_t index_pos;
+   uint64_t index_hash;
 	libretrodb_query_t * query;
 	libretrodb_t * db;
 } libretrodb_cursor_t;
@@ -63,9 +98,39 @@ void libretrodb_close(libretrodb_t * db);
 
 int libretrodb_open(const char * path, libretrodb_t * db);
 
+/**
+ * libretrodb_open_mapped:
+ * @path                : Path to database.
+ * @db                  : Handle to database.
+ *
+ * Opens database read-only and maps it into memory, so that 
+ * lookups and cursors read indexes and records in place.
+ * Indexes cannot be created on a database opened this way.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libretrodb_open_mapped(const char * path, libretrodb_t * db);
+
 int libretrodb_create_index(libretrodb_t * db, const char *name,
       const char *field_name);
 
+/**
+ * libretrodb_create_hash_index:
+ * @db                  : Handle to database.
+ * @name                : Name of index.
+ * @field_name          : Field to index.
+ *
+ * Builds a hash index for exact-match lookups of a binary or 
+ * string field, such as crc, md5, sha1 or serial. Records 
+ * without the field are left out of the index. Values need not 
+ * be unique: libretrodb_find_entry() returns the first record 
+ * with a value, cursors return all of them.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libretrodb_create_hash_index(libretrodb_t * db, const char *name,
+      const char *field_name);
+
 int libretrodb_find_entry(
         libretrodb_t * db,
         const char * index_name,
@@ -73,6 +138,9 @@ int libretrodb_find_entry(
         struct rmsgpack_dom_value * out
 );
 
+int libretrodb_find_entries(libretrodb_t *db, const char *index_name,
+      const void *keys, size_t count, struct rmsgpack_dom_value *out);
+
 /**
  * libretrodb_cursor_open:
  * @db                  : Handle to database.
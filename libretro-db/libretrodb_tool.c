@@ -19,14 +19,22 @@ int main(int argc, char ** argv)
       printf("Available Commands:\n");
       printf("\tlist\n");
       printf("\tcreate-index <index name> <field name>\n");
+      printf("\tcreate-hash-index <index name> <field name>\n");
       printf("\tfind <query expression>\n");
+      printf("\tget <index name> <hex key>\n");
       return 1;
    }
 
    command = argv[2];
    path    = argv[1];
 
-   if ((rv = libretrodb_open(path, &db)) != 0)
+   /* Only creating an index writes to the database. */
+   if (strncmp(command, "create-", strlen("create-")) == 0)
+      rv = libretrodb_open(path, &db);
+   else
+      rv = libretrodb_open_mapped(path, &db);
+
+   if (rv != 0)
    {
       printf("Could not open db file '%s': %s\n", path, strerror(-rv));
       return 1;
@@ -75,6 +83,7 @@ int main(int argc, char ** argv)
          printf("Could not open cursor: %s\n", strerror(-rv));
          return 1;
       }
+      libretrodb_query_free(q);
 
       while (libretrodb_cursor_read_item(&cur, &item) == 0)
       {
@@ -82,6 +91,53 @@ int main(int argc, char ** argv)
          printf("\n");
          rmsgpack_dom_value_free(&item);
       }
+
+      libretrodb_cursor_close(&cur);
+   }
+   else if (strcmp(command, "get") == 0)
+   {
+      uint8_t key[257];
+      unsigned i, key_size;
+      const char *hex;
+
+      if (argc != 5)
+      {
+         printf("Usage: %s <db file> get <index name> <hex key>\n", argv[0]);
+         return 1;
+      }
+
+      hex      = argv[4];
+      key_size = strlen(hex) / 2;
+
+      if (key_size == 0 || key_size >= sizeof(key) || strlen(hex) % 2)
+      {
+         printf("Invalid key '%s'\n", hex);
+         return 1;
+      }
+
+      for (i = 0; i < key_size; i++)
+      {
+         unsigned byte;
+         if (sscanf(hex + i * 2, "%2x", &byte) != 1)
+         {
+            printf("Invalid key '%s'\n", hex);
+            return 1;
+         }
+         key[i] = byte;
+      }
+
+      /* Hash indexes over string fields take NUL-terminated keys. */
+      key[key_size] = '\0';
+
+      if ((rv = libretrodb_find_entry(&db, argv[3], key, &item)) != 0)
+      {
+         printf("Not found\n");
+         return 1;
+      }
+
+      rmsgpack_dom_value_print(&item);
+      printf("\n");
+      rmsgpack_dom_value_free(&item);
    }
    else if (strcmp(command, "create-index") == 0)
    {
@@ -98,6 +154,25 @@ int main(int argc, char ** argv)
 
       libretrodb_create_index(&db, index_name, field_name);
    }
+   else if (strcmp(command, "create-hash-index") == 0)
+   {
+      const char * index_name, * field_name;
+
+      if (argc != 5)
+      {
+         printf("Usage: %s <db file> create-hash-index <index name> <field name>\n", argv[0]);
+         return 1;
+      }
+
+      index_name = argv[3];
+      field_name = argv[4];
+
+      if ((rv = libretrodb_create_hash_index(&db, index_name, field_name)) != 0)
+      {
+         printf("Could not create index: %s\n", strerror(-rv));
+         return 1;
+      }
+   }
    else
    {
       printf("Unknown command %s\n", argv[2]);
@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "libretrodb.h"
+#include "query.h"
 
 #include "rmsgpack_dom.h"
 #include <compat/fnmatch.h>
@@ -58,6 +59,18 @@ static void raise_expected_string(off_t where, const char ** error)
    *error = tmp_error_buff;
 }
 
+static void raise_expected_binary(off_t where, const char ** error)
+{
+   snprintf(tmp_error_buff, MAX_ERROR_LEN,
+#ifdef _WIN32
+         "%I64u::Expected hexadecimal binary",
+#else
+         "%llu::Expected hexadecimal binary",
+#endif
+         (unsigned long long)where);
+   *error = tmp_error_buff;
+}
+
 static void raise_unexpected_eof(off_t where, const char ** error)
 {
    snprintf(tmp_error_buff, MAX_ERROR_LEN,
@@ -165,6 +178,7 @@ static void argument_free(struct argument *arg)
 
    for (i = 0; i < arg->invocation.argc; i++)
       argument_free(&arg->invocation.argv[i]);
+   free(arg->invocation.argv);
 }
 
 struct query
@@ -279,7 +293,10 @@ static struct rmsgpack_dom_value between(struct rmsgpack_dom_value input,
          res.bool_ = input.int_ >= argv[0].value.int_ && input.int_ <= argv[1].value.int_;
          break;
       case RDT_UINT:
-         res.bool_ = input.int_ >= argv[0].value.uint_ && input.int_ <= argv[1].value.int_;
+         res.bool_ = argv[1].value.int_ >= 0 &&
+            (argv[0].value.int_ < 0 ||
+             input.uint_ >= (uint64_t)argv[0].value.int_) &&
+            input.uint_ <= (uint64_t)argv[1].value.int_;
          break;
       default:
          return res;
@@ -520,6 +537,66 @@ static struct buffer parse_string(struct buffer buff,
    return buff;
 }
 
+static int hex_digit(char c)
+{
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
+}
+
+static struct buffer parse_binary(struct buffer buff,
+      struct rmsgpack_dom_value *value, const char **error)
+{
+   unsigned i;
+   char *hex;
+   size_t len;
+   off_t start = buff.offset;
+
+   /* Skip the 'b' prefix, then read the digits as a string. */
+   buff.offset++;
+   buff = parse_string(buff, value, error);
+
+   if (*error)
+      return buff;
+
+   hex = value->string.buff;
+   len = value->string.len;
+
+   if (len % 2 != 0)
+   {
+      free(hex);
+      value->type = RDT_NULL;
+      raise_expected_binary(start, error);
+      return buff;
+   }
+
+   for (i = 0; i < len / 2; i++)
+   {
+      int hi = hex_digit(hex[i * 2]);
+      int lo = hex_digit(hex[i * 2 + 1]);
+
+      if (hi < 0 || lo < 0)
+      {
+         free(hex);
+         value->type = RDT_NULL;
+         raise_expected_binary(start, error);
+         return buff;
+      }
+
+      /* Decode in place, the output never overtakes the input. */
+      hex[i] = (char)((hi << 4) | lo);
+   }
+
+   value->type        = RDT_BINARY;
+   value->binary.len  = len / 2;
+   value->binary.buff = hex;
+   return buff;
+}
+
 static struct buffer parse_integer(struct buffer buff,
       struct rmsgpack_dom_value *value, const char **error)
 {
@@ -535,6 +612,8 @@ static struct buffer parse_integer(struct buffer buff,
       raise_expected_number(buff.offset, error);
    else
    {
+      if (buff.data[buff.offset] == '-')
+         buff.offset++;
       while (isdigit(buff.data[buff.offset]))
          buff.offset++;
    }
@@ -565,7 +644,11 @@ static struct buffer parse_value(struct buffer buff,
    }
    else if (peek(buff, "\"") || peek(buff, "'"))
       buff = parse_string(buff, value, error);
-   else if (isdigit(buff.data[buff.offset]))
+   else if (peek(buff, "b\"") || peek(buff, "b'"))
+      buff = parse_binary(buff, value, error);
+   else if (isdigit(buff.data[buff.offset]) ||
+         (peek(buff, "-") && buff.offset + 1 < buff.len &&
+          isdigit(buff.data[buff.offset + 1])))
       buff = parse_integer(buff, value, error);
    return buff;
 }
@@ -821,6 +904,8 @@ static struct buffer parse_argument(struct buffer buff,
             peek(buff, "nil")
             || peek(buff, "true")
             || peek(buff, "false")
+            || peek(buff, "b\"")
+            || peek(buff, "b'")
             )
       )
    {
@@ -853,6 +938,8 @@ void libretrodb_query_free(void *q)
 
 	for (i = 0; i < real_q->root.argc; i++)
 		argument_free(&real_q->root.argv[i]);
+	free(real_q->root.argv);
+	free(real_q);
 }
 
 void *libretrodb_query_compile(libretrodb_t *db,
@@ -890,12 +977,13 @@ void *libretrodb_query_compile(libretrodb_t *db,
    if (!q->root.func)
    {
       raise_unexpected_eof(buff.offset, error);
-      return NULL;
+      goto clean;
    }
    goto success;
 clean:
    if (q)
       libretrodb_query_free(q);
+   q = NULL;
 success:
    return q;
 }
@@ -914,3 +1002,49 @@ int libretrodb_query_filter(libretrodb_query_t *q,
    struct rmsgpack_dom_value res = inv.func(*v, inv.argc, inv.argv);
    return (res.type == RDT_BOOL && res.bool_);
 }
+
+static void query_terms(const struct invocation *inv,
+      libretrodb_query_term_cb cb, void *ctx)
+{
+   unsigned i;
+
+   if (inv->func == operator_and)
+   {
+      for (i = 0; i < inv->argc; i++)
+         if (inv->argv[i].type == AT_FUNCTION)
+            query_terms(&inv->argv[i].invocation, cb, ctx);
+      return;
+   }
+
+   if (inv->func != all_map)
+      return;
+
+   for (i = 0; i + 1 < inv->argc; i += 2)
+   {
+      const struct argument *field = &inv->argv[i];
+      const struct argument *arg   = &inv->argv[i + 1];
+
+      if (field->type != AT_VALUE || field->value.type != RDT_STRING)
+         continue;
+
+      /* Missing fields are nil, which no index can find. */
+      if (arg->type == AT_VALUE && arg->value.type != RDT_NULL)
+         cb(ctx, &field->value, &arg->value, &arg->value);
+      else if (arg->type == AT_FUNCTION &&
+            arg->invocation.func == between &&
+            arg->invocation.argc == 2 &&
+            arg->invocation.argv[0].type == AT_VALUE &&
+            arg->invocation.argv[1].type == AT_VALUE &&
+            arg->invocation.argv[0].value.type == RDT_INT &&
+            arg->invocation.argv[1].value.type == RDT_INT)
+         cb(ctx, &field->value, &arg->invocation.argv[0].value,
+               &arg->invocation.argv[1].value);
+   }
+}
+
+void libretrodb_query_terms(libretrodb_query_t *q,
+      libretrodb_query_term_cb cb, void *ctx)
+{
+   if (q)
+      query_terms(&((struct query*)q)->root, cb, ctx);
+}
@@ -10,4 +10,22 @@ void libretrodb_query_dec_ref(libretrodb_query_t *q);
 int libretrodb_query_filter(libretrodb_query_t *q,
       struct rmsgpack_dom_value * v);
 
+typedef void (*libretrodb_query_term_cb)(void *ctx,
+      const struct rmsgpack_dom_value *field,
+      const struct rmsgpack_dom_value *min,
+      const struct rmsgpack_dom_value *max);
+
+/**
+ * libretrodb_query_terms:
+ * @q                   : Compiled query.
+ * @cb                  : Called for each term.
+ * @ctx                 : Passed to @cb.
+ *
+ * Reports the fields every match of @q must have a given value 
+ * for (@min == @max), or an integer value within [@min, @max].
+ * Other predicates, like glob(), are not reported.
+ **/
+void libretrodb_query_terms(libretrodb_query_t *q,
+      libretrodb_query_term_cb cb, void *ctx);
+
 #endif
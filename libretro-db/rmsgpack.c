@@ -328,12 +328,89 @@ int rmsgpack_write_uint(int fd, uint64_t value)
    return written;
 }
 
-static int read_uint(int fd, uint64_t *out, size_t size)
+/* Where rmsgpack_read() and friends take their bytes from:
+ * a file descriptor, or memory if ptr is set. */
+struct rmsgpack_reader
 {
-   uint64_t tmp;
+   int fd;
+   const uint8_t *ptr;
+   const uint8_t *end;
+   /* Hand out strings and binaries in place instead of copies. */
+   int borrow;
+};
+
+static int reader_read(struct rmsgpack_reader *reader, void *out, size_t size)
+{
+   if (reader->ptr)
+   {
+      if ((size_t)(reader->end - reader->ptr) < size)
+         return -EINVAL;
+
+      memcpy(out, reader->ptr, size);
+      reader->ptr += size;
+      return 0;
+   }
 
-   if (read(fd, &tmp, size) == -1)
+   if (read(reader->fd, out, size) == -1)
       return -errno;
+   return 0;
+}
+
+/**
+ * reader_buff:
+ * @reader              : Reader.
+ * @len                 : Number of bytes.
+ * @pbuff               : Set to the next @len bytes.
+ *
+ * Borrowing readers point @pbuff into their buffer. Otherwise 
+ * it is a NUL-terminated copy owned by the caller.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+static int reader_buff(struct rmsgpack_reader *reader, uint64_t len,
+      char **pbuff)
+{
+   int rv;
+
+   if (reader->borrow)
+   {
+      if ((uint64_t)(reader->end - reader->ptr) < len)
+         return -EINVAL;
+
+      *pbuff       = (char*)reader->ptr;
+      reader->ptr += len;
+      return 0;
+   }
+
+   *pbuff = (char *)calloc(len + 1, sizeof(char));
+   if (!*pbuff)
+      return -ENOMEM;
+
+   if ((rv = reader_read(reader, *pbuff, len)) < 0)
+   {
+      free(*pbuff);
+      return rv;
+   }
+
+   return 0;
+}
+
+static void reader_buff_free(struct rmsgpack_reader *reader, char *buff)
+{
+   if (!reader->borrow)
+      free(buff);
+}
+
+static int read_value(struct rmsgpack_reader *reader,
+      struct rmsgpack_read_callbacks *callbacks, void *data);
+
+static int read_uint(struct rmsgpack_reader *reader, uint64_t *out, size_t size)
+{
+   int rv;
+   uint64_t tmp;
+
+   if ((rv = reader_read(reader, &tmp, size)) < 0)
+      return rv;
 
    switch (size)
    {
@@ -353,15 +430,16 @@ static int read_uint(int fd, uint64_t *out, size_t size)
    return 0;
 }
 
-static int read_int(int fd, int64_t *out, size_t size)
+static int read_int(struct rmsgpack_reader *reader, int64_t *out, size_t size)
 {
+   int rv;
    uint8_t tmp8 = 0;
    uint16_t tmp16;
    uint32_t tmp32;
    uint64_t tmp64;
 
-   if (read(fd, &tmp64, size) == -1)
-      return -errno;
+   if ((rv = reader_read(reader, &tmp64, size)) < 0)
+      return rv;
 
    (void)tmp8;
 
@@ -386,26 +464,23 @@ static int read_int(int fd, int64_t *out, size_t size)
    return 0;
 }
 
-static int read_buff(int fd, size_t size, char **pbuff, uint64_t *len)
+static int read_buff(struct rmsgpack_reader *reader, size_t size,
+      char **pbuff, uint64_t *len)
 {
+   int rv;
    uint64_t tmp_len = 0;
 
-   if (read_uint(fd, &tmp_len, size) == -1)
-      return -errno;
-
-   *pbuff = (char *)calloc(tmp_len + 1, sizeof(char));
+   if ((rv = read_uint(reader, &tmp_len, size)) < 0)
+      return rv;
 
-   if (read(fd, *pbuff, tmp_len) == -1)
-   {
-      free(*pbuff);
-      return -errno;
-   }
+   if ((rv = reader_buff(reader, tmp_len, pbuff)) < 0)
+      return rv;
 
    *len = tmp_len;
    return 0;
 }
 
-static int read_map(int fd, uint32_t len,
+static int read_map(struct rmsgpack_reader *reader, uint32_t len,
         struct rmsgpack_read_callbacks *callbacks, void *data)
 {
    int rv;
@@ -417,16 +492,16 @@ static int read_map(int fd, uint32_t len,
 
    for (i = 0; i < len; i++)
    {
-      if ((rv = rmsgpack_read(fd, callbacks, data)) < 0)
+      if ((rv = read_value(reader, callbacks, data)) < 0)
          return rv;
-      if ((rv = rmsgpack_read(fd, callbacks, data)) < 0)
+      if ((rv = read_value(reader, callbacks, data)) < 0)
          return rv;
    }
 
    return 0;
 }
 
-static int read_array(int fd, uint32_t len,
+static int read_array(struct rmsgpack_reader *reader, uint32_t len,
       struct rmsgpack_read_callbacks *callbacks, void *data)
 {
    int rv;
@@ -438,14 +513,14 @@ static int read_array(int fd, uint32_t len,
 
    for (i = 0; i < len; i++)
    {
-      if ((rv = rmsgpack_read(fd, callbacks, data)) < 0)
+      if ((rv = read_value(reader, callbacks, data)) < 0)
          return rv;
    }
 
    return 0;
 }
 
-int rmsgpack_read(int fd,
+static int read_value(struct rmsgpack_reader *reader,
       struct rmsgpack_read_callbacks *callbacks, void *data)
 {
    int rv;
@@ -455,8 +530,8 @@ int rmsgpack_read(int fd,
    uint8_t type      = 0;
    char *buff        = NULL;
 
-   if (read(fd, &type, sizeof(uint8_t)) == -1)
-      return -errno;
+   if ((rv = reader_read(reader, &type, sizeof(uint8_t))) < 0)
+      return rv;
 
    if (type < MPF_FIXMAP)
    {
@@ -467,28 +542,21 @@ int rmsgpack_read(int fd,
    else if (type < MPF_FIXARRAY)
    {
       tmp_len = type - MPF_FIXMAP;
-      return read_map(fd, tmp_len, callbacks, data);
+      return read_map(reader, tmp_len, callbacks, data);
    }
    else if (type < MPF_FIXSTR)
    {
       tmp_len = type - MPF_FIXARRAY;
-      return read_array(fd, tmp_len, callbacks, data);
+      return read_array(reader, tmp_len, callbacks, data);
    }
    else if (type < MPF_NIL)
    {
       tmp_len = type - MPF_FIXSTR;
-      buff = (char *)calloc(tmp_len + 1, sizeof(char));
-      if (!buff)
-         return -ENOMEM;
-      if (read(fd, buff, tmp_len) == -1)
-      {
-         free(buff);
-         return -errno;
-      }
-      buff[tmp_len] = '\0';
+      if ((rv = reader_buff(reader, tmp_len, &buff)) < 0)
+         return rv;
       if (!callbacks->read_string)
       {
-         free(buff);
+         reader_buff_free(reader, buff);
          return 0;
       }
       return callbacks->read_string(buff, tmp_len, data);
@@ -517,12 +585,13 @@ int rmsgpack_read(int fd,
       case 0xc4:
       case 0xc5:
       case 0xc6:
-         if ((rv = read_buff(fd, 1<<(type - 0xc4),
+         if ((rv = read_buff(reader, 1<<(type - 0xc4),
                      &buff, &tmp_len)) < 0)
             return rv;
 
          if (callbacks->read_bin)
             return callbacks->read_bin(buff, tmp_len, data);
+         reader_buff_free(reader, buff);
          break;
       case 0xcc:
       case 0xcd:
@@ -530,8 +599,8 @@ int rmsgpack_read(int fd,
       case 0xcf:
          tmp_len = 1ULL << (type - 0xcc);
          tmp_uint = 0;
-         if (read_uint(fd, &tmp_uint, tmp_len) == -1)
-            return -errno;
+         if ((rv = read_uint(reader, &tmp_uint, tmp_len)) < 0)
+            return rv;
 
          if (callbacks->read_uint)
             return callbacks->read_uint(tmp_uint, data);
@@ -542,8 +611,8 @@ int rmsgpack_read(int fd,
       case 0xd3:
          tmp_len = 1ULL << (type - 0xd0);
          tmp_int = 0;
-         if (read_int(fd, &tmp_int, tmp_len) == -1)
-            return -errno;
+         if ((rv = read_int(reader, &tmp_int, tmp_len)) < 0)
+            return rv;
 
          if (callbacks->read_int)
             return callbacks->read_int(tmp_int, data);
@@ -551,25 +620,72 @@ int rmsgpack_read(int fd,
       case 0xd9:
       case 0xda:
       case 0xdb:
-         if ((rv = read_buff(fd, 1<<(type - 0xd9), &buff, &tmp_len)) < 0)
+         if ((rv = read_buff(reader, 1<<(type - 0xd9), &buff, &tmp_len)) < 0)
             return rv;
 
          if (callbacks->read_string)
             return callbacks->read_string(buff, tmp_len, data);
+         reader_buff_free(reader, buff);
          break;
       case 0xdc:
       case 0xdd:
-         if (read_uint(fd, &tmp_len, 2<<(type - 0xdc)) == -1)
-            return -errno;
+         if ((rv = read_uint(reader, &tmp_len, 2<<(type - 0xdc))) < 0)
+            return rv;
 
-         return read_array(fd, tmp_len, callbacks, data);
+         return read_array(reader, tmp_len, callbacks, data);
       case 0xde:
       case 0xdf:
-         if (read_uint(fd, &tmp_len, 2<<(type - 0xde)) == -1)
-            return -errno;
+         if ((rv = read_uint(reader, &tmp_len, 2<<(type - 0xde))) < 0)
+            return rv;
 
-         return read_map(fd, tmp_len, callbacks, data);
+         return read_map(reader, tmp_len, callbacks, data);
    }
 
    return 0;
 }
+
+int rmsgpack_read(int fd,
+      struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   struct rmsgpack_reader reader = {0};
+
+   reader.fd = fd;
+   return read_value(&reader, callbacks, data);
+}
+
+int rmsgpack_read_mem(const void *buf, size_t size, size_t *read_size,
+      struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   int rv;
+   struct rmsgpack_reader reader;
+
+   reader.fd     = -1;
+   reader.ptr    = (const uint8_t*)buf;
+   reader.end    = reader.ptr + size;
+   reader.borrow = 0;
+
+   rv = read_value(&reader, callbacks, data);
+
+   if (read_size)
+      *read_size = reader.ptr - (const uint8_t*)buf;
+   return rv;
+}
+
+int rmsgpack_read_mem_borrowed(const void *buf, size_t size,
+      size_t *read_size, struct rmsgpack_read_callbacks *callbacks,
+      void *data)
+{
+   int rv;
+   struct rmsgpack_reader reader;
+
+   reader.fd     = -1;
+   reader.ptr    = (const uint8_t*)buf;
+   reader.end    = reader.ptr + size;
+   reader.borrow = 1;
+
+   rv = read_value(&reader, callbacks, data);
+
+   if (read_size)
+      *read_size = reader.ptr - (const uint8_t*)buf;
+   return rv;
+}
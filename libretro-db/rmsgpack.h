@@ -2,6 +2,7 @@
 #define __RARCHDB_MSGPACK_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 struct rmsgpack_read_callbacks {
 	int (* read_nil)(void *);
@@ -76,5 +77,27 @@ int rmsgpack_read(
         void * data
 );
 
+/* Same as rmsgpack_read(), but parses the value at @buf, which 
+ * must be entirely within @size bytes. @read_size is set to the 
+ * number of bytes it took up. */
+int rmsgpack_read_mem(
+        const void * buf,
+        size_t size,
+        size_t * read_size,
+        struct rmsgpack_read_callbacks * callbacks,
+        void * data
+);
+
+/* Same as rmsgpack_read_mem(), but strings and binaries are passed 
+ * to the callbacks as pointers into @buf, without a terminating 
+ * NUL. Callbacks must not free them. */
+int rmsgpack_read_mem_borrowed(
+        const void * buf,
+        size_t size,
+        size_t * read_size,
+        struct rmsgpack_read_callbacks * callbacks,
+        void * data
+);
+
 #endif
 
@@ -15,8 +15,32 @@ struct dom_reader_state
 {
 	int i;
 	struct rmsgpack_dom_value *stack[MAX_DEPTH];
+   /* When set, values are allocated here instead of the heap. */
+   uint8_t *arena;
+   size_t arena_size;
+   size_t arena_used;
 };
 
+static void *dom_alloc(struct dom_reader_state *s, size_t size)
+{
+   void *ptr;
+
+   if (!s->arena)
+      return calloc(1, size);
+
+   /* Keep every allocation 8-byte aligned. */
+   if (size > SIZE_MAX - 7)
+      return NULL;
+   size = (size + 7) & ~(size_t)7;
+   if (size > s->arena_size - s->arena_used)
+      return NULL;
+
+   ptr            = s->arena + s->arena_used;
+   s->arena_used += size;
+   memset(ptr, 0, size);
+   return ptr;
+}
+
 static struct rmsgpack_dom_value *dom_reader_state_pop(
       struct dom_reader_state *s)
 {
@@ -89,6 +113,28 @@ static int dom_read_string(char *value, uint32_t len, void *data)
    return 0;
 }
 
+/* Borrowed strings are not NUL-terminated, so copy them. */
+static int dom_view_read_string(char *value, uint32_t len, void *data)
+{
+   struct dom_reader_state *dom_state = (struct dom_reader_state *)data;
+   struct rmsgpack_dom_value *v =
+      (struct rmsgpack_dom_value*)dom_reader_state_pop(dom_state);
+   char *copy;
+
+   if (len >= SIZE_MAX)
+      return -EINVAL;
+
+   copy = (char*)dom_alloc(dom_state, (size_t)len + 1);
+   if (!copy)
+      return -ENOMEM;
+
+   memcpy(copy, value, len);
+   v->type = RDT_STRING;
+   v->string.len = len;
+   v->string.buff = copy;
+   return 0;
+}
+
 static int dom_read_bin(void *value, uint32_t len, void *data)
 {
    struct dom_reader_state *dom_state = (struct dom_reader_state *)data;
@@ -109,15 +155,20 @@ static int dom_read_map_start(uint32_t len, void *data)
    struct rmsgpack_dom_value *v = dom_reader_state_pop(dom_state);
 
    v->type = RDT_MAP;
-   v->map.len = len;
+   v->map.len = 0;
    v->map.items = NULL;
 
-   items = (struct rmsgpack_dom_pair *)calloc(len,
-         sizeof(struct rmsgpack_dom_pair));
+   /* The length comes straight from the file. */
+   if (len > SIZE_MAX / sizeof(struct rmsgpack_dom_pair))
+      return -EINVAL;
+
+   items = (struct rmsgpack_dom_pair *)dom_alloc(dom_state,
+         len * sizeof(struct rmsgpack_dom_pair));
 
    if (!items)
       return -ENOMEM;
 
+   v->map.len = len;
    v->map.items = items;
 
    for (i = 0; i < len; i++)
@@ -139,14 +190,20 @@ static int dom_read_array_start(uint32_t len, void *data)
 	struct rmsgpack_dom_value *items   = NULL;
 
 	v->type = RDT_ARRAY;
-	v->array.len = len;
+	v->array.len = 0;
 	v->array.items = NULL;
 
-	items = (struct rmsgpack_dom_value *)calloc(len, sizeof(struct rmsgpack_dom_pair));
+	/* The length comes straight from the file. */
+	if (len > SIZE_MAX / sizeof(struct rmsgpack_dom_value))
+		return -EINVAL;
+
+	items = (struct rmsgpack_dom_value *)dom_alloc(dom_state,
+         len * sizeof(struct rmsgpack_dom_value));
 
 	if (!items)
 		return -ENOMEM;
 
+	v->array.len = len;
 	v->array.items = items;
 
 	for (i = 0; i < len; i++)
@@ -169,6 +226,17 @@ static struct rmsgpack_read_callbacks dom_reader_callbacks = {
 	dom_read_array_start
 };
 
+static struct rmsgpack_read_callbacks dom_view_callbacks = {
+	dom_read_nil,
+	dom_read_bool,
+	dom_read_int,
+	dom_read_uint,
+	dom_view_read_string,
+	dom_read_bin,
+	dom_read_map_start,
+	dom_read_array_start
+};
+
 void rmsgpack_dom_value_free(struct rmsgpack_dom_value *v)
 {
    unsigned i;
@@ -397,6 +465,7 @@ int rmsgpack_dom_read(int fd, struct rmsgpack_dom_value *out)
 
    s.i        = 0;
    s.stack[0] = out;
+   s.arena    = NULL;
 
    rv = rmsgpack_read(fd, &dom_reader_callbacks, &s);
 
@@ -406,6 +475,40 @@ int rmsgpack_dom_read(int fd, struct rmsgpack_dom_value *out)
    return rv;
 }
 
+int rmsgpack_dom_read_mem(const void *buf, size_t size, size_t *read_size,
+      struct rmsgpack_dom_value *out)
+{
+   struct dom_reader_state s;
+   int rv = 0;
+
+   s.i        = 0;
+   s.stack[0] = out;
+   s.arena    = NULL;
+
+   rv = rmsgpack_read_mem(buf, size, read_size, &dom_reader_callbacks, &s);
+
+   if (rv < 0)
+      rmsgpack_dom_value_free(out);
+
+   return rv;
+}
+
+int rmsgpack_dom_read_view(const void *buf, size_t size, size_t *read_size,
+      void *arena, size_t arena_size, struct rmsgpack_dom_value *out)
+{
+   struct dom_reader_state s;
+
+   s.i          = 0;
+   s.stack[0]   = out;
+   s.arena      = (uint8_t*)arena;
+   s.arena_size = arena_size;
+   s.arena_used = 0;
+
+   /* Nothing to free on failure, it all lives in @buf and @arena. */
+   return rmsgpack_read_mem_borrowed(buf, size, read_size,
+         &dom_view_callbacks, &s);
+}
+
 int rmsgpack_dom_read_into(int fd, ...)
 {
    va_list ap;
@@ -2,6 +2,7 @@
 #define __RARCHDB_MSGPACK_DOM_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,6 +70,26 @@ int rmsgpack_dom_write(
         const struct rmsgpack_dom_value * obj
 );
 
+int rmsgpack_dom_read_mem(
+        const void * buf,
+        size_t size,
+        size_t * read_size,
+        struct rmsgpack_dom_value * out
+);
+
+/* Decodes the value at @buf without touching the heap: binaries 
+ * point into @buf, strings and containers are placed in @arena. 
+ * @out must not be freed, and is only valid as long as both @buf 
+ * and @arena are. Returns -ENOMEM if @arena is too small. */
+int rmsgpack_dom_read_view(
+        const void * buf,
+        size_t size,
+        size_t * read_size,
+        void * arena,
+        size_t arena_size,
+        struct rmsgpack_dom_value * out
+);
+
 int rmsgpack_dom_read_into(int fd, ...);
 
 #ifdef __cplusplus
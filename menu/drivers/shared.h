@@ -336,6 +336,8 @@ static INLINE void get_title(const char *label, const char *dir,
       snprintf(title, sizeof_title, "ASSETS DIR %s", dir);
    else if (!strcmp(label, "extraction_directory"))
       snprintf(title, sizeof_title, "EXTRACTION DIR %s", dir);
+   else if (!strcmp(label, "patch_cache_directory"))
+      snprintf(title, sizeof_title, "PATCH CACHE DIR %s", dir);
    else if (!strcmp(label, "joypad_autoconfig_dir"))
       snprintf(title, sizeof_title, "AUTOCONFIG DIR %s", dir);
    else
@@ -27,7 +27,7 @@ int menu_database_populate_query(file_list_t *list, const char *path,
    libretrodb_t db;
    libretrodb_cursor_t cur;
 
-   if ((libretrodb_open(path, &db)) != 0)
+   if ((libretrodb_open_mapped(path, &db)) != 0)
       return -1;
    if ((database_open_cursor(&db, &cur, query) != 0))
       return -1;
@@ -46,6 +46,7 @@ static void menu_database_playlist_free(menu_handle_t *menu)
    if (menu->db_playlist)
       content_playlist_free(menu->db_playlist);
    menu->db_playlist = NULL;
+   *menu->db_playlist_file = '\0';
 }
 
 void menu_database_free(void *data)
@@ -16,6 +16,7 @@
 
 #include "movie.h"
 #include "hash.h"
+#include "content.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -70,7 +71,7 @@ static bool init_playback(bsv_movie_t *handle, const char *path)
       return false;
    }
 
-   if (swap_if_big32(header[CRC_INDEX]) != g_extern.content_crc)
+   if (swap_if_big32(header[CRC_INDEX]) != content_get_crc())
       RARCH_WARN("CRC32 checksum mismatch between content file and saved content checksum in replay file header; replay highly likely to desync on playback.\n");
 
    state_size = swap_if_big32(header[STATE_SIZE_INDEX]);
@@ -116,7 +117,7 @@ static bool init_record(bsv_movie_t *handle, const char *path)
     * BSV1 in a HEX editor, big-endian. */
    header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
 
-   header[CRC_INDEX] = swap_if_big32(g_extern.content_crc);
+   header[CRC_INDEX] = swap_if_big32(content_get_crc());
 
    state_size = pretro_serialize_size();
 
@@ -98,6 +98,29 @@ bool socket_nonblock(int fd)
 #endif
 }
 
+bool socket_timeout(int fd, unsigned msec)
+{
+#if defined(__CELLOS_LV2__)
+   (void)fd;
+   (void)msec;
+   return false;
+#else
+#if defined(_WIN32)
+   DWORD tv = msec;
+#else
+   struct timeval tv;
+
+   tv.tv_sec  = msec / 1000;
+   tv.tv_usec = (msec % 1000) * 1000;
+#endif
+
+   return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+         (const char*)&tv, sizeof(tv)) == 0
+      && setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+         (const char*)&tv, sizeof(tv)) == 0;
+#endif
+}
+
 int socket_close(int fd)
 { 
 #if defined(_WIN32) && !defined(_XBOX360)
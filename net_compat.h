@@ -146,6 +146,18 @@ void freeaddrinfo_rarch(struct addrinfo *res);
 
 bool socket_nonblock(int fd);
 
+/**
+ * socket_timeout:
+ * @fd                   : socket
+ * @msec                 : timeout in milliseconds, 0 for none.
+ *
+ * Makes blocking sends and receives on @fd give up once they 
+ * have made no progress for @msec.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+bool socket_timeout(int fd, unsigned msec);
+
 int socket_close(int fd);
 
 int socket_select(int nfds, fd_set *readfs, fd_set *writefds,
@@ -24,31 +24,109 @@
 #include "runloop.h"
 #include "autosave.h"
 #include "dynamic.h"
+#include "rewind.h"
+#include "hash.h"
+#include "content.h"
+#include "performance.h"
 #include <queues/message_queue.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+
+#if defined(__linux__) && !defined(HAVE_EPOLL)
+#define HAVE_EPOLL
+#endif
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 struct delta_frame
 {
    void *state;
 
-   uint16_t real_input_state;
-   uint16_t simulated_input_state;
+   uint16_t simulated_input_state[MAX_USERS];
    uint16_t self_state;
 
-   bool is_simulated;
-   bool used_real;
+   /* Remote ports whose input was predicted rather than
+    * known the last time this frame was run. */
+   uint32_t simulated_mask;
 };
 
 #define UDP_FRAME_PACKETS 16
-#define MAX_SPECTATORS 16
+/* A packet is the sender's port, the session token of the client 
+ * it comes from or goes to, how much input the sender has from every
+ * port and the CRC of its newest final state, followed by up to 
+ * UDP_FRAME_PACKETS frames of input per port. */
+#define UDP_HEADER_SIZE (2 + MAX_USERS + 2)
+#define UDP_MAX_SIZE (UDP_HEADER_SIZE + UDP_FRAME_PACKETS * MAX_USERS * 2)
+#define MAX_SPECTATORS 512
+#ifdef HAVE_EPOLL
+#define MAX_POLLED_SPECTATORS MAX_SPECTATORS
+#else
+/* select() has to fit the listening socket and every spectator 
+ * in one fd_set. */
+#define MAX_POLLED_SPECTATORS (MAX_SPECTATORS < FD_SETSIZE - 1 \
+      ? MAX_SPECTATORS : FD_SETSIZE - 1)
+#endif
+/* Input recorded for spectators, shared by all of them.
+ * Spectators falling further behind than this are dropped. */
+#define SPECTATE_RING_SIZE (1 << 20)
+/* epoll user data of the listening socket, spectators use their index. */
+#define SPECTATE_LISTEN_ID ((uint32_t)-1)
+
+/* How far ahead of confirmed remote input we may run,
+ * i.e. the deepest rollback we are prepared to do. */
+#define MAX_ROLLBACK_FRAMES 120
+
+/* How long a joining user has to send its header, and how long 
+ * any send or receive of the join handshake may stall after that, 
+ * as the session waits on it. */
+#define JOIN_HEADER_TIMEOUT_USEC (5 * 1000000)
+#define JOIN_STALL_TIMEOUT_MSEC  2000
 
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
 
+struct spectator
+{
+   int fd;
+   struct sockaddr_storage addr;
+
+   /* Our nick and a savestate, sent before any input. */
+   uint8_t *header;
+   size_t header_size;
+   size_t header_ptr;
+
+   /* Position in the input ring sent up to. */
+   uint64_t input_ptr;
+   /* Socket buffer is full; wait until it becomes writable. */
+   bool blocked;
+
+   /* The spectator's nick, which it sends us as soon as it connects. */
+   uint8_t join[1 + 32];
+   size_t join_ptr;
+   bool joined;
+   char nick[32];
+};
+
+/* How many of our own state CRCs we keep to compare with peers. */
+#define NETPLAY_CRC_HISTORY 64
+#define NETPLAY_NO_CRC UINT32_MAX
+
+struct netplay_crc
+{
+   uint32_t frame;
+   uint32_t crc;
+};
+
 #define PREV_PTR(x) ((x) == 0 ? netplay->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % netplay->buffer_size)
+/* All pointers start at frame 0, so a frame always lives in the same slot. */
+#define FRAME_PTR(x) ((x) % netplay->buffer_size)
+#define REAL_INPUT(frame, port) \
+   netplay->real_input[((frame) % netplay->input_size) * MAX_USERS + (port)]
 
 struct netplay
 {
@@ -57,24 +135,34 @@ struct netplay
    struct sockaddr_storage other_addr;
 
    struct retro_callbacks cbs;
-   /* TCP connection for state sending, etc. Also used for commands */
+   /* TCP connection for state sending, etc. Also used for commands.
+    * On the host, this is the connection to user 2. */
    int fd;
+   /* TCP connection responsible for each port: the host for clients,
+    * every client for the host. -1 for ports we have no link to. */
+   int peer_fds[MAX_USERS];
    /* UDP connection for game state updates. */
    int udp_fd;
-   /* Which port is governed by netplay (other user)? */
-   unsigned port;
+   /* Which port do we control, and how many users are there? 
+    * The host is always port 0. */
+   unsigned self_port;
+   unsigned users;
    bool has_connection;
 
    struct delta_frame *buffer;
    size_t buffer_size;
+   /* Backing store for all buffer[].state, allocated once. */
+   uint8_t *states;
+   /* Real input per frame and port, our own included. A peer may be 
+    * a whole rollback window ahead of or behind what we have confirmed,
+    * and may need input resent from a further window back. */
+   uint16_t *real_input;
+   size_t input_size;
 
    /* Pointer where we are now. */
    size_t self_ptr; 
    /* Points to the last reliable state that self ever had. */
    size_t other_ptr;
-   /* Pointer to where we are reading. 
-    * Generally, other_ptr <= read_ptr <= self_ptr. */
-   size_t read_ptr;
    /* A temporary pointer used on replay. */
    size_t tmp_ptr;
 
@@ -85,26 +173,73 @@ struct netplay
    /* We don't want to poll several times on a frame. */
    bool can_poll;
 
-   /* To compat UDP packet loss we also send 
-    * old data along with the packets. */
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 2];
+   /* To compat UDP packet loss we keep sending input
+    * until the other side tells us it has it. */
+   uint32_t packet_buffer[UDP_MAX_SIZE];
+   /* How many frames of each port's input each peer has told us it has. */
+   uint32_t peer_read_count[MAX_USERS][MAX_USERS];
    uint32_t frame_count;
-   uint32_t read_frame_count;
+   /* How many frames of real input we have per port.
+    * Generally, other_frame_count <= read_frame_count. */
+   uint32_t read_frame_count[MAX_USERS];
    uint32_t other_frame_count;
    uint32_t tmp_frame_count;
    struct addrinfo *addr;
-   struct sockaddr_storage their_addr;
-   bool has_client_addr;
+   /* Where the host sends each client's input. */
+   struct sockaddr_storage peer_addr[MAX_USERS];
+   socklen_t peer_addr_size[MAX_USERS];
+   /* Handed to each client over TCP, and carried by every UDP 
+    * packet to or from it, so nobody else can pose as the client 
+    * and have its input sent elsewhere. Clients only know theirs. */
+   uint32_t tokens[MAX_USERS];
 
    unsigned timeout_cnt;
 
+   struct netplay_stats stats;
+   /* When we sent our input for each frame. */
+   retro_time_t *frame_time;
+   /* CRCs of our states that can no longer be rolled back, by frame.
+    * Only every check_frames'th frame is hashed, if any. 
+    * The newest is sent along with our input. */
+   unsigned check_frames;
+   struct netplay_crc crcs[NETPLAY_CRC_HISTORY];
+   struct netplay_crc self_crc;
+   /* Newest state CRC from each peer, compared once we have ours. */
+   struct netplay_crc peer_crc[MAX_USERS];
+   bool peer_crc_pending[MAX_USERS];
+   /* The last comparison failed; warn again only once back in sync. */
+   bool desynced;
+
    /* Spectating. */
    bool spectate;
    bool spectate_client;
-   int spectate_fds[MAX_SPECTATORS];
-   uint16_t *spectate_input;
-   size_t spectate_input_ptr;
-   size_t spectate_input_size;
+   struct spectator *spectators;
+   /* Every spectator is sent from this one ring at its own pace. */
+   uint8_t *spectate_input;
+   uint64_t spectate_input_ptr;
+#ifdef HAVE_EPOLL
+   int spectate_epoll_fd;
+#endif
+
+   /* Joining mid-session.
+    * The host keeps listening after everyone is in. Ports whose 
+    * client has left are played with no input until somebody else 
+    * takes them over. The joiner is sent the state of the newest 
+    * confirmed frame, as a delta against the state the content 
+    * loaded with, which it should have as well. */
+   int listen_fd;
+   /* A user that has connected to join, but not sent its header 
+    * yet, and the time at which we give up on it. */
+   int join_fd;
+   retro_time_t join_deadline;
+   uint32_t vacant_mask;
+   state_manager_t *join_delta;
+   uint8_t *join_baseline;
+   uint32_t join_baseline_crc;
+   /* Client: the frame we start running at, and the first frame 
+    * the host has not already filled in for our port. */
+   uint32_t join_frame;
+   uint32_t join_input_frame;
 
    /* User flipping
     * Flipping state. If ptr >= flip_frame, we apply the flip.
@@ -150,27 +285,141 @@ static bool netplay_can_poll(netplay_t *netplay)
    return netplay->can_poll;
 }
 
+static bool netplay_is_remote(netplay_t *netplay, unsigned port)
+{
+   return port < netplay->users && port != netplay->self_port;
+}
+
+/**
+ * confirmed_frame_count:
+ * @netplay              : pointer to netplay object
+ *
+ * Returns: number of frames for which we have real input
+ * from every remote port.
+ **/
+static uint32_t confirmed_frame_count(netplay_t *netplay)
+{
+   unsigned i;
+   uint32_t count = UINT32_MAX;
+
+   for (i = 0; i < netplay->users; i++)
+   {
+      if (netplay_is_remote(netplay, i) && netplay->read_frame_count[i] < count)
+         count = netplay->read_frame_count[i];
+   }
+
+   return count;
+}
+
+/**
+ * send_chunk_to:
+ * @netplay              : pointer to netplay object
+ * @peer                 : port of the receiver
+ * @addr                 : destination address
+ * @addr_size            : size of @addr
+ *
+ * Batches all input @peer has not acknowledged yet into a
+ * single packet, oldest first. Clients only send their own 
+ * input, the host sends everyone's.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool send_chunk_to(netplay_t *netplay, unsigned peer,
+      const struct sockaddr *addr, socklen_t addr_size)
+{
+   unsigned i;
+   size_t size = 0;
+
+   netplay->packet_buffer[size++] = htonl(netplay->self_port);
+   netplay->packet_buffer[size++] = htonl(
+         netplay->tokens[netplay->addr ? netplay->self_port : peer]);
+   for (i = 0; i < MAX_USERS; i++)
+      netplay->packet_buffer[size++] = htonl(netplay->read_frame_count[i]);
+   netplay->packet_buffer[size++] = htonl(netplay->self_crc.frame);
+   netplay->packet_buffer[size++] = htonl(netplay->self_crc.crc);
+
+   for (i = 0; i < netplay->users; i++)
+   {
+      uint32_t frame, from, to;
+
+      if (i == peer || (netplay->addr && i != netplay->self_port))
+         continue;
+
+      from = netplay->peer_read_count[peer][i];
+      to   = i == netplay->self_port ?
+         netplay->frame_count + 1 : netplay->read_frame_count[i];
+
+      /* Stale acknowledgement, it has moved on since. */
+      if (to > netplay->input_size && from < to - netplay->input_size)
+         from = to - netplay->input_size;
+      if (to > from + UDP_FRAME_PACKETS)
+         to = from + UDP_FRAME_PACKETS;
+
+      for (frame = from; frame < to; frame++)
+      {
+         netplay->packet_buffer[size++] = htonl(frame);
+         netplay->packet_buffer[size++] = htonl((i << 16) |
+               REAL_INPUT(frame, i));
+      }
+   }
+
+   size *= sizeof(uint32_t);
+   return sendto(netplay->udp_fd, (const char*)netplay->packet_buffer,
+         size, 0, addr, addr_size) == (ssize_t)size;
+}
+
 static bool send_chunk(netplay_t *netplay)
 {
-   const struct sockaddr *addr = NULL;
+   unsigned i;
 
    if (netplay->addr)
-      addr = netplay->addr->ai_addr;
-   else if (netplay->has_client_addr)
-      addr = (const struct sockaddr*)&netplay->their_addr;
-
-   if (addr)
    {
-      if (sendto(netplay->udp_fd, (const char*)netplay->packet_buffer,
-               sizeof(netplay->packet_buffer), 0, addr,
-               sizeof(struct sockaddr)) != sizeof(netplay->packet_buffer))
+      if (send_chunk_to(netplay, 0, netplay->addr->ai_addr,
+               netplay->addr->ai_addrlen))
+         return true;
+   }
+   else
+   {
+      for (i = 1; i < netplay->users; i++)
       {
-         warn_hangup();
-         netplay->has_connection = false;
-         return false;
+         if (!netplay->peer_addr_size[i])
+            continue;
+
+         if (!send_chunk_to(netplay, i,
+                  (const struct sockaddr*)&netplay->peer_addr[i],
+                  netplay->peer_addr_size[i]))
+            break;
       }
+
+      if (i == netplay->users)
+         return true;
+   }
+
+   warn_hangup();
+   netplay->has_connection = false;
+   return false;
+}
+
+/**
+ * fill_vacant_input:
+ * @netplay              : pointer to netplay object
+ *
+ * Host only. Nobody plays on vacant ports until someone joins; 
+ * they get zero input up to the frame we are running, like we 
+ * give ourselves on the first frame.
+ **/
+static void fill_vacant_input(netplay_t *netplay)
+{
+   unsigned i;
+
+   for (i = 1; i < netplay->users; i++)
+   {
+      if (!(netplay->vacant_mask & (1 << i)))
+         continue;
+
+      while (netplay->read_frame_count[i] <= netplay->frame_count)
+         REAL_INPUT(netplay->read_frame_count[i]++, i) = 0;
    }
-   return true;
 }
 
 /**
@@ -187,47 +436,46 @@ static bool get_self_input_state(netplay_t *netplay)
    struct delta_frame *ptr = &netplay->buffer[netplay->self_ptr];
    uint32_t state = 0;
 
-   if (!driver.block_libretro_input && netplay->frame_count > 0)
+   if (!driver.block_libretro_input && netplay->frame_count > 0 &&
+         netplay->frame_count >= netplay->join_input_frame)
    {
       /* First frame we always give zero input since relying on 
-       * input from first frame screws up when we use -F 0. */
+       * input from first frame screws up when we use -F 0. 
+       * When joining late, the host already gave us zero input 
+       * for the frames before we were in. */
       retro_input_state_t cb = netplay->cbs.state_cb;
       for (i = 0; i < RARCH_FIRST_META_KEY; i++)
       {
          int16_t tmp = cb(g_settings.input.netplay_client_swap_input ?
-               0 : !netplay->port,
+               0 : netplay->self_port,
                RETRO_DEVICE_JOYPAD, 0, i);
          state |= tmp ? 1 << i : 0;
       }
    }
 
-   memmove(netplay->packet_buffer, netplay->packet_buffer + 2,
-         sizeof (netplay->packet_buffer) - 2 * sizeof(uint32_t));
-   netplay->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(netplay->frame_count); 
-   netplay->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+   REAL_INPUT(netplay->frame_count, netplay->self_port) = state;
+   netplay->frame_time[netplay->frame_count % netplay->input_size] =
+      rarch_get_time_usec();
+   fill_vacant_input(netplay);
 
    if (!send_chunk(netplay))
-   {
-      warn_hangup();
-      netplay->has_connection = false;
       return false;
-   }
 
    ptr->self_state = state;
    netplay->self_ptr = NEXT_PTR(netplay->self_ptr);
    return true;
 }
 
-static bool netplay_cmd_ack(netplay_t *netplay)
+static bool netplay_cmd_ack(int fd)
 {
    uint32_t cmd = htonl(NETPLAY_CMD_ACK);
-   return socket_send_all_blocking(netplay->fd, &cmd, sizeof(cmd));
+   return socket_send_all_blocking(fd, &cmd, sizeof(cmd));
 }
 
-static bool netplay_cmd_nak(netplay_t *netplay)
+static bool netplay_cmd_nak(int fd)
 {
    uint32_t cmd = htonl(NETPLAY_CMD_NAK);
-   return socket_send_all_blocking(netplay->fd, &cmd, sizeof(cmd));
+   return socket_send_all_blocking(fd, &cmd, sizeof(cmd));
 }
 
 static bool netplay_get_response(netplay_t *netplay)
@@ -239,12 +487,12 @@ static bool netplay_get_response(netplay_t *netplay)
    return ntohl(response) == NETPLAY_CMD_ACK;
 }
 
-static bool netplay_get_cmd(netplay_t *netplay)
+static bool netplay_get_cmd(netplay_t *netplay, int fd)
 {
    uint32_t cmd, flip_frame;
    size_t cmd_size;
 
-   if (!socket_receive_all_blocking(netplay->fd, &cmd, sizeof(cmd)))
+   if (!socket_receive_all_blocking(fd, &cmd, sizeof(cmd)))
       return false;
 
    cmd = ntohl(cmd);
@@ -258,13 +506,13 @@ static bool netplay_get_cmd(netplay_t *netplay)
          if (cmd_size != sizeof(uint32_t))
          {
             RARCH_ERR("CMD_FLIP_PLAYERS has unexpected command size.\n");
-            return netplay_cmd_nak(netplay);
+            return netplay_cmd_nak(fd);
          }
 
-         if (!socket_receive_all_blocking(netplay->fd, &flip_frame, sizeof(flip_frame)))
+         if (!socket_receive_all_blocking(fd, &flip_frame, sizeof(flip_frame)))
          {
             RARCH_ERR("Failed to receive CMD_FLIP_PLAYERS argument.\n");
-            return netplay_cmd_nak(netplay);
+            return netplay_cmd_nak(fd);
          }
 
          flip_frame = ntohl(flip_frame);
@@ -272,7 +520,7 @@ static bool netplay_get_cmd(netplay_t *netplay)
          if (flip_frame < netplay->flip_frame)
          {
             RARCH_ERR("Host asked us to flip users in the past. Not possible ...\n");
-            return netplay_cmd_nak(netplay);
+            return netplay_cmd_nak(fd);
          }
 
          netplay->flip ^= true;
@@ -281,14 +529,42 @@ static bool netplay_get_cmd(netplay_t *netplay)
          RARCH_LOG("Netplay users are flipped.\n");
          rarch_main_msg_queue_push("Netplay users are flipped.", 1, 180, false);
 
-         return netplay_cmd_ack(netplay);
+         return netplay_cmd_ack(fd);
 
       default:
          break;
    }
 
    RARCH_ERR("Unknown netplay command received.\n");
-   return netplay_cmd_nak(netplay);
+   return netplay_cmd_nak(fd);
+}
+
+/**
+ * drop_client:
+ * @netplay              : pointer to netplay object
+ * @port                 : port of the client
+ *
+ * Host only. Lets the session go on without a client that hung up.
+ * Its port is left vacant for somebody else to join on.
+ **/
+static void drop_client(netplay_t *netplay, unsigned port)
+{
+   char msg[512];
+
+   if (netplay->fd == netplay->peer_fds[port])
+      netplay->fd = -1;
+   socket_close(netplay->peer_fds[port]);
+
+   netplay->peer_fds[port]         = -1;
+   netplay->peer_addr_size[port]   = 0;
+   netplay->tokens[port]           = 0;
+   netplay->peer_crc_pending[port] = false;
+   netplay->vacant_mask           |= 1 << port;
+   fill_vacant_input(netplay);
+
+   snprintf(msg, sizeof(msg), "User %u has left.", port + 1);
+   RARCH_WARN("%s\n", msg);
+   rarch_main_msg_queue_push(msg, 1, 180, false);
 }
 
 #define MAX_RETRIES 16
@@ -296,12 +572,19 @@ static bool netplay_get_cmd(netplay_t *netplay)
 
 static int poll_input(netplay_t *netplay, bool block)
 {
-   int max_fd = (netplay->fd > netplay->udp_fd ? netplay->fd : netplay->udp_fd) + 1;
+   unsigned i;
+   int max_fd = netplay->udp_fd;
 
    struct timeval tv = {0};
    tv.tv_sec = 0;
    tv.tv_usec = block ? (RETRY_MS * 1000) : 0;
 
+   for (i = 0; i < netplay->users; i++)
+   {
+      if (netplay->peer_fds[i] > max_fd)
+         max_fd = netplay->peer_fds[i];
+   }
+
    do
    { 
       fd_set fds;
@@ -310,19 +593,36 @@ static int poll_input(netplay_t *netplay, bool block)
        * we go paranoia mode. */
       struct timeval tmp_tv = tv;
 
-      netplay->timeout_cnt++;
+      /* Only time spent waiting counts towards a timeout. */
+      if (block)
+         netplay->timeout_cnt++;
 
       FD_ZERO(&fds);
       FD_SET(netplay->udp_fd, &fds);
-      FD_SET(netplay->fd, &fds);
+      for (i = 0; i < netplay->users; i++)
+      {
+         if (netplay->peer_fds[i] >= 0)
+            FD_SET(netplay->peer_fds[i], &fds);
+      }
 
-      if (socket_select(max_fd, &fds, NULL, NULL, &tmp_tv) < 0)
+      if (socket_select(max_fd + 1, &fds, NULL, NULL, &tmp_tv) < 0)
          return -1;
 
       /* Somewhat hacky,
        * but we aren't using the TCP connection for anything useful atm. */
-      if (FD_ISSET(netplay->fd, &fds) && !netplay_get_cmd(netplay))
-         return -1; 
+      for (i = 0; i < netplay->users; i++)
+      {
+         if (netplay->peer_fds[i] < 0 || !FD_ISSET(netplay->peer_fds[i], &fds)
+               || netplay_get_cmd(netplay, netplay->peer_fds[i]))
+            continue;
+
+         if (netplay->addr)
+            return -1;
+
+         /* We may have been waiting on its input. */
+         drop_client(netplay, i);
+         return 0;
+      }
 
       if (FD_ISSET(netplay->udp_fd, &fds))
          return 1;
@@ -331,11 +631,7 @@ static int poll_input(netplay_t *netplay, bool block)
          continue;
 
       if (!send_chunk(netplay))
-      {
-         warn_hangup();
-         netplay->has_connection = false;
          return -1;
-      }
 
       RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
             netplay->timeout_cnt, MAX_RETRIES);
@@ -346,50 +642,304 @@ static int poll_input(netplay_t *netplay, bool block)
    return 0;
 }
 
-static bool receive_data(netplay_t *netplay, uint32_t *buffer, size_t size)
+/**
+ * stats_sample:
+ * @avg                  : running average
+ * @max                  : worst case
+ * @sample               : new sample
+ *
+ * Adds a sample to a running average, weighing in recent ones most.
+ **/
+static void stats_sample(retro_time_t *avg, retro_time_t *max,
+      retro_time_t sample)
 {
-   socklen_t addrlen = sizeof(netplay->their_addr);
+   *avg += (sample - *avg) / 16;
+   if (sample > *max)
+      *max = sample;
+}
 
-   if (recvfrom(netplay->udp_fd, (char*)buffer, size, 0,
-            (struct sockaddr*)&netplay->their_addr, &addrlen) != (ssize_t)size)
-      return false;
-   netplay->has_client_addr = true;
-   return true;
+/* Figures other than time spent in code, for the performance log. */
+static struct retro_perf_counter netplay_rtt_usec = {"netplay_rtt_usec"};
+static struct retro_perf_counter netplay_rollback_frames = {"netplay_rollback_frames"};
+static struct retro_perf_counter netplay_stall_usec = {"netplay_stall_usec"};
+
+/**
+ * perf_add:
+ * @perf                 : performance counter
+ * @value                : new sample
+ *
+ * Adds a sample to a counter that does not measure time 
+ * spent between start and stop.
+ **/
+static void perf_add(struct retro_perf_counter *perf, retro_perf_tick_t value)
+{
+   if (!g_extern.perfcnt_enable)
+      return;
+
+   if (!perf->registered)
+      rarch_perf_register(perf);
+   perf->call_cnt++;
+   perf->total += value;
+}
+
+/**
+ * compare_crc:
+ * @netplay              : pointer to netplay object
+ * @peer                 : port of the peer
+ *
+ * Compares the newest state CRC @peer sent with ours for the 
+ * same frame, if we have got that far.
+ **/
+static void compare_crc(netplay_t *netplay, unsigned peer)
+{
+   const struct netplay_crc *theirs = &netplay->peer_crc[peer];
+   const struct netplay_crc *ours   =
+      &netplay->crcs[theirs->frame % NETPLAY_CRC_HISTORY];
+
+   if (ours->frame != theirs->frame)
+   {
+      /* Keep it until we get there, unless we are already past it. */
+      if (ours->frame != NETPLAY_NO_CRC && ours->frame > theirs->frame)
+         netplay->peer_crc_pending[peer] = false;
+      return;
+   }
+
+   netplay->peer_crc_pending[peer] = false;
+   netplay->stats.crc_checks++;
+
+   if (ours->crc == theirs->crc)
+   {
+      netplay->desynced = false;
+      return;
+   }
+
+   netplay->stats.desyncs++;
+   netplay->stats.last_desync_frame = theirs->frame;
+
+   if (netplay->desynced)
+      return;
+   netplay->desynced = true;
+
+   RARCH_WARN("Netplay desync with user %u at frame %u.\n",
+         peer + 1, theirs->frame);
+   rarch_main_msg_queue_push("Netplay has desynced.", 1, 180, false);
+}
+
+/**
+ * check_frame:
+ * @netplay              : pointer to netplay object
+ * @frame                : frame number
+ *
+ * Returns: true (1) if the state of @frame is compared with peers.
+ **/
+static bool check_frame(netplay_t *netplay, uint32_t frame)
+{
+   return netplay->check_frames && frame % netplay->check_frames == 0;
 }
 
-static void parse_packet(netplay_t *netplay, uint32_t *buffer, unsigned size)
+/**
+ * crc_state:
+ * @netplay              : pointer to netplay object
+ * @frame                : frame @state is the start of
+ * @state                : savestate that can no longer be rolled back
+ *
+ * Records the CRC of a final state, to be compared with what 
+ * our peers have for the same frame.
+ **/
+static void crc_state(netplay_t *netplay, uint32_t frame, const void *state)
 {
    unsigned i;
+   struct netplay_crc *crc = &netplay->crcs[frame % NETPLAY_CRC_HISTORY];
+
+   if (crc->frame == frame)
+      return;
+
+   RARCH_PERFORMANCE_INIT(netplay_state_crc);
+   RARCH_PERFORMANCE_START(netplay_state_crc);
+   crc->frame = frame;
+   crc->crc   = crc32_calculate((const uint8_t*)state, netplay->state_size);
+   RARCH_PERFORMANCE_STOP(netplay_state_crc);
 
-   for (i = 0; i < size * 2; i++)
+   netplay->self_crc = *crc;
+
+   for (i = 0; i < netplay->users; i++)
+   {
+      if (netplay->peer_crc_pending[i])
+         compare_crc(netplay, i);
+   }
+}
+
+/**
+ * parse_packet:
+ * @netplay              : pointer to netplay object
+ * @buffer               : received packet
+ * @size                 : size of @buffer in 32-bit words
+ * @addr                 : address the packet came from
+ * @addr_size            : size of @addr
+ *
+ * Stores any input we were waiting for. Input may arrive for 
+ * frames we have not run yet.
+ *
+ * Returns: true (1) if any new input was stored, otherwise false (0).
+ **/
+static bool parse_packet(netplay_t *netplay, uint32_t *buffer, size_t size,
+      const struct sockaddr_storage *addr, socklen_t addr_size)
+{
+   size_t i;
+   unsigned peer;
+   uint32_t ack, crc_frame;
+   bool got_input = false;
+   retro_time_t now = rarch_get_time_usec();
+   /* Anything further ahead than this would overwrite input we still
+    * need; the peer will resend it once we are ready for it. */
+   uint32_t max_frame = netplay->other_frame_count + 2 * netplay->buffer_size;
+
+   for (i = 0; i < size; i++)
       buffer[i] = ntohl(buffer[i]);
 
-   for (i = 0; i < size && netplay->read_frame_count <= netplay->frame_count; i++)
+   /* Clients only hear from the host, the host from its clients. */
+   peer = buffer[0];
+   if (!netplay_is_remote(netplay, peer) || (netplay->addr && peer != 0))
+      return false;
+
+   if (buffer[1] != netplay->tokens[netplay->addr ? netplay->self_port : peer]
+         || (netplay->vacant_mask & (1 << peer)))
+      return false;
+
+   /* Only the client itself knows its token, so it may have moved,
+    * e.g. behind a NAT that picked a new port. */
+   if (!netplay->addr && (netplay->peer_addr_size[peer] != addr_size ||
+            memcmp(&netplay->peer_addr[peer], addr, addr_size)))
+   {
+      memcpy(&netplay->peer_addr[peer], addr, addr_size);
+      netplay->peer_addr_size[peer] = addr_size;
+   }
+
+   /* The peer has our input up to here; we sent the last of it
+    * one round trip ago. */
+   ack = buffer[2 + netplay->self_port];
+   if (ack > netplay->peer_read_count[peer][netplay->self_port] &&
+         ack <= netplay->frame_count + 1 &&
+         ack + netplay->input_size > netplay->frame_count + 1)
+   {
+      retro_time_t rtt = now -
+         netplay->frame_time[(ack - 1) % netplay->input_size];
+
+      stats_sample(&netplay->stats.rtt_usec, &netplay->stats.rtt_max_usec,
+            rtt);
+      perf_add(&netplay_rtt_usec, rtt);
+   }
+
+   crc_frame = buffer[2 + MAX_USERS];
+   if (crc_frame != NETPLAY_NO_CRC && crc_frame > netplay->peer_crc[peer].frame)
+   {
+      netplay->peer_crc[peer].frame  = crc_frame;
+      netplay->peer_crc[peer].crc    = buffer[3 + MAX_USERS];
+      netplay->peer_crc_pending[peer] = true;
+      compare_crc(netplay, peer);
+   }
+
+   for (i = 0; i < MAX_USERS; i++)
+   {
+      if (buffer[2 + i] > netplay->peer_read_count[peer][i])
+         netplay->peer_read_count[peer][i] = buffer[2 + i];
+   }
+
+   for (i = UDP_HEADER_SIZE; i + 1 < size; i += 2)
    {
-      uint32_t frame = buffer[2 * i + 0];
-      uint32_t state = buffer[2 * i + 1];
+      uint32_t frame = buffer[i + 0];
+      unsigned port  = buffer[i + 1] >> 16;
+      uint16_t state = buffer[i + 1] & 0xffff;
 
-      if (frame != netplay->read_frame_count)
+      if (!netplay_is_remote(netplay, port))
          continue;
 
-      netplay->buffer[netplay->read_ptr].is_simulated = false;
-      netplay->buffer[netplay->read_ptr].real_input_state = state;
-      netplay->read_ptr = NEXT_PTR(netplay->read_ptr);
-      netplay->read_frame_count++;
+      if (frame != netplay->read_frame_count[port] || frame >= max_frame)
+         continue;
+
+      REAL_INPUT(frame, port) = state;
+      netplay->read_frame_count[port]++;
       netplay->timeout_cnt = 0;
+      got_input = true;
+
+      /* Input for a frame we have already run with a prediction 
+       * arrived this much too late. */
+      stats_sample(&netplay->stats.input_latency_usec,
+            &netplay->stats.input_latency_max_usec,
+            frame > netplay->frame_count ? 0 :
+            now - netplay->frame_time[frame % netplay->input_size]);
    }
+
+   return got_input;
 }
 
-/* TODO: Somewhat better prediction. :P */
-static void simulate_input(netplay_t *netplay)
+/**
+ * receive_data:
+ * @netplay              : pointer to netplay object
+ * @got_input            : set to true if new input was stored
+ *
+ * Reads one pending packet from the UDP socket.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool receive_data(netplay_t *netplay, bool *got_input)
+{
+   uint32_t buffer[UDP_MAX_SIZE];
+   struct sockaddr_storage addr;
+   socklen_t addr_size = sizeof(addr);
+   ssize_t size = recvfrom(netplay->udp_fd, (char*)buffer, sizeof(buffer), 0,
+         (struct sockaddr*)&addr, &addr_size);
+
+   if (size < (ssize_t)(UDP_HEADER_SIZE * sizeof(uint32_t)) ||
+         (size % sizeof(uint32_t)) != 0)
+      return false;
+
+   if (parse_packet(netplay, buffer, size / sizeof(uint32_t),
+            &addr, addr_size))
+      *got_input = true;
+   return true;
+}
+
+/**
+ * predict_input:
+ * @netplay              : pointer to netplay object
+ * @port                 : remote port
+ *
+ * Remote input we don't have yet is predicted to be
+ * the last input we did receive; buttons tend to be held
+ * for many frames.
+ *
+ * Returns: predicted remote input state.
+ **/
+static uint16_t predict_input(netplay_t *netplay, unsigned port)
+{
+   return REAL_INPUT(netplay->read_frame_count[port] - 1, port);
+}
+
+/**
+ * simulate_input:
+ * @netplay              : pointer to netplay object
+ * @ptr                  : buffer slot of the frame about to be run
+ * @frame                : frame about to be run
+ *
+ * Predicts input for every remote port we have not heard
+ * from yet for @frame.
+ **/
+static void simulate_input(netplay_t *netplay, size_t ptr, uint32_t frame)
 {
-   size_t ptr  = PREV_PTR(netplay->self_ptr);
-   size_t prev = PREV_PTR(netplay->read_ptr);
+   unsigned i;
+   struct delta_frame *delta = &netplay->buffer[ptr];
+
+   delta->simulated_mask = 0;
+
+   for (i = 0; i < netplay->users; i++)
+   {
+      if (!netplay_is_remote(netplay, i) || frame < netplay->read_frame_count[i])
+         continue;
 
-   netplay->buffer[ptr].simulated_input_state = 
-      netplay->buffer[prev].real_input_state;
-   netplay->buffer[ptr].is_simulated = true;
-   netplay->buffer[ptr].used_real = false;
+      delta->simulated_input_state[i] = predict_input(netplay, i);
+      delta->simulated_mask |= 1 << i;
+   }
 }
 
 /**
@@ -404,7 +954,10 @@ static void simulate_input(netplay_t *netplay)
  **/
 static bool netplay_poll(netplay_t *netplay)
 {
-   int res;
+   unsigned i;
+   uint32_t first_read;
+   retro_time_t stall_start = 0;
+   bool block, relay = false;
 
    if (!netplay->has_connection)
       return false;
@@ -418,57 +971,79 @@ static bool netplay_poll(netplay_t *netplay)
     * our host info so we don't block forever :') */
    if (netplay->frame_count == 0)
    {
-      netplay->buffer[0].used_real = true;
-      netplay->buffer[0].is_simulated = false;
-      netplay->buffer[0].real_input_state = 0;
-      netplay->read_ptr = NEXT_PTR(netplay->read_ptr);
-      netplay->read_frame_count++;
+      for (i = 0; i < netplay->users; i++)
+      {
+         REAL_INPUT(0, i) = 0;
+         netplay->read_frame_count[i] = 1;
+      }
+      netplay->buffer[0].simulated_mask = 0;
       return true;
    }
 
    /* We might have reached the end of the buffer, where we 
     * simply have to block. */
-   res = poll_input(netplay, netplay->other_ptr == netplay->self_ptr);
-   if (res == -1)
-   {
-      netplay->has_connection = false;
-      warn_hangup();
-      return false;
-   }
+   first_read = confirmed_frame_count(netplay);
+   block      = netplay->other_ptr == netplay->self_ptr;
+   if (block)
+      stall_start = rarch_get_time_usec();
 
-   if (res == 1)
+   for (;;)
    {
-      uint32_t first_read = netplay->read_frame_count;
-      do 
+      int res = poll_input(netplay, block);
+
+      if (res == -1)
       {
-         uint32_t buffer[UDP_FRAME_PACKETS * 2];
-         if (!receive_data(netplay, buffer, sizeof(buffer)))
-         {
-            warn_hangup();
-            netplay->has_connection = false;
-            return false;
-         }
-         parse_packet(netplay, buffer, UDP_FRAME_PACKETS);
+         netplay->has_connection = false;
+         warn_hangup();
+         return false;
+      }
 
-      } while ((netplay->read_frame_count <= netplay->frame_count) && 
-            poll_input(netplay, (netplay->other_ptr == netplay->self_ptr) && 
-               (first_read == netplay->read_frame_count)) == 1);
-   }
-   else
-   {
-      /* Cannot allow this. Should not happen though. */
-      if (netplay->self_ptr == netplay->other_ptr)
+      if (res == 0)
+      {
+         if (!block)
+            break;
+
+         /* A client has left; its input no longer holds us up. */
+         block = (netplay->other_ptr == netplay->self_ptr) &&
+            (first_read == confirmed_frame_count(netplay));
+         if (!block)
+            break;
+         continue;
+      }
+
+      if (!receive_data(netplay, &relay))
       {
          warn_hangup();
+         netplay->has_connection = false;
          return false;
       }
+
+      block = (netplay->other_ptr == netplay->self_ptr) &&
+         (first_read == confirmed_frame_count(netplay));
+
+      /* A client may be stalled on input only we can relay to it. */
+      if (relay && block && !netplay->addr)
+      {
+         if (!send_chunk(netplay))
+            return false;
+         relay = false;
+      }
    }
 
-   if (netplay->read_ptr != netplay->self_ptr)
-      simulate_input(netplay);
-   else
-      netplay->buffer[PREV_PTR(netplay->self_ptr)].used_real = true;
+   if (stall_start)
+   {
+      retro_time_t stall = rarch_get_time_usec() - stall_start;
+
+      netplay->stats.stalls++;
+      netplay->stats.stall_usec += stall;
+      perf_add(&netplay_stall_usec, stall);
+   }
+
+   /* Pass on whatever the clients sent us in one go. */
+   if (relay && !netplay->addr && !send_chunk(netplay))
+      return false;
 
+   simulate_input(netplay, PREV_PTR(netplay->self_ptr), netplay->frame_count);
    return true;
 }
 
@@ -517,11 +1092,12 @@ static bool netplay_is_alive(netplay_t *netplay)
    return netplay->has_connection;
 }
 
-static bool netplay_flip_port(netplay_t *netplay, bool port)
+static unsigned netplay_flip_port(netplay_t *netplay, unsigned port)
 {
    size_t frame = netplay->frame_count;
 
-   if (netplay->flip_frame == 0)
+   /* Flipping only exists for two users. */
+   if (netplay->flip_frame == 0 || port > 1)
       return port;
 
    if (netplay->is_replay)
@@ -530,19 +1106,28 @@ static bool netplay_flip_port(netplay_t *netplay, bool port)
    return port ^ netplay->flip ^ (frame < netplay->flip_frame);
 }
 
-static int16_t netplay_input_state(netplay_t *netplay, bool port, unsigned device,
-      unsigned idx, unsigned id)
+static int16_t netplay_input_state(netplay_t *netplay, unsigned port,
+      unsigned device, unsigned idx, unsigned id)
 {
    size_t ptr = netplay->is_replay ? 
       netplay->tmp_ptr : PREV_PTR(netplay->self_ptr);
-   uint16_t curr_input_state = netplay->buffer[ptr].self_state;
+   uint32_t frame = netplay->is_replay ?
+      netplay->tmp_frame_count : netplay->frame_count;
+   const struct delta_frame *delta = &netplay->buffer[ptr];
+   uint16_t curr_input_state = delta->self_state;
+
+   port = netplay_flip_port(netplay, port);
+
+   /* Nobody is playing on this port. */
+   if (port >= netplay->users)
+      return 0;
 
-   if (netplay->port == (netplay_flip_port(netplay, port) ? 1 : 0))
+   if (port != netplay->self_port)
    {
-      if (netplay->buffer[ptr].is_simulated)
-         curr_input_state = netplay->buffer[ptr].simulated_input_state;
+      if (delta->simulated_mask & (1 << port))
+         curr_input_state = delta->simulated_input_state[port];
       else
-         curr_input_state = netplay->buffer[ptr].real_input_state;
+         curr_input_state = REAL_INPUT(frame, port);
    }
 
    return ((1 << id) & curr_input_state) ? 1 : 0;
@@ -613,8 +1198,7 @@ static void log_connection(const struct sockaddr_storage *their_addr,
 #endif
 
 static int init_tcp_connection(const struct addrinfo *res,
-      bool server, bool spectate,
-      struct sockaddr *other_addr, socklen_t addr_size)
+      bool server, bool spectate)
 {
    bool ret = true;
    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -639,24 +1223,11 @@ static int init_tcp_connection(const struct addrinfo *res,
       setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(int));
 
       if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
-            listen(fd, spectate ? MAX_SPECTATORS : 1) < 0)
+            listen(fd, spectate ? MAX_SPECTATORS : MAX_USERS) < 0)
       {
          ret = false;
          goto end;
       }
-
-      if (!spectate)
-      {
-         int new_fd = accept(fd, other_addr, &addr_size);
-         if (new_fd < 0)
-         {
-            ret = false;
-            goto end;
-         }
-
-         socket_close(fd);
-         fd = new_fd;
-      }
    }
 
 end:
@@ -703,9 +1274,8 @@ static bool init_tcp_socket(netplay_t *netplay, const char *server,
    while (tmp_info)
    {
       int fd;
-      if ((fd = init_tcp_connection(tmp_info, server, netplay->spectate,
-               (struct sockaddr*)&netplay->other_addr,
-               sizeof(netplay->other_addr))) >= 0)
+      if ((fd = init_tcp_connection(tmp_info, server,
+               netplay->spectate)) >= 0)
       {
          ret = true;
          netplay->fd = fd;
@@ -874,24 +1444,131 @@ static bool get_nickname(netplay_t *netplay, int fd)
    return true;
 }
 
+/**
+ * receive_join_state:
+ * @netplay              : pointer to netplay object
+ * @state                : the state we loaded the content with
+ * @crc                  : CRC of @state
+ *
+ * Receives the host's state when joining a session that is already 
+ * running, and loads it. It comes as a delta against the state the 
+ * host loaded the content with, or against nothing if that state 
+ * is not the same as ours.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool receive_join_state(netplay_t *netplay, uint8_t *state,
+      uint32_t crc)
+{
+   uint32_t sync_crc, byte_order, delta_header[2];
+   size_t stored_size;
+   size_t save_state_size   = pretro_serialize_size();
+   uint8_t *delta           = NULL;
+   state_manager_t *decoder = NULL;
+   bool ret                 = false;
+
+   if (!socket_receive_all_blocking(netplay->fd, &sync_crc, sizeof(sync_crc))
+         || !socket_receive_all_blocking(netplay->fd,
+            &byte_order, sizeof(byte_order))
+         || !socket_receive_all_blocking(netplay->fd,
+            delta_header, sizeof(delta_header)))
+   {
+      RARCH_ERR("Failed to receive save state from host.\n");
+      return false;
+   }
+
+   /* Only the sizes of the delta are in network byte order. */
+   if (ntohl(byte_order) != is_little_endian())
+   {
+      RARCH_ERR("Host uses a different byte order, cannot join.\n");
+      return false;
+   }
+
+   stored_size = (ntohl(delta_header[1]) + 1) & ~1u;
+   if (stored_size > save_state_size * 2 + 64)
+   {
+      RARCH_ERR("Received invalid save state size from host.\n");
+      return false;
+   }
+
+   delta = (uint8_t*)malloc(sizeof(delta_header) + stored_size);
+   if (!delta)
+      return false;
+
+   memcpy(delta, delta_header, sizeof(delta_header));
+   if (!socket_receive_all_blocking(netplay->fd,
+            delta + sizeof(delta_header), stored_size))
+   {
+      RARCH_ERR("Failed to receive save state from host.\n");
+      goto end;
+   }
+
+   if (!save_state_size)
+   {
+      ret = true;
+      goto end;
+   }
+
+   /* Our state differs from the host's baseline, so it sent all of it. */
+   if (ntohl(sync_crc) != crc)
+      memset(state, 0, save_state_size);
+
+   decoder = state_manager_new(save_state_size, 0, 0, false, true);
+   if (!decoder || !state_manager_delta_apply(decoder, state, delta,
+            sizeof(delta_header) + stored_size))
+   {
+      RARCH_ERR("Received invalid save state from host.\n");
+      goto end;
+   }
+
+   RARCH_LOG("Received save state from host in %u bytes.\n",
+         (unsigned)(sizeof(delta_header) + stored_size));
+
+   ret = pretro_unserialize(state, save_state_size);
+
+end:
+   state_manager_free(decoder);
+   free(delta);
+   return ret;
+}
+
 static bool send_info(netplay_t *netplay)
 {
    unsigned sram_size;
    char msg[512];
-   void *sram = NULL;
-   uint32_t header[3] = {
-      htonl(g_extern.content_crc),
-      htonl(implementation_magic_value()),
-      htonl(pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM))
-   };
+   uint32_t assign[5];
+   uint32_t crc            = 0;
+   void *sram              = NULL;
+   uint8_t *state          = NULL;
+   size_t save_state_size  = pretro_serialize_size();
+   bool ret                = false;
+   uint32_t header[4];
+
+   /* Should the session already be running, the host only sends 
+    * what differs from the state we loaded with. */
+   if (save_state_size)
+   {
+      state = (uint8_t*)malloc(save_state_size);
+      if (!state || !pretro_serialize(state, save_state_size))
+      {
+         RARCH_ERR("Failed to save state before joining.\n");
+         goto end;
+      }
+      crc = crc32_calculate(state, save_state_size);
+   }
+
+   header[0] = htonl(content_get_crc());
+   header[1] = htonl(implementation_magic_value());
+   header[2] = htonl(pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM));
+   header[3] = htonl(crc);
 
    if (!socket_send_all_blocking(netplay->fd, header, sizeof(header)))
-      return false;
+      goto end;
 
    if (!send_nickname(netplay, netplay->fd))
    {
       RARCH_ERR("Failed to send nick to host.\n");
-      return false;
+      goto end;
    }
 
    /* Get SRAM data from User 1. */
@@ -901,35 +1578,69 @@ static bool send_info(netplay_t *netplay)
    if (!socket_receive_all_blocking(netplay->fd, sram, sram_size))
    {
       RARCH_ERR("Failed to receive SRAM data from host.\n");
-      return false;
+      goto end;
    }
 
    if (!get_nickname(netplay, netplay->fd))
    {
       RARCH_ERR("Failed to receive nick from host.\n");
-      return false;
+      goto end;
+   }
+
+   /* Only arrives once every client has connected. */
+   RARCH_LOG("Waiting for other users to connect...\n");
+
+   if (!socket_receive_all_blocking(netplay->fd, assign, sizeof(assign)))
+   {
+      RARCH_ERR("Failed to receive user assignment from host.\n");
+      goto end;
+   }
+
+   netplay->self_port        = ntohl(assign[0]);
+   netplay->users            = ntohl(assign[1]);
+   netplay->join_frame       = ntohl(assign[3]);
+   netplay->join_input_frame = ntohl(assign[4]);
+
+   if (netplay->users < 2 || netplay->users > MAX_USERS ||
+         netplay->self_port == 0 || netplay->self_port >= netplay->users ||
+         netplay->join_input_frame < netplay->join_frame)
+   {
+      RARCH_ERR("Host sent an invalid user assignment.\n");
+      goto end;
    }
 
-   snprintf(msg, sizeof(msg), "Connected to: \"%s\"", netplay->other_nick);
+   netplay->tokens[netplay->self_port] = ntohl(assign[2]);
+
+   if ((netplay->join_frame || netplay->join_input_frame) &&
+         !receive_join_state(netplay, state, crc))
+      goto end;
+
+   snprintf(msg, sizeof(msg), "Connected to: \"%s\" as user %u of %u",
+         netplay->other_nick, netplay->self_port + 1, netplay->users);
    RARCH_LOG("%s\n", msg);
    rarch_main_msg_queue_push(msg, 1, 180, false);
 
-   return true;
+   ret = true;
+
+end:
+   free(state);
+   return ret;
 }
 
-static bool get_info(netplay_t *netplay)
+static bool get_info(netplay_t *netplay, int fd, unsigned port,
+      uint32_t *state_crc)
 {
    const void *sram;
    unsigned sram_size;
-   uint32_t header[3];
+   uint32_t header[4];
 
-   if (!socket_receive_all_blocking(netplay->fd, header, sizeof(header)))
+   if (!socket_receive_all_blocking(fd, header, sizeof(header)))
    {
       RARCH_ERR("Failed to receive header from client.\n");
       return false;
    }
 
-   if (g_extern.content_crc != ntohl(header[0]))
+   if (content_get_crc() != ntohl(header[0]))
    {
       RARCH_ERR("Content CRC32s differ. Cannot use different games.\n");
       return false;
@@ -947,60 +1658,249 @@ static bool get_info(netplay_t *netplay)
       return false;
    }
 
-   if (!get_nickname(netplay, netplay->fd))
+   *state_crc = ntohl(header[3]);
+
+   if (!get_nickname(netplay, fd))
    {
       RARCH_ERR("Failed to get nickname from client.\n");
       return false;
    }
 
-   /* Send SRAM data to our User 2. */
+   /* Send SRAM data to our client. */
    sram      = pretro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
    sram_size = pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
 
-   if (!socket_send_all_blocking(netplay->fd, sram, sram_size))
+   if (!socket_send_all_blocking(fd, sram, sram_size))
    {
       RARCH_ERR("Failed to send SRAM data to client.\n");
       return false;
    }
 
-   if (!send_nickname(netplay, netplay->fd))
+   if (!send_nickname(netplay, fd))
    {
       RARCH_ERR("Failed to send nickname to client.\n");
       return false;
    }
 
 #ifndef HAVE_SOCKET_LEGACY
-   log_connection(&netplay->other_addr, 0, netplay->other_nick);
+   log_connection(&netplay->other_addr, port, netplay->other_nick);
 #endif
 
    return true;
 }
 
-static uint32_t *bsv_header_generate(size_t *size, uint32_t magic)
+/**
+ * netplay_new_token:
+ *
+ * Returns: a session token that is hard to guess from outside.
+ **/
+static uint32_t netplay_new_token(void)
+{
+   uint32_t token = 0;
+#if defined(__unix__) || defined(__APPLE__)
+   FILE *file     = fopen("/dev/urandom", "rb");
+
+   if (file)
+   {
+      if (fread(&token, 1, sizeof(token), file) != sizeof(token))
+         token = 0;
+      fclose(file);
+   }
+#endif
+
+   /* Weaker, but still unknown to anyone not in the session. */
+   if (!token)
+      token = (uint32_t)rand() ^ (uint32_t)rarch_get_time_usec() ^
+         ((uint32_t)rarch_get_perf_counter() << 16);
+
+   return token;
+}
+
+/**
+ * send_assignment:
+ * @netplay              : pointer to netplay object
+ * @port                 : port the client gets
+ * @frame                : frame the client starts running at
+ * @input_frame          : first frame of the client's input we do 
+ *                         not have yet
+ *
+ * Tells a client which user it is, and hands it its token.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool send_assignment(netplay_t *netplay, unsigned port,
+      uint32_t frame, uint32_t input_frame)
 {
-   uint32_t *header, bsv_header[4] = {0};
-   size_t serialize_size = pretro_serialize_size();
-   size_t header_size = sizeof(bsv_header) + serialize_size;
+   uint32_t assign[5];
 
-   *size = header_size;
+   netplay->tokens[port] = netplay_new_token();
 
-   header = (uint32_t*)malloc(header_size);
-   if (!header)
-      return NULL;
+   assign[0] = htonl(port);
+   assign[1] = htonl(netplay->users);
+   assign[2] = htonl(netplay->tokens[port]);
+   assign[3] = htonl(frame);
+   assign[4] = htonl(input_frame);
+
+   if (!socket_send_all_blocking(netplay->peer_fds[port],
+            assign, sizeof(assign)))
+   {
+      RARCH_ERR("Failed to send user assignment to client.\n");
+      return false;
+   }
+
+   return true;
+}
 
-   bsv_header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
-   bsv_header[SERIALIZER_INDEX] = swap_if_big32(magic);
-   bsv_header[CRC_INDEX] = swap_if_big32(g_extern.content_crc);
-   bsv_header[STATE_SIZE_INDEX] = swap_if_big32(serialize_size);
+/**
+ * send_join_state:
+ * @netplay              : pointer to netplay object
+ * @port                 : port of the joining client
+ * @state                : state to send
+ * @their_crc            : CRC of the state the client loaded with
+ *
+ * Sends @state to a client joining a running session, as a delta 
+ * against the state we loaded the content with if the client has 
+ * the same one, otherwise against nothing.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool send_join_state(netplay_t *netplay, unsigned port,
+      const uint8_t *state, uint32_t their_crc)
+{
+   uint32_t byte_order;
+   uint32_t sync_crc = 0;
+   uint32_t empty[2] = {0};
+   const void *delta = empty;
+   size_t delta_size = sizeof(empty);
+   uint8_t *zeros    = NULL;
+   bool ret          = false;
 
-   if (serialize_size && !pretro_serialize(header + 4, serialize_size))
+   if (netplay->state_size)
    {
-      free(header);
-      return NULL;
+      const uint8_t *baseline = netplay->join_baseline;
+
+      if (their_crc == netplay->join_baseline_crc)
+         sync_crc = their_crc;
+      else
+      {
+         RARCH_WARN("User %u did not load the same state, sending all of it.\n",
+               port + 1);
+         baseline = zeros = (uint8_t*)calloc(1, netplay->state_size);
+         if (!zeros)
+            return false;
+      }
+
+      delta = state_manager_delta_encode(netplay->join_delta,
+            baseline, state, &delta_size);
+      if (!delta)
+         goto end;
+   }
+
+   sync_crc   = htonl(sync_crc);
+   byte_order = htonl(is_little_endian());
+
+   if (!socket_send_all_blocking(netplay->peer_fds[port],
+            &sync_crc, sizeof(sync_crc)) ||
+         !socket_send_all_blocking(netplay->peer_fds[port],
+            &byte_order, sizeof(byte_order)) ||
+         !socket_send_all_blocking(netplay->peer_fds[port],
+            delta, delta_size))
+   {
+      RARCH_ERR("Failed to send save state to client.\n");
+      goto end;
+   }
+
+   RARCH_LOG("Sent save state to user %u in %u bytes.\n",
+         port + 1, (unsigned)delta_size);
+   ret = true;
+
+end:
+   free(zeros);
+   return ret;
+}
+
+/**
+ * accept_clients:
+ * @netplay              : pointer to netplay object
+ *
+ * Waits for every client to connect on our listening socket. 
+ * Clients are assigned ports in the order they connect, and are
+ * only told so once everyone is there, so that all users start
+ * running frames at the same time. The listening socket stays 
+ * open for users joining later on.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool accept_clients(netplay_t *netplay)
+{
+   unsigned i;
+
+   for (i = 1; i < netplay->users; i++)
+   {
+      int new_fd;
+      uint32_t state_crc;
+      socklen_t addr_size = sizeof(netplay->other_addr);
+
+      RARCH_LOG("Waiting for user %u of %u...\n", i + 1, netplay->users);
+
+      new_fd = accept(netplay->fd,
+            (struct sockaddr*)&netplay->other_addr, &addr_size);
+      if (new_fd < 0)
+      {
+         RARCH_ERR("Failed to accept netplay client.\n");
+         return false;
+      }
+
+      netplay->peer_fds[i] = new_fd;
+
+      if (!get_info(netplay, new_fd, i, &state_crc))
+         return false;
+   }
+
+   for (i = 1; i < netplay->users; i++)
+   {
+      if (!send_assignment(netplay, i, 0, 0))
+         return false;
+   }
+
+   netplay->listen_fd = netplay->fd;
+   netplay->fd        = netplay->peer_fds[1];
+
+   return true;
+}
+
+/**
+ * close_sockets:
+ * @netplay              : pointer to netplay object
+ *
+ * Closes every socket netplay has opened.
+ **/
+static void close_sockets(netplay_t *netplay)
+{
+   unsigned i;
+
+   for (i = 0; i < MAX_USERS; i++)
+   {
+      if (netplay->peer_fds[i] >= 0 && netplay->peer_fds[i] != netplay->fd)
+         socket_close(netplay->peer_fds[i]);
    }
 
-   memcpy(header, bsv_header, sizeof(bsv_header));
-   return header;
+   if (netplay->fd >= 0)
+      socket_close(netplay->fd);
+   if (netplay->listen_fd >= 0)
+      socket_close(netplay->listen_fd);
+   if (netplay->join_fd >= 0)
+      socket_close(netplay->join_fd);
+   if (netplay->udp_fd >= 0)
+      socket_close(netplay->udp_fd);
+}
+
+static void bsv_header_generate(uint32_t *header, uint32_t magic)
+{
+   header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
+   header[SERIALIZER_INDEX] = swap_if_big32(magic);
+   header[CRC_INDEX] = swap_if_big32(content_get_crc());
+   header[STATE_SIZE_INDEX] = swap_if_big32(pretro_serialize_size());
 }
 
 static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
@@ -1023,10 +1923,10 @@ static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
    }
 
    in_crc = swap_if_big32(header[CRC_INDEX]);
-   if (in_crc != g_extern.content_crc)
+   if (in_crc != content_get_crc())
    {
       RARCH_ERR("CRC32 mismatch, got 0x%x, expected 0x%x.\n", in_crc,
-            g_extern.content_crc);
+            content_get_crc());
       return false;
    }
 
@@ -1065,7 +1965,6 @@ static bool get_info_spectate(netplay_t *netplay)
    rarch_main_msg_queue_push(msg, 1, 180, false);
    RARCH_LOG("%s\n", msg);
 
-
    if (!socket_receive_all_blocking(netplay->fd, header, sizeof(header)))
    {
       RARCH_ERR("Cannot get header from host.\n");
@@ -1114,83 +2013,245 @@ static bool init_buffers(netplay_t *netplay)
 
    netplay->state_size = pretro_serialize_size();
 
+   /* One block for the whole ring; it is reused every frame. */
+   netplay->states = (uint8_t*)malloc(netplay->buffer_size *
+         netplay->state_size);
+
+   if (!netplay->states)
+      return false;
+
    for (i = 0; i < netplay->buffer_size; i++)
-   {
-      netplay->buffer[i].state = malloc(netplay->state_size);
+      netplay->buffer[i].state = netplay->states + i * netplay->state_size;
 
-      if (!netplay->buffer[i].state)
-         return false;
+   netplay->input_size = 4 * netplay->buffer_size;
+   netplay->real_input = (uint16_t*)calloc(netplay->input_size * MAX_USERS,
+         sizeof(*netplay->real_input));
 
-      netplay->buffer[i].is_simulated = true;
-   }
+   if (!netplay->real_input)
+      return false;
+
+   netplay->frame_time = (retro_time_t*)calloc(netplay->input_size,
+         sizeof(*netplay->frame_time));
+
+   if (!netplay->frame_time)
+      return false;
+
+   for (i = 0; i < NETPLAY_CRC_HISTORY; i++)
+      netplay->crcs[i].frame = NETPLAY_NO_CRC;
+   netplay->self_crc.frame = NETPLAY_NO_CRC;
 
    return true;
 }
 
+static void deinit_buffers(netplay_t *netplay)
+{
+   state_manager_free(netplay->join_delta);
+   free(netplay->join_baseline);
+   free(netplay->real_input);
+   free(netplay->frame_time);
+   free(netplay->states);
+   free(netplay->buffer);
+}
+
 /**
- * netplay_new:
- * @server               : IP address of server.
- * @port                 : Port of server.
- * @frames               : Amount of lag frames.
- * @cb                   : Libretro callbacks.
- * @spectate             : If true, enable spectator mode.
- * @nick                 : Nickname of user.
+ * init_join:
+ * @netplay              : pointer to netplay object
  *
- * Creates a new netplay handle. A NULL host means we're 
- * hosting (user 1).
+ * Host only. Keeps the state we start the session with, which 
+ * users joining later send the CRC of theirs to compare with.
  *
- * Returns: new netplay handle.
+ * Returns: true (1) if successful, otherwise false (0).
  **/
-netplay_t *netplay_new(const char *server, uint16_t port,
-      unsigned frames, const struct retro_callbacks *cb,
-      bool spectate,
-      const char *nick)
+static bool init_join(netplay_t *netplay)
 {
-   unsigned i;
-   netplay_t *netplay = NULL;
+   if (!netplay->state_size)
+      return true;
 
-   if (frames > UDP_FRAME_PACKETS)
-      frames = UDP_FRAME_PACKETS;
+   netplay->join_delta    = state_manager_new(netplay->state_size, 0, 0,
+         false, true);
+   netplay->join_baseline = (uint8_t*)malloc(netplay->state_size);
 
-   netplay = (netplay_t*)calloc(1, sizeof(*netplay));
-   if (!netplay)
-      return NULL;
+   if (!netplay->join_delta || !netplay->join_baseline)
+      return false;
 
-   netplay->fd              = -1;
-   netplay->udp_fd          = -1;
-   netplay->cbs             = *cb;
-   netplay->port            = server ? 0 : 1;
-   netplay->spectate        = spectate;
-   netplay->spectate_client = server != NULL;
-   strlcpy(netplay->nick, nick, sizeof(netplay->nick));
+   if (!pretro_serialize(netplay->join_baseline, netplay->state_size))
+      return false;
 
-   if (!init_socket(netplay, server, port))
-   {
-      free(netplay);
-      return NULL;
-   }
+   netplay->join_baseline_crc = crc32_calculate(netplay->join_baseline,
+         netplay->state_size);
+   return true;
+}
 
-   if (spectate)
-   {
-      if (server)
-      {
-         if (!get_info_spectate(netplay))
-            goto error;
-      }
+/**
+ * join_session:
+ * @netplay              : pointer to netplay object
+ *
+ * Client only. Picks up a session that is already running at 
+ * the frame the host gave us its state for.
+ **/
+static void join_session(netplay_t *netplay)
+{
+   unsigned i;
+   uint32_t frame = netplay->join_frame;
 
-      for (i = 0; i < MAX_SPECTATORS; i++)
-         netplay->spectate_fds[i] = -1;
-   }
-   else
-   {
-      if (server)
+   netplay->frame_count       = frame;
+   netplay->other_frame_count = frame;
+   netplay->self_ptr          = FRAME_PTR(frame);
+   netplay->other_ptr         = FRAME_PTR(frame);
+
+   for (i = 0; i < MAX_USERS; i++)
+      netplay->read_frame_count[i] = frame;
+
+   /* The host does not need our input from before we were in. */
+   netplay->peer_read_count[0][netplay->self_port] =
+      netplay->join_input_frame;
+}
+
+/**
+ * init_spectate_host:
+ * @netplay              : pointer to netplay object
+ *
+ * Sets up the spectator slots, the shared input ring and
+ * readiness polling on our listening socket.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool init_spectate_host(netplay_t *netplay)
+{
+   unsigned i;
+#ifdef HAVE_EPOLL
+   struct epoll_event event = {0};
+#endif
+
+   netplay->spectators = (struct spectator*)calloc(MAX_SPECTATORS,
+         sizeof(*netplay->spectators));
+   netplay->spectate_input = (uint8_t*)malloc(SPECTATE_RING_SIZE);
+
+   if (!netplay->spectators || !netplay->spectate_input)
+      return false;
+
+   for (i = 0; i < MAX_SPECTATORS; i++)
+      netplay->spectators[i].fd = -1;
+
+   if (!socket_nonblock(netplay->fd))
+      return false;
+
+#ifdef HAVE_EPOLL
+   netplay->spectate_epoll_fd = epoll_create(MAX_SPECTATORS + 1);
+   if (netplay->spectate_epoll_fd < 0)
+      return false;
+
+   event.events   = EPOLLIN;
+   event.data.u32 = SPECTATE_LISTEN_ID;
+   if (epoll_ctl(netplay->spectate_epoll_fd, EPOLL_CTL_ADD,
+            netplay->fd, &event) < 0)
+      return false;
+#endif
+
+   return true;
+}
+
+static void deinit_spectate_host(netplay_t *netplay)
+{
+   unsigned i;
+
+   if (netplay->spectators)
+   {
+      for (i = 0; i < MAX_SPECTATORS; i++)
+      {
+         if (netplay->spectators[i].fd >= 0)
+            socket_close(netplay->spectators[i].fd);
+         free(netplay->spectators[i].header);
+      }
+   }
+
+#ifdef HAVE_EPOLL
+   if (netplay->spectate_epoll_fd >= 0)
+      close(netplay->spectate_epoll_fd);
+#endif
+
+   free(netplay->spectators);
+   free(netplay->spectate_input);
+}
+
+/**
+ * netplay_new:
+ * @server               : IP address of server.
+ * @port                 : Port of server.
+ * @frames               : Rollback window, i.e. how many frames we
+ *                         may run ahead of remote input.
+ * @users                : Number of users, host included. 0 means 2.
+ *                         Only used when hosting; clients are told by
+ *                         the host.
+ * @cb                   : Libretro callbacks.
+ * @spectate             : If true, enable spectator mode.
+ * @nick                 : Nickname of user.
+ *
+ * Creates a new netplay handle. A NULL host means we're 
+ * hosting (user 1).
+ *
+ * Returns: new netplay handle.
+ **/
+netplay_t *netplay_new(const char *server, uint16_t port,
+      unsigned frames, unsigned users, const struct retro_callbacks *cb,
+      bool spectate,
+      const char *nick)
+{
+   unsigned i;
+   netplay_t *netplay = NULL;
+
+   if (frames > MAX_ROLLBACK_FRAMES)
+      frames = MAX_ROLLBACK_FRAMES;
+   if (users < 2)
+      users = 2;
+   if (users > MAX_USERS)
+      users = MAX_USERS;
+
+   netplay = (netplay_t*)calloc(1, sizeof(*netplay));
+   if (!netplay)
+      return NULL;
+
+   netplay->fd              = -1;
+   netplay->listen_fd       = -1;
+   netplay->join_fd         = -1;
+   netplay->udp_fd          = -1;
+#ifdef HAVE_EPOLL
+   netplay->spectate_epoll_fd = -1;
+#endif
+   for (i = 0; i < MAX_USERS; i++)
+      netplay->peer_fds[i]  = -1;
+   netplay->cbs             = *cb;
+   netplay->self_port       = 0;
+   netplay->users           = users;
+   netplay->spectate        = spectate;
+   netplay->spectate_client = server != NULL;
+   netplay->check_frames    = g_extern.netplay_check_frames;
+   strlcpy(netplay->nick, nick, sizeof(netplay->nick));
+
+   if (!init_socket(netplay, server, port))
+      goto error;
+
+   if (spectate)
+   {
+      if (server)
+      {
+         if (!get_info_spectate(netplay))
+            goto error;
+      }
+      else if (!init_spectate_host(netplay))
+         goto error;
+   }
+   else
+   {
+      if (server)
       {
          if (!send_info(netplay))
             goto error;
+         netplay->peer_fds[0] = netplay->fd;
       }
       else
       {
-         if (!get_info(netplay))
+         if (!accept_clients(netplay))
             goto error;
       }
 
@@ -1199,16 +2260,25 @@ netplay_t *netplay_new(const char *server, uint16_t port,
       if (!init_buffers(netplay))
          goto error;
 
+      if (!server && !init_join(netplay))
+         goto error;
+      if (server && (netplay->join_frame || netplay->join_input_frame))
+         join_session(netplay);
+
       netplay->has_connection = true;
    }
 
    return netplay;
 
 error:
-   if (netplay->fd >= 0)
-      socket_close(netplay->fd);
-   if (netplay->udp_fd >= 0)
-      socket_close(netplay->udp_fd);
+   if (spectate && !server)
+      deinit_spectate_host(netplay);
+   else if (!spectate)
+      deinit_buffers(netplay);
+   close_sockets(netplay);
+
+   if (netplay->addr)
+      freeaddrinfo_rarch(netplay->addr);
 
    free(netplay);
    return NULL;
@@ -1237,7 +2307,11 @@ static bool netplay_send_cmd(netplay_t *netplay, uint32_t cmd,
  **/
 void netplay_flip_users(netplay_t *netplay)
 {
-   uint32_t flip_frame     = netplay->frame_count + 2 * UDP_FRAME_PACKETS;
+   /* The other side can be up to a whole rollback window
+    * behind or ahead of us; flip well past either. */
+   uint32_t flip_delay     = 2 * (netplay->buffer_size > UDP_FRAME_PACKETS ?
+         netplay->buffer_size : UDP_FRAME_PACKETS);
+   uint32_t flip_frame     = netplay->frame_count + flip_delay;
    uint32_t flip_frame_net = htonl(flip_frame);
    const char *msg = NULL;
 
@@ -1247,14 +2321,20 @@ void netplay_flip_users(netplay_t *netplay)
       goto error;
    }
 
-   if (netplay->port == 0)
+   if (netplay->self_port != 0)
    {
       msg = "Cannot flip users if you're not the host.";
       goto error;
    }
 
+   if (netplay->users != 2)
+   {
+      msg = "Cannot flip users with more than two users.";
+      goto error;
+   }
+
    /* Make sure both clients are definitely synced up. */
-   if (netplay->frame_count < (netplay->flip_frame + 2 * UDP_FRAME_PACKETS))
+   if (netplay->frame_count < (netplay->flip_frame + flip_delay))
    {
       msg = "Cannot flip users yet. Wait a second or two before attempting flip.";
       goto error;
@@ -1284,6 +2364,13 @@ error:
    rarch_main_msg_queue_push(msg, 1, 180, false);
 }
 
+void netplay_get_stats(netplay_t *netplay, struct netplay_stats *stats)
+{
+   *stats = netplay->stats;
+   stats->frame_count           = netplay->frame_count;
+   stats->confirmed_frame_count = netplay->other_frame_count;
+}
+
 /**
  * netplay_free:
  * @netplay              : pointer to netplay object
@@ -1292,32 +2379,113 @@ error:
  **/
 void netplay_free(netplay_t *netplay)
 {
-   unsigned i;
-
-   socket_close(netplay->fd);
+   close_sockets(netplay);
 
    if (netplay->spectate)
+      deinit_spectate_host(netplay);
+   else
+      deinit_buffers(netplay);
+
+   if (netplay->addr)
+      freeaddrinfo_rarch(netplay->addr);
+
+   free(netplay);
+}
+
+/**
+ * accept_join:
+ * @netplay              : pointer to netplay object
+ *
+ * Host only. Lets a user waiting on our listening socket take 
+ * over a vacant port. It starts at the newest frame everyone has 
+ * confirmed input for, from the state we had then.
+ **/
+static void accept_join(netplay_t *netplay)
+{
+   int new_fd;
+   unsigned i, port;
+   uint32_t state_crc, frame, input_frame;
+   struct timeval tv   = {0};
+   socklen_t addr_size = sizeof(netplay->other_addr);
+   fd_set fds;
+
+   if (netplay->join_fd < 0)
    {
-      for (i = 0; i < MAX_SPECTATORS; i++)
-         if (netplay->spectate_fds[i] >= 0)
-            socket_close(netplay->spectate_fds[i]);
+      FD_ZERO(&fds);
+      FD_SET(netplay->listen_fd, &fds);
+
+      if (socket_select(netplay->listen_fd + 1, &fds, NULL, NULL, &tv) <= 0)
+         return;
 
-      free(netplay->spectate_input);
+      netplay->join_fd = accept(netplay->listen_fd,
+            (struct sockaddr*)&netplay->other_addr, &addr_size);
+      if (netplay->join_fd < 0)
+         return;
+
+      netplay->join_deadline = rarch_get_time_usec() +
+         JOIN_HEADER_TIMEOUT_USEC;
    }
-   else
+
+   /* The handshake blocks everyone, so it only starts once the 
+    * user has shown it is there by sending its header. */
+   FD_ZERO(&fds);
+   FD_SET(netplay->join_fd, &fds);
+
+   if (socket_select(netplay->join_fd + 1, &fds, NULL, NULL, &tv) <= 0)
    {
-      socket_close(netplay->udp_fd);
+      if (rarch_get_time_usec() < netplay->join_deadline)
+         return;
 
-      for (i = 0; i < netplay->buffer_size; i++)
-         free(netplay->buffer[i].state);
+      RARCH_WARN("Joining user sent nothing, turning it away.\n");
+      socket_close(netplay->join_fd);
+      netplay->join_fd = -1;
+      return;
+   }
 
-      free(netplay->buffer);
+   new_fd           = netplay->join_fd;
+   netplay->join_fd = -1;
+
+   for (port = 1; port < netplay->users; port++)
+   {
+      if (netplay->vacant_mask & (1 << port))
+         break;
    }
 
-   if (netplay->addr)
-      freeaddrinfo_rarch(netplay->addr);
+   if (port == netplay->users)
+   {
+      RARCH_WARN("Netplay session is full, turning away a user.\n");
+      socket_close(new_fd);
+      return;
+   }
 
-   free(netplay);
+   /* Nothing past the other frame count can be rolled back, and we 
+    * have already made up our mind about the vacant port's input. */
+   frame       = netplay->other_frame_count;
+   input_frame = netplay->read_frame_count[port];
+
+   netplay->peer_fds[port] = new_fd;
+
+   if (!socket_timeout(new_fd, JOIN_STALL_TIMEOUT_MSEC)
+         || !get_info(netplay, new_fd, port, &state_crc)
+         || !send_assignment(netplay, port, frame, input_frame)
+         || !send_join_state(netplay, port,
+            netplay->buffer[FRAME_PTR(frame)].state, state_crc)
+         || !socket_timeout(new_fd, 0))
+   {
+      RARCH_ERR("User failed to join.\n");
+      socket_close(new_fd);
+      netplay->peer_fds[port] = -1;
+      netplay->tokens[port]   = 0;
+      return;
+   }
+
+   for (i = 0; i < MAX_USERS; i++)
+      netplay->peer_read_count[port][i] = frame;
+   netplay->peer_crc[port].frame = 0;
+   netplay->vacant_mask         &= ~(1 << port);
+
+   if (port == 1)
+      netplay->fd = new_fd;
 }
 
 /**
@@ -1328,24 +2496,29 @@ void netplay_free(netplay_t *netplay)
  **/
 static void netplay_pre_frame_net(netplay_t *netplay)
 {
-   pretro_serialize(netplay->buffer[netplay->self_ptr].state,
-         netplay->state_size);
+   void *state = netplay->buffer[netplay->self_ptr].state;
+
+   pretro_serialize(state, netplay->state_size);
    netplay->can_poll = true;
 
+   /* Nothing we ran so far was predicted, so this state is final. */
+   if (netplay->has_connection &&
+         netplay->other_frame_count == netplay->frame_count &&
+         check_frame(netplay, netplay->frame_count))
+      crc_state(netplay, netplay->frame_count, state);
+
+   if (netplay->has_connection && netplay->listen_fd >= 0)
+      accept_join(netplay);
+
    input_poll_net();
 }
 
 static void netplay_set_spectate_input(netplay_t *netplay, int16_t input)
 {
-   if (netplay->spectate_input_ptr >= netplay->spectate_input_size)
-   {
-      netplay->spectate_input_size++;
-      netplay->spectate_input_size *= 2;
-      netplay->spectate_input = (uint16_t*)realloc(netplay->spectate_input,
-            netplay->spectate_input_size * sizeof(uint16_t));
-   }
+   size_t offset = netplay->spectate_input_ptr & (SPECTATE_RING_SIZE - 1);
 
-   netplay->spectate_input[netplay->spectate_input_ptr++] = swap_if_big16(input);
+   *(int16_t*)(netplay->spectate_input + offset) = swap_if_big16(input);
+   netplay->spectate_input_ptr += sizeof(input);
 }
 
 int16_t input_state_spectate(unsigned port, unsigned device,
@@ -1380,102 +2553,383 @@ int16_t input_state_spectate_client(unsigned port, unsigned device,
          device, idx, id);
 }
 
+static void spectator_drop(netplay_t *netplay, unsigned idx)
+{
+   char msg[512];
+   struct spectator *spectator = &netplay->spectators[idx];
+
+   RARCH_LOG("Client (#%u) disconnected ...\n", idx);
+
+   snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", idx);
+   rarch_main_msg_queue_push(msg, 1, 180, false);
+
+   /* Closing also takes it out of the epoll set. */
+   socket_close(spectator->fd);
+   free(spectator->header);
+   memset(spectator, 0, sizeof(*spectator));
+   spectator->fd = -1;
+}
+
+static void spectator_set_blocked(netplay_t *netplay, unsigned idx,
+      bool blocked)
+{
+   struct spectator *spectator = &netplay->spectators[idx];
+#ifdef HAVE_EPOLL
+   struct epoll_event event = {0};
+
+   event.events   = blocked ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+   event.data.u32 = idx;
+   epoll_ctl(netplay->spectate_epoll_fd, EPOLL_CTL_MOD,
+         spectator->fd, &event);
+#endif
+
+   spectator->blocked = blocked;
+}
+
 /**
- * netplay_pre_frame_spectate:   
+ * spectator_send:
  * @netplay              : pointer to netplay object
+ * @idx                  : spectator slot
+ * @data                 : data to send
+ * @size                 : size of @data
  *
- * Pre-frame for Netplay (spectate mode version).
+ * Sends as much of @data as the socket takes without blocking.
+ *
+ * Returns: bytes sent, or -1 if the spectator has to be dropped.
  **/
-static void netplay_pre_frame_spectate(netplay_t *netplay)
+static ssize_t spectator_send(netplay_t *netplay, unsigned idx,
+      const void *data, size_t size)
 {
-   unsigned i;
-   uint32_t *header;
-   int new_fd, idx, bufsize;
-   size_t header_size;
-   struct sockaddr_storage their_addr;
-   socklen_t addr_size;
-   fd_set fds;
-   struct timeval tmp_tv = {0};
+   ssize_t ret = send(netplay->spectators[idx].fd, (const char*)data, size, 0);
 
-   if (netplay->spectate_client)
-      return;
+   if (ret > 0)
+      return ret;
 
-   FD_ZERO(&fds);
-   FD_SET(netplay->fd, &fds);
+   if (!isagain(ret))
+      return -1;
 
-   if (socket_select(netplay->fd + 1, &fds, NULL, NULL, &tmp_tv) <= 0)
-      return;
+   spectator_set_blocked(netplay, idx, true);
+   return 0;
+}
 
-   if (!FD_ISSET(netplay->fd, &fds))
-      return;
+/**
+ * spectator_flush:
+ * @netplay              : pointer to netplay object
+ * @idx                  : spectator slot
+ *
+ * Sends the spectator everything it has not got yet, straight 
+ * out of the shared input ring, until its socket buffer is full.
+ *
+ * Returns: false (0) if the spectator has to be dropped.
+ **/
+static bool spectator_flush(netplay_t *netplay, unsigned idx)
+{
+   struct spectator *spectator = &netplay->spectators[idx];
+
+   if (!spectator->joined)
+      return true;
 
-   addr_size = sizeof(their_addr);
-   new_fd = accept(netplay->fd, (struct sockaddr*)&their_addr, &addr_size);
-   if (new_fd < 0)
+   while (!spectator->blocked && spectator->header_ptr < spectator->header_size)
    {
-      RARCH_ERR("Failed to accept incoming spectator.\n");
-      return;
+      ssize_t ret = spectator_send(netplay, idx,
+            spectator->header + spectator->header_ptr,
+            spectator->header_size - spectator->header_ptr);
+      if (ret < 0)
+         return false;
+      spectator->header_ptr += ret;
    }
 
-   idx = -1;
-   for (i = 0; i < MAX_SPECTATORS; i++)
+   if (spectator->header && spectator->header_ptr == spectator->header_size)
    {
-      if (netplay->spectate_fds[i] == -1)
-      {
-         idx = i;
-         break;
-      }
+      free(spectator->header);
+      spectator->header = NULL;
    }
 
-   /* No vacant client streams :( */
-   if (idx == -1)
+   /* What it still needs has already been overwritten. */
+   if (netplay->spectate_input_ptr - spectator->input_ptr > SPECTATE_RING_SIZE)
    {
-      socket_close(new_fd);
-      return;
+      RARCH_WARN("Client (#%u) cannot keep up.\n", idx);
+      return false;
    }
 
-   if (!get_nickname(netplay, new_fd))
+   while (!spectator->blocked &&
+         spectator->input_ptr < netplay->spectate_input_ptr)
    {
-      RARCH_ERR("Failed to get nickname from client.\n");
-      socket_close(new_fd);
-      return;
+      ssize_t ret;
+      size_t offset = spectator->input_ptr & (SPECTATE_RING_SIZE - 1);
+      size_t size   = netplay->spectate_input_ptr - spectator->input_ptr;
+
+      if (size > SPECTATE_RING_SIZE - offset)
+         size = SPECTATE_RING_SIZE - offset;
+
+      ret = spectator_send(netplay, idx,
+            netplay->spectate_input + offset, size);
+      if (ret < 0)
+         return false;
+      spectator->input_ptr += ret;
    }
 
-   if (!send_nickname(netplay, new_fd))
+   return true;
+}
+
+/**
+ * spectator_join:
+ * @netplay              : pointer to netplay object
+ * @idx                  : spectator slot
+ *
+ * Prepares what a spectator gets before any input: our nick and 
+ * our current state. From here on, it is sent the same input as 
+ * everyone else.
+ *
+ * Returns: false (0) if the spectator has to be dropped.
+ **/
+static bool spectator_join(netplay_t *netplay, unsigned idx)
+{
+   uint32_t bsv_header[4];
+   struct spectator *spectator = &netplay->spectators[idx];
+   uint8_t nick_size           = strlen(netplay->nick);
+   size_t state_size           = pretro_serialize_size();
+   uint8_t *ptr;
+
+   memcpy(spectator->nick, spectator->join + 1, spectator->join[0]);
+   spectator->nick[spectator->join[0]] = '\0';
+
+   bsv_header_generate(bsv_header, implementation_magic_value());
+
+   spectator->header_size = 1 + nick_size + sizeof(bsv_header) + state_size;
+   spectator->header = (uint8_t*)malloc(spectator->header_size);
+   if (!spectator->header)
+      return false;
+
+   ptr    = spectator->header;
+   *ptr++ = nick_size;
+   memcpy(ptr, netplay->nick, nick_size);
+   ptr   += nick_size;
+   memcpy(ptr, bsv_header, sizeof(bsv_header));
+   ptr   += sizeof(bsv_header);
+
+   if (state_size && !pretro_serialize(ptr, state_size))
    {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      socket_close(new_fd);
-      return;
+      RARCH_ERR("Failed to save state for client (#%u).\n", idx);
+      return false;
    }
 
-   header = bsv_header_generate(&header_size,
-         implementation_magic_value());
+   spectator->header_ptr = 0;
+   spectator->input_ptr  = netplay->spectate_input_ptr;
+   spectator->joined     = true;
+
+#ifndef HAVE_SOCKET_LEGACY
+   log_connection(&spectator->addr, idx, spectator->nick);
+#endif
+
+   return true;
+}
 
-   if (!header)
+/**
+ * spectator_read:
+ * @netplay              : pointer to netplay object
+ * @idx                  : spectator slot
+ *
+ * Spectators only ever send us their nick. Anything 
+ * after that is ignored, but we still need to notice hangups.
+ *
+ * Returns: false (0) if the spectator has to be dropped.
+ **/
+static bool spectator_read(netplay_t *netplay, unsigned idx)
+{
+   struct spectator *spectator = &netplay->spectators[idx];
+
+   for (;;)
    {
-      RARCH_ERR("Failed to generate BSV header.\n");
-      socket_close(new_fd);
-      return;
+      char buf[64];
+      ssize_t ret;
+      size_t join_size = 1;
+
+      if (spectator->join_ptr)
+         join_size += spectator->join[0];
+
+      if (spectator->joined)
+         ret = recv(spectator->fd, buf, sizeof(buf), 0);
+      else
+         ret = recv(spectator->fd,
+               (char*)spectator->join + spectator->join_ptr,
+               join_size - spectator->join_ptr, 0);
+
+      if (ret <= 0)
+         return isagain(ret);
+
+      if (spectator->joined)
+         continue;
+
+      if (spectator->join_ptr == 0 &&
+            spectator->join[0] >= sizeof(spectator->nick))
+      {
+         RARCH_ERR("Invalid nick size.\n");
+         return false;
+      }
+
+      spectator->join_ptr += ret;
+
+      if (spectator->join_ptr == 1 + spectator->join[0]
+            && !spectator_join(netplay, idx))
+         return false;
+   }
+}
+
+/**
+ * spectate_accept:
+ * @netplay              : pointer to netplay object
+ *
+ * Takes in every spectator waiting on our listening socket. 
+ * They are sent nothing until they have told us who they are.
+ **/
+static void spectate_accept(netplay_t *netplay)
+{
+   for (;;)
+   {
+      unsigned i;
+      struct spectator *spectator = NULL;
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      int new_fd = accept(netplay->fd,
+            (struct sockaddr*)&their_addr, &addr_size);
+#ifdef HAVE_EPOLL
+      struct epoll_event event = {0};
+#endif
+
+      if (new_fd < 0)
+      {
+         if (!isagain(new_fd))
+            RARCH_ERR("Failed to accept incoming spectator.\n");
+         return;
+      }
+
+      for (i = 0; i < MAX_POLLED_SPECTATORS; i++)
+      {
+         if (netplay->spectators[i].fd == -1)
+         {
+            spectator = &netplay->spectators[i];
+            break;
+         }
+      }
+
+#if !defined(HAVE_EPOLL) && !defined(_WIN32)
+      /* FD_SET() cannot take descriptors past FD_SETSIZE. */
+      if (new_fd >= FD_SETSIZE)
+         spectator = NULL;
+#endif
+
+      /* No vacant client streams :( */
+      if (!spectator || !socket_nonblock(new_fd))
+      {
+         socket_close(new_fd);
+         continue;
+      }
+
+      memset(spectator, 0, sizeof(*spectator));
+      spectator->fd   = new_fd;
+      spectator->addr = their_addr;
+
+#ifdef HAVE_EPOLL
+      event.events   = EPOLLIN;
+      event.data.u32 = i;
+      if (epoll_ctl(netplay->spectate_epoll_fd, EPOLL_CTL_ADD,
+               new_fd, &event) < 0)
+         spectator_drop(netplay, i);
+#endif
    }
+}
 
-   bufsize = header_size;
-   setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, (const char*)&bufsize,
-         sizeof(int));
+#ifdef HAVE_EPOLL
+static void spectate_poll(netplay_t *netplay)
+{
+   int i, ret;
+   struct epoll_event events[64];
 
-   if (!socket_send_all_blocking(new_fd, header, header_size))
+   do
    {
-      RARCH_ERR("Failed to send header to client.\n");
-      socket_close(new_fd);
-      free(header);
-      return;
+      ret = epoll_wait(netplay->spectate_epoll_fd, events,
+            sizeof(events) / sizeof(events[0]), 0);
+
+      for (i = 0; i < ret; i++)
+      {
+         uint32_t idx = events[i].data.u32;
+
+         if (idx == SPECTATE_LISTEN_ID)
+         {
+            spectate_accept(netplay);
+            continue;
+         }
+
+         if (events[i].events & EPOLLOUT)
+            spectator_set_blocked(netplay, idx, false);
+
+         if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+               && !spectator_read(netplay, idx))
+            spectator_drop(netplay, idx);
+      }
+   } while (ret == sizeof(events) / sizeof(events[0]));
+}
+#else
+static void spectate_poll(netplay_t *netplay)
+{
+   unsigned i;
+   fd_set read_fds, write_fds;
+   struct timeval tmp_tv = {0};
+   int max_fd = netplay->fd;
+
+   FD_ZERO(&read_fds);
+   FD_ZERO(&write_fds);
+   FD_SET(netplay->fd, &read_fds);
+
+   for (i = 0; i < MAX_SPECTATORS; i++)
+   {
+      int fd = netplay->spectators[i].fd;
+
+      if (fd < 0)
+         continue;
+
+      FD_SET(fd, &read_fds);
+      if (netplay->spectators[i].blocked)
+         FD_SET(fd, &write_fds);
+      if (fd > max_fd)
+         max_fd = fd;
    }
 
-   free(header);
-   netplay->spectate_fds[idx] = new_fd;
+   if (socket_select(max_fd + 1, &read_fds, &write_fds, NULL, &tmp_tv) <= 0)
+      return;
 
-#ifndef HAVE_SOCKET_LEGACY
-   log_connection(&their_addr, idx, netplay->other_nick);
+   for (i = 0; i < MAX_SPECTATORS; i++)
+   {
+      int fd = netplay->spectators[i].fd;
+
+      if (fd < 0)
+         continue;
+
+      if (FD_ISSET(fd, &write_fds))
+         spectator_set_blocked(netplay, i, false);
+
+      if (FD_ISSET(fd, &read_fds) && !spectator_read(netplay, i))
+         spectator_drop(netplay, i);
+   }
+
+   if (FD_ISSET(netplay->fd, &read_fds))
+      spectate_accept(netplay);
+}
 #endif
+
+/**
+ * netplay_pre_frame_spectate:   
+ * @netplay              : pointer to netplay object
+ *
+ * Pre-frame for Netplay (spectate mode version).
+ **/
+static void netplay_pre_frame_spectate(netplay_t *netplay)
+{
+   if (netplay->spectate_client)
+      return;
+
+   spectate_poll(netplay);
 }
 
 /**
@@ -1502,28 +2956,57 @@ void netplay_pre_frame(netplay_t *netplay)
  **/
 static void netplay_post_frame_net(netplay_t *netplay)
 {
+   uint32_t confirmed;
+
    netplay->frame_count++;
 
+   /* Input may be known ahead of frames we have actually run. */
+   confirmed = confirmed_frame_count(netplay);
+   if (confirmed > netplay->frame_count)
+      confirmed = netplay->frame_count;
+
    /* Nothing to do... */
-   if (netplay->other_frame_count == netplay->read_frame_count)
+   if (netplay->other_frame_count == confirmed)
       return;
 
    /* Skip ahead if we predicted correctly.
     * Skip until our simulation failed. */
-   while (netplay->other_frame_count < netplay->read_frame_count)
+   while (netplay->other_frame_count < confirmed)
    {
+      unsigned i;
       const struct delta_frame *ptr = &netplay->buffer[netplay->other_ptr];
 
-      if ((ptr->simulated_input_state != ptr->real_input_state)
-            && !ptr->used_real)
+      for (i = 0; i < netplay->users; i++)
+      {
+         if ((ptr->simulated_mask & (1 << i)) &&
+               ptr->simulated_input_state[i] !=
+               REAL_INPUT(netplay->other_frame_count, i))
+            break;
+      }
+
+      if (i < netplay->users)
          break;
+
+      if (check_frame(netplay, netplay->other_frame_count))
+         crc_state(netplay, netplay->other_frame_count, ptr->state);
+
       netplay->other_ptr = NEXT_PTR(netplay->other_ptr);
       netplay->other_frame_count++;
    }
 
-   if (netplay->other_frame_count < netplay->read_frame_count)
+   if (netplay->other_frame_count < confirmed)
    {
       bool first = true;
+      unsigned depth = netplay->frame_count - netplay->other_frame_count;
+      RARCH_PERFORMANCE_INIT(netplay_resimulate);
+
+      RARCH_PERFORMANCE_START(netplay_resimulate);
+
+      netplay->stats.rollbacks++;
+      netplay->stats.resimulated_frames += depth;
+      if (depth > netplay->stats.rollback_depth_max)
+         netplay->stats.rollback_depth_max = depth;
+      perf_add(&netplay_rollback_frames, depth);
 
       /* Replay frames. */
       netplay->is_replay = true;
@@ -1535,8 +3018,21 @@ static void netplay_post_frame_net(netplay_t *netplay)
 
       while (first || (netplay->tmp_ptr != netplay->self_ptr))
       {
-         pretro_serialize(netplay->buffer[netplay->tmp_ptr].state,
-               netplay->state_size);
+         void *state = netplay->buffer[netplay->tmp_ptr].state;
+
+         /* Frames before confirmed will never be rolled back to
+          * again, so only the rest need fresh savestates, 
+          * besides those compared with peers. */
+         if (netplay->tmp_frame_count >= confirmed)
+            pretro_serialize(state, netplay->state_size);
+         else if (check_frame(netplay, netplay->tmp_frame_count))
+         {
+            pretro_serialize(state, netplay->state_size);
+            crc_state(netplay, netplay->tmp_frame_count, state);
+         }
+
+         simulate_input(netplay, netplay->tmp_ptr, netplay->tmp_frame_count);
+
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
          lock_autosave();
 #endif
@@ -1549,10 +3045,18 @@ static void netplay_post_frame_net(netplay_t *netplay)
          first = false;
       }
 
-      netplay->other_ptr = netplay->read_ptr;
-      netplay->other_frame_count = netplay->read_frame_count;
       netplay->is_replay = false;
+      RARCH_PERFORMANCE_STOP(netplay_resimulate);
    }
+
+   netplay->other_ptr = FRAME_PTR(confirmed);
+   netplay->other_frame_count = confirmed;
+
+   /* The state we have for the current frame is only written 
+    * in pre-frame; it is checked there. */
+   if (confirmed < netplay->frame_count && check_frame(netplay, confirmed))
+      crc_state(netplay, confirmed,
+            netplay->buffer[netplay->other_ptr].state);
 }
 
 /**
@@ -1569,29 +3073,14 @@ static void netplay_post_frame_spectate(netplay_t *netplay)
    if (netplay->spectate_client)
       return;
 
+   /* Spectators whose socket is full are picked up again 
+    * once it is writable. */
    for (i = 0; i < MAX_SPECTATORS; i++)
    {
-      char msg[PATH_MAX_LENGTH];
-
-      if (netplay->spectate_fds[i] == -1)
-         continue;
-
-      if (socket_send_all_blocking(netplay->spectate_fds[i],
-               netplay->spectate_input,
-               netplay->spectate_input_ptr * sizeof(int16_t)))
-         continue;
-
-      RARCH_LOG("Client (#%u) disconnected ...\n", i);
-
-      snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
-      rarch_main_msg_queue_push(msg, 1, 180, false);
-
-      socket_close(netplay->spectate_fds[i]);
-      netplay->spectate_fds[i] = -1;
-      break;
+      if (netplay->spectators[i].fd >= 0 && !netplay->spectators[i].blocked
+            && !spectator_flush(netplay, i))
+         spectator_drop(netplay, i);
    }
-
-   netplay->spectate_input_ptr = 0;
 }
 
 /**
@@ -26,6 +26,35 @@
 
 typedef struct netplay netplay_t;
 
+struct netplay_stats
+{
+   /* Frames run, and how many of them can no longer be rolled back. */
+   uint32_t frame_count;
+   uint32_t confirmed_frame_count;
+
+   /* From sending our input for a frame until a peer has it. */
+   retro_time_t rtt_usec;
+   retro_time_t rtt_max_usec;
+   /* How long after we ran a frame remote input for it arrived, 
+    * or zero if it arrived in time. */
+   retro_time_t input_latency_usec;
+   retro_time_t input_latency_max_usec;
+
+   /* Mispredictions, and how many frames were run again for them. */
+   uint64_t rollbacks;
+   uint64_t resimulated_frames;
+   unsigned rollback_depth_max;
+
+   /* Savestate CRCs compared with peers, and how many differed. */
+   uint64_t crc_checks;
+   uint64_t desyncs;
+   uint32_t last_desync_frame;
+
+   /* Times we had to wait for remote input, and for how long. */
+   uint64_t stalls;
+   retro_time_t stall_usec;
+};
+
 void input_poll_net(void);
 
 int16_t input_state_net(unsigned port, unsigned device,
@@ -49,6 +78,7 @@ int16_t input_state_spectate_client(unsigned port, unsigned device,
  * @server               : IP address of server.
  * @port                 : Port of server.
  * @frames               : Amount of lag frames.
+ * @users                : Number of users, host included. 0 means 2.
  * @cb                   : Libretro callbacks.
  * @spectate             : If true, enable spectator mode.
  * @nick                 : Nickname of user.
@@ -59,7 +89,7 @@ int16_t input_state_spectate_client(unsigned port, unsigned device,
  * Returns: new netplay handle.
  **/
 netplay_t *netplay_new(const char *server,
-      uint16_t port, unsigned frames,
+      uint16_t port, unsigned frames, unsigned users,
       const struct retro_callbacks *cb, bool spectate,
       const char *nick);
 
@@ -79,6 +109,15 @@ void netplay_free(netplay_t *handle);
  **/
 void netplay_flip_users(netplay_t *handle);
 
+/**
+ * netplay_get_stats:
+ * @netplay              : pointer to netplay object
+ * @stats                : filled in with current statistics
+ *
+ * Latencies are running averages and worst cases, in microseconds.
+ **/
+void netplay_get_stats(netplay_t *handle, struct netplay_stats *stats);
+
 /**
  * netplay_pre_frame:   
  * @netplay              : pointer to netplay object
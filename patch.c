@@ -21,6 +21,7 @@
 #include <boolean.h>
 #include <compat/msvc.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include "patch.h"
 #include "hash.h"
@@ -28,530 +29,899 @@
 #include "general.h"
 #include "retroarch_logger.h"
 
-enum bps_mode
-{
-   SOURCE_READ = 0,
-   TARGET_READ,
-   SOURCE_COPY,
-   TARGET_COPY
-};
+/* Hashes are advanced this far behind the write position, so the 
+ * bytes are still in cache and no separate pass is needed. */
+#define PATCH_CRC_CHUNK (64 * 1024)
 
-struct bps_data
+/**
+ * patch_crc_update:
+ * @crc          : running CRC32.
+ * @hashed       : number of bytes of @data hashed so far.
+ * @data         : buffer being hashed.
+ * @end          : number of bytes of @data that are final.
+ * @flush        : hash everything up to @end, even if little.
+ *
+ * Advances @crc over the final part of @data not hashed yet.
+ **/
+static void patch_crc_update(uint32_t *crc, size_t *hashed,
+      const uint8_t *data, size_t end, bool flush)
 {
-   const uint8_t *modify_data, *source_data; 
-   uint8_t *target_data;
-   size_t modify_length, source_length, target_length;
-   size_t modify_offset, source_offset, target_offset;
-   uint32_t modify_checksum, source_checksum, target_checksum;
+   if (end <= *hashed || (!flush && end - *hashed < PATCH_CRC_CHUNK))
+      return;
 
-   size_t source_relative_offset, target_relative_offset, output_offset;
-};
+   *crc    = crc32_update(*crc, data + *hashed, end - *hashed);
+   *hashed = end;
+}
+
+/* Reads the little endian CRC32 at @data. */
+static uint32_t patch_read_crc(const uint8_t *data)
+{
+   return (uint32_t)data[0]       | ((uint32_t)data[1] << 8) |
+         ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
 
-static uint8_t bps_read(struct bps_data *bps)
+/* The last four bytes of BPS and UPS patches are the CRC32 of 
+ * everything before them. */
+static bool patch_checksum_valid(const uint8_t *patch_data,
+      size_t patch_length)
 {
-   uint8_t data = bps->modify_data[bps->modify_offset++];
-   bps->modify_checksum = crc32_adjust(bps->modify_checksum, data);
-   return data;
+   return crc32_calculate(patch_data, patch_length - 4)
+      == patch_read_crc(patch_data + patch_length - 4);
 }
 
-static uint64_t bps_decode(struct bps_data *bps)
+/* Decodes a BPS/UPS variable length number. Sets @invalid when 
+ * it runs past @length or does not fit. */
+static uint64_t patch_decode(const uint8_t *data, size_t length,
+      size_t *offset, bool *invalid)
 {
-   uint64_t data = 0, shift = 1;
+   uint64_t value = 0, shift = 1;
 
    for (;;)
    {
-      uint8_t x = bps_read(bps);
-      data += (x & 0x7f) * shift;
+      uint8_t x;
+
+      if (*offset >= length || shift > ((uint64_t)1 << 56))
+      {
+         *invalid = true;
+         return 0;
+      }
+
+      x      = data[(*offset)++];
+      value += (x & 0x7f) * shift;
       if (x & 0x80)
          break;
       shift <<= 7;
-      data += shift;
+      value  += shift;
    }
 
-   return data;
+   return value;
 }
 
-static void bps_write(struct bps_data *bps, uint8_t data)
+enum bps_mode
 {
-   if (!bps)
-      return;
+   SOURCE_READ = 0,
+   TARGET_READ,
+   SOURCE_COPY,
+   TARGET_COPY
+};
 
-   bps->target_data[bps->output_offset++] = data;
-   bps->target_checksum = crc32_adjust(bps->target_checksum, data);
-}
+struct bps_header
+{
+   size_t source_size;
+   size_t target_size;
+   /* Offset of the first action. */
+   size_t offset;
+};
 
-patch_error_t bps_apply_patch(
-      const uint8_t *modify_data, size_t modify_length,
-      const uint8_t *source_data, size_t source_length,
-      uint8_t *target_data, size_t *target_length)
+static patch_error_t bps_read_header(const uint8_t *modify_data,
+      size_t modify_length, struct bps_header *header)
 {
-   size_t i;
-   size_t modify_source_size, modify_target_size,
-          modify_markup_size;
-   struct bps_data bps = {0};
-   uint32_t modify_source_checksum = 0, modify_target_checksum = 0,
-            modify_modify_checksum = 0, checksum;
+   uint64_t source_size, target_size, markup_size;
+   bool invalid  = false;
+   size_t offset = 4;
 
    if (modify_length < 19)
       return PATCH_PATCH_TOO_SMALL;
 
-   bps.modify_data = modify_data;
-   bps.modify_length = modify_length;
-   bps.target_data = target_data;
-   bps.target_length = *target_length;
-   bps.source_data = source_data;
-   bps.source_length = source_length;
-   bps.modify_checksum = ~0;
-   bps.target_checksum = ~0;
-
-   if ((bps_read(&bps) != 'B') || (bps_read(&bps) != 'P') ||
-         (bps_read(&bps) != 'S') || (bps_read(&bps) != '1'))
+   if (memcmp(modify_data, "BPS1", 4) != 0)
       return PATCH_PATCH_INVALID_HEADER;
 
-   modify_source_size = bps_decode(&bps);
-   modify_target_size = bps_decode(&bps);
-   modify_markup_size = bps_decode(&bps);
-   for (i = 0; i < modify_markup_size; i++)
-      bps_read(&bps);
+   source_size = patch_decode(modify_data, modify_length - 12,
+         &offset, &invalid);
+   target_size = patch_decode(modify_data, modify_length - 12,
+         &offset, &invalid);
+   markup_size = patch_decode(modify_data, modify_length - 12,
+         &offset, &invalid);
+
+   if (invalid || markup_size > modify_length - 12 - offset
+         || source_size > SIZE_MAX || target_size >= SIZE_MAX)
+      return PATCH_PATCH_INVALID;
+
+   header->source_size = source_size;
+   header->target_size = target_size;
+   header->offset      = offset + markup_size;
+   return PATCH_SUCCESS;
+}
+
+patch_error_t bps_patch_target_size(
+      const uint8_t *modify_data, size_t modify_length,
+      size_t source_length, size_t *target_length)
+{
+   struct bps_header header;
+   patch_error_t err = bps_read_header(modify_data, modify_length, &header);
+
+   (void)source_length;
+
+   if (err == PATCH_SUCCESS)
+      *target_length = header.target_size;
+   return err;
+}
 
-   if (modify_source_size > bps.source_length)
+patch_error_t bps_apply_patch(
+      const uint8_t *modify_data, size_t modify_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc)
+{
+   struct bps_header header;
+   size_t end;
+   size_t source_offset   = 0, target_offset = 0, output_offset = 0;
+   size_t source_hashed   = 0, target_hashed = 0;
+   uint32_t source_crc    = 0, crc           = 0;
+   size_t offset;
+   bool invalid           = false;
+   patch_error_t err      = bps_read_header(modify_data,
+         modify_length, &header);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   if (!patch_checksum_valid(modify_data, modify_length))
+      return PATCH_PATCH_CHECKSUM_INVALID;
+   if (header.source_size > source_length)
       return PATCH_SOURCE_TOO_SMALL;
-   if (modify_target_size > bps.target_length)
+   if (header.target_size > *target_length)
       return PATCH_TARGET_TOO_SMALL;
 
-   while (bps.modify_offset < bps.modify_length - 12)
+   end    = modify_length - 12;
+   offset = header.offset;
+
+   while (offset < end)
    {
-      size_t length = bps_decode(&bps);
-      unsigned mode = length & 3;
+      uint64_t length = patch_decode(modify_data, end, &offset, &invalid);
+      unsigned mode   = length & 3;
 
       length = (length >> 2) + 1;
 
+      if (invalid || length > header.target_size - output_offset)
+         return PATCH_PATCH_INVALID;
+
       switch (mode)
       {
          case SOURCE_READ:
-            while (length--)
-               bps_write(&bps, bps.source_data[bps.output_offset]);
+            if (output_offset + length > source_length)
+               return PATCH_PATCH_INVALID;
+            memcpy(target_data + output_offset,
+                  source_data + output_offset, length);
             break;
 
          case TARGET_READ:
-            while (length--)
-               bps_write(&bps, bps_read(&bps));
+            if (length > end - offset)
+               return PATCH_PATCH_INVALID;
+            memcpy(target_data + output_offset,
+                  modify_data + offset, length);
+            offset += length;
             break;
 
          case SOURCE_COPY:
          case TARGET_COPY:
          {
-            int offset = bps_decode(&bps);
-            bool negative = offset & 1;
-            offset >>= 1;
-            if (negative)
-               offset = -offset;
+            uint64_t data = patch_decode(modify_data, end, &offset, &invalid);
+            uint64_t delta = data >> 1;
+            bool negative  = data & 1;
 
             if (mode == SOURCE_COPY)
             {
-               bps.source_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.source_data[bps.source_offset++]);
+               if (invalid || (negative ? delta > source_offset
+                        : delta > source_length - source_offset))
+                  return PATCH_PATCH_INVALID;
+               source_offset = negative ? source_offset - delta
+                  : source_offset + delta;
+
+               if (length > source_length - source_offset)
+                  return PATCH_PATCH_INVALID;
+               memcpy(target_data + output_offset,
+                     source_data + source_offset, length);
+               source_offset += length;
             }
             else
             {
-               bps.target_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.target_data[bps.target_offset++]);
-               break;
+               if (invalid || (negative ? delta > target_offset
+                        : delta >= output_offset - target_offset))
+                  return PATCH_PATCH_INVALID;
+               target_offset = negative ? target_offset - delta
+                  : target_offset + delta;
+
+               /* Overlapping copies repeat what they just wrote, 
+                * so those have to go byte by byte. */
+               if (target_offset + length > output_offset)
+               {
+                  uint8_t *out      = target_data + output_offset;
+                  const uint8_t *in = target_data + target_offset;
+                  size_t i;
+
+                  for (i = 0; i < length; i++)
+                     out[i] = in[i];
+               }
+               else
+                  memcpy(target_data + output_offset,
+                        target_data + target_offset, length);
+               target_offset += length;
             }
             break;
          }
       }
-   }
 
+      output_offset += length;
 
-   for (i = 0; i < 32; i += 8)
-      modify_source_checksum |= bps_read(&bps) << i;
-   for (i = 0; i < 32; i += 8)
-      modify_target_checksum |= bps_read(&bps) << i;
+      patch_crc_update(&crc, &target_hashed, target_data,
+            output_offset, false);
+      patch_crc_update(&source_crc, &source_hashed, source_data,
+            output_offset < source_length ? output_offset : source_length,
+            false);
+   }
 
-   checksum = ~bps.modify_checksum;
-   for (i = 0; i < 32; i += 8)
-      modify_modify_checksum |= bps_read(&bps) << i;
+   if (output_offset != header.target_size)
+      return PATCH_PATCH_INVALID;
 
-   bps.source_checksum = crc32_calculate(bps.source_data, bps.source_length);
-   bps.target_checksum = ~bps.target_checksum;
+   patch_crc_update(&crc, &target_hashed, target_data,
+         output_offset, true);
+   patch_crc_update(&source_crc, &source_hashed, source_data,
+         source_length, true);
 
-   if (bps.source_checksum != modify_source_checksum)
+   if (source_crc != patch_read_crc(modify_data + end))
       return PATCH_SOURCE_CHECKSUM_INVALID;
-   if (bps.target_checksum != modify_target_checksum)
+   if (crc != patch_read_crc(modify_data + end + 4))
       return PATCH_TARGET_CHECKSUM_INVALID;
-   if (checksum != modify_modify_checksum)
-      return PATCH_PATCH_CHECKSUM_INVALID;
 
-   *target_length = modify_target_size;
+   *target_length = header.target_size;
+   *target_crc    = crc;
 
    return PATCH_SUCCESS;
 }
 
-struct ups_data
+struct ups_header
 {
-   const uint8_t *patch_data, *source_data; 
-   uint8_t *target_data;
-   unsigned patch_length, source_length, target_length;
-   unsigned patch_offset, source_offset, target_offset;
-   unsigned patch_checksum, source_checksum, target_checksum;
+   size_t source_size;
+   size_t target_size;
+   size_t offset;
 };
 
-static uint8_t ups_patch_read(struct ups_data *data) 
+static patch_error_t ups_read_header(const uint8_t *patch_data,
+      size_t patch_length, struct ups_header *header)
 {
-   if (data && data->patch_offset < data->patch_length) 
-   {
-      uint8_t n = data->patch_data[data->patch_offset++];
-      data->patch_checksum = crc32_adjust(data->patch_checksum, n);
-      return n;
-   }
-   return 0x00;
-}
+   uint64_t source_size, target_size;
+   bool invalid  = false;
+   size_t offset = 4;
 
-static uint8_t ups_source_read(struct ups_data *data) 
-{
-   if (data && data->source_offset < data->source_length) 
-   {
-      uint8_t n = data->source_data[data->source_offset++];
-      data->source_checksum = crc32_adjust(data->source_checksum, n);
-      return n;
-   }
-   return 0x00;
+   if (patch_length < 18)
+      return PATCH_PATCH_INVALID;
+   if (memcmp(patch_data, "UPS1", 4) != 0)
+      return PATCH_PATCH_INVALID;
+
+   source_size = patch_decode(patch_data, patch_length - 12,
+         &offset, &invalid);
+   target_size = patch_decode(patch_data, patch_length - 12,
+         &offset, &invalid);
+
+   if (invalid || source_size > SIZE_MAX || target_size >= SIZE_MAX)
+      return PATCH_PATCH_INVALID;
+
+   header->source_size = source_size;
+   header->target_size = target_size;
+   header->offset      = offset;
+   return PATCH_SUCCESS;
 }
 
-static void ups_target_write(struct ups_data *data, uint8_t n) 
+patch_error_t ups_patch_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length)
 {
-   if (data && data->target_offset < data->target_length) 
-   {
-      data->target_data[data->target_offset] = n;
-      data->target_checksum = crc32_adjust(data->target_checksum, n);
-   }
+   struct ups_header header;
+   patch_error_t err = ups_read_header(patch_data, patch_length, &header);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   /* UPS patches apply in both directions. */
+   if (source_length == header.source_size)
+      *target_length = header.target_size;
+   else if (source_length == header.target_size)
+      *target_length = header.source_size;
+   else
+      return PATCH_SOURCE_INVALID;
 
-   if (data)
-      data->target_offset++;
+   return PATCH_SUCCESS;
 }
 
-static uint64_t ups_decode(struct ups_data *data) 
+/**
+ * ups_copy:
+ *
+ * Copies the source to the target for [@start, @end). Source past 
+ * its end reads as zero, target past its end is dropped.
+ **/
+static void ups_copy(const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t target_length, size_t start, size_t end)
 {
-   uint64_t offset = 0, shift = 1;
-   while (true) 
+   size_t source_end;
+
+   if (end > target_length)
+      end = target_length;
+   if (start >= end)
+      return;
+
+   source_end = end < source_length ? end : source_length;
+   if (start < source_end)
    {
-      uint8_t x = ups_patch_read(data);
-      offset += (x & 0x7f) * shift;
-      if (x & 0x80) 
-         break;
-      shift <<= 7;
-      offset += shift;
+      memcpy(target_data + start, source_data + start, source_end - start);
+      start = source_end;
    }
-   return offset;
+   if (start < end)
+      memset(target_data + start, 0, end - start);
 }
 
 patch_error_t ups_apply_patch(
-      const uint8_t *patchdata, size_t patchlength,
-      const uint8_t *sourcedata, size_t sourcelength,
-      uint8_t *targetdata, size_t *targetlength)
+      const uint8_t *patch_data, size_t patch_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc)
 {
-   size_t i;
-   unsigned source_read_length, target_read_length;
-   uint32_t patch_read_checksum = 0, source_read_checksum = 0,
-            target_read_checksum = 0, patch_result_checksum;
-   struct ups_data data = {0};
-
-   data.patch_data      = patchdata;
-   data.source_data     = sourcedata;
-   data.target_data     = targetdata;
-   data.patch_length    = patchlength;
-   data.source_length   = sourcelength;
-   data.target_length   = *targetlength;
-   data.patch_checksum  = ~0;
-   data.source_checksum = ~0;
-   data.target_checksum = ~0;
-
-   if (data.patch_length < 18) 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'U') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'P') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'S') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != '1') 
+   struct ups_header header;
+   size_t offset, end, length;
+   size_t pos           = 0;
+   size_t source_hashed = 0, target_hashed = 0;
+   uint32_t source_crc  = 0, crc           = 0;
+   uint32_t source_read_checksum, target_read_checksum;
+   bool invalid         = false;
+   patch_error_t err    = ups_patch_target_size(patch_data,
+         patch_length, source_length, &length);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   if (!patch_checksum_valid(patch_data, patch_length))
       return PATCH_PATCH_INVALID;
+   if (*target_length < length)
+      return PATCH_TARGET_TOO_SMALL;
 
-   source_read_length = ups_decode(&data);
-   target_read_length = ups_decode(&data);
+   ups_read_header(patch_data, patch_length, &header);
 
-   if (data.source_length != source_read_length
-         && data.source_length != target_read_length) 
-      return PATCH_SOURCE_INVALID;
-   *targetlength = (data.source_length == source_read_length ?
-         target_read_length : source_read_length);
-   if (data.target_length < *targetlength) 
-      return PATCH_TARGET_TOO_SMALL;
-   data.target_length = *targetlength;
+   end    = patch_length - 12;
+   offset = header.offset;
 
-   while (data.patch_offset < data.patch_length - 12) 
+   while (offset < end)
    {
-      unsigned length = ups_decode(&data);
-      while (length--) 
-         ups_target_write(&data, ups_source_read(&data));
-      while (true) 
+      uint64_t skip = patch_decode(patch_data, end, &offset, &invalid);
+
+      if (invalid || skip > SIZE_MAX - pos)
+         return PATCH_PATCH_INVALID;
+
+      ups_copy(source_data, source_length, target_data, length,
+            pos, pos + skip);
+      pos += skip;
+
+      /* XOR run, terminated by a zero byte. */
+      for (;;)
       {
-         uint8_t patch_xor = ups_patch_read(&data);
-         ups_target_write(&data, patch_xor ^ ups_source_read(&data));
+         uint8_t patch_xor;
+
+         if (offset >= end)
+            return PATCH_PATCH_INVALID;
+
+         patch_xor = patch_data[offset++];
+         if (pos < length)
+            target_data[pos] = patch_xor
+               ^ (pos < source_length ? source_data[pos] : 0);
+         pos++;
+
          if (patch_xor == 0)
             break;
       }
-   }
-
-   while (data.source_offset < data.source_length) 
-      ups_target_write(&data, ups_source_read(&data));
-   while (data.target_offset < data.target_length) 
-      ups_target_write(&data, ups_source_read(&data));
-
 
-   for (i = 0; i < 4; i++) 
-      source_read_checksum |= ups_patch_read(&data) << (i * 8);
-   for (i = 0; i < 4; i++) 
-      target_read_checksum |= ups_patch_read(&data) << (i * 8);
+      patch_crc_update(&crc, &target_hashed, target_data,
+            pos < length ? pos : length, false);
+      patch_crc_update(&source_crc, &source_hashed, source_data,
+            pos < source_length ? pos : source_length, false);
+   }
 
-   patch_result_checksum = ~data.patch_checksum;
-   data.source_checksum  = ~data.source_checksum;
-   data.target_checksum  = ~data.target_checksum;
+   ups_copy(source_data, source_length, target_data, length, pos, length);
 
-   for (i = 0; i < 4; i++) 
-      patch_read_checksum |= ups_patch_read(&data) << (i * 8);
+   patch_crc_update(&crc, &target_hashed, target_data, length, true);
+   patch_crc_update(&source_crc, &source_hashed, source_data,
+         source_length, true);
 
-   if (patch_result_checksum != patch_read_checksum) 
-      return PATCH_PATCH_INVALID;
+   source_read_checksum = patch_read_crc(patch_data + end);
+   target_read_checksum = patch_read_crc(patch_data + end + 4);
 
-   if (data.source_checksum == source_read_checksum
-         && data.source_length == source_read_length) 
+   if (source_crc == source_read_checksum
+         && source_length == header.source_size)
    {
-      if (data.target_checksum == target_read_checksum
-            && data.target_length == target_read_length) 
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
-   } 
-   else if (data.source_checksum == target_read_checksum
-         && data.source_length == target_read_length) 
+      if (crc != target_read_checksum
+            || length != header.target_size)
+         return PATCH_TARGET_INVALID;
+   }
+   else if (source_crc == target_read_checksum
+         && source_length == header.target_size)
    {
-      if (data.target_checksum == source_read_checksum
-            && data.target_length == source_read_length) 
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
-   } 
+      if (crc != source_read_checksum
+            || length != header.source_size)
+         return PATCH_TARGET_INVALID;
+   }
+   else
+      return PATCH_SOURCE_INVALID;
 
-   return PATCH_SOURCE_INVALID;
+   *target_length = length;
+   *target_crc    = crc;
+
+   return PATCH_SUCCESS;
 }
 
-patch_error_t ips_apply_patch(
-      const uint8_t *patchdata, size_t patchlen,
-      const uint8_t *sourcedata, size_t sourcelength,
-      uint8_t *targetdata, size_t *targetlength)
+/**
+ * ips_parse:
+ * @patch_data   : IPS patch.
+ * @patch_length : size of @patch_data.
+ * @target_data  : target to write the records to, or NULL to 
+ *                 only check the patch.
+ * @record_end   : end of the furthest record.
+ * @truncate     : size the patch truncates to, or SIZE_MAX.
+ *
+ * Returns: PATCH_SUCCESS if the patch is well formed.
+ **/
+static patch_error_t ips_parse(const uint8_t *patch_data,
+      size_t patch_length, uint8_t *target_data,
+      size_t *record_end, size_t *truncate)
 {
-   uint32_t offset = 5;
-
-   if (patchlen < 8 ||
-         patchdata[0] != 'P' ||
-         patchdata[1] != 'A' ||
-         patchdata[2] != 'T' ||
-         patchdata[3] != 'C' ||
-         patchdata[4] != 'H')
-      return PATCH_PATCH_INVALID;
+   size_t offset = 5;
 
-   memcpy(targetdata, sourcedata, sourcelength);
+   *record_end = 0;
+   *truncate   = SIZE_MAX;
 
-   *targetlength = sourcelength;
+   if (patch_length < 8 || memcmp(patch_data, "PATCH", 5) != 0)
+      return PATCH_PATCH_INVALID;
 
    for (;;)
    {
-      uint32_t address;
-      unsigned length;
+      size_t address, length;
 
-      if (offset > patchlen - 3)
+      if (offset > patch_length - 3)
          break;
 
-      address  = patchdata[offset++] << 16;
-      address |= patchdata[offset++] << 8;
-      address |= patchdata[offset++] << 0;
+      address  = patch_data[offset++] << 16;
+      address |= patch_data[offset++] << 8;
+      address |= patch_data[offset++] << 0;
 
       if (address == 0x454f46) /* EOF */
       {
-         if (offset == patchlen)
+         if (offset == patch_length)
             return PATCH_SUCCESS;
-         else if (offset == patchlen - 3)
+         else if (offset == patch_length - 3)
          {
-            uint32_t size = patchdata[offset++] << 16;
-            size |= patchdata[offset++] << 8;
-            size |= patchdata[offset++] << 0;
-            *targetlength = size;
+            *truncate  = patch_data[offset++] << 16;
+            *truncate |= patch_data[offset++] << 8;
+            *truncate |= patch_data[offset++] << 0;
             return PATCH_SUCCESS;
          }
       }
 
-      if (offset > patchlen - 2)
+      if (offset > patch_length - 2)
          break;
 
-      length  = patchdata[offset++] << 8;
-      length |= patchdata[offset++] << 0;
+      length  = patch_data[offset++] << 8;
+      length |= patch_data[offset++] << 0;
 
       if (length) /* Copy */
       {
-         if (offset > patchlen - length)
+         if (offset > patch_length - length)
             break;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset++];
+         if (target_data)
+            memcpy(target_data + address, patch_data + offset, length);
+         offset += length;
       }
       else /* RLE */
       {
-         if (offset > patchlen - 3)
+         if (offset > patch_length - 3)
             break;
 
-         length  = patchdata[offset++] << 8;
-         length |= patchdata[offset++] << 0;
+         length  = patch_data[offset++] << 8;
+         length |= patch_data[offset++] << 0;
 
          if (length == 0) /* Illegal */
             break;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset];
-
+         if (target_data)
+            memset(target_data + address, patch_data[offset], length);
          offset++;
       }
 
-      if (address > *targetlength)
-         *targetlength = address;
+      if (address + length > *record_end)
+         *record_end = address + length;
    }
 
    return PATCH_PATCH_INVALID;
 }
 
-static bool apply_patch_content(uint8_t **buf,
-      ssize_t *size, const char *patch_desc, const char *patch_path,
-      patch_func_t func)
+patch_error_t ips_patch_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length)
 {
-   size_t target_size;
+   size_t record_end, truncate;
+   patch_error_t err = ips_parse(patch_data, patch_length, NULL,
+         &record_end, &truncate);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   /* Records past the truncation point are still written. */
+   *target_length = source_length;
+   if (record_end > *target_length)
+      *target_length = record_end;
+   if (truncate != SIZE_MAX && truncate > *target_length)
+      *target_length = truncate;
+
+   return PATCH_SUCCESS;
+}
+
+patch_error_t ips_apply_patch(
+      const uint8_t *patch_data, size_t patch_length,
+      const uint8_t *source_data, size_t source_length,
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc)
+{
+   size_t size, record_end, truncate;
+   patch_error_t err = ips_patch_target_size(patch_data, patch_length,
+         source_length, &size);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+   if (*target_length < size)
+      return PATCH_TARGET_TOO_SMALL;
+
+   memcpy(target_data, source_data, source_length);
+   memset(target_data + source_length, 0, size - source_length);
+
+   ips_parse(patch_data, patch_length, target_data,
+         &record_end, &truncate);
+
+   *target_length = truncate != SIZE_MAX ? truncate
+      : (record_end > source_length ? record_end : source_length);
+   *target_crc    = crc32_calculate(target_data, *target_length);
+
+   return PATCH_SUCCESS;
+}
+
+#define PATCH_CACHE_MAGIC "RAPATCH1"
+
+/* Follows the patched content in a patch cache entry, so the 
+ * content itself can be read back in place. Entries are only 
+ * read back on the machine that wrote them. */
+struct patch_cache_trailer
+{
+   char magic[8];
+   uint64_t target_size;
+   uint32_t source_crc;
+   uint32_t target_crc;
+   uint8_t patch_sha1[20];
+};
+
+/**
+ * patch_cache_key:
+ * @trailer      : filled in with the key of the patched content.
+ * @path         : filled in with the path of its cache entry.
+ * @size         : size of @path.
+ * @cache_dir    : patch cache directory.
+ * @source       : content to patch.
+ * @source_size  : size of @source.
+ * @patch_data   : patch to apply.
+ * @patch_size   : size of @patch_data.
+ *
+ * Patched content is keyed by the CRC32 of the content and the 
+ * SHA1 of the patch, so either changing invalidates the entry.
+ **/
+static void patch_cache_key(struct patch_cache_trailer *trailer,
+      char *path, size_t size, const char *cache_dir,
+      const uint8_t *source, size_t source_size,
+      const uint8_t *patch_data, size_t patch_size)
+{
+   unsigned i;
+   char name[64];
+   SHA1Context sha;
+
+   memset(trailer, 0, sizeof(*trailer));
+   memcpy(trailer->magic, PATCH_CACHE_MAGIC, sizeof(trailer->magic));
+
+   sha1_init(&sha);
+   sha1_update(&sha, patch_data, patch_size);
+   sha1_final(&sha, trailer->patch_sha1);
+   trailer->source_crc = crc32_calculate(source, source_size);
+
+   snprintf(name, sizeof(name), "%08X-",
+         (unsigned)trailer->source_crc);
+   for (i = 0; i < 20; i++)
+      snprintf(name + 9 + 2 * i, sizeof(name) - 9 - 2 * i, "%02X",
+            (unsigned)trailer->patch_sha1[i]);
+   strlcat(name, ".patched", sizeof(name));
+
+   fill_pathname_join(path, cache_dir, name, size);
+}
+
+/**
+ * patch_cache_load:
+ * @path         : path of the cache entry.
+ * @key          : key from patch_cache_key().
+ * @buf          : patched content, NUL terminated, to free().
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
+ *
+ * Returns: true if @path holds a valid entry for @key.
+ **/
+static bool patch_cache_load(const char *path,
+      const struct patch_cache_trailer *key,
+      uint8_t **buf, ssize_t *size, uint32_t *crc)
+{
+   struct patch_cache_trailer trailer;
+   ssize_t len   = 0;
+   uint8_t *data = NULL;
+
+   if (!path_file_exists(path))
+      return false;
+   if (!read_file(path, (void**)&data, &len))
+      return false;
+
+   if (len < (ssize_t)sizeof(trailer))
+      goto error;
+
+   memcpy(&trailer, data + len - sizeof(trailer), sizeof(trailer));
+
+   if (memcmp(trailer.magic, key->magic, sizeof(trailer.magic))
+         || memcmp(trailer.patch_sha1, key->patch_sha1,
+            sizeof(trailer.patch_sha1))
+         || trailer.source_crc != key->source_crc
+         || trailer.target_size != (uint64_t)(len - sizeof(trailer)))
+      goto error;
+
+   /* Catches entries that were truncated or damaged on disk. */
+   if (crc32_calculate(data, trailer.target_size) != trailer.target_crc)
+      goto error;
+
+   data[trailer.target_size] = '\0';
+
+   *buf  = data;
+   *size = trailer.target_size;
+   *crc  = trailer.target_crc;
+   return true;
+
+error:
+   RARCH_WARN("Ignoring invalid patch cache entry \"%s\".\n", path);
+   free(data);
+   return false;
+}
+
+/**
+ * patch_cache_store:
+ * @path         : path of the cache entry.
+ * @cache_dir    : patch cache directory, created if needed.
+ * @key          : key from patch_cache_key().
+ * @buf          : patched content.
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
+ *
+ * Writes the entry to a temporary file first, so an interrupted 
+ * write never leaves a partial entry behind under @path.
+ **/
+static void patch_cache_store(const char *path, const char *cache_dir,
+      const struct patch_cache_trailer *key,
+      const uint8_t *buf, size_t size, uint32_t crc)
+{
+   char tmp_path[PATH_MAX_LENGTH];
+   struct patch_cache_trailer trailer = *key;
+   bool ok                            = false;
+   FILE *file                         = NULL;
+
+   trailer.target_size = size;
+   trailer.target_crc  = crc;
+
+   if (!path_is_directory(cache_dir) && !path_mkdir(cache_dir))
+   {
+      RARCH_WARN("Could not create patch cache directory \"%s\".\n",
+            cache_dir);
+      return;
+   }
+
+   strlcpy(tmp_path, path, sizeof(tmp_path));
+   strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+   if ((file = fopen(tmp_path, "wb")))
+   {
+      ok = fwrite(buf, 1, size, file) == size
+         && fwrite(&trailer, sizeof(trailer), 1, file) == 1;
+      ok = (fclose(file) == 0) && ok;
+   }
+
+#ifdef _WIN32
+   /* rename() does not replace existing files here. */
+   if (ok)
+      remove(path);
+#endif
+   if (ok && rename(tmp_path, path) == 0)
+   {
+      RARCH_LOG("Stored patched content in \"%s\".\n", path);
+      return;
+   }
+
+   RARCH_WARN("Could not store patched content in \"%s\".\n", path);
+   remove(tmp_path);
+}
+
+static bool apply_patch_content(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc,
+      const char *patch_desc, const char *patch_path,
+      const char *cache_dir, patch_size_func_t size_func, patch_func_t func)
+{
+   struct patch_cache_trailer key;
+   char cache_path[PATH_MAX_LENGTH];
    ssize_t patch_size;
+   size_t target_size       = 0;
    void *patch_data         = NULL;
-   patch_error_t err        = PATCH_UNKNOWN;
-   bool success             = false;
    uint8_t *patched_content = NULL;
-   ssize_t ret_size         = *size;
-   uint8_t *ret_buf         = *buf;
-   
+   patch_error_t err        = PATCH_UNKNOWN;
+
+   if (!path_file_exists(patch_path))
+      return false;
    if (!read_file(patch_path, &patch_data, &patch_size))
       return false;
    if (patch_size < 0)
       return false;
 
-
-   if (!path_file_exists(patch_path))
-      return false;
-
    RARCH_LOG("Found %s file in \"%s\", attempting to patch ...\n",
          patch_desc, patch_path);
 
-   target_size = ret_size * 4; /* Just to be sure. */
+   if (cache_dir && *cache_dir)
+   {
+      patch_cache_key(&key, cache_path, sizeof(cache_path), cache_dir,
+            source, source_size, (const uint8_t*)patch_data, patch_size);
+
+      if (patch_cache_load(cache_path, &key, buf, size, crc))
+      {
+         RARCH_LOG("Loaded patched content from \"%s\".\n", cache_path);
+         free(patch_data);
+         return true;
+      }
+   }
 
-   patched_content = (uint8_t*)malloc(target_size);
+   /* Sizing only looks at the patch, so the target is allocated 
+    * once, at its final size. */
+   err = size_func((const uint8_t*)patch_data, patch_size,
+         source_size, &target_size);
 
-   if (!patched_content)
+   if (err == PATCH_SUCCESS)
    {
-      RARCH_ERR("Failed to allocate memory for patched content ...\n");
-      goto error;
-   }
+      /* One byte over for the NUL read_file() adds. */
+      patched_content = (uint8_t*)malloc(target_size + 1);
+
+      if (!patched_content)
+      {
+         RARCH_ERR("Failed to allocate memory for patched content ...\n");
+         free(patch_data);
+         return false;
+      }
 
-   err = func((const uint8_t*)patch_data, patch_size, ret_buf,
-         ret_size, patched_content, &target_size);
+      err = func((const uint8_t*)patch_data, patch_size, source,
+            source_size, patched_content, &target_size, crc);
+   }
 
    if (err == PATCH_SUCCESS)
    {
       RARCH_LOG("Content patched successfully (%s).\n", patch_desc);
-      success = true;
+      patched_content[target_size] = '\0';
+      *buf  = patched_content;
+      *size = target_size;
+
+      if (cache_dir && *cache_dir)
+         patch_cache_store(cache_path, cache_dir, &key,
+               patched_content, target_size, *crc);
    }
    else
+   {
       RARCH_ERR("Failed to patch %s: Error #%u\n", patch_desc,
             (unsigned)err);
-
-   if (success)
-   {
-      free(ret_buf);
-      *buf = patched_content;
-      *size = target_size;
+      free(patched_content);
    }
 
    free(patch_data);
    return true;
-
-error:
-   *buf = ret_buf;
-   *size = ret_size;
-   free(patch_data);
-
-   return false;
-}
-
-static bool try_bps_patch(uint8_t **buf, ssize_t *size)
-{
-   bool allow_bps = !g_extern.ups_pref && !g_extern.ips_pref;
-
-   if (!allow_bps)
-      return false;
-   if (g_extern.bps_name[0] == '\0')
-      return false;
-
-   return apply_patch_content(buf, size, "BPS", g_extern.bps_name,
-         bps_apply_patch);
 }
 
-static bool try_ups_patch(uint8_t **buf, ssize_t *size)
+static bool try_patch(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc,
+      const char *patch_desc, const char *patch_path,
+      const char *cache_dir, patch_size_func_t size_func, patch_func_t func)
 {
-   bool allow_ups = !g_extern.bps_pref && !g_extern.ips_pref;
-
-   if (!allow_ups)
-      return false;
-   if (g_extern.ups_name[0] == '\0')
+   if (!patch_path || patch_path[0] == '\0')
       return false;
 
-   return apply_patch_content(buf, size, "UPS", g_extern.ups_name,
-         ups_apply_patch);
+   return apply_patch_content(source, source_size, buf, size, crc,
+         patch_desc, patch_path, cache_dir, size_func, func);
 }
 
-static bool try_ips_patch(uint8_t **buf, ssize_t *size)
+/**
+ * patch_content_files:
+ * @source       : content to patch, left untouched.
+ * @source_size  : size of @source.
+ * @buf          : patched content, NUL terminated, to free().
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
+ * @ups_path     : UPS patch to try, or NULL.
+ * @bps_path     : BPS patch to try, or NULL.
+ * @ips_path     : IPS patch to try, or NULL.
+ * @cache_dir    : patch cache directory, or NULL.
+ *
+ * Apply the first patch found to the content, into a new buffer.
+ * With @cache_dir, the result of an earlier run with the same 
+ * content and patch is loaded from there instead.
+ *
+ * Returns: true if the content was patched.
+ **/
+bool patch_content_files(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc,
+      const char *ups_path, const char *bps_path, const char *ips_path,
+      const char *cache_dir)
 {
-   bool allow_ips = !g_extern.ups_pref && !g_extern.bps_pref;
-
-   if (!allow_ips)
-      return false;
-   if (g_extern.ips_name[0] == '\0')
+   *buf = NULL;
+
+   if (!try_patch(source, source_size, buf, size, crc, "UPS", ups_path,
+            cache_dir, ups_patch_target_size, ups_apply_patch)
+         && !try_patch(source, source_size, buf, size, crc, "BPS", bps_path,
+            cache_dir, bps_patch_target_size, bps_apply_patch)
+         && !try_patch(source, source_size, buf, size, crc, "IPS", ips_path,
+            cache_dir, ips_patch_target_size, ips_apply_patch))
+   {
+      RARCH_WARN("Did not find a valid content patch.\n");
       return false;
+   }
 
-   return apply_patch_content(buf, size, "IPS", g_extern.ips_name,
-         ips_apply_patch);
+   return *buf != NULL;
 }
 
 /**
  * patch_content:
- * @buf          : buffer of the content file.
- * @size         : size   of the content file.
+ * @source       : content to patch, left untouched.
+ * @source_size  : size of @source.
+ * @buf          : patched content, NUL terminated, to free().
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
  *
- * Apply patch to the content file in-memory.
+ * Apply the user's patch to the content, into a new buffer, 
+ * going through the patch cache directory if one is set.
  *
+ * Returns: true if the content was patched.
  **/
-void patch_content(uint8_t **buf, ssize_t *size)
+bool patch_content(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc)
 {
+   bool allow_ups = !g_extern.bps_pref && !g_extern.ips_pref;
+   bool allow_bps = !g_extern.ups_pref && !g_extern.ips_pref;
+   bool allow_ips = !g_extern.ups_pref && !g_extern.bps_pref;
+
    if (g_extern.ups_pref + g_extern.bps_pref + g_extern.ips_pref > 1)
    {
       RARCH_WARN("Several patches are explicitly defined, ignoring all ...\n");
-      return;
+      return false;
    }
 
-   if (!try_ups_patch(buf, size) && !try_bps_patch(buf, size) && !try_ips_patch(buf, size))
-   {
-      RARCH_WARN("Did not find a valid content patch.\n");
-   }
+   return patch_content_files(source, source_size, buf, size, crc,
+         allow_ups ? g_extern.ups_name : NULL,
+         allow_bps ? g_extern.bps_name : NULL,
+         allow_ips ? g_extern.ips_name : NULL,
+         g_settings.patch_cache_directory);
 }
@@ -39,33 +39,84 @@ typedef enum
    PATCH_PATCH_CHECKSUM_INVALID
 } patch_error_t;
 
+/* Size of the target a patch produces from a source of 
+ * the given size. */
+typedef patch_error_t (*patch_size_func_t)(const uint8_t*, size_t,
+      size_t, size_t*);
+
+/* Applies a patch in a single pass, into a target of at least the 
+ * size reported by the matching patch_size_func_t. The target size 
+ * is updated to the size of the result, and its CRC32 returned. */
 typedef patch_error_t (*patch_func_t)(const uint8_t*, size_t,
-      const uint8_t*, size_t, uint8_t*, size_t*);
+      const uint8_t*, size_t, uint8_t*, size_t*, uint32_t*);
+
+patch_error_t bps_patch_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
 
 patch_error_t bps_apply_patch(
       const uint8_t *patch_data, size_t patch_length,
       const uint8_t *source_data, size_t source_length,
-      uint8_t *target_data, size_t *target_length);
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc);
+
+patch_error_t ups_patch_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
 
 patch_error_t ups_apply_patch(
       const uint8_t *patch_data, size_t patch_length,
       const uint8_t *source_data, size_t source_length,
-      uint8_t *target_data, size_t *target_length);
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc);
 
+patch_error_t ips_patch_target_size(
+      const uint8_t *patch_data, size_t patch_length,
+      size_t source_length, size_t *target_length);
 
 patch_error_t ips_apply_patch(
       const uint8_t *patch_data, size_t patch_length,
       const uint8_t *source_data, size_t source_length,
-      uint8_t *target_data, size_t *target_length);
+      uint8_t *target_data, size_t *target_length,
+      uint32_t *target_crc);
 
 /**
  * patch_content:
- * @buf          : buffer of the content file.
- * @size         : size   of the content file.
+ * @source       : content to patch, left untouched.
+ * @source_size  : size of @source.
+ * @buf          : patched content, NUL terminated, to free().
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
+ *
+ * Apply the user's patch to the content, into a new buffer, 
+ * going through the patch cache directory if one is set.
+ *
+ * Returns: true if the content was patched.
+ **/
+bool patch_content(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc);
+
+/**
+ * patch_content_files:
+ * @source       : content to patch, left untouched.
+ * @source_size  : size of @source.
+ * @buf          : patched content, NUL terminated, to free().
+ * @size         : size of the patched content.
+ * @crc          : CRC32 of the patched content.
+ * @ups_path     : UPS patch to try, or NULL.
+ * @bps_path     : BPS patch to try, or NULL.
+ * @ips_path     : IPS patch to try, or NULL.
+ * @cache_dir    : patch cache directory, or NULL.
  *
- * Apply patch to the content file in-memory.
+ * Apply the first patch found to the content, into a new buffer.
+ * With @cache_dir, the result of an earlier run with the same 
+ * content and patch is loaded from there instead.
  *
+ * Returns: true if the content was patched.
  **/
-void patch_content(uint8_t **buf, ssize_t *size);
+bool patch_content_files(const uint8_t *source, size_t source_size,
+      uint8_t **buf, ssize_t *size, uint32_t *crc,
+      const char *ups_path, const char *bps_path, const char *ips_path,
+      const char *cache_dir);
 
 #endif
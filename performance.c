@@ -276,15 +276,16 @@ static void x86_cpuid(int func, int flags[4])
 #define REG_S "esi"
 #endif
 
+   /* Leaf 7 has subleaves selected by ECX, so always ask for 0. */
 #if defined(__GNUC__)
    asm volatile (
          "mov %%" REG_b ", %%" REG_S "\n"
          "cpuid\n"
          "xchg %%" REG_b ", %%" REG_S "\n"
          : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
-         : "a"(func));
+         : "a"(func), "c"(0));
 #elif defined(_MSC_VER)
-   __cpuid(flags, func);
+   __cpuidex(flags, func, 0);
 #else
    RARCH_WARN("Unknown compiler. Cannot check CPUID with inline assembly.\n");
    memset(flags, 0, 4 * sizeof(int));
@@ -397,7 +398,7 @@ uint64_t rarch_get_cpu_features(void)
    uint64_t cpu = 0;
 
    const unsigned MAX_FEATURES = \
-         sizeof(" MMX MMXEXT SSE SSE2 SSE3 SSSE3 SS4 SSE4.2 AES AVX AVX2 NEON VMX VMX128 VFPU PS");
+         sizeof(" MMX MMXEXT SSE SSE2 SSE3 SSSE3 SS4 SSE4.2 AES PCLMUL SHA AVX AVX2 NEON VMX VMX128 VFPU PS");
    char buf[MAX_FEATURES];
    memset(buf, 0, MAX_FEATURES);
 
@@ -432,6 +433,9 @@ uint64_t rarch_get_cpu_features(void)
    if (flags[2] & (1 << 0))
       cpu |= RETRO_SIMD_SSE3;
 
+   if (flags[2] & (1 << 1))
+      cpu |= RARCH_SIMD_PCLMUL;
+
    if (flags[2] & (1 << 9))
       cpu |= RETRO_SIMD_SSSE3;
 
@@ -457,6 +461,8 @@ uint64_t rarch_get_cpu_features(void)
       x86_cpuid(7, flags);
       if (flags[1] & (1 << 5))
          cpu |= RETRO_SIMD_AVX2;
+      if (flags[1] & (1 << 29))
+         cpu |= RARCH_SIMD_SHA;
    }
 
    x86_cpuid(0x80000000, flags);
@@ -485,6 +491,9 @@ uint64_t rarch_get_cpu_features(void)
 #elif defined(__ARM_NEON__)
    cpu |= RETRO_SIMD_NEON;
    arm_enable_runfast_mode();
+#elif defined(__aarch64__)
+   /* Advanced SIMD is mandatory on AArch64. */
+   cpu |= RETRO_SIMD_NEON;
 #elif defined(__ALTIVEC__)
    cpu |= RETRO_SIMD_VMX;
 #elif defined(XBOX360)
@@ -504,6 +513,8 @@ uint64_t rarch_get_cpu_features(void)
    if (cpu & RETRO_SIMD_SSE4)   strlcat(buf, " SSE4", sizeof(buf));
    if (cpu & RETRO_SIMD_SSE42)  strlcat(buf, " SSE4.2", sizeof(buf));
    if (cpu & RETRO_SIMD_AES)    strlcat(buf, " AES", sizeof(buf));
+   if (cpu & RARCH_SIMD_PCLMUL) strlcat(buf, " PCLMUL", sizeof(buf));
+   if (cpu & RARCH_SIMD_SHA)    strlcat(buf, " SHA", sizeof(buf));
    if (cpu & RETRO_SIMD_AVX)    strlcat(buf, " AVX", sizeof(buf));
    if (cpu & RETRO_SIMD_AVX2)   strlcat(buf, " AVX2", sizeof(buf));
    if (cpu & RETRO_SIMD_NEON)   strlcat(buf, " NEON", sizeof(buf));
@@ -517,3 +528,16 @@ uint64_t rarch_get_cpu_features(void)
 
    return cpu;
 }
+
+/**
+ * rarch_get_core_cpu_features:
+ *
+ * Gets CPU features for cores, which only know the 
+ * RETRO_SIMD_* flags.
+ *
+ * Returns: rarch_get_cpu_features() without the RARCH_SIMD_* flags.
+ **/
+uint64_t rarch_get_core_cpu_features(void)
+{
+   return rarch_get_cpu_features() & ~RARCH_SIMD_MASK;
+}
@@ -109,15 +109,25 @@ static INLINE void rarch_perf_stop(struct retro_perf_counter *perf)
    perf->total += rarch_get_perf_counter() - perf->start;
 }
 
+/* CPU features only the frontend uses. These are not part of 
+ * libretro.h, so they live in the upper 32 bits, clear of the 
+ * RETRO_SIMD_* flags, and are masked out before cores see them. */
+#define RARCH_SIMD_PCLMUL   (1ULL << 32)
+#define RARCH_SIMD_SHA      (1ULL << 33)
+#define RARCH_SIMD_MASK     0xffffffff00000000ULL
+
 /**
  * rarch_get_cpu_features:
  *
  * Gets CPU features..
  *
- * Returns: bitmask of all CPU features available.
+ * Returns: bitmask of all CPU features available, including 
+ * the frontend-only RARCH_SIMD_* flags.
  **/
 uint64_t rarch_get_cpu_features(void);
 
+uint64_t rarch_get_core_cpu_features(void);
+
 /**
  * rarch_get_cpu_cores:
  *
@@ -34,6 +34,7 @@
 #include <compat/strl.h>
 #include "screenshot.h"
 #include "performance.h"
+#include "hash.h"
 #include "cheats.h"
 #include <compat/getopt.h>
 #include <compat/posix_string.h>
@@ -222,8 +223,10 @@ static void print_help(void)
 #ifdef HAVE_NETPLAY
    puts("\t-H/--host: Host netplay as user 1.");
    puts("\t-C/--connect: Connect to netplay as user 2.");
+   puts("\t\tWith more than two users, the host assigns each client its user.");
    puts("\t--port: Port used to netplay. Default is 55435.");
    puts("\t-F/--frames: Sync frames when using netplay.");
+   puts("\t--users: Number of users the host waits for (2-16). Default is 2.");
    puts("\t--spectate: Netplay will become spectating mode.");
    puts("\t\tHost can live stream the game content to users that connect.");
    puts("\t\tHowever, the client will not be able to play. Multiple clients can connect to the host.");
@@ -246,12 +249,21 @@ static void print_help(void)
    puts("\t--max-frames: Runs for the specified number of frames, then exits.\n");
 }
 
-static void set_basename(const char *path)
+/**
+ * rarch_fill_content_basename:
+ * @basename             : output path.
+ * @path                 : content path.
+ * @size                 : size of @basename.
+ *
+ * Fills in the path saves, states and patches for @path 
+ * are named after, without any extension.
+ **/
+void rarch_fill_content_basename(char *basename, const char *path,
+      size_t size)
 {
    char *dst = NULL;
 
-   strlcpy(g_extern.fullpath, path, sizeof(g_extern.fullpath));
-   strlcpy(g_extern.basename, path, sizeof(g_extern.basename));
+   strlcpy(basename, path, size);
 
 #ifdef HAVE_COMPRESSION
    /* Removing extension is a bit tricky for compressed files.
@@ -273,14 +285,21 @@ static void set_basename(const char *path)
     * directory then and the name of srm and states are meaningful.
     *
     */
-   path_basedir(g_extern.basename);
-   fill_pathname_dir(g_extern.basename, path, "", sizeof(g_extern.basename));
+   path_basedir(basename);
+   fill_pathname_dir(basename, path, "", size);
 #endif
 
-   if ((dst = strrchr(g_extern.basename, '.')))
+   if ((dst = strrchr(basename, '.')))
       *dst = '\0';
 }
 
+static void set_basename(const char *path)
+{
+   strlcpy(g_extern.fullpath, path, sizeof(g_extern.fullpath));
+   rarch_fill_content_basename(g_extern.basename, path,
+         sizeof(g_extern.basename));
+}
+
 static void set_special_paths(char **argv, unsigned num_content)
 {
    unsigned i;
@@ -391,6 +410,7 @@ static void parse_input(int argc, char *argv[])
    g_extern.has_set_netplay_ip_address = false;
    g_extern.has_set_netplay_delay_frames = false;
    g_extern.has_set_netplay_ip_port = false;
+   g_extern.has_set_netplay_users = false;
 
    g_extern.has_set_ups_pref = false;
    g_extern.has_set_bps_pref = false;
@@ -443,6 +463,7 @@ static void parse_input(int argc, char *argv[])
       { "frames", 1, NULL, 'F' },
       { "port", 1, &val, 'p' },
       { "spectate", 0, &val, 'S' },
+      { "users", 1, &val, 'u' },
 #endif
       { "nick", 1, &val, 'N' },
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
@@ -677,6 +698,11 @@ static void parse_input(int argc, char *argv[])
                   g_extern.netplay_is_spectate = true;
                   break;
 
+               case 'u':
+                  g_extern.has_set_netplay_users = true;
+                  g_extern.netplay_users = strtoul(optarg, NULL, 0);
+                  break;
+
 #endif
                case 'N':
                   g_extern.has_set_username = true;
@@ -920,7 +946,9 @@ static void init_rewind(void)
          (unsigned)(g_settings.rewind_buffer_size / 1000000));
 
    g_extern.rewind.state = state_manager_new(g_extern.rewind.size,
-         g_settings.rewind_buffer_size);
+         g_settings.rewind_buffer_size, g_settings.rewind_keyframe_interval,
+         g_settings.rewind_threaded,
+         g_settings.rewind_compression);
 
    if (!g_extern.rewind.state)
       RARCH_WARN(RETRO_LOG_REWIND_INIT_FAILED);
@@ -1007,8 +1035,8 @@ static bool init_netplay(void)
    driver.netplay_data = (netplay_t*)netplay_new(
          g_extern.netplay_is_client ? g_extern.netplay_server : NULL,
          g_extern.netplay_port ? g_extern.netplay_port : RARCH_DEFAULT_PORT,
-         g_extern.netplay_sync_frames, &cbs, g_extern.netplay_is_spectate,
-         g_settings.username);
+         g_extern.netplay_sync_frames, g_extern.netplay_users,
+         &cbs, g_extern.netplay_is_spectate, g_settings.username);
 
    if (driver.netplay_data)
       return true;
@@ -1067,7 +1095,8 @@ static void init_autosave(void)
       g_extern.autosave[i] = autosave_new(path,
             pretro_get_memory_data(type),
             pretro_get_memory_size(type),
-            g_settings.autosave_interval);
+            g_settings.autosave_interval,
+            g_settings.autosave_journal);
       if (!g_extern.autosave[i])
          RARCH_WARN(RETRO_LOG_INIT_AUTOSAVE_FAILED);
    }
@@ -1765,6 +1794,8 @@ static void deinit_core(void)
    pretro_unload_game();
    pretro_deinit();
 
+   deinit_content_file();
+
    rarch_main_command(RARCH_CMD_DRIVERS_DEINIT);
 
    uninit_libretro_sym();
@@ -1851,6 +1882,7 @@ int rarch_main_init(int argc, char *argv[])
    }
 
    validate_cpu_features();
+   hash_init();
    config_load();
 
    init_libretro_sym(g_extern.libretro_dummy);
@@ -1989,6 +2021,12 @@ void rarch_main_set_state(unsigned cmd)
          break;
       case RARCH_ACTION_STATE_LOAD_CONTENT:
 #ifdef HAVE_MENU
+#ifdef HAVE_THREADS
+         /* Prepare the content in the background first. The data 
+          * runloop comes back to this state once it is ready. */
+         if (content_load_task_start(g_extern.fullpath))
+            break;
+#endif
          /* If content loading fails, we go back to menu. */
          if (!menu_load_content())
             rarch_main_set_state(RARCH_ACTION_STATE_MENU_RUNNING);
@@ -2323,6 +2361,12 @@ bool rarch_main_command(unsigned cmd)
          else
             rarch_main_command(RARCH_CMD_REWIND_DEINIT);
          break;
+      case RARCH_CMD_REWIND_REINIT:
+         if (!g_extern.rewind.state)
+            break;
+         rarch_main_command(RARCH_CMD_REWIND_DEINIT);
+         rarch_main_command(RARCH_CMD_REWIND_INIT);
+         break;
       case RARCH_CMD_AUTOSAVE_DEINIT:
 #ifdef HAVE_THREADS
          deinit_autosave();
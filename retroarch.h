@@ -52,6 +52,8 @@ enum basic_event
    RARCH_CMD_REWIND_INIT,
    /* Toggles rewind. */
    RARCH_CMD_REWIND_TOGGLE,
+   /* Reinitializes rewind if it is enabled. */
+   RARCH_CMD_REWIND_REINIT,
    /* Deinitializes autosave. */
    RARCH_CMD_AUTOSAVE_DEINIT,
    /* Initializes autosave. */
@@ -327,6 +329,18 @@ bool rarch_replace_config(const char *path);
 void rarch_playlist_load_content(content_playlist_t *playlist,
       unsigned index);
 
+/**
+ * rarch_fill_content_basename:
+ * @basename             : output path.
+ * @path                 : content path.
+ * @size                 : size of @basename.
+ *
+ * Fills in the path saves, states and patches for @path 
+ * are named after, without any extension.
+ **/
+void rarch_fill_content_basename(char *basename, const char *path,
+      size_t size);
+
 /**
  * rarch_defer_core:
  * @core_info            : Core info list handle.
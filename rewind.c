@@ -22,6 +22,15 @@
 #include <stdint.h>
 #include <string.h>
 #include <retro_inline.h>
+#include <retro_endianness.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+#include <zlib.h>
+#endif
 
 #ifndef UINT16_MAX
 #define UINT16_MAX 0xffff
@@ -40,6 +49,30 @@
 #define NO_UNALIGNED_MEM
 #endif
 
+/* AVX2 scanners are built with a per-function target attribute,
+ * so the rest of the file doesn't need -mavx2, and only
+ * selected if the CPU reports support at runtime. */
+#if defined(CPU_X86) && defined(__GNUC__) && \
+   (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_REWIND_AVX2
+#include <immintrin.h>
+#endif
+
+/* Advanced SIMD is mandatory on AArch64. */
+#if defined(__aarch64__)
+#define HAVE_REWIND_NEON
+#include <arm_neon.h>
+#endif
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Scanners need this much readable padding past the end of a block. */
+#define SCAN_PADDING 32
+
+typedef size_t (*state_manager_scan_t)(const uint16_t *a, const uint16_t *b);
+
 /* Format per frame (pseudocode): */
 #if 0
 size nextstart;
@@ -78,7 +111,22 @@ size thisstart;
  * the tail retreats until it can no longer collide.
  *
  * This means that on average, ~2 * maxcompsize is 
- * unused at any given moment. */
+ * unused at any given moment.
+ *
+ * If deltas are deflated, each frame is instead stored as
+ * uint32 deltasize, uint32 storedsize, followed by storedsize bytes
+ * (padded to an even count). If storedsize equals deltasize, the
+ * delta is stored as-is, otherwise it is a zlib stream which
+ * inflates to deltasize bytes of the format above.
+ *
+ * Every frame starts with a uint16 FRAME_DELTA or FRAME_KEY.
+ * A keyframe holds the entire older state rather than a delta,
+ * so it can be applied without the newer frames; with a keyframe
+ * interval of N, the frame that restores push number k is a
+ * keyframe if k % N == 0. */
+
+#define FRAME_DELTA 0
+#define FRAME_KEY   1
 
 
 /* These are called very few constant times per frame, 
@@ -96,6 +144,24 @@ static INLINE size_t read_size_t(const void *ptr)
    return ret;
 }
 
+/* We could do memcpy, but it seems that memcpy has a 
+ * constant-per-call overhead that actually shows up.
+ *
+ * Our average size in here seems to be 8 or something.
+ * Therefore, we do something with lower overhead. */
+static INLINE void copy_words(uint16_t *out, const uint16_t *in, size_t count)
+{
+#if __SSE2__
+   for (; count >= 8; count -= 8, in += 8, out += 8)
+      _mm_storeu_si128((__m128i*)out, _mm_loadu_si128((const __m128i*)in));
+#elif defined(HAVE_REWIND_NEON)
+   for (; count >= 8; count -= 8, in += 8, out += 8)
+      vst1q_u16(out, vld1q_u16(in));
+#endif
+   while (count--)
+      *out++ = *in++;
+}
+
 struct state_manager
 {
    uint8_t *data;
@@ -110,17 +176,124 @@ struct state_manager
 
    /* This one is rounded up from reset::blocksize. */
    size_t blocksize;
+   size_t state_size;
+
+   /* Output of state_manager_delta_encode(), allocated on first use. */
+   uint8_t *transfer;
 
-   /* size_t + (blocksize + 131071) / 131072 * 
+   /* size_t + u16 + (blocksize + 131071) / 131072 * 
     * (blocksize + u16 + u16) + u16 + u32 + size_t
     * (yes, the math is a bit ugly). */
    size_t maxcompsize;
 
    unsigned entries;
    bool thisblock_valid;
+
+   /* Push number of the state in thisblock. The newest frame
+    * in the ring buffer restores push number serial - 1. */
+   uint64_t serial;
+   unsigned keyframe_interval;
+
+   /* Delta scanners, picked at init from CPU features. */
+   state_manager_scan_t find_change;
+   state_manager_scan_t find_same;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   /* Second stage; deltas are built in 'scratch' and deflated
+    * into the ring buffer. maxdeltasize bounds a raw delta. */
+   bool compress_deltas;
+   bool deflate_init;
+   bool inflate_init;
+   z_stream deflate_stream;
+   z_stream inflate_stream;
+   uint8_t *scratch;
+   size_t maxdeltasize;
+#endif
+
+#ifdef HAVE_THREADS
+   /* Delta encoding runs on this thread if non-NULL.
+    * While 'busy' is set, the worker owns thisblock, nextblock
+    * and the ring buffer; the main thread must not touch them. */
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   bool busy;
+   bool quit;
+#endif
+
+   /* Timing of the encoder, wherever it runs. Only the main 
+    * thread adds it to the registered gen_deltas counter. */
+   struct retro_perf_counter encode_perf;
 };
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
+static struct retro_perf_counter gen_deltas = {"gen_deltas"};
+
+static void state_manager_push_compress(state_manager_t *state);
+static void state_manager_select_scanners(state_manager_t *state);
+
+#ifdef HAVE_THREADS
+/**
+ * state_manager_thread:
+ * @data            : pointer to state manager object
+ *
+ * Worker loop for threaded rewind. Waits for a push to be
+ * handed off by state_manager_push_do(), encodes it into the
+ * ring buffer and signals completion.
+ **/
+static void state_manager_thread(void *data)
+{
+   state_manager_t *state = (state_manager_t*)data;
+
+   slock_lock(state->lock);
+
+   for (;;)
+   {
+      while (!state->busy && !state->quit)
+         scond_wait(state->cond, state->lock);
+
+      if (state->quit)
+         break;
+
+      slock_unlock(state->lock);
+      state_manager_push_compress(state);
+      slock_lock(state->lock);
+
+      state->busy = false;
+      scond_broadcast(state->cond);
+   }
+
+   slock_unlock(state->lock);
+}
+#endif
+
+/**
+ * state_manager_sync:
+ * @state           : pointer to state manager object
+ *
+ * Waits until any push in flight on the worker thread has
+ * been written to the ring buffer, then adds the time spent
+ * encoding to the gen_deltas counter. Main thread only.
+ **/
+static void state_manager_sync(state_manager_t *state)
+{
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      while (state->busy)
+         scond_wait(state->cond, state->lock);
+      slock_unlock(state->lock);
+   }
+#endif
+
+   gen_deltas.total            += state->encode_perf.total;
+   gen_deltas.call_cnt         += state->encode_perf.call_cnt;
+   state->encode_perf.total    = 0;
+   state->encode_perf.call_cnt = 0;
+}
+
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size,
+      unsigned keyframe_interval, bool threaded, bool compress)
 {
    size_t newblocksize;
    int maxcblks;
@@ -130,20 +303,25 @@ state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
    if (!state)
       return NULL;
 
+   /* Registered here, as the encoder may run on the worker. */
+   rarch_perf_register(&gen_deltas);
+
    newblocksize = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
    state->blocksize = newblocksize;
+   state->state_size = state_size;
 
    maxcblks = (state->blocksize + maxcblkcover - 1) / maxcblkcover;
    state->maxcompsize = state->blocksize + maxcblks * sizeof(uint16_t) * 2 +
-      sizeof(uint16_t) + sizeof(uint32_t) + sizeof(size_t) * 2;
+      sizeof(uint16_t) * 2 + sizeof(uint32_t) + sizeof(size_t) * 2;
+   state->keyframe_interval = keyframe_interval;
 
    state->data = (uint8_t*)malloc(buffer_size);
 
    state->thisblock = (uint8_t*)
-      calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
+      calloc(state->blocksize + sizeof(uint16_t) * 4 + SCAN_PADDING, 1);
    state->nextblock = (uint8_t*)
-      calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
-   if (!state->data || !state->thisblock || !state->nextblock)
+      calloc(state->blocksize + sizeof(uint16_t) * 4 + SCAN_PADDING, 1);
+   if ((buffer_size && !state->data) || !state->thisblock || !state->nextblock)
       goto error;
 
    /* Force in a different byte at the end, so we don't need to check 
@@ -155,7 +333,7 @@ state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
     * There is also some padding at the end. This is so we don't 
     * read outside the buffer end if we're reading in large blocks;
     *
-    * It doesn't make any difference to us, but sacrificing 16 bytes to get 
+    * It doesn't make any difference to us, but sacrificing 32 bytes to get 
     * Valgrind happy is worth it. */
    *(uint16_t*)(state->thisblock + state->blocksize + sizeof(uint16_t) * 3) =
       0xFFFF;
@@ -164,9 +342,51 @@ state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
 
    state->capacity = buffer_size;
 
+   state_manager_select_scanners(state);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (compress)
+   {
+      state->maxdeltasize = state->maxcompsize - sizeof(size_t) * 2;
+      state->maxcompsize += sizeof(uint32_t) * 2 + 1;
+
+      state->scratch = (uint8_t*)malloc(state->maxdeltasize);
+      if (!state->scratch)
+         goto error;
+
+      if (deflateInit(&state->deflate_stream, Z_BEST_SPEED) != Z_OK)
+         goto error;
+      state->deflate_init = true;
+
+      if (inflateInit(&state->inflate_stream) != Z_OK)
+         goto error;
+      state->inflate_init = true;
+
+      state->compress_deltas = true;
+   }
+#else
+   (void)compress;
+#endif
+
    state->head = state->data + sizeof(size_t);
    state->tail = state->data + sizeof(size_t);
 
+#ifdef HAVE_THREADS
+   if (threaded)
+   {
+      state->lock = slock_new();
+      state->cond = scond_new();
+      if (!state->lock || !state->cond)
+         goto error;
+
+      state->thread = sthread_create(state_manager_thread, state);
+      if (!state->thread)
+         goto error;
+   }
+#else
+   (void)threaded;
+#endif
+
    return state;
 
 error:
@@ -179,60 +399,122 @@ void state_manager_free(state_manager_t *state)
    if (!state)
       return;
 
+   state_manager_sync(state);
+
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->quit = true;
+      scond_broadcast(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+   }
+   if (state->lock)
+      slock_free(state->lock);
+   if (state->cond)
+      scond_free(state->cond);
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->deflate_init)
+      deflateEnd(&state->deflate_stream);
+   if (state->inflate_init)
+      inflateEnd(&state->inflate_stream);
+   free(state->scratch);
+#endif
+
    free(state->data);
+   free(state->transfer);
    free(state->thisblock);
    free(state->nextblock);
    free(state);
 }
 
-bool state_manager_pop(state_manager_t *state, const void **data)
+#ifdef HAVE_ZLIB_DEFLATE
+/**
+ * state_manager_deflate:
+ * @state           : pointer to state manager object
+ * @delta           : delta built in state->scratch
+ * @deltasize       : size of @delta
+ * @out             : where to store the frame in the ring buffer
+ *
+ * Second compression stage. Stores the delta deflated if that
+ * makes it smaller, otherwise as-is.
+ *
+ * Returns: end of the stored frame (excluding the prev pointer).
+ **/
+static uint8_t *state_manager_deflate(state_manager_t *state,
+      const uint8_t *delta, size_t deltasize, uint8_t *out)
 {
-   size_t start;
-   uint8_t *out;
-   uint16_t *out16;
-   const uint8_t *compressed = NULL;
-   const uint16_t *compressed16 = NULL;
-
-   *data = NULL;
-
-   if (state->thisblock_valid)
+   uint32_t header[2];
+   z_stream *stream = &state->deflate_stream;
+   uint8_t *stored  = out + sizeof(header);
+
+   deflateReset(stream);
+   stream->next_in   = (Bytef*)delta;
+   stream->avail_in  = deltasize;
+   stream->next_out  = stored;
+   stream->avail_out = deltasize - 1;
+
+   header[0] = deltasize;
+   if (deflate(stream, Z_FINISH) == Z_STREAM_END)
+      header[1] = stream->total_out;
+   else
    {
-      state->thisblock_valid = false;
-      state->entries--;
-      *data = state->thisblock;
-      return true;
+      memcpy(stored, delta, deltasize);
+      header[1] = deltasize;
    }
 
-   if (state->head == state->tail)
-      return false;
+   memcpy(out, header, sizeof(header));
+   return stored + ((header[1] + 1) & ~1u);
+}
 
-   start = read_size_t(state->head - sizeof(size_t));
-   state->head = state->data + start;
+/**
+ * state_manager_inflate:
+ * @state           : pointer to state manager object
+ * @in              : frame data, past its header
+ * @raw_size        : size of the delta, from the header
+ * @stored_size     : size of @in, from the header
+ *
+ * Undoes state_manager_deflate().
+ *
+ * Returns: pointer to the raw delta, or NULL if it could not
+ * be inflated.
+ **/
+static const uint8_t *state_manager_inflate(state_manager_t *state,
+      const uint8_t *in, uint32_t raw_size, uint32_t stored_size)
+{
+   z_stream *stream = &state->inflate_stream;
 
-   compressed = state->data + start + sizeof(size_t);
-   out = state->thisblock;
+   if (stored_size == raw_size)
+      return in;
 
-   /* Begin decompression code
-    * out is the last pushed (or returned) state */
-   compressed16 = (const uint16_t*)compressed;
-   out16 = (uint16_t*)out;
+   inflateReset(stream);
+   stream->next_in   = (Bytef*)in;
+   stream->avail_in  = stored_size;
+   stream->next_out  = state->scratch;
+   stream->avail_out = raw_size;
+
+   if (inflate(stream, Z_FINISH) != Z_STREAM_END)
+      return NULL;
+   return state->scratch;
+}
+#endif
 
+/* out is the last pushed (or returned) state. */
+static void apply_delta(uint16_t *out16, const uint16_t *compressed16)
+{
+   /* Begin decompression code */
    for (;;)
    {
-      uint16_t i;
       uint16_t numchanged = *(compressed16++);
 
       if (numchanged)
       {
          out16 += *compressed16++;
 
-         /* We could do memcpy, but it seems that memcpy has a 
-          * constant-per-call overhead that actually shows up.
-          *
-          * Our average size in here seems to be 8 or something.
-          * Therefore, we do something with lower overhead. */
-         for (i = 0; i < numchanged; i++)
-            out16[i] = compressed16[i];
+         copy_words(out16, compressed16, numchanged);
 
          compressed16 += numchanged;
          out16 += numchanged;
@@ -248,8 +530,197 @@ bool state_manager_pop(state_manager_t *state, const void **data)
       }
    }
    /* End decompression code */
+}
+
+/**
+ * delta_valid:
+ * @compressed16    : delta, past the frame type
+ * @count           : number of uint16s available in @compressed16
+ * @num16s          : number of uint16s in the state
+ *
+ * Checks that applying a delta from an untrusted source stays
+ * within both the delta and the state.
+ *
+ * Returns: true if apply_delta() can safely use it.
+ **/
+static bool delta_valid(const uint16_t *compressed16, size_t count,
+      size_t num16s)
+{
+   size_t pos = 0;
+
+   while (count)
+   {
+      uint16_t numchanged = *(compressed16++);
+
+      count--;
+
+      if (numchanged)
+      {
+         if (count < 1u + numchanged)
+            return false;
+
+         pos += compressed16[0] + numchanged;
+         compressed16 += 1 + numchanged;
+         count -= 1 + numchanged;
+      }
+      else
+      {
+         uint32_t numunchanged;
+
+         if (count < 2)
+            return false;
+
+         numunchanged = compressed16[0] | (compressed16[1] << 16);
+         if (!numunchanged)
+            return true;
+
+         pos += numunchanged;
+         compressed16 += 2;
+         count -= 2;
+      }
+
+      if (pos > num16s)
+         return false;
+   }
+
+   return false;
+}
+
+/**
+ * state_manager_pop_entry:
+ * @state           : pointer to state manager object
+ *
+ * Removes the newest frame from the ring buffer and applies it
+ * to thisblock, which then holds the state one push older.
+ *
+ * Returns: true if successful, false if the frame was unreadable.
+ **/
+static bool state_manager_pop_entry(state_manager_t *state)
+{
+   size_t start;
+   uint16_t *out16;
+   const uint8_t *compressed = NULL;
+   const uint16_t *compressed16 = NULL;
+
+   start = read_size_t(state->head - sizeof(size_t));
+   state->head = state->data + start;
+
+   compressed = state->data + start + sizeof(size_t);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->compress_deltas)
+   {
+      uint32_t header[2];
+
+      memcpy(header, compressed, sizeof(header));
+      compressed = state_manager_inflate(state,
+            compressed + sizeof(header), header[0], header[1]);
+      if (!compressed)
+      {
+         /* The ring buffer is corrupt; nothing older can be trusted. */
+         RARCH_ERR("Failed to inflate rewind state.\n");
+         state->tail = state->head;
+         state->entries = 0;
+         return false;
+      }
+   }
+#endif
+
+   compressed16 = (const uint16_t*)compressed;
+   out16 = (uint16_t*)state->thisblock;
+
+   if (*compressed16++ == FRAME_KEY)
+      copy_words(out16, compressed16, state->blocksize / sizeof(uint16_t));
+   else
+      apply_delta(out16, compressed16);
 
    state->entries--;
+   state->serial--;
+   return true;
+}
+
+bool state_manager_pop(state_manager_t *state, const void **data)
+{
+   *data = NULL;
+
+   state_manager_sync(state);
+
+   if (state->thisblock_valid)
+   {
+      state->thisblock_valid = false;
+      state->entries--;
+      *data = state->thisblock;
+      return true;
+   }
+
+   if (state->head == state->tail)
+      return false;
+
+   if (!state_manager_pop_entry(state))
+      return false;
+
+   *data = state->thisblock;
+   return true;
+}
+
+bool state_manager_seek(state_manager_t *state, unsigned frames_back,
+      const void **data)
+{
+   unsigned avail, skip, i;
+   const uint8_t *head;
+
+   *data = NULL;
+
+   if (!frames_back)
+      return false;
+
+   state_manager_sync(state);
+
+   if (state->thisblock_valid)
+   {
+      state->thisblock_valid = false;
+      state->entries--;
+      *data = state->thisblock;
+      if (!--frames_back)
+         return true;
+   }
+
+   /* Find out how far back we can go. Following the prev
+    * pointers is cheap, it's applying the frames that isn't. */
+   head = state->head;
+   for (avail = 0; avail < frames_back && head != state->tail; avail++)
+      head = state->data + read_size_t(head - sizeof(size_t));
+
+   if (!avail)
+      return *data != NULL;
+
+   /* Drop everything newer than the closest keyframe at or
+    * after the target without decoding it. */
+   skip = 0;
+   if (state->keyframe_interval)
+   {
+      uint64_t target = state->serial - avail;
+      uint64_t key    = (target + state->keyframe_interval - 1) /
+         state->keyframe_interval * state->keyframe_interval;
+
+      if (key < state->serial)
+         skip = state->serial - 1 - key;
+   }
+
+   for (i = 0; i < skip; i++)
+      state->head = state->data + read_size_t(state->head - sizeof(size_t));
+   state->entries -= skip;
+   state->serial  -= skip;
+
+   for (i = skip; i < avail; i++)
+   {
+      if (!state_manager_pop_entry(state))
+      {
+         *data = NULL;
+         return false;
+      }
+   }
+
    *data = state->thisblock;
    return true;
 }
@@ -260,7 +731,9 @@ void state_manager_push_where(state_manager_t *state, void **data)
     * pushed state, or we could end up applying a 'patch' to wrong 
     * savestate, and that'd blow up rather quickly. */
 
-   if (!state->thisblock_valid) 
+   state_manager_sync(state);
+
+   if (!state->thisblock_valid)
    {
       const void *ignored;
       if (state_manager_pop(state, &ignored))
@@ -298,11 +771,10 @@ static INLINE int compat_ctz(unsigned x)
 }
 #endif
 
-#include <emmintrin.h>
 /* There's no equivalent in libc, you'd think so ...
  * std::mismatch exists, but it's not optimized at all. */
 
-static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
+static size_t find_change(const uint16_t *a, const uint16_t *b)
 {
    const __m128i *a128 = (const __m128i*)a;
    const __m128i *b128 = (const __m128i*)b;
@@ -326,7 +798,7 @@ static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
    }
 }
 #else
-static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
+static size_t find_change(const uint16_t *a, const uint16_t *b)
 {
    const uint16_t *a_org = a;
 #ifdef NO_UNALIGNED_MEM
@@ -359,7 +831,7 @@ static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
 }
 #endif
 
-static INLINE size_t find_same(const uint16_t *a, const uint16_t *b)
+static size_t find_same(const uint16_t *a, const uint16_t *b)
 {
    const uint16_t *a_org = a;
 #ifdef NO_UNALIGNED_MEM
@@ -399,121 +871,339 @@ static INLINE size_t find_same(const uint16_t *a, const uint16_t *b)
    return a - a_org;
 }
 
-void state_manager_push_do(state_manager_t *state)
+#ifdef HAVE_REWIND_AVX2
+__attribute__((target("avx2")))
+static size_t find_change_avx2(const uint16_t *a, const uint16_t *b)
 {
-   if (state->thisblock_valid)
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
+
+   for (;;)
    {
-      if (state->capacity < sizeof(size_t) + state->maxcompsize)
-         return;
+      __m256i v0    = _mm256_loadu_si256(a256);
+      __m256i v1    = _mm256_loadu_si256(b256);
+      __m256i c     = _mm256_cmpeq_epi16(v0, v1);
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(c);
 
-recheckcapacity:;
+      if (mask != 0xffffffffu)
+         return ((size_t)((const uint8_t*)a256 - (const uint8_t*)a) +
+               __builtin_ctz(~mask)) >> 1;
+
+      a256++;
+      b256++;
+   }
+}
+
+/* Same pairing rules as find_same: looks for two identical
+ * words at an even offset from the start, then backs up one. */
+__attribute__((target("avx2")))
+static size_t find_same_avx2(const uint16_t *a, const uint16_t *b)
+{
+   size_t ret;
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
 
-      size_t headpos = state->head - state->data;
-      size_t tailpos = state->tail - state->data;
-      size_t remaining = (tailpos + state->capacity -
-            sizeof(size_t) - headpos - 1) % state->capacity + 1;
+   for (;;)
+   {
+      __m256i v0    = _mm256_loadu_si256(a256);
+      __m256i v1    = _mm256_loadu_si256(b256);
+      __m256i c     = _mm256_cmpeq_epi32(v0, v1);
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(c);
 
-      if (remaining <= state->maxcompsize)
+      if (mask)
       {
-         state->tail = state->data + read_size_t(state->tail);
-         state->entries--;
-         goto recheckcapacity;
+         ret = ((size_t)((const uint8_t*)a256 - (const uint8_t*)a) +
+               __builtin_ctz(mask)) >> 1;
+         break;
       }
 
-      RARCH_PERFORMANCE_INIT(gen_deltas);
-      RARCH_PERFORMANCE_START(gen_deltas);
+      a256++;
+      b256++;
+   }
 
-      const uint8_t *oldb = state->thisblock;
-      const uint8_t *newb = state->nextblock;
-      uint8_t *compressed = state->head + sizeof(size_t);
+   if (ret && a[ret - 1] == b[ret - 1])
+      ret--;
+   return ret;
+}
+#endif
 
-      /* Begin compression code; 'compressed' will point to 
-       * the end of the compressed data (excluding the prev pointer). */
-      const uint16_t *old16 = (const uint16_t*)oldb;
-      const uint16_t *new16 = (const uint16_t*)newb;
-      uint16_t *compressed16 = (uint16_t*)compressed;
-      size_t num16s = state->blocksize / sizeof(uint16_t);
+#ifdef HAVE_REWIND_NEON
+static size_t find_change_neon(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
 
-      while (num16s)
-      {
-         size_t i;
-         size_t skip = find_change(old16, new16);
+   for (;;)
+   {
+      uint16x8_t diff = veorq_u16(vld1q_u16(a), vld1q_u16(b));
 
-         if (skip >= num16s)
-            break;
+      if (vmaxvq_u16(diff))
+         break;
+
+      a += 8;
+      b += 8;
+   }
+
+   while (*a == *b)
+   {
+      a++;
+      b++;
+   }
+   return a - a_org;
+}
+
+static size_t find_same_neon(const uint16_t *a, const uint16_t *b)
+{
+   size_t ret;
+   const uint32_t *a32 = (const uint32_t*)a;
+   const uint32_t *b32 = (const uint32_t*)b;
+
+   for (;;)
+   {
+      uint32x4_t c = vceqq_u32(vld1q_u32(a32), vld1q_u32(b32));
+
+      if (vmaxvq_u32(c))
+         break;
+
+      a32 += 4;
+      b32 += 4;
+   }
+
+   while (*a32 != *b32)
+   {
+      a32++;
+      b32++;
+   }
+
+   ret = (const uint16_t*)a32 - a;
+   if (ret && a[ret - 1] == b[ret - 1])
+      ret--;
+   return ret;
+}
+#endif
+
+/**
+ * state_manager_select_scanners:
+ * @state           : pointer to state manager object
+ *
+ * Picks the widest delta scanners the CPU supports.
+ **/
+static void state_manager_select_scanners(state_manager_t *state)
+{
+#ifdef HAVE_REWIND_AVX2
+   uint64_t cpu = rarch_get_cpu_features();
+#endif
+
+   state->find_change = find_change;
+   state->find_same   = find_same;
+
+#if defined(HAVE_REWIND_AVX2)
+   if ((cpu & RETRO_SIMD_AVX) && (cpu & RETRO_SIMD_AVX2))
+   {
+      state->find_change = find_change_avx2;
+      state->find_same   = find_same_avx2;
+   }
+#elif defined(HAVE_REWIND_NEON)
+   state->find_change = find_change_neon;
+   state->find_same   = find_same_neon;
+#endif
+}
+
+/**
+ * state_manager_encode:
+ * @state           : pointer to state manager object
+ * @oldb            : state the delta restores
+ * @newb            : state the delta is applied to
+ * @compressed      : output, at least maxcompsize bytes
+ * @keyframe        : store all of @oldb instead of a delta
+ *
+ * First compression stage. Both blocks need the sentinel and
+ * padding set up by state_manager_new().
+ *
+ * Returns: end of the encoded frame.
+ **/
+static uint8_t *state_manager_encode(state_manager_t *state,
+      const uint8_t *oldb, const uint8_t *newb, uint8_t *compressed,
+      bool keyframe)
+{
+   /* Begin compression code. */
+   const uint16_t *old16 = (const uint16_t*)oldb;
+   const uint16_t *new16 = (const uint16_t*)newb;
+   uint16_t *compressed16 = (uint16_t*)compressed;
+   size_t num16s = state->blocksize / sizeof(uint16_t);
+
+   if (keyframe)
+   {
+      *compressed16++ = FRAME_KEY;
+      copy_words(compressed16, old16, num16s);
+      compressed16 += num16s;
+      num16s = 0;
+   }
+   else
+      *compressed16++ = FRAME_DELTA;
+
+   while (num16s)
+   {
+      size_t skip = state->find_change(old16, new16);
+
+      if (skip >= num16s)
+         break;
 
-         old16 += skip;
-         new16 += skip;
-         num16s -= skip;
+      old16 += skip;
+      new16 += skip;
+      num16s -= skip;
 
-         if (skip > UINT16_MAX)
+      if (skip > UINT16_MAX)
+      {
+         if (skip > UINT32_MAX)
          {
-            if (skip > UINT32_MAX)
-            {
-               /* This will make it scan the entire thing again, 
-                * but it only hits on 8GB unchanged data anyways,
-                * and if you're doing that, you've got bigger problems. */
-               skip = UINT32_MAX;
-            }
-            *compressed16++ = 0;
-            *compressed16++ = skip;
-            *compressed16++ = skip >> 16;
-            skip = 0;
-            continue;
+            /* This will make it scan the entire thing again, 
+             * but it only hits on 8GB unchanged data anyways,
+             * and if you're doing that, you've got bigger problems. */
+            skip = UINT32_MAX;
          }
+         *compressed16++ = 0;
+         *compressed16++ = skip;
+         *compressed16++ = skip >> 16;
+         skip = 0;
+         continue;
+      }
 
-         size_t changed = find_same(old16, new16);
-         if (changed > UINT16_MAX)
-            changed = UINT16_MAX;
+      size_t changed = state->find_same(old16, new16);
+      if (changed > UINT16_MAX)
+         changed = UINT16_MAX;
 
-         *compressed16++ = changed;
-         *compressed16++ = skip;
+      *compressed16++ = changed;
+      *compressed16++ = skip;
 
-         for (i = 0; i < changed; i++)
-            compressed16[i] = old16[i];
+      copy_words(compressed16, old16, changed);
 
-         old16 += changed;
-         new16 += changed;
-         num16s -= changed;
-         compressed16 += changed;
-      }
+      old16 += changed;
+      new16 += changed;
+      num16s -= changed;
+      compressed16 += changed;
+   }
 
+   if (!keyframe)
+   {
       compressed16[0] = 0;
       compressed16[1] = 0;
       compressed16[2] = 0;
-      compressed = (uint8_t*)(compressed16 + 3);
-      /* End compression code. */
+      compressed16 += 3;
+   }
+   /* End compression code. */
 
-      if (compressed - state->data + state->maxcompsize > state->capacity)
-      {
-         compressed = state->data;
-         if (state->tail == state->data + sizeof(size_t))
-            state->tail = state->data + read_size_t(state->tail);
-      }
-      write_size_t(compressed, state->head-state->data);
-      compressed += sizeof(size_t);
-      write_size_t(state->head, compressed-state->data);
-      state->head = compressed;
+   return (uint8_t*)compressed16;
+}
+
+/**
+ * state_manager_push_compress:
+ * @state           : pointer to state manager object
+ *
+ * Encodes nextblock as a delta against thisblock, appends it
+ * to the ring buffer and makes nextblock the current state.
+ * Runs on the worker thread when threaded rewind is enabled.
+ **/
+static void state_manager_push_compress(state_manager_t *state)
+{
+recheckcapacity:;
 
-      RARCH_PERFORMANCE_STOP(gen_deltas);
+   size_t headpos = state->head - state->data;
+   size_t tailpos = state->tail - state->data;
+   size_t remaining = (tailpos + state->capacity -
+         sizeof(size_t) - headpos - 1) % state->capacity + 1;
+
+   if (remaining <= state->maxcompsize)
+   {
+      state->tail = state->data + read_size_t(state->tail);
+      state->entries--;
+      goto recheckcapacity;
    }
-   else
-      state->thisblock_valid = true;
+
+   RARCH_PERFORMANCE_START(state->encode_perf);
+
+   const uint8_t *oldb = state->thisblock;
+   const uint8_t *newb = state->nextblock;
+   uint8_t *compressed = state->head + sizeof(size_t);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->compress_deltas)
+      compressed = state->scratch;
+#endif
+
+   bool keyframe = state->keyframe_interval &&
+      (state->serial % state->keyframe_interval) == 0;
+
+   compressed = state_manager_encode(state, oldb, newb, compressed, keyframe);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->compress_deltas)
+      compressed = state_manager_deflate(state, state->scratch,
+            compressed - state->scratch, state->head + sizeof(size_t));
+#endif
+
+   if (compressed - state->data + state->maxcompsize > state->capacity)
+   {
+      compressed = state->data;
+      if (state->tail == state->data + sizeof(size_t))
+         state->tail = state->data + read_size_t(state->tail);
+   }
+   write_size_t(compressed, state->head-state->data);
+   compressed += sizeof(size_t);
+   write_size_t(state->head, compressed-state->data);
+   state->head = compressed;
+
+   RARCH_PERFORMANCE_STOP(state->encode_perf);
 
    uint8_t *swap = state->thisblock;
    state->thisblock = state->nextblock;
    state->nextblock = swap;
 
    state->entries++;
-   return;
+   state->serial++;
+}
+
+void state_manager_push_do(state_manager_t *state)
+{
+   if (!state->thisblock_valid)
+   {
+      uint8_t *swap = state->thisblock;
+      state->thisblock = state->nextblock;
+      state->nextblock = swap;
+
+      state->thisblock_valid = true;
+      state->entries++;
+      return;
+   }
+
+   if (state->capacity < sizeof(size_t) + state->maxcompsize)
+      return;
+
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      /* Hand off to the worker; the next pop/push_where
+       * will wait for it to finish. */
+      slock_lock(state->lock);
+      state->busy = true;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      return;
+   }
+#endif
+
+   state_manager_push_compress(state);
 }
 
 void state_manager_capacity(state_manager_t *state,
       unsigned *entries, size_t *bytes, bool *full)
 {
-   size_t headpos   = state->head - state->data;
-   size_t tailpos   = state->tail - state->data;
-   size_t remaining = (tailpos + state->capacity -
+   size_t headpos, tailpos, remaining;
+
+   state_manager_sync(state);
+
+   headpos   = state->head - state->data;
+   tailpos   = state->tail - state->data;
+   remaining = (tailpos + state->capacity -
          sizeof(size_t) - headpos - 1) % state->capacity + 1;
 
    if (entries)
@@ -523,3 +1213,95 @@ void state_manager_capacity(state_manager_t *state,
    if (full)
       *full = remaining <= state->maxcompsize * 2;
 }
+
+const void *state_manager_delta_encode(state_manager_t *state,
+      const void *baseline, const void *data, size_t *size)
+{
+   uint32_t header[2];
+   uint8_t *end;
+
+   *size = 0;
+
+   if (!state->transfer)
+   {
+      state->transfer = (uint8_t*)malloc(state->maxcompsize);
+      if (!state->transfer)
+         return NULL;
+   }
+
+   /* Only the blocks have the sentinels the scanners rely on. */
+   memcpy(state->thisblock, data, state->state_size);
+   memcpy(state->nextblock, baseline, state->state_size);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->compress_deltas)
+   {
+      end = state_manager_encode(state, state->thisblock, state->nextblock,
+            state->scratch, false);
+      end = state_manager_deflate(state, state->scratch,
+            end - state->scratch, state->transfer);
+      memcpy(header, state->transfer, sizeof(header));
+   }
+   else
+#endif
+   {
+      /* Same layout as an incompressible deflated frame. */
+      end = state_manager_encode(state, state->thisblock, state->nextblock,
+            state->transfer + sizeof(header), false);
+      header[0] = end - state->transfer - sizeof(header);
+      header[1] = header[0];
+   }
+
+   /* The sizes are read before anything else, so they go out in 
+    * network byte order. */
+   header[0] = swap_if_little32(header[0]);
+   header[1] = swap_if_little32(header[1]);
+   memcpy(state->transfer, header, sizeof(header));
+
+   *size = end - state->transfer;
+   return state->transfer;
+}
+
+bool state_manager_delta_apply(state_manager_t *state, void *data,
+      const void *delta, size_t size)
+{
+   uint32_t header[2];
+   const uint8_t *in = (const uint8_t*)delta + sizeof(header);
+   const uint16_t *in16;
+
+   if (size < sizeof(header))
+      return false;
+
+   memcpy(header, delta, sizeof(header));
+   header[0] = swap_if_little32(header[0]);
+   header[1] = swap_if_little32(header[1]);
+   if (header[1] > size - sizeof(header) || header[0] < sizeof(uint16_t))
+      return false;
+
+   if (header[1] != header[0])
+   {
+#ifdef HAVE_ZLIB_DEFLATE
+      if (!state->compress_deltas || header[0] > state->maxdeltasize)
+         return false;
+
+      in = state_manager_inflate(state, in, header[0], header[1]);
+      if (!in)
+         return false;
+#else
+      RARCH_ERR("Cannot inflate state delta without zlib.\n");
+      return false;
+#endif
+   }
+
+   in16 = (const uint16_t*)in;
+   if (in16[0] != FRAME_DELTA || !delta_valid(in16 + 1,
+            header[0] / sizeof(uint16_t) - 1,
+            state->blocksize / sizeof(uint16_t)))
+      return false;
+
+   memcpy(state->thisblock, data, state->state_size);
+   apply_delta((uint16_t*)state->thisblock, in16 + 1);
+   memcpy(data, state->thisblock, state->state_size);
+
+   return true;
+}
@@ -27,19 +27,46 @@ extern "C" {
 
 typedef struct state_manager state_manager_t;
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size);
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size,
+      unsigned keyframe_interval, bool threaded, bool compress);
 
 void state_manager_free(state_manager_t *state);
 
 bool state_manager_pop(state_manager_t *state, const void **data);
 
+/* Same as calling state_manager_pop() @frames_back times, except
+ * that it only applies the frames after the closest keyframe.
+ * Stops early if history runs out. */
+bool state_manager_seek(state_manager_t *state, unsigned frames_back,
+      const void **data);
+
 void state_manager_push_where(state_manager_t *state, void **data);
 
 void state_manager_push_do(state_manager_t *state);
 
+/* Reports the number of stored states and the ring buffer
+ * space they use, after compression. */
 void state_manager_capacity(state_manager_t *state,
       unsigned int *entries, size_t *bytes, bool *full);
 
+/* Encodes @data as a delta against @baseline, for sending to
+ * someone who already has @baseline. Both are as large as the
+ * state size given to state_manager_new(). The delta is deflated
+ * if the state manager compresses; the result is valid until the
+ * next call. Uses the same buffers as rewinding, so it needs a
+ * state manager of its own (a buffer_size of 0 is fine).
+ * It starts with its raw and stored sizes as two uint32s in 
+ * network byte order. The rest is in the byte order of the host 
+ * that made it, like the state itself. */
+const void *state_manager_delta_encode(state_manager_t *state,
+      const void *baseline, const void *data, size_t *size);
+
+/* Turns @data from the baseline into the state a delta from
+ * state_manager_delta_encode() was made from. Deltas are checked
+ * before being applied, so they may come from the network. */
+bool state_manager_delta_apply(state_manager_t *state, void *data,
+      const void *delta, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
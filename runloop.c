@@ -232,11 +232,23 @@ static void check_rewind(bool pressed)
    if (!g_extern.rewind.state)
       return;
 
-   if (pressed)
+   if (pressed || g_extern.rewind.seek_frames)
    {
       const void *buf = NULL;
+      unsigned frames_back = 1;
 
-      if (state_manager_pop(g_extern.rewind.state, &buf))
+      /* Movies can only be rewound one frame at a time. */
+      if (g_extern.rewind.seek_frames && !g_extern.bsv.movie)
+      {
+         unsigned granularity = g_settings.rewind_granularity ?
+            g_settings.rewind_granularity : 1;
+
+         frames_back = (g_extern.rewind.seek_frames + granularity - 1)
+            / granularity;
+      }
+      g_extern.rewind.seek_frames = 0;
+
+      if (state_manager_seek(g_extern.rewind.state, frames_back, &buf))
       {
          g_extern.rewind.frame_is_reverse = true;
          setup_rewind_audio();
@@ -16,10 +16,15 @@
 #include <retro_miscellaneous.h>
 #include "runloop.h"
 #include "general.h"
+#include "content.h"
+#include "retroarch.h"
 #include "input/input_overlay.h"
 #ifdef HAVE_NETWORKING
 #include "net_http.h"
 #endif
+#ifdef HAVE_MENU
+#include "menu/menu_database.h"
+#endif
 
 struct data_runloop g_data_runloop;
 
@@ -538,6 +543,9 @@ static void rarch_main_data_rdl_iterate(void)
 #ifdef HAVE_LIBRETRODB
    if (!driver.menu->rdl->iterating)
    {
+      /* The menu's copy of a database playlist would overwrite 
+       * the scan's matches, so write it out first. */
+      menu_database_free(driver.menu);
       database_info_write_rdl_free(driver.menu->rdl);
       driver.menu->rdl = NULL;
       return;
@@ -708,4 +716,9 @@ void rarch_main_data_iterate(void)
    rarch_main_data_http_iterate(&g_data_runloop.http);
 #endif
    rarch_main_data_db_iterate();
+   save_state_iterate();
+#if defined(HAVE_MENU) && defined(HAVE_THREADS)
+   if (content_load_task_iterate())
+      rarch_main_set_state(RARCH_ACTION_STATE_LOAD_CONTENT);
+#endif
 }
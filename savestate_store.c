@@ -0,0 +1,595 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2015 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <file/file_path.h>
+#include <file/dir_list.h>
+#include <compat/strl.h>
+#include <retro_miscellaneous.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "savestate_store.h"
+#include "file_ops.h"
+#include "hash.h"
+#include "general.h"
+#include "retroarch_logger.h"
+
+#define SAVESTATE_STORE_MAGIC "RASTATEC"
+#define SAVESTATE_STORE_DIR   "state_chunks"
+
+/* Manifest: magic, 64-bit state size, 32-bit chunk count, then
+ * the size and SHA256 of each chunk. All little endian. */
+#define MANIFEST_HEADER_SIZE  20
+#define MANIFEST_ENTRY_SIZE   36
+
+/* Chunks end where the rolling hash has its top 16 bits clear,
+ * every 64 KiB on average, but are kept between 16 and 256 KiB.
+ * Chunk files start with one of the CHUNK_* methods. */
+#define CHUNK_MIN_SIZE        (16 * 1024)
+#define CHUNK_MAX_SIZE        (256 * 1024)
+#define CHUNK_MASK            0xffff0000u
+#define CHUNK_HASH_SIZE       32
+
+/* Chunks this recent are never dropped, since a state that uses 
+ * them may still be on its way to disk from another instance. */
+#define CHUNK_GRACE_SECONDS   (10 * 60)
+
+enum
+{
+   CHUNK_RAW = 0,
+   CHUNK_DEFLATE
+};
+
+static void savestate_store_put_u32(uint8_t *out, uint32_t value)
+{
+   unsigned i;
+   for (i = 0; i < 4; i++)
+      out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t savestate_store_get_u32(const uint8_t *in)
+{
+   return (uint32_t)in[0]       | ((uint32_t)in[1] << 8) |
+         ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/* The table only has to be the same every time, so that equal
+ * data gets cut in the same places. */
+static void savestate_store_init_gear(uint32_t *gear)
+{
+   unsigned i;
+   uint32_t x = 0x9e3779b9u;
+
+   for (i = 0; i < 256; i++)
+   {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      gear[i] = x;
+   }
+}
+
+/**
+ * savestate_store_cut:
+ * @data         : data left to chunk.
+ * @size         : size of @data.
+ * @gear         : table from savestate_store_init_gear().
+ *
+ * Returns: size of the next chunk of @data.
+ **/
+static size_t savestate_store_cut(const uint8_t *data, size_t size,
+      const uint32_t *gear)
+{
+   size_t i;
+   uint32_t hash = 0;
+
+   if (size <= CHUNK_MIN_SIZE)
+      return size;
+   if (size > CHUNK_MAX_SIZE)
+      size = CHUNK_MAX_SIZE;
+
+   for (i = CHUNK_MIN_SIZE; i < size; i++)
+   {
+      hash = (hash << 1) + gear[data[i]];
+      if (!(hash & CHUNK_MASK))
+         return i + 1;
+   }
+
+   return size;
+}
+
+static void savestate_store_chunk_path(char *path, size_t size,
+      const char *chunk_dir, const uint8_t *hash)
+{
+   unsigned i;
+   char name[CHUNK_HASH_SIZE * 2 + 1];
+
+   for (i = 0; i < CHUNK_HASH_SIZE; i++)
+      snprintf(name + 2 * i, sizeof(name) - 2 * i, "%02x",
+            (unsigned)hash[i]);
+
+   fill_pathname_join(path, chunk_dir, name, size);
+}
+
+static void savestate_store_chunk_dir(char *chunk_dir, size_t size,
+      const char *path)
+{
+   char dir[PATH_MAX_LENGTH];
+
+   fill_pathname_basedir(dir, path, sizeof(dir));
+   fill_pathname_join(chunk_dir, dir, SAVESTATE_STORE_DIR, size);
+}
+
+/**
+ * savestate_store_put:
+ * @path         : file to write.
+ * @head         : written first.
+ * @head_size    : size of @head.
+ * @data         : written after @head.
+ * @size         : size of @data.
+ *
+ * Writes through a temporary file, so @path is either left as it
+ * was or replaced completely.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool savestate_store_put(const char *path,
+      const uint8_t *head, size_t head_size,
+      const uint8_t *data, size_t size)
+{
+   char tmp_path[PATH_MAX_LENGTH];
+   bool ok    = false;
+   FILE *file = NULL;
+
+   snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+   if (!(file = fopen(tmp_path, "wb")))
+      return false;
+
+   ok = fwrite(head, 1, head_size, file) == head_size
+      && fwrite(data, 1, size, file) == size;
+   ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+   /* rename() does not replace existing files here. */
+   if (ok)
+      remove(path);
+#endif
+   if (ok && rename(tmp_path, path) == 0)
+      return true;
+
+   remove(tmp_path);
+   return false;
+}
+
+static bool savestate_store_put_chunk(const char *path,
+      const uint8_t *data, size_t size, bool compress)
+{
+   uint8_t method = CHUNK_RAW;
+#ifdef HAVE_ZLIB_DEFLATE
+   bool ok;
+   uLongf packed_size = compressBound(size);
+   uint8_t *packed    = compress ? (uint8_t*)malloc(packed_size) : NULL;
+
+   if (packed && compress2(packed, &packed_size, data, size,
+            Z_BEST_SPEED) == Z_OK && packed_size < size)
+   {
+      method = CHUNK_DEFLATE;
+      ok     = savestate_store_put(path, &method, 1, packed, packed_size);
+      free(packed);
+      return ok;
+   }
+   free(packed);
+#endif
+
+   (void)compress;
+   return savestate_store_put(path, &method, 1, data, size);
+}
+
+/**
+ * savestate_store_get_chunk:
+ * @path         : chunk file.
+ * @out          : where the chunk goes.
+ * @size         : size of the chunk, from the manifest.
+ *
+ * Returns: true if the chunk file holds @size bytes of data.
+ **/
+static bool savestate_store_get_chunk(const char *path,
+      uint8_t *out, size_t size)
+{
+   bool ok       = false;
+   ssize_t len   = 0;
+   uint8_t *data = NULL;
+
+   if (!read_file(path, (void**)&data, &len) || len < 1)
+   {
+      free(data);
+      return false;
+   }
+
+   switch (data[0])
+   {
+      case CHUNK_RAW:
+         if ((size_t)len - 1 == size)
+         {
+            memcpy(out, data + 1, size);
+            ok = true;
+         }
+         break;
+#ifdef HAVE_ZLIB
+      case CHUNK_DEFLATE:
+      {
+         uLongf out_size = size;
+         ok = uncompress(out, &out_size, data + 1, len - 1) == Z_OK
+            && out_size == size;
+         break;
+      }
+#endif
+   }
+
+   free(data);
+   return ok;
+}
+
+/**
+ * savestate_store_has_chunk:
+ * @path         : chunk file.
+ * @data         : chunk that should be stored there.
+ * @size         : size of @data.
+ * @scratch      : room for CHUNK_MAX_SIZE bytes.
+ *
+ * Returns: true if @path holds @data intact, so it does not 
+ * have to be written again.
+ **/
+static bool savestate_store_has_chunk(const char *path,
+      const uint8_t *data, size_t size, uint8_t *scratch)
+{
+   return path_file_exists(path)
+      && savestate_store_get_chunk(path, scratch, size)
+      && !memcmp(scratch, data, size);
+}
+
+/**
+ * savestate_store_read_hashes:
+ * @path         : file that may be a manifest.
+ * @hashes       : chunk hashes of manifests so far, grown as needed.
+ * @count        : number of hashes in @hashes.
+ * @cap          : number of hashes @hashes has room for.
+ *
+ * Returns: false if @path could not be read, true otherwise,
+ * whether or not it is a manifest.
+ **/
+static bool savestate_store_read_hashes(const char *path,
+      uint8_t **hashes, size_t *count, size_t *cap)
+{
+   uint8_t header[MANIFEST_HEADER_SIZE];
+   uint8_t entry[MANIFEST_ENTRY_SIZE];
+   uint32_t i, chunks;
+   bool ok    = true;
+   FILE *file = fopen(path, "rb");
+
+   if (!file)
+      return false;
+
+   if (fread(header, 1, sizeof(header), file) != sizeof(header)
+         || !savestate_store_is_manifest(header, sizeof(header)))
+      goto end;
+
+   chunks = savestate_store_get_u32(header + 16);
+
+   for (i = 0; i < chunks; i++)
+   {
+      if (fread(entry, 1, sizeof(entry), file) != sizeof(entry))
+      {
+         ok = false;
+         break;
+      }
+
+      if (*count == *cap)
+      {
+         size_t new_cap = *cap ? *cap * 2 : 1024;
+         uint8_t *tmp   = (uint8_t*)realloc(*hashes,
+               new_cap * CHUNK_HASH_SIZE);
+
+         if (!tmp)
+         {
+            ok = false;
+            break;
+         }
+
+         *hashes = tmp;
+         *cap    = new_cap;
+      }
+
+      memcpy(*hashes + *count * CHUNK_HASH_SIZE, entry + 4,
+            CHUNK_HASH_SIZE);
+      (*count)++;
+   }
+
+end:
+   fclose(file);
+   return ok;
+}
+
+static int savestate_store_hash_cmp(const void *a, const void *b)
+{
+   return memcmp(a, b, CHUNK_HASH_SIZE);
+}
+
+static bool savestate_store_parse_hash(const char *name, uint8_t *hash)
+{
+   unsigned i;
+
+   if (strlen(name) != CHUNK_HASH_SIZE * 2)
+      return false;
+
+   for (i = 0; i < CHUNK_HASH_SIZE; i++)
+   {
+      unsigned byte;
+      if (sscanf(name + 2 * i, "%2x", &byte) != 1)
+         return false;
+      hash[i] = byte;
+   }
+
+   return true;
+}
+
+void savestate_store_collect(const char *path)
+{
+   size_t i;
+   char chunk_dir[PATH_MAX_LENGTH], dir[PATH_MAX_LENGTH];
+   struct string_list *states = NULL;
+   struct string_list *chunks = NULL;
+   uint8_t *live              = NULL;
+   size_t live_count          = 0, live_cap = 0;
+   unsigned removed           = 0;
+   time_t now                 = time(NULL);
+
+   savestate_store_chunk_dir(chunk_dir, sizeof(chunk_dir), path);
+   if (!path_is_directory(chunk_dir))
+      return;
+
+   fill_pathname_basedir(dir, path, sizeof(dir));
+   if (!(states = dir_list_new(dir, NULL, false)))
+      return;
+
+   /* Only files sized like a manifest are opened. Any manifest 
+    * that cannot be read might use any chunk, so then nothing 
+    * is dropped. */
+   for (i = 0; i < states->size; i++)
+   {
+      struct stat buf;
+
+      if (states->elems[i].attr.i == RARCH_DIRECTORY)
+         continue;
+      if (stat(states->elems[i].data, &buf) < 0)
+         goto end;
+      if (buf.st_size < MANIFEST_HEADER_SIZE || (buf.st_size
+               - MANIFEST_HEADER_SIZE) % MANIFEST_ENTRY_SIZE)
+         continue;
+      if (!savestate_store_read_hashes(states->elems[i].data,
+               &live, &live_count, &live_cap))
+         goto end;
+   }
+
+   if (live_count > 1)
+      qsort(live, live_count, CHUNK_HASH_SIZE, savestate_store_hash_cmp);
+
+   if (!(chunks = dir_list_new(chunk_dir, NULL, false)))
+      goto end;
+
+   for (i = 0; i < chunks->size; i++)
+   {
+      struct stat buf;
+      uint8_t hash[CHUNK_HASH_SIZE];
+
+      if (!savestate_store_parse_hash(
+               path_basename(chunks->elems[i].data), hash))
+         continue;
+
+      if (live_count && bsearch(hash, live, live_count,
+               CHUNK_HASH_SIZE, savestate_store_hash_cmp))
+         continue;
+
+      if (stat(chunks->elems[i].data, &buf) < 0
+            || difftime(now, buf.st_mtime) < CHUNK_GRACE_SECONDS)
+         continue;
+
+      if (remove(chunks->elems[i].data) == 0)
+         removed++;
+   }
+
+   if (removed)
+      RARCH_LOG("Dropped %u unused savestate chunks.\n", removed);
+
+end:
+   if (chunks)
+      dir_list_free(chunks);
+   dir_list_free(states);
+   free(live);
+}
+
+bool savestate_store_write(const char *path,
+      const uint8_t *data, size_t size, bool compress)
+{
+   char chunk_dir[PATH_MAX_LENGTH], chunk_path[PATH_MAX_LENGTH];
+   uint32_t gear[256];
+   size_t pos, manifest_size;
+   uint8_t *manifest = NULL;
+   uint8_t *entry    = NULL;
+   uint8_t *scratch  = NULL;
+   uint32_t chunks   = 0;
+   unsigned added    = 0;
+   bool ok           = false;
+
+   savestate_store_chunk_dir(chunk_dir, sizeof(chunk_dir), path);
+   if (!path_is_directory(chunk_dir) && !path_mkdir(chunk_dir))
+   {
+      RARCH_ERR("Could not create savestate chunk directory \"%s\".\n",
+            chunk_dir);
+      return false;
+   }
+
+   /* Room for as many chunks as the minimum size allows. */
+   manifest_size = MANIFEST_HEADER_SIZE +
+      (size / CHUNK_MIN_SIZE + 1) * MANIFEST_ENTRY_SIZE;
+   if (!(manifest = (uint8_t*)malloc(manifest_size)))
+      return false;
+   if (!(scratch = (uint8_t*)malloc(CHUNK_MAX_SIZE)))
+   {
+      free(manifest);
+      return false;
+   }
+
+   savestate_store_init_gear(gear);
+   entry = manifest + MANIFEST_HEADER_SIZE;
+
+   for (pos = 0; pos < size; )
+   {
+      sha256_ctx_t sha;
+      size_t len = savestate_store_cut(data + pos, size - pos, gear);
+
+      sha256_init(&sha);
+      sha256_update(&sha, data + pos, len);
+      sha256_final(&sha, entry + 4);
+      savestate_store_put_u32(entry, len);
+
+      savestate_store_chunk_path(chunk_path, sizeof(chunk_path),
+            chunk_dir, entry + 4);
+
+      /* A chunk left damaged by a crash or a bad disk is 
+       * written again rather than trusted for its name. */
+      if (!savestate_store_has_chunk(chunk_path, data + pos, len,
+               scratch))
+      {
+         if (!savestate_store_put_chunk(chunk_path, data + pos, len,
+                  compress))
+            goto end;
+         added++;
+      }
+
+      entry += MANIFEST_ENTRY_SIZE;
+      pos   += len;
+      chunks++;
+   }
+
+   memcpy(manifest, SAVESTATE_STORE_MAGIC, 8);
+   savestate_store_put_u32(manifest + 8,  (uint32_t)((uint64_t)size));
+   savestate_store_put_u32(manifest + 12, (uint32_t)((uint64_t)size >> 32));
+   savestate_store_put_u32(manifest + 16, chunks);
+
+   if (!savestate_store_put(path, manifest, MANIFEST_HEADER_SIZE,
+            manifest + MANIFEST_HEADER_SIZE,
+            entry - manifest - MANIFEST_HEADER_SIZE))
+      goto end;
+
+   RARCH_LOG("Stored state as %u chunks, %u of them new.\n",
+         chunks, added);
+   ok = true;
+
+end:
+   free(manifest);
+   free(scratch);
+   return ok;
+}
+
+bool savestate_store_is_manifest(const void *data, size_t size)
+{
+   return size >= MANIFEST_HEADER_SIZE
+      && !memcmp(data, SAVESTATE_STORE_MAGIC, 8);
+}
+
+bool savestate_store_read(const char *path, void **buf, ssize_t *size)
+{
+   char chunk_dir[PATH_MAX_LENGTH], chunk_path[PATH_MAX_LENGTH];
+   uint32_t i, chunks;
+   uint64_t state_size;
+   size_t pos            = 0;
+   const uint8_t *header = (const uint8_t*)*buf;
+   const uint8_t *entry  = header + MANIFEST_HEADER_SIZE;
+   uint8_t *out          = NULL;
+
+   if (!savestate_store_is_manifest(*buf, *size))
+      return false;
+
+   state_size = savestate_store_get_u32(header + 8) |
+      ((uint64_t)savestate_store_get_u32(header + 12) << 32);
+   chunks     = savestate_store_get_u32(header + 16);
+
+   if ((uint64_t)(*size - MANIFEST_HEADER_SIZE)
+         != (uint64_t)chunks * MANIFEST_ENTRY_SIZE
+         || state_size >= SIZE_MAX)
+      return false;
+
+   if (!(out = (uint8_t*)malloc(state_size + 1)))
+      return false;
+
+   savestate_store_chunk_dir(chunk_dir, sizeof(chunk_dir), path);
+
+   for (i = 0; i < chunks; i++, entry += MANIFEST_ENTRY_SIZE)
+   {
+      uint8_t hash[CHUNK_HASH_SIZE];
+      sha256_ctx_t sha;
+      size_t len = savestate_store_get_u32(entry);
+
+      if (len > state_size - pos)
+         goto error;
+
+      savestate_store_chunk_path(chunk_path, sizeof(chunk_path),
+            chunk_dir, entry + 4);
+
+      if (!savestate_store_get_chunk(chunk_path, out + pos, len))
+      {
+         RARCH_ERR("Savestate chunk \"%s\" is missing or damaged.\n",
+               chunk_path);
+         goto error;
+      }
+
+      sha256_init(&sha);
+      sha256_update(&sha, out + pos, len);
+      sha256_final(&sha, hash);
+
+      if (memcmp(hash, entry + 4, CHUNK_HASH_SIZE))
+      {
+         RARCH_ERR("Savestate chunk \"%s\" is damaged.\n", chunk_path);
+         goto error;
+      }
+
+      pos += len;
+   }
+
+   if (pos != state_size)
+      goto error;
+
+   out[state_size] = '\0';
+   free(*buf);
+   *buf  = out;
+   *size = state_size;
+   return true;
+
+error:
+   free(out);
+   return false;
+}
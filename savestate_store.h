@@ -0,0 +1,90 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2015 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_SAVESTATE_STORE_H
+#define __RARCH_SAVESTATE_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <boolean.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deduplicating savestate store.
+ *
+ * States are cut into content-defined chunks, and each distinct
+ * chunk is kept once, named by its SHA256, in a directory next to
+ * the states. The state file itself becomes a small manifest
+ * listing its chunks, so slots that mostly hold the same data
+ * share it on disk. */
+
+/**
+ * savestate_store_write:
+ * @path         : path of the state. Its manifest is written here.
+ * @data         : serialized state.
+ * @size         : size of @data.
+ * @compress     : deflate new chunks.
+ *
+ * Stores the chunks of @data that are not stored intact yet,
+ * then writes the manifest. Chunks no state uses anymore are
+ * left for savestate_store_collect().
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+bool savestate_store_write(const char *path,
+      const uint8_t *data, size_t size, bool compress);
+
+/**
+ * savestate_store_is_manifest:
+ * @data         : contents of a state file.
+ * @size         : size of @data.
+ *
+ * Returns: true if @data is a manifest of the savestate store.
+ **/
+bool savestate_store_is_manifest(const void *data, size_t size);
+
+/**
+ * savestate_store_read:
+ * @path         : path of the state.
+ * @buf          : manifest read from @path, replaced by the
+ *                 reassembled state.
+ * @size         : size of @buf, updated along with it.
+ *
+ * Returns: true if successful, false if a chunk is missing or
+ * damaged.
+ **/
+bool savestate_store_read(const char *path, void **buf, ssize_t *size);
+
+/**
+ * savestate_store_collect:
+ * @path         : path of a state.
+ *
+ * Drops chunks that no state next to @path uses anymore and
+ * that have not been written recently. Only the manifests are
+ * read, but the whole directory is listed, so this is meant to
+ * run once in a while rather than on every save.
+ * Does nothing if there is no store there.
+ **/
+void savestate_store_collect(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -471,16 +471,22 @@ static void config_set_defaults(void)
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
    g_settings.rewind_granularity = rewind_granularity;
+   g_settings.rewind_keyframe_interval = rewind_keyframe_interval;
+   g_settings.rewind_threaded = rewind_threaded;
+   g_settings.rewind_compression = rewind_compression;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.fastforward_ratio = fastforward_ratio;
    g_settings.fastforward_ratio_throttle_enable = fastforward_ratio_throttle_enable;
    g_settings.pause_nonactive = pause_nonactive;
    g_settings.autosave_interval = autosave_interval;
+   g_settings.autosave_journal = autosave_journal;
 
    g_settings.block_sram_overwrite = block_sram_overwrite;
    g_settings.savestate_auto_index = savestate_auto_index;
    g_settings.savestate_auto_save  = savestate_auto_save;
    g_settings.savestate_auto_load  = savestate_auto_load;
+   g_settings.savestate_compression = savestate_compression;
+   g_settings.savestate_dedup      = savestate_dedup;
    g_settings.network_cmd_enable   = network_cmd_enable;
    g_settings.network_cmd_port     = network_cmd_port;
    g_settings.stdin_cmd_enable     = stdin_cmd_enable;
@@ -606,6 +612,7 @@ static void config_set_defaults(void)
    *g_settings.screenshot_directory = '\0';
    *g_settings.system_directory = '\0';
    *g_settings.extraction_directory = '\0';
+   *g_settings.patch_cache_directory = '\0';
    *g_settings.input_remapping_directory = '\0';
    *g_settings.input.autoconfig_dir = '\0';
    *g_settings.input.overlay = '\0';
@@ -1347,6 +1354,7 @@ static bool config_load_file(const char *path, bool set_defaults)
 
    CONFIG_GET_PATH(resampler_directory, "resampler_directory");
    CONFIG_GET_PATH(extraction_directory, "extraction_directory");
+   CONFIG_GET_PATH(patch_cache_directory, "patch_cache_directory");
    CONFIG_GET_PATH(input_remapping_directory, "input_remapping_directory");
    CONFIG_GET_PATH(content_directory, "content_directory");
    CONFIG_GET_PATH(assets_directory, "assets_directory");
@@ -1400,6 +1408,9 @@ static bool config_load_file(const char *path, bool set_defaults)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_INT(rewind_keyframe_interval, "rewind_keyframe_interval");
+   CONFIG_GET_BOOL(rewind_threaded, "rewind_threaded");
+   CONFIG_GET_BOOL(rewind_compression, "rewind_compression");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
@@ -1415,6 +1426,7 @@ static bool config_load_file(const char *path, bool set_defaults)
 
    CONFIG_GET_BOOL(pause_nonactive, "pause_nonactive");
    CONFIG_GET_INT(autosave_interval, "autosave_interval");
+   CONFIG_GET_BOOL(autosave_journal, "autosave_journal");
 
    CONFIG_GET_PATH(content_database, "content_database_path");
    CONFIG_GET_PATH(cheat_database, "cheat_database_path");
@@ -1425,6 +1437,8 @@ static bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_BOOL(savestate_auto_index, "savestate_auto_index");
    CONFIG_GET_BOOL(savestate_auto_save, "savestate_auto_save");
    CONFIG_GET_BOOL(savestate_auto_load, "savestate_auto_load");
+   CONFIG_GET_BOOL(savestate_compression, "savestate_compression");
+   CONFIG_GET_BOOL(savestate_dedup, "savestate_dedup");
 
    CONFIG_GET_BOOL(network_cmd_enable, "network_cmd_enable");
    CONFIG_GET_INT(network_cmd_port, "network_cmd_port");
@@ -1458,6 +1472,9 @@ static bool config_load_file(const char *path, bool set_defaults)
       CONFIG_GET_INT_EXTERN(netplay_sync_frames, "netplay_delay_frames");
    if (!g_extern.has_set_netplay_ip_port)
       CONFIG_GET_INT_EXTERN(netplay_port, "netplay_ip_port");
+   if (!g_extern.has_set_netplay_users)
+      CONFIG_GET_INT_EXTERN(netplay_users, "netplay_users");
+   CONFIG_GET_INT_EXTERN(netplay_check_frames, "netplay_check_frames");
 #endif
 
    CONFIG_GET_BOOL(config_save_on_exit, "config_save_on_exit");
@@ -1864,6 +1881,9 @@ bool config_save_file(const char *path)
    config_set_bool(conf,  "audio_sync",    g_settings.audio.sync);
    config_set_int(conf,   "audio_block_frames", g_settings.audio.block_frames);
    config_set_int(conf,   "rewind_granularity", g_settings.rewind_granularity);
+   config_set_int(conf,   "rewind_keyframe_interval", g_settings.rewind_keyframe_interval);
+   config_set_bool(conf,  "rewind_threaded", g_settings.rewind_threaded);
+   config_set_bool(conf,  "rewind_compression", g_settings.rewind_compression);
    config_set_path(conf,  "video_shader", g_settings.video.shader_path);
    config_set_bool(conf,  "video_shader_enable",
          g_settings.video.shader_enable);
@@ -1873,6 +1893,7 @@ bool config_save_file(const char *path)
          g_settings.video.windowed_fullscreen);
    config_set_float(conf, "video_scale", g_settings.video.scale);
    config_set_int(conf,   "autosave_interval", g_settings.autosave_interval);
+   config_set_bool(conf,  "autosave_journal", g_settings.autosave_journal);
    config_set_bool(conf,  "video_crop_overscan", g_settings.video.crop_overscan);
    config_set_bool(conf,  "video_scale_integer", g_settings.video.scale_integer);
 #ifdef GEKKO
@@ -1954,6 +1975,8 @@ bool config_save_file(const char *path)
          g_settings.system_directory : "default");
    config_set_path(conf, "extraction_directory",
          g_settings.extraction_directory);
+   config_set_path(conf, "patch_cache_directory",
+         g_settings.patch_cache_directory);
    config_set_path(conf, "input_remapping_directory",
          g_settings.input_remapping_directory);
    config_set_path(conf, "input_remapping_path",
@@ -2069,6 +2092,10 @@ bool config_save_file(const char *path)
          g_settings.savestate_auto_save);
    config_set_bool(conf, "savestate_auto_load",
          g_settings.savestate_auto_load);
+   config_set_bool(conf, "savestate_compression",
+         g_settings.savestate_compression);
+   config_set_bool(conf, "savestate_dedup",
+         g_settings.savestate_dedup);
    config_set_bool(conf, "history_list_enable",
          g_settings.history_list_enable);
 
@@ -2088,6 +2115,8 @@ bool config_save_file(const char *path)
    config_set_string(conf, "netplay_ip_address", g_extern.netplay_server);
    config_set_int(conf, "netplay_ip_port", g_extern.netplay_port);
    config_set_int(conf, "netplay_delay_frames", g_extern.netplay_sync_frames);
+   config_set_int(conf, "netplay_users", g_extern.netplay_users);
+   config_set_int(conf, "netplay_check_frames", g_extern.netplay_check_frames);
 #endif
    config_set_string(conf, "netplay_nickname", g_settings.username);
    config_set_int(conf, "user_language", g_settings.user_language);
@@ -2415,6 +2415,15 @@ int setting_data_get_description(const char *label, char *msg,
             " \n"
             "A value of 0 disables autosave.");
    }
+   else if (!strcmp(label, "autosave_journal"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Journal SRAM autosaves.\n"
+            " \n"
+            "Changed parts of SRAM are written to a \n"
+            "journal first, so an autosave cut short \n"
+            "by a crash is finished on the next start.");
+   }
    else if (!strcmp(label, "screenshot_directory"))
    {
       snprintf(msg, sizeof_msg,
@@ -2520,6 +2529,32 @@ int setting_data_get_description(const char *label, char *msg,
             "at a time, increasing the rewinding \n"
             "speed.");
    }
+   else if (!strcmp(label, "rewind_keyframe_interval"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Rewind keyframe interval.\n"
+            " \n"
+            "Stores a full savestate every this \n"
+            "many rewind states, so jumping far \n"
+            "back in history is fast. 0 disables.");
+   }
+   else if (!strcmp(label, "rewind_threaded"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Threaded rewind.\n"
+            " \n"
+            "Compresses rewind states on a separate \n"
+            "thread. Helps with cores that have \n"
+            "large savestates.");
+   }
+   else if (!strcmp(label, "rewind_compression"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Compress rewind states.\n"
+            " \n"
+            "Fits more rewind history into the \n"
+            "same buffer size, at some CPU cost.");
+   }
    else if (!strcmp(label, "rewind_enable"))
    {
       snprintf(msg, sizeof_msg,
@@ -2558,6 +2593,24 @@ int setting_data_get_description(const char *label, char *msg,
             "with this path on startup if 'Savestate Auto\n"
             "Load' is set.");
    }
+   else if (!strcmp(label, "savestate_compression"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Compress savestates.\n"
+            " \n"
+            "Makes savestate files smaller. Compressed \n"
+            "and uncompressed savestates both load \n"
+            "regardless of this setting.");
+   }
+   else if (!strcmp(label, "savestate_dedup"))
+   {
+      snprintf(msg, sizeof_msg,
+            " -- Deduplicate savestates.\n"
+            " \n"
+            "Splits savestates into chunks that are \n"
+            "stored once for all savestates in the \n"
+            "same directory.");
+   }
    else if (!strcmp(label, "shader_apply_changes"))
    {
       snprintf(msg, sizeof_msg,
@@ -3098,6 +3151,8 @@ static void general_write_handler(void *data)
    }
    else if (!strcmp(setting->name, "netplay_delay_frames"))
       g_extern.has_set_netplay_delay_frames = (g_extern.netplay_sync_frames > 0);
+   else if (!strcmp(setting->name, "netplay_users"))
+      g_extern.has_set_netplay_users = (g_extern.netplay_users > 0);
 #endif
    else if (!strcmp(setting->name, "log_verbosity"))
    {
@@ -3712,6 +3767,51 @@ static bool setting_data_append_list_general_options(
    settings_list_current_add_range(list, list_info, 1, 32768, 1, true, false);
    settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
 
+   CONFIG_UINT(
+         g_settings.rewind_keyframe_interval,
+         "rewind_keyframe_interval",
+         "Rewind Keyframe Interval",
+         rewind_keyframe_interval,
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_range(list, list_info, 0, 36000, 60, true, false);
+   settings_list_current_add_cmd(list, list_info, RARCH_CMD_REWIND_REINIT);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
+#ifdef HAVE_THREADS
+   CONFIG_BOOL(
+         g_settings.rewind_threaded,
+         "rewind_threaded",
+         "Threaded Rewind",
+         rewind_threaded,
+         "OFF",
+         "ON",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_cmd(list, list_info, RARCH_CMD_REWIND_REINIT);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+   CONFIG_BOOL(
+         g_settings.rewind_compression,
+         "rewind_compression",
+         "Rewind Compression",
+         rewind_compression,
+         "OFF",
+         "ON",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_cmd(list, list_info, RARCH_CMD_REWIND_REINIT);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+#endif
+
    END_SUB_GROUP(list, list_info);
 
    START_SUB_GROUP(list, list_info, "Saving", group_info.name, subgroup_info);
@@ -3743,6 +3843,20 @@ static bool setting_data_append_list_general_options(
    settings_data_list_current_add_flags(list, list_info, SD_FLAG_CMD_APPLY_AUTO);
    (*list)[list_info->index - 1].get_string_representation = 
       &setting_data_get_string_representation_uint_autosave_interval;
+
+   CONFIG_BOOL(
+         g_settings.autosave_journal,
+         "autosave_journal",
+         "SRAM Autosave Journal",
+         autosave_journal,
+         "OFF",
+         "ON",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_cmd(list, list_info, RARCH_CMD_AUTOSAVE_INIT);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_CMD_APPLY_AUTO);
 #endif
 
    CONFIG_BOOL(
@@ -3781,6 +3895,32 @@ static bool setting_data_append_list_general_options(
          general_write_handler,
          general_read_handler);
 
+#ifdef HAVE_ZLIB_DEFLATE
+   CONFIG_BOOL(
+         g_settings.savestate_compression,
+         "savestate_compression",
+         "Save State Compression",
+         savestate_compression,
+         "OFF",
+         "ON",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+#endif
+
+   CONFIG_BOOL(
+         g_settings.savestate_dedup,
+         "savestate_dedup",
+         "Save State Deduplication",
+         savestate_dedup,
+         "OFF",
+         "ON",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+
 
    END_SUB_GROUP(list, list_info);
 
@@ -5578,6 +5718,30 @@ static bool setting_data_append_list_netplay_options(
    settings_list_current_add_range(list, list_info, 0, 10, 1, true, false);
    settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
 
+   CONFIG_UINT(
+         g_extern.netplay_users,
+         "netplay_users",
+         "Netplay Users",
+         0,
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_range(list, list_info, 0, MAX_USERS, 1, true, true);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
+   CONFIG_UINT(
+         g_extern.netplay_check_frames,
+         "netplay_check_frames",
+         "Netplay Check Frames",
+         0,
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_list_current_add_range(list, list_info, 0, 600, 1, true, false);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
    CONFIG_UINT(
          g_extern.netplay_port,
          "netplay_tcp_udp_port",
@@ -6144,6 +6308,21 @@ static bool setting_data_append_list_path_options(
          list,
          list_info,
          SD_FLAG_ALLOW_EMPTY | SD_FLAG_PATH_DIR | SD_FLAG_BROWSER_ACTION);
+
+   CONFIG_DIR(
+         g_settings.patch_cache_directory,
+         "patch_cache_directory",
+         "Patch Cache Directory",
+         "",
+         "<None>",
+         group_info.name,
+         subgroup_info.name,
+         general_write_handler,
+         general_read_handler);
+   settings_data_list_current_add_flags(
+         list,
+         list_info,
+         SD_FLAG_ALLOW_EMPTY | SD_FLAG_PATH_DIR | SD_FLAG_BROWSER_ACTION);
    END_SUB_GROUP(list, list_info);
    END_GROUP(list, list_info);
 